@@ -236,6 +236,15 @@ def export_scene(depsgraph, is_preview, fs):
     # this is a special code for the render to identify that the serialized input is still valid.
     vericiation_bits = SID('verification bits')
     fs.serialize( vericiation_bits )
+    fs.serialize( SCENE_FORMAT_VERSION )
+
+    # every entity is prefixed with the size of its data so that the renderer can load entities in parallel
+    def serialize_entity(class_name, export_entity):
+        es = stream.MemoryStream()
+        export_entity(es)
+        fs.serialize( SID(class_name) )
+        fs.serialize( len(es.data) )
+        fs.serialize( es.data )
 
     # camera node
     camera = scene.camera
@@ -256,40 +265,78 @@ def export_scene(depsgraph, is_preview, fs):
     aspect_ratio_y = scene.render.pixel_aspect_y
     fov_angle = bpy.data.cameras[0].angle
 
-    fs.serialize(SID('PerspectiveCameraEntity'))
-    fs.serialize(vec3_to_tuple(pos))
-    fs.serialize(vec3_to_tuple(up))
-    fs.serialize(vec3_to_tuple(target))
-    fs.serialize(camera.data.sort_data.lens_size)
-    fs.serialize((sensor_w,sensor_h))
-    fs.serialize(int(sensor_fit))
-    fs.serialize((aspect_ratio_x,aspect_ratio_y))
-    fs.serialize(fov_angle)
+    def export_camera(es):
+        es.serialize(vec3_to_tuple(pos))
+        es.serialize(vec3_to_tuple(up))
+        es.serialize(vec3_to_tuple(target))
+        es.serialize(camera.data.sort_data.lens_size)
+        es.serialize((sensor_w,sensor_h))
+        es.serialize(int(sensor_fit))
+        es.serialize((aspect_ratio_x,aspect_ratio_y))
+        es.serialize(fov_angle)
+    serialize_entity('PerspectiveCameraEntity', export_camera)
 
     all_lights = [ ob for ob in depsgraph_objects(depsgraph) if ob.type == 'LIGHT' ]
     all_objs = [ ob for ob in depsgraph_objects(depsgraph) if ob.type == 'MESH' ]
 
+    # objects sharing the same mesh without any modifier applied are exported only once as instances, meshes with
+    # subsurface scattering are left out since it is not supported in instances.
+    def can_be_instanced(obj):
+        if obj.is_modified(scene, 'RENDER'):
+            return False
+        return not any( material and name_compat(material.name) in sss_matnames for material in obj.data.materials[:] )
+
+    instanced_objs = {}
+    if scene.sort_data.auto_instancing:
+        for obj in all_objs:
+            if can_be_instanced(obj):
+                instanced_objs.setdefault( obj.original.data.name , [] ).append( obj )
+    instanced_objs = { name : objs for name, objs in instanced_objs.items() if len(objs) > 1 }
+    instanced_names = set( obj.name for objs in instanced_objs.values() for obj in objs )
+
     total_vert_cnt = 0
     total_prim_cnt = 0
+    total_instance_cnt = 0
     # export meshes
     for obj in all_objs:
-        fs.serialize(SID('VisualEntity'))
-        fs.serialize( matrix_to_tuple( MatrixBlenderToSort() @ obj.matrix_world ) )
-        fs.serialize( 1 )   # only one mesh for each mesh entity
+        if obj.name in instanced_names:
+            continue
+
         stat = None
-        # apply the modifier if there is one
-        if obj.type != 'MESH' or obj.is_modified(scene, 'RENDER'):
-            try:
-                evaluated_obj = obj.evaluated_get(depsgraph)
-                mesh = evaluated_obj.to_mesh()
-                stat = export_mesh(evaluated_obj, mesh, fs)
-            finally:
-                evaluated_obj.to_mesh_clear()
-        else:
-            stat = export_mesh(obj, obj.data, fs)
+        def export_mesh_entity(es):
+            nonlocal stat
+            es.serialize( matrix_to_tuple( MatrixBlenderToSort() @ obj.matrix_world ) )
+            es.serialize( 1 )   # only one mesh for each mesh entity
+            # apply the modifier if there is one
+            if obj.type != 'MESH' or obj.is_modified(scene, 'RENDER'):
+                try:
+                    evaluated_obj = obj.evaluated_get(depsgraph)
+                    mesh = evaluated_obj.to_mesh()
+                    stat = export_mesh(evaluated_obj, mesh, es)
+                finally:
+                    evaluated_obj.to_mesh_clear()
+            else:
+                stat = export_mesh(obj, obj.data, es)
+        serialize_entity('VisualEntity', export_mesh_entity)
+
+        total_vert_cnt += stat[0]
+        total_prim_cnt += stat[1]
+
+    # export instances, all instances of a mesh share the same geometry in the renderer
+    for objs in instanced_objs.values():
+        stat = None
+        def export_instance_entity(es):
+            nonlocal stat
+            es.serialize( 1 )   # only one mesh shared by all instances
+            stat = export_mesh(objs[0], objs[0].data, es)
+            es.serialize( len(objs) )
+            for obj in objs:
+                es.serialize( matrix_to_tuple( MatrixBlenderToSort() @ obj.matrix_world ) )
+        serialize_entity('InstanceEntity', export_instance_entity)
 
         total_vert_cnt += stat[0]
         total_prim_cnt += stat[1]
+        total_instance_cnt += len(objs)
 
     # output hair/fur exporting
     for obj in all_objs:
@@ -297,16 +344,19 @@ def export_scene(depsgraph, is_preview, fs):
 
         # output hair/fur information
         if len( evaluted_obj.particle_systems ) > 0:
-            fs.serialize( SID('VisualEntity') )
-            fs.serialize( matrix_to_tuple( MatrixBlenderToSort() @ evaluted_obj.matrix_world ) )
-            fs.serialize( len( evaluted_obj.particle_systems ) )
-            for ps in evaluted_obj.particle_systems:
-                stat = export_hair( ps , evaluted_obj , scene , is_preview, fs )
-                total_vert_cnt += stat[0]
-                total_prim_cnt += stat[1]
+            def export_hair_entity(es):
+                nonlocal total_vert_cnt, total_prim_cnt
+                es.serialize( matrix_to_tuple( MatrixBlenderToSort() @ evaluted_obj.matrix_world ) )
+                es.serialize( len( evaluted_obj.particle_systems ) )
+                for ps in evaluted_obj.particle_systems:
+                    stat = export_hair( ps , evaluted_obj , scene , is_preview, es )
+                    total_vert_cnt += stat[0]
+                    total_prim_cnt += stat[1]
+            serialize_entity('VisualEntity', export_hair_entity)
 
     log( "Total vertices: %d." % total_vert_cnt )
     log( "Total primitives: %d." % total_prim_cnt )
+    log( "Total instances: %d." % total_instance_cnt )
 
     mapping = {'SUN': 'DirLightEntity', 'POINT': 'PointLightEntity', 'SPOT': 'SpotLightEntity', 'AREA': 'AreaLightEntity' }
     for ob in all_lights:
@@ -320,42 +370,44 @@ def export_scene(depsgraph, is_preview, fs):
         # make sure the type of the light is supported
         assert( lamp.type in mapping )
 
+        def export_light(es):
+            # transformation of light source
+            es.serialize(matrix_to_tuple(world_matrix))
+
+            # total light power, it defines how bright light is
+            es.serialize(lamp.energy)
+
+            # light spectrum color, it defines color of the light
+            es.serialize(lamp.color[:])
+
+            # spot light and area light have extra properties to be serialized
+            if lamp.type == 'SPOT':
+                falloff_start = degrees(lamp.spot_size * ( 1.0 - lamp.spot_blend ) * 0.5)
+                falloff_range = degrees(lamp.spot_size*0.5)
+                es.serialize(falloff_start)
+                es.serialize(falloff_range)
+            elif lamp.type == 'AREA':
+                es.serialize( SID(lamp.shape) )
+                if lamp.shape == 'SQUARE':
+                    es.serialize(lamp.size)
+                elif lamp.shape == 'RECTANGLE':
+                    es.serialize(lamp.size)
+                    es.serialize(lamp.size_y)
+                elif lamp.shape == 'DISK':
+                    es.serialize(lamp.size * 0.5)
+
         # name identifier of the light
-        fs.serialize( SID(mapping[lamp.type]) )
-
-        # transformation of light source
-        fs.serialize(matrix_to_tuple(world_matrix))
-
-        # total light power, it defines how bright light is
-        fs.serialize(lamp.energy)
-
-        # light spectrum color, it defines color of the light
-        fs.serialize(lamp.color[:])
-
-        # spot light and area light have extra properties to be serialized
-        if lamp.type == 'SPOT':
-            falloff_start = degrees(lamp.spot_size * ( 1.0 - lamp.spot_blend ) * 0.5)
-            falloff_range = degrees(lamp.spot_size*0.5)
-            fs.serialize(falloff_start)
-            fs.serialize(falloff_range)
-        elif lamp.type == 'AREA':
-            fs.serialize( SID(lamp.shape) )
-            if lamp.shape == 'SQUARE':
-                fs.serialize(lamp.size)
-            elif lamp.shape == 'RECTANGLE':
-                fs.serialize(lamp.size)
-                fs.serialize(lamp.size_y)
-            elif lamp.shape == 'DISK':
-                fs.serialize(lamp.size * 0.5)
+        serialize_entity(mapping[lamp.type], export_light)
 
     hdr_sky_image = scene.sort_hdr_sky.hdr_image
     if hdr_sky_image is not None:
-        fs.serialize(SID('SkyLightEntity'))
-        global_matrix = mathutils.Matrix()
-        fs.serialize(matrix_to_tuple(global_matrix))
-        fs.serialize(( 1.0 , 1.0 , 1.0 ))   # light tint color
-        fs.serialize( 1.0 )                 # sky light scaling, not supported since it is not pbs.
-        fs.serialize(bpy.path.abspath( hdr_sky_image.filepath ))
+        def export_sky(es):
+            global_matrix = mathutils.Matrix()
+            es.serialize(matrix_to_tuple(global_matrix))
+            es.serialize(( 1.0 , 1.0 , 1.0 ))   # light tint color
+            es.serialize( 1.0 )                 # sky light scaling, not supported since it is not pbs.
+            es.serialize(bpy.path.abspath( hdr_sky_image.filepath ))
+        serialize_entity('SkyLightEntity', export_sky)
 
     # to indicate the scene stream comes to an end
     fs.serialize(SID('End of Entities'))
@@ -379,7 +431,7 @@ def export_global_config(scene, fs, sort_resource_path):
     integrator_type = sort_data.integrator_type_prop
     accelerator_type = sort_data.accelerator_type_prop
 
-    fs.serialize( 0 )
+    fs.serialize( 4 )
     fs.serialize( sort_resource_path )
     fs.serialize( sort_output_file )
     fs.serialize( 64 )    # tile size, hard-coded it until I need to update it throught exposed interface later.
@@ -388,11 +440,20 @@ def export_global_config(scene, fs, sort_resource_path):
     fs.serialize( int(xres) )
     fs.serialize( int(yres) )
     fs.serialize( sort_data.clampping )
+    fs.serialize( bool(sort_data.adaptive_sampling) )
+    fs.serialize( int(sort_data.adaptive_sample_per_pass) )
+    fs.serialize( sort_data.adaptive_error_threshold )
+    fs.serialize( sort_data.adaptive_time_budget )
+    fs.serialize( int(sort_data.texture_cache_size) )
+    fs.serialize( int(sort_data.texture_storage_mode) )
+    fs.serialize( bpy.path.abspath(sort_data.disk_cache_path) if sort_data.disk_cache else '' )
 
     if accelerator_type == "bvh":
         fs.serialize( SID('Bvh') )
         fs.serialize( int(sort_data.bvh_max_node_depth) )
         fs.serialize( int(sort_data.bvh_max_pri_in_leaf) )
+        fs.serialize( bool(sort_data.bvh_spatial_split) )
+        fs.serialize( sort_data.bvh_spatial_split_budget )
     elif accelerator_type == "KDTree":
         fs.serialize( SID('KDTree') )
         fs.serialize( int(sort_data.kdtree_max_node_depth) )
@@ -405,16 +466,22 @@ def export_global_config(scene, fs, sort_resource_path):
         fs.serialize( SID('Qbvh') )
         fs.serialize( int(sort_data.qbvh_max_node_depth) )
         fs.serialize( int(sort_data.qbvh_max_pri_in_leaf) )
+        fs.serialize( bool(sort_data.qbvh_spatial_split) )
+        fs.serialize( sort_data.qbvh_spatial_split_budget )
+        fs.serialize( sort_data.qbvh_refit_threshold )
     elif accelerator_type == "Obvh":
         fs.serialize( SID('Obvh') )
         fs.serialize( int(sort_data.obvh_max_node_depth) )
         fs.serialize( int(sort_data.obvh_max_pri_in_leaf) )
+        fs.serialize( bool(sort_data.obvh_spatial_split) )
+        fs.serialize( sort_data.obvh_spatial_split_budget )
+        fs.serialize( sort_data.obvh_refit_threshold )
     else:
         fs.serialize( SID('UniGrid') )
 
     fs.serialize( SID(integrator_type) )
     fs.serialize( int(sort_data.inte_max_recur_depth) )
-    if integrator_type == "PathTracing":
+    if integrator_type == "PathTracing" or integrator_type == "WavefrontPathTracing":
         fs.serialize( int(sort_data.max_bssrdf_bounces) )
     if integrator_type == "AmbientOcclusion":
         fs.serialize( sort_data.ao_max_dist )
@@ -460,6 +527,12 @@ def export_smoke(obj, fs):
 
     fs.serialize(density_data)
 
+# version of the mesh chunk layout, it needs to match MESH_CHUNK_VERSION in SORT
+MESH_CHUNK_VERSION = 1
+
+# version of the scene layout, it needs to match SCENE_FORMAT_VERSION in SORT
+SCENE_FORMAT_VERSION = 2
+
 # export a mesh
 def export_mesh(obj, mesh, fs):
     LENFMT = struct.Struct('=i')
@@ -556,9 +629,12 @@ def export_mesh(obj, mesh, fs):
 
     fs.serialize(SID('MeshVisual'))
     fs.serialize(bool(has_uv))
+    fs.serialize(LENFMT.pack(MESH_CHUNK_VERSION))
     fs.serialize(LENFMT.pack(vert_cnt))
+    fs.serialize(LENFMT.pack(VERTFMT.size))
     fs.serialize(wo3_verts)
     fs.serialize(LENFMT.pack(primitive_cnt))
+    fs.serialize(LENFMT.pack(TRIFMT.size))
     fs.serialize(wo3_tris)
 
     # export smoke data if needed, this is for volumetric rendering
@@ -706,7 +782,11 @@ def collect_shader_resources(depsgraph, scene, fs):
         fs.serialize( resource[1] ) # external file name
 
 matname_to_id = {}
+# materials with subsurface scattering, meshes using any of them are not exported as instances
+sss_matnames = set()
 def export_materials(depsgraph, fs):
+    sss_matnames.clear()
+
     # if we are in no-material mode, just skip outputting all materials
     if depsgraph.scene.sort_data.allUseDefaultMaterial is True:
         fs.serialize( SID('End of Material') )
@@ -909,10 +989,16 @@ def export_materials(depsgraph, fs):
         # mark whether there is transparent support in the material, this is very important because it will affect performance eventually.
         fs.serialize( bool(has_transparent_node) )
         fs.serialize( bool(has_sss_node) )
+        if has_sss_node:
+            sss_matnames.add( compact_material_name )
 
         # volume step size and step count
         fs.serialize( material.sort_material.volume_step )
         fs.serialize( material.sort_material.volume_step_cnt )
 
+        # radiance emitted by the surfaces, meshes with emissive materials are exported as light sources
+        emission_strength = material.sort_material.emission_strength
+        fs.serialize( tuple( c * emission_strength for c in material.sort_material.emission_color ) )
+
     # indicate the end of material parsing
     fs.serialize(SID('End of Material'))
\ No newline at end of file
@@ -61,6 +61,8 @@ class SORTShaderNodeTree(bpy.types.NodeTree):
         bpy.types.Material.sort_material = bpy.props.PointerProperty(type=bpy.types.NodeTree, name='SORT Material Settings')
         bpy.types.NodeTree.volume_step = bpy.props.FloatProperty( name='Step' , default=0.1 , min=0.0, max=100.0 )
         bpy.types.NodeTree.volume_step_cnt = bpy.props.IntProperty( name='Max Step Count' , default=1024 , min=0, max=8192 )
+        bpy.types.NodeTree.emission_color = bpy.props.FloatVectorProperty( name='Color' , default=(1.0, 1.0, 1.0) , subtype='COLOR' , min=0.0, max=1.0 )
+        bpy.types.NodeTree.emission_strength = bpy.props.FloatProperty( name='Strength' , default=0.0 , min=0.0, max=float('inf') )
 
         # Register all nodes
         cats = []
@@ -20,9 +20,31 @@ class Stream():
     def __init__(self):
         pass
 
+    # Write raw bytes into the stream
+    def write(self,data):
+        pass
+
     # Serialize data
     def serialize(self,data):
-        pass
+        def serialize_type(data):
+            if type(data).__name__ == 'float' or type(data).__name__ == 'float64':
+                self.write(struct.pack( 'f' , data ) )
+            elif type(data).__name__ == 'int':
+                self.write(struct.pack( 'I' , data ))
+            elif type(data).__name__ == 'bool':
+                self.write(struct.pack( '?' , data ) )
+
+        if type(data).__name__ == 'bytes' or type(data).__name__ == 'bytearray':
+            self.write(data)
+        elif type(data).__name__ == 'str' :
+            self.write(data.encode('ascii'))
+            end = 0
+            self.write(end.to_bytes(1, byteorder='little'))
+        elif type(data).__name__ == 'tuple':
+            for d in data:
+                serialize_type(d)
+        else:
+            serialize_type(data)
 
 # File stream will serialize data into a file.
 class FileStream(Stream):
@@ -38,25 +60,19 @@ class FileStream(Stream):
     def flush(self):
         self.file.flush()
 
+    def write(self,data):
+        self.file.write(data)
+
     # Serialize data
     def serialize(self,data):
-        def serialize_type(data):
-            if type(data).__name__ == 'float' or type(data).__name__ == 'float64':
-                self.file.write(struct.pack( 'f' , data ) )
-            elif type(data).__name__ == 'int':
-                self.file.write(struct.pack( 'I' , data ))
-            elif type(data).__name__ == 'bool':
-                self.file.write(struct.pack( '?' , data ) )
-
-        if type(data).__name__ == 'bytes' or type(data).__name__ == 'bytearray':
-            self.file.write(data)
-        elif type(data).__name__ == 'str' :
-            self.file.write(data.encode('ascii'))
-            end = 0
-            self.file.write(end.to_bytes(1, byteorder='little'))
-        elif type(data).__name__ == 'tuple':
-            for d in data:
-                serialize_type(d)
-        else:
-            serialize_type(data)
+        super().serialize(data)
         self.file.flush()
+
+# Memory stream will serialize data into a memory buffer, it is used when the size of the data needs to be known
+# before writing it into another stream.
+class MemoryStream(Stream):
+    def __init__(self):
+        self.data = bytearray()
+
+    def write(self,data):
+        self.data += data
@@ -33,7 +33,8 @@ class SORTRenderData(bpy.types.PropertyGroup):
                          ("InstantRadiosity", "Instant Radiosity", "", 4),
                          ("AmbientOcclusion", "Ambient Occlusion", "", 5),
                          ("DirectLight", "Direct Lighting", "", 6),
-                         ("WhittedRT", "Whitted", "", 7) ]
+                         ("WhittedRT", "Whitted", "", 7),
+                         ("WavefrontPathTracing", "Wavefront Path Tracing", "", 8) ]
     integrator_type_prop : bpy.props.EnumProperty(items=integrator_types, name='Accelerator')
 
     # general integrator parameters
@@ -65,17 +66,28 @@ class SORTRenderData(bpy.types.PropertyGroup):
                           ("OcTree" , "OcTree" , "This is not quite practical in all cases." , 5)]
     accelerator_type_prop : bpy.props.EnumProperty(items=accelerator_types, name='Accelerator')
 
+    # objects sharing the same mesh are exported as instances of it
+    auto_instancing : bpy.props.BoolProperty(name='Auto Instancing', default=True, description='Export objects sharing the same unmodified mesh as instances of it. Meshes with subsurface scattering are never instanced since it is not supported in instances.')
+
     # bvh properties
     bvh_max_node_depth : bpy.props.IntProperty(name='Maximum Recursive Depth', default=28, min=8)
     bvh_max_pri_in_leaf : bpy.props.IntProperty(name='Maximum Primitives in Leaf Node.', default=8, min=8, max=64)
+    bvh_spatial_split : bpy.props.BoolProperty(name='Spatial Split', default=False)
+    bvh_spatial_split_budget : bpy.props.FloatProperty(name='Spatial Split Budget', default=0.3, min=0.0, max=4.0)
 
     # qbvh properties
     qbvh_max_node_depth : bpy.props.IntProperty(name='Maximum Recursive Depth', default=28, min=8)
     qbvh_max_pri_in_leaf : bpy.props.IntProperty(name='Maximum Primitives in Leaf Node.', default=16, min=4, max=64)
+    qbvh_spatial_split : bpy.props.BoolProperty(name='Spatial Split', default=False)
+    qbvh_spatial_split_budget : bpy.props.FloatProperty(name='Spatial Split Budget', default=0.3, min=0.0, max=4.0)
+    qbvh_refit_threshold : bpy.props.FloatProperty(name='Refit Threshold', default=1.5, min=1.0, max=10.0)
 
     # obvh properties
     obvh_max_node_depth : bpy.props.IntProperty(name='Maximum Recursive Depth', default=28, min=8)
     obvh_max_pri_in_leaf : bpy.props.IntProperty(name='Maximum Primitives in Leaf Node.', default=16, min=8, max=64)
+    obvh_spatial_split : bpy.props.BoolProperty(name='Spatial Split', default=False)
+    obvh_spatial_split_budget : bpy.props.FloatProperty(name='Spatial Split Budget', default=0.3, min=0.0, max=4.0)
+    obvh_refit_threshold : bpy.props.FloatProperty(name='Refit Threshold', default=1.5, min=1.0, max=10.0)
 
     # kdtree properties
     kdtree_max_node_depth : bpy.props.IntProperty(name='Maximum Recursive Depth', default=28, min=8)
@@ -94,12 +106,31 @@ class SORTRenderData(bpy.types.PropertyGroup):
     #                                 Sampling Settings                                  #
     #------------------------------------------------------------------------------------#
     sampler_count_prop : bpy.props.IntProperty(name='Count',default=1, min=1)
+    adaptive_sampling : bpy.props.BoolProperty(name='Adaptive Sampling',default=False,description='Render tiles in multiple passes, pixels stop taking samples once they are converged.')
+    adaptive_sample_per_pass : bpy.props.IntProperty(name='Samples per Pass',default=4, min=1)
+    adaptive_error_threshold : bpy.props.FloatProperty(name='Error Threshold',default=0.01, min=0.0001, max=1.0, description='Relative error for a pixel to be considered converged.')
+    adaptive_time_budget : bpy.props.FloatProperty(name='Time Budget',default=0.0, min=0.0, description='Time budget in seconds, no more passes will be rendered after it. Zero means no time budget.')
 
     #------------------------------------------------------------------------------------#
     #                                 Threading Settings                                 #
     #------------------------------------------------------------------------------------#
     thread_num_prop : bpy.props.IntProperty(name='Thread Num', default=8, min=1, max=32)
 
+    #------------------------------------------------------------------------------------#
+    #                                 Texture Settings                                   #
+    #------------------------------------------------------------------------------------#
+    texture_cache_size : bpy.props.IntProperty(name='Texture Cache Size (MB)', default=1024, min=1, description='Maximum memory taken by textures, least recently used texture tiles are paged out once it is exceeded.')
+    texture_storage_modes = [ ("0", "Full Precision", "Store all textures in 32 bit floats, this takes the most memory.", 0),
+                              ("1", "Half Precision", "Store LDR textures in 8 bit and HDR textures in 16 bit floats.", 1),
+                              ("2", "Shared Exponent", "Store LDR textures in 8 bit and HDR textures in 32 bit shared exponent format.", 2)]
+    texture_storage_mode : bpy.props.EnumProperty(items=texture_storage_modes, name='Texture Storage', default="1")
+
+    #------------------------------------------------------------------------------------#
+    #                                 Disk Cache Settings                                #
+    #------------------------------------------------------------------------------------#
+    disk_cache : bpy.props.BoolProperty(name='Disk Cache',default=False,description='Keep transformed meshes and built acceleration structures on disk, unchanged ones are loaded from it in the next render.')
+    disk_cache_path : bpy.props.StringProperty(name='Cache Directory',default='//sort_cache/',subtype='DIR_PATH',description='Directory of the cache files, stale ones are not cleaned up automatically.')
+
     #------------------------------------------------------------------------------------#
     #                                 Debugging Settings                                 #
     #------------------------------------------------------------------------------------#
@@ -150,7 +181,7 @@ class RENDER_PT_IntegratorPanel(SORTRenderPanel,bpy.types.Panel):
         integrator_type = data.integrator_type_prop
         if integrator_type != "WhittedRT" and integrator_type != "DirectLight" and integrator_type != "AmbientOcclusion":
             self.layout.prop(data,"inte_max_recur_depth")
-        if integrator_type == "PathTracing":
+        if integrator_type == "PathTracing" or integrator_type == "WavefrontPathTracing":
             self.layout.prop(data,"max_bssrdf_bounces" )
         if integrator_type == "AmbientOcclusion":
             self.layout.prop(data,"ao_max_dist")
@@ -167,16 +198,30 @@ class RENDER_PT_AcceleratorPanel(SORTRenderPanel,bpy.types.Panel):
     def draw(self, context):
         data = context.scene.sort_data
         self.layout.prop(data,"accelerator_type_prop")
+        self.layout.prop(data,"auto_instancing")
         accelerator_type = data.accelerator_type_prop
         if accelerator_type == "bvh":
             self.layout.prop(data,"bvh_max_node_depth")
             self.layout.prop(data,"bvh_max_pri_in_leaf")
+            self.layout.prop(data,"bvh_spatial_split")
+            if data.bvh_spatial_split:
+                self.layout.prop(data,"bvh_spatial_split_budget")
         elif accelerator_type == "Qbvh":
             self.layout.prop(data,"qbvh_max_node_depth")
             self.layout.prop(data,"qbvh_max_pri_in_leaf")
+            self.layout.prop(data,"qbvh_spatial_split")
+            if data.qbvh_spatial_split:
+                self.layout.prop(data,"qbvh_spatial_split_budget")
+            if data.disk_cache:
+                self.layout.prop(data,"qbvh_refit_threshold")
         elif accelerator_type == "Obvh":
             self.layout.prop(data,"obvh_max_node_depth")
             self.layout.prop(data,"obvh_max_pri_in_leaf")
+            self.layout.prop(data,"obvh_spatial_split")
+            if data.obvh_spatial_split:
+                self.layout.prop(data,"obvh_spatial_split_budget")
+            if data.disk_cache:
+                self.layout.prop(data,"obvh_refit_threshold")
         elif accelerator_type == "KDTree":
             self.layout.prop(data,"kdtree_max_node_depth")
             self.layout.prop(data,"kdtree_max_pri_in_leaf")
@@ -197,11 +242,33 @@ class RENDER_PT_MultiThreadPanel(SORTRenderPanel, bpy.types.Panel):
     def draw(self, context):
         self.layout.prop(context.scene.sort_data,"thread_num_prop")
 
+@base.register_class
+class RENDER_PT_TexturePanel(SORTRenderPanel, bpy.types.Panel):
+    bl_label = 'Texture'
+    def draw(self, context):
+        self.layout.prop(context.scene.sort_data,"texture_cache_size")
+        self.layout.prop(context.scene.sort_data,"texture_storage_mode")
+
+@base.register_class
+class RENDER_PT_DiskCachePanel(SORTRenderPanel, bpy.types.Panel):
+    bl_label = 'Disk Cache'
+    def draw(self, context):
+        data = context.scene.sort_data
+        self.layout.prop(data,"disk_cache")
+        if data.disk_cache:
+            self.layout.prop(data,"disk_cache_path")
+
 @base.register_class
 class RENDER_PT_SamplerPanel(SORTRenderPanel, bpy.types.Panel):
     bl_label = 'Sample'
     def draw(self, context):
-        self.layout.prop(context.scene.sort_data,"sampler_count_prop")
+        data = context.scene.sort_data
+        self.layout.prop(data,"sampler_count_prop")
+        self.layout.prop(data,"adaptive_sampling")
+        if data.adaptive_sampling:
+            self.layout.prop(data,"adaptive_sample_per_pass")
+            self.layout.prop(data,"adaptive_error_threshold")
+            self.layout.prop(data,"adaptive_time_budget")
 
 @base.register_class
 class SORT_export_debug_scene(bpy.types.Operator):
@@ -22,6 +22,11 @@ SORT_STATS_DEFINE_COUNTER(sRayCount)
 SORT_STATS_DEFINE_COUNTER(sShadowRayCount)
 SORT_STATS_DEFINE_COUNTER(sIntersectionTest)
 
+#ifdef SIMD_DISPATCH_ENABLED
+SORT_STATS_DEFINE_COUNTER(sSimdIsa)
+SORT_STATS_SIMD_ISA("Performance", "SIMD Kernels", sSimdIsa);
+#endif
+
 #ifdef ENABLE_TRANSPARENT_SHADOW
 bool Accelerator::GetAttenuation( Ray& ray , Spectrum& attenuation , MediumStack* ms ) const {
     SurfaceInteraction intersection;
@@ -68,6 +73,28 @@ bool Accelerator::GetAttenuation( Ray& ray , Spectrum& attenuation , MediumStack
 }
 #endif
 
+void Accelerator::IntersectStream( const Ray* rays , SurfaceInteraction* intersects , unsigned cnt ) const{
+    for( auto i = 0u ; i < cnt ; ++i ){
+#ifdef ENABLE_TRANSPARENT_SHADOW
+        sAssert( !intersects[i].query_shadow , SPATIAL_ACCELERATOR );
+#endif
+        GetIntersect( rays[i] , intersects[i] );
+    }
+}
+
+void Accelerator::OccludedStream( const Ray* rays , bool* occluded , unsigned cnt ) const{
+    for( auto i = 0u ; i < cnt ; ++i ){
+#ifdef ENABLE_TRANSPARENT_SHADOW
+        // an opaque hit terminates the traversal early, a transparent one is still a hit.
+        SurfaceInteraction intersection;
+        intersection.query_shadow = true;
+        occluded[i] = GetIntersect( rays[i] , intersection );
+#else
+        occluded[i] = IsOccluded( rays[i] );
+#endif
+    }
+}
+
 bool Accelerator::UpdateMediumStack( Ray& ray , MediumStack& ms , const bool reversed ) const{
 	SurfaceInteraction intersection;
 
@@ -118,6 +118,30 @@ public:
     //! @param  matID       We are only interested in intersection with the same material, whose material id should be set to matID.
     virtual void GetIntersect( const Ray& r , BSSRDFIntersections& intersect , const StringID matID = INVALID_SID ) const = 0;
 
+    //! @brief Get the nearest intersections of a stream of rays.
+    //!
+    //! This is the batched version of 'GetIntersect'. Rays that are coherent, like primary rays in a tile, share most of
+    //! the nodes visited during traversal, accelerators supporting packet traversal can take advantage of it by fetching
+    //! and testing each node once for all of the rays. The default implementation simply traces the rays one by one.
+    //! Shadow queries are not supported in this interface, 'OccludedStream' should be used for them instead.
+    //!
+    //! @param rays         The rays to be tested.
+    //! @param intersects   The intersection results, one for each ray. A ray hits the scene if the primitive of its
+    //!                     intersection is valid.
+    //! @param cnt          The number of rays in the stream.
+    virtual void IntersectStream( const Ray* rays , SurfaceInteraction* intersects , unsigned cnt ) const;
+
+    //! @brief Check whether each ray in a stream hits anything.
+    //!
+    //! Transparency is not taken into account in this interface, a ray hitting a fully transparent surface is still
+    //! considered as occluded. It is up to the higher level logic to fall back to 'GetAttenuation' if semi-transparent
+    //! shadow matters.
+    //!
+    //! @param rays         The rays to be tested.
+    //! @param occluded     Whether each ray is occluded by anything.
+    //! @param cnt          The number of rays in the stream.
+    virtual void OccludedStream( const Ray* rays , bool* occluded , unsigned cnt ) const;
+
     //! @brief Build the acceleration structure.
     //!
     //! @param primitives       A vector holding all primitives.
@@ -28,6 +28,7 @@ SORT_STATS_DEFINE_COUNTER(sBvhLeafNodeCount)
 SORT_STATS_DEFINE_COUNTER(sBVHDepth)
 SORT_STATS_DEFINE_COUNTER(sBvhMaxPriCountInLeaf)
 SORT_STATS_DEFINE_COUNTER(sBvhPrimitiveCount)
+SORT_STATS_DEFINE_COUNTER(sBvhSpatialSplitReferenceCount)
 
 SORT_STATS_COUNTER("Spatial-Structure(BVH)", "Total Ray Count", sRayCount);
 SORT_STATS_COUNTER("Spatial-Structure(BVH)", "Shadow Ray Count", sShadowRayCount);
@@ -38,6 +39,7 @@ SORT_STATS_COUNTER("Spatial-Structure(BVH)", "BVH Depth", sBVHDepth);
 SORT_STATS_COUNTER("Spatial-Structure(BVH)", "Maximum Primitive in Leaf", sBvhMaxPriCountInLeaf);
 SORT_STATS_AVG_COUNT("Spatial-Structure(BVH)", "Average Primitive Count in Leaf", sBvhPrimitiveCount , sBvhLeafNodeCount );
 SORT_STATS_AVG_COUNT("Spatial-Structure(BVH)", "Average Primitive Tested per Ray", sIntersectionTest, sRayCount);
+SORT_STATS_COUNTER("Spatial-Structure(BVH)", "Extra References by Spatial Splits", sBvhSpatialSplitReferenceCount);
 
 void Bvh::Build(const std::vector<const Primitive*>& primitives, const BBox& bbox){
     SORT_PROFILE("Build Bvh");
@@ -46,18 +48,20 @@ void Bvh::Build(const std::vector<const Primitive*>& primitives, const BBox& bbo
 	if (primitives.empty())
 		return;
 
-    m_bvhpri = std::make_unique<Bvh_Primitive[]>(m_primitives->size());
+    // spatial splits need room for extra references of primitives straddling split planes.
+    const auto primitive_cnt = m_primitives->size();
+    const auto capacity = m_spatialSplit ? primitive_cnt + (size_t)( primitive_cnt * std::max( m_spatialSplitBudget , 0.0f ) ) : primitive_cnt;
+    m_bvhpri = std::make_unique<Bvh_Primitive[]>(capacity);
 
     m_bbox = bbox;
 
     // generate BVH primitives
-    const auto primitive_cnt = m_primitives->size();
     for (auto i = 0u; i < primitive_cnt; ++i)
         m_bvhpri[i].SetPrimitive((*m_primitives)[i]);
 
     // recursively split node
     m_root = std::make_unique<Bvh_Node>();
-    splitNode( m_root.get() , 0u , (unsigned)m_primitives->size() , 1u );
+    splitNode( m_root.get() , Bvh_Range( 0u , (unsigned)primitive_cnt , (unsigned)capacity ) , 1u );
 
     m_isValid = true;
 
@@ -65,9 +69,12 @@ void Bvh::Build(const std::vector<const Primitive*>& primitives, const BBox& bbo
     SORT_STATS(sBvhPrimitiveCount=primitive_cnt);
 }
 
-void Bvh::splitNode( Bvh_Node* node , unsigned start , unsigned end , unsigned depth ){
+void Bvh::splitNode( Bvh_Node* node , const Bvh_Range& range , unsigned depth ){
     SORT_STATS(sBVHDepth = std::max( sBVHDepth , (StatsInt)depth ) );
 
+    const auto start = range.start;
+    const auto end = range.end;
+
     // generate the bounding box for the node
     for( auto i = start ; i < end ; i++ )
         node->bbox.Union( m_bvhpri[i].GetBBox() );
@@ -79,32 +86,33 @@ void Bvh::splitNode( Bvh_Node* node , unsigned start , unsigned end , unsigned d
     }
 
     // pick best split plane
-    unsigned    split_axis;
-    float       split_pos;
-    const auto sah = pickBestSplit( split_axis , split_pos , m_bvhpri.get() , node->bbox , start , end );
-    if( sah >= primitive_num ){
+    Bvh_Split split;
+    if( m_spatialSplit )
+        split = pickBestSplitSBVH( m_bvhpri.get() , node->bbox , range , m_bbox.HalfSurfaceArea() );
+    else
+        split.sah = pickBestSplit( split.axis , split.pos , m_bvhpri.get() , node->bbox , start , end );
+    if( split.sah >= primitive_num ){
         makeLeaf( node , start , end );
         return;
     }
 
     // partition the data
-    auto compare = [split_pos,split_axis](const Bvh_Primitive& pri){return pri.m_centroid[split_axis] < split_pos;};
-    auto middle = std::partition( m_bvhpri.get() + start , m_bvhpri.get() + end, compare );
-    auto mid = (unsigned)(middle - m_bvhpri.get());
-
     // To avoid degenerated node that has nothing in it.
     // Technically, this shouldn't happen. Unlike KD-Tree implementation, there is only 16 split plane candidate, it is
     // totally possible to pick one with no primitive on one side of the plane, resulting a crash later during ray tracing.
-    if (mid == start || mid == end){
+    Bvh_Range left , right;
+    if( !splitPrimitives( split , m_bvhpri.get() , range , left , right ) ){
         makeLeaf(node, start, end);
         return;
     }
 
+    SORT_STATS(sBvhSpatialSplitReferenceCount += left.Count() + right.Count() - primitive_num);
+
     node->left = std::make_unique<Bvh_Node>();
-    splitNode( node->left.get() , start , mid , depth + 1 );
+    splitNode( node->left.get() , left , depth + 1 );
 
     node->right = std::make_unique<Bvh_Node>();
-    splitNode( node->right.get() , mid , end , depth + 1 );
+    splitNode( node->right.get() , right , depth + 1 );
 
     SORT_STATS(sBvhNodeCount+=2);
 }
@@ -242,6 +250,10 @@ void Bvh::traverseNode( const Bvh_Node* node , const Ray& ray , BSSRDFIntersecti
         for(auto i = _start ; i < _end ; i++ ){
             if( matID != m_bvhpri[i].primitive->GetMaterial()->GetUniqueID() )
                 continue;
+
+            // spatial splits could put the primitive in other leaf nodes too, make sure it is not checked before
+            if( intersect.HasPrimitive( m_bvhpri[i].primitive ) )
+                continue;
             SORT_STATS(++sIntersectionTest);
         
             intersection.Reset();
@@ -295,6 +307,8 @@ std::unique_ptr<Accelerator> Bvh::Clone() const {
 	auto ret = std::make_unique<Bvh>();
 	ret->m_maxNodeDepth = m_maxNodeDepth;
 	ret->m_maxPriInLeaf = m_maxPriInLeaf;
+	ret->m_spatialSplit = m_spatialSplit;
+	ret->m_spatialSplitBudget = m_spatialSplitBudget;
 
 	return ret;
 }
\ No newline at end of file
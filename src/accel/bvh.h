@@ -112,6 +112,8 @@ public:
     void    Serialize( IStreamBase& stream ) override{
         stream >> m_maxNodeDepth;
         stream >> m_maxPriInLeaf;
+        stream >> m_spatialSplit;
+        stream >> m_spatialSplitBudget;
     }
 
 	//! @brief	Clone the accelerator.
@@ -130,14 +132,17 @@ private:
     unsigned                                m_maxPriInLeaf = 8;
     /**< Maximum depth of node in BVH. */
     unsigned                                m_maxNodeDepth = 16;
+    /**< Whether spatial splits are enabled, primitives straddling split planes could be referred by both sides. */
+    bool                                    m_spatialSplit = false;
+    /**< Maximum number of extra references created by spatial splits, relative to the number of primitives. */
+    float                                   m_spatialSplitBudget = 0.3f;
 
     //! @brief Split current BVH node.
     //!
     //! @param node         The BVH node to be split.
-    //! @param start        The start offset of primitives that the node holds.
-    //! @param end          The end offset of primitives that the node holds.
+    //! @param range        The range of primitives that the node holds.
     //! @param depth        The current depth of the node. Starting from 1 for root node.
-    void    splitNode( Bvh_Node* node , unsigned start , unsigned end , unsigned depth );
+    void    splitNode( Bvh_Node* node , const Bvh_Range& range , unsigned depth );
 
     //! @brief Mark the current node as leaf node.
     //!
@@ -18,30 +18,191 @@
 #pragma once
 
 #include <string.h>
+#include <cmath>
+#include <vector>
+#include <atomic>
 #include "core/define.h"
 #include "math/point.h"
 #include "math/bbox.h"
-
-class Primitive;
+#include "task/task.h"
+#include "core/primitive.h"
 
 //! @brief Bounding volume hierarchy node primitives. It is used during BVH construction.
+/**
+ * With spatial splits, a primitive straddling a split plane is referred by both sides, each reference only covers the
+ * part of the primitive on its own side, which is why the bounding box is kept here instead of the one of the primitive.
+ * This also avoids chasing pointers to primitives and shapes during binning.
+ */
 struct Bvh_Primitive {
     const Primitive*    primitive;              /**< Primitive lists for this node. */
     Point               m_centroid;             /**< Center point of the BVH node. */
+    BBox                m_bbox;                 /**< Bounding box of the part of the primitive that it refers to. */
 
     //! @brief Set primitive.
     //!
     //! @param p    Primitive list holding all primitives in the node.
     void SetPrimitive(const Primitive* p){
         primitive = p;
-        m_centroid = (p->GetBBox().m_Max + p->GetBBox().m_Min) * 0.5f;
+        SetBBox( p->GetBBox() );
+    }
+
+    //! @brief Set bounding box of the part of the primitive that it refers to.
+    //!
+    //! @param bbox The bounding box of the part of the primitive.
+    void SetBBox( const BBox& bbox ){
+        m_bbox = bbox;
+        m_centroid = (bbox.m_Max + bbox.m_Min) * 0.5f;
     }
 
     //! Get bounding box of this primitive set.
     //!
     //! @return     Axis-Aligned bounding box holding all the primitives.
     const BBox& GetBBox() const {
-        return primitive->GetBBox();
+        return m_bbox;
+    }
+
+    //! @brief Get bounding box of the part of the primitive inside a bounding box.
+    //!
+    //! @param box  The bounding box to clip the primitive against.
+    //! @return     Bounding box of the part of the primitive inside the box, it is invalid if there is nothing inside.
+    BBox ClipBBox( const BBox& box ) const {
+        const auto clip_box = Intersection( m_bbox , box );
+        if( !clip_box.IsValid() )
+            return clip_box;
+        return primitive->GetShape()->ClipBBox( clip_box );
+    }
+};
+
+//! @brief A range of BVH primitives.
+/**
+ * With spatial splits, references of primitives keep growing during construction. Room is reserved after primitives
+ * of each range for them, splitting a range hands its room over to both sides. Sub-trees never touch memory of each
+ * other this way, which still allows them to be split in parallel. Without spatial splits, there is no room at all.
+ */
+struct Bvh_Range {
+    unsigned    start = 0;      /**< The start offset of primitives in the range. */
+    unsigned    end = 0;        /**< The end offset of primitives in the range. */
+    unsigned    cap = 0;        /**< The end offset of the room reserved for the range, it is no smaller than 'end'. */
+
+    //! @brief Default constructor.
+    Bvh_Range() = default;
+
+    //! @brief Constructor.
+    //!
+    //! @param s    The start offset of primitives in the range.
+    //! @param e    The end offset of primitives in the range.
+    //! @param c    The end offset of the room reserved for the range.
+    Bvh_Range( unsigned s , unsigned e , unsigned c ) : start(s), end(e), cap(c) {}
+
+    //! @brief Number of primitives in the range.
+    //!
+    //! @return     Number of primitives in the range.
+    unsigned Count() const {
+        return end - start;
+    }
+};
+
+//! @brief A split of a range of BVH primitives.
+struct Bvh_Split {
+    unsigned    axis = 0;           /**< The axis id of the split plane. */
+    float       pos = 0.0f;         /**< Position of the split plane. */
+    float       sah = FLT_MAX;      /**< SAH value of the split. */
+    bool        spatial = false;    /**< Primitives straddling the plane are referred by both sides in a spatial split. */
+};
+
+//! @brief Update an atomic value with the maximum of itself and a new value.
+//!
+//! @param target       The atomic value to be updated.
+//! @param value        The new value.
+template<class T>
+SORT_FORCEINLINE void atomicMax( std::atomic<T>& target , const T value ){
+    auto cur = target.load( std::memory_order_relaxed );
+    while( cur < value && !target.compare_exchange_weak( cur , value , std::memory_order_relaxed ) );
+}
+
+//! @brief Bounding boxes of children of a wide BVH node, quantized relative to the bounding box of the node.
+/**
+ * Each plane of a child bounding box is quantized to 8 bits on a grid spanning the bounding box of the node, taking six
+ * bytes for a child instead of twenty four. The size of grid cells along each axis is a power of two so that it takes
+ * only one byte too. Planes are rounded outwards, a quantized bounding box always encloses the original one.
+ */
+template<unsigned N>
+struct Quantized_BBox {
+    float           origin[3];          /**< Minimum corner of the node, it is also the origin of the grid. */
+    signed char     exponent[3];        /**< Size of grid cells along each axis is two to the power of it. */
+    unsigned char   child_cnt;          /**< Number of valid children. */
+    unsigned char   q_min[3][N];        /**< Quantized minimum planes of children along each axis. */
+    unsigned char   q_max[3][N];        /**< Quantized maximum planes of children along each axis. */
+
+    //! @brief Quantize bounding boxes of children.
+    //!
+    //! @param children     Bounding boxes of children.
+    //! @param cnt          Number of children.
+    void Quantize( const BBox* children , unsigned cnt ){
+        child_cnt = (unsigned char)cnt;
+        for( auto axis = 0 ; axis < 3 ; ++axis ){
+            auto lo = FLT_MAX , hi = -FLT_MAX;
+            for( auto i = 0u ; i < cnt ; ++i ){
+                lo = std::min( lo , children[i].m_Min[axis] );
+                hi = std::max( hi , children[i].m_Max[axis] );
+            }
+
+            // pick the smallest cell size with which 255 cells cover the node.
+            auto e = 0;
+            std::frexp( ( hi - lo ) / 255.0f , &e );
+            e = std::max( e , -126 );
+            while( lo + 255.0f * std::ldexp( 1.0f , e ) < hi )
+                ++e;
+
+            origin[axis] = lo;
+            exponent[axis] = (signed char)e;
+
+            const auto cell = std::ldexp( 1.0f , e );
+            for( auto i = 0u ; i < N ; ++i ){
+                if( i >= cnt ){
+                    q_min[axis][i] = q_max[axis][i] = 0;
+                    continue;
+                }
+
+                // make sure the planes are rounded outwards even if there is precision issue in the division.
+                const auto& bbox = children[i];
+                auto qmin = std::max( (int)std::floor( ( bbox.m_Min[axis] - lo ) / cell ) , 0 );
+                auto qmax = std::min( (int)std::ceil( ( bbox.m_Max[axis] - lo ) / cell ) , 255 );
+                while( qmin > 0 && lo + qmin * cell > bbox.m_Min[axis] )
+                    --qmin;
+                while( qmax < 255 && lo + qmax * cell < bbox.m_Max[axis] )
+                    ++qmax;
+
+                q_min[axis][i] = (unsigned char)qmin;
+                q_max[axis][i] = (unsigned char)qmax;
+            }
+        }
+    }
+
+    //! @brief Size of grid cells along an axis.
+    //!
+    //! @param axis         The axis of interest.
+    //! @return             Two to the power of the exponent along the axis.
+    SORT_FORCEINLINE float Cell( int axis ) const {
+        // the float is built from its bits directly, this is a lot cheaper than calling ldexp during traversal.
+        const auto bits = (unsigned)( exponent[axis] + 127 ) << 23;
+        float ret;
+        memcpy( &ret , &bits , sizeof( ret ) );
+        return ret;
+    }
+
+    //! @brief Restore the bounding box of a child.
+    //!
+    //! @param i            Index of the child.
+    //! @return             The quantized bounding box of the child in world space.
+    SORT_FORCEINLINE BBox operator []( unsigned i ) const {
+        BBox bbox;
+        for( auto axis = 0 ; axis < 3 ; ++axis ){
+            const auto cell = Cell( axis );
+            bbox.m_Min[axis] = origin[axis] + q_min[axis][i] * cell;
+            bbox.m_Max[axis] = origin[axis] + q_max[axis][i] * cell;
+        }
+        return bbox;
     }
 };
 
@@ -57,44 +218,147 @@ SORT_FORCEINLINE float sah( unsigned left , unsigned right , const BBox& lbox ,
     return (left * lbox.HalfSurfaceArea() + right * rbox.HalfSurfaceArea()) / box.HalfSurfaceArea();
 }
 
-//! @brief Pick the best split among all possible splits.
+// Number of bins used for evaluating SAH along the picked axis.
+static constexpr unsigned   BVH_SPLIT_COUNT                 = 16;
+// Nodes with more primitives than this will have their binning passes distributed among worker threads.
+static constexpr unsigned   BVH_PARALLEL_BINNING_THRESHOLD  = 65536;
+// Number of primitives processed in each task of a distributed binning pass.
+static constexpr unsigned   BVH_BINNING_CHUNK_SIZE          = 16384;
+// Spatial splits are only evaluated if children of the best object split overlap more than this, relative to the root node.
+static constexpr float      BVH_SPATIAL_SPLIT_ALPHA         = 1e-5f;
+
+//! @brief  Primitive bins of a range of primitives, it is used during SAH evaluation.
+struct Bvh_Bins {
+    unsigned    cnt[BVH_SPLIT_COUNT] = { 0 };   /**< Number of primitives in each bin. */
+    BBox        bbox[BVH_SPLIT_COUNT];          /**< Bounding box of primitives in each bin. */
+
+    //! @brief  Merge bins of another range of primitives.
+    //!
+    //! @param  bins        Bins to be merged.
+    void Merge( const Bvh_Bins& bins ){
+        for( auto i = 0u ; i < BVH_SPLIT_COUNT ; ++i ){
+            cnt[i] += bins.cnt[i];
+            bbox[i].Union( bins.bbox[i] );
+        }
+    }
+};
+
+//! @brief  Spatial bins of a range of primitives, it is used during SAH evaluation of spatial splits.
+struct Bvh_Spatial_Bins {
+    unsigned    entry[BVH_SPLIT_COUNT] = { 0 }; /**< Number of primitives starting in each bin. */
+    unsigned    exit[BVH_SPLIT_COUNT] = { 0 };  /**< Number of primitives ending in each bin. */
+    BBox        bbox[BVH_SPLIT_COUNT];          /**< Bounding box of parts of primitives clipped in each bin. */
+
+    //! @brief  Merge bins of another range of primitives.
+    //!
+    //! @param  bins        Bins to be merged.
+    void Merge( const Bvh_Spatial_Bins& bins ){
+        for( auto i = 0u ; i < BVH_SPLIT_COUNT ; ++i ){
+            entry[i] += bins.entry[i];
+            exit[i] += bins.exit[i];
+            bbox[i].Union( bins.bbox[i] );
+        }
+    }
+};
+
+//! @brief Process a range of primitives in chunks, large ranges are distributed among worker threads.
+//!
+//! @param start        The start offset of primitives to be processed.
+//! @param end          The end offset of primitives to be processed.
+//! @param results      Results of all chunks, one per chunk.
+//! @param func         The function processing one chunk, taking the range of the chunk and its result.
+template<class T, class F>
+SORT_FORCEINLINE void processPrimitiveChunks( const unsigned start , const unsigned end , std::vector<T>& results , const F& func ){
+    const auto chunk_cnt = ( end - start + BVH_BINNING_CHUNK_SIZE - 1 ) / BVH_BINNING_CHUNK_SIZE;
+    results.resize( chunk_cnt );
+
+    TaskGroup task_group;
+    for( auto i = 0u ; i < chunk_cnt ; ++i ){
+        const auto chunk_start = start + i * BVH_BINNING_CHUNK_SIZE;
+        const auto chunk_end = std::min( chunk_start + BVH_BINNING_CHUNK_SIZE , end );
+        auto& result = results[i];
+
+        // the last chunk is processed in the current thread
+        if( i + 1 == chunk_cnt )
+            func( chunk_start , chunk_end , result );
+        else
+            task_group.Fork( [&func, &result, chunk_start, chunk_end](){ func( chunk_start , chunk_end , result ); } , "Bvh Binning" );
+    }
+    task_group.Wait();
+}
+
+//! @brief Calculate bounding box of centroids of a range of primitives.
 //!
-//! @param axis         The selected axis id of the picked split plane.
-//! @param split_pos    Position of the selected split plane.
 //! @param primitives   The buffer hold all primitives.
-//! @param node         The node to be split.
+//! @param start        The start offset of primitives.
+//! @param end          The end offset of primitives.
+//! @return             Bounding box of centroids of the primitives.
+SORT_FORCEINLINE BBox calcCentroidBBox( const Bvh_Primitive* const primitives , const unsigned start , const unsigned end ){
+    const auto centroid_bounds = [primitives]( const unsigned s , const unsigned e , BBox& bbox ){
+        for(auto i = s ; i < e ; i++ )
+            bbox.Union( primitives[i].m_centroid );
+    };
+
+    BBox inner;
+    if( end - start >= BVH_PARALLEL_BINNING_THRESHOLD ){
+        std::vector<BBox> chunk_bbox;
+        processPrimitiveChunks( start , end , chunk_bbox , centroid_bounds );
+        for( const auto& bbox : chunk_bbox )
+            inner.Union( bbox );
+    }else{
+        centroid_bounds( start , end , inner );
+    }
+    return inner;
+}
+
+//! @brief Evaluate object splits along an axis, primitives are binned by their centroids.
+//!
+//! @param split        The best split so far, it is updated if there is a better one along the axis.
+//! @param best_lbox    Bounding box of the left side of the best split so far.
+//! @param best_rbox    Bounding box of the right side of the best split so far.
+//! @param axis         The axis id of split planes.
+//! @param primitives   The buffer hold all primitives.
+//! @param node_bbox    Bounding box of the node to be split.
+//! @param inner        Bounding box of centroids of primitives.
 //! @param start        The start offset of primitives that the node holds.
 //! @param end          The end offset of primitives that the node holds.
-//! @return             The SAH value of the selected best split plane.
-SORT_FORCEINLINE float pickBestSplit( unsigned& axis , float& splitPos , const Bvh_Primitive* const primitives , const BBox& node_bbox , const unsigned start , const unsigned end ){
-    static constexpr unsigned   BVH_SPLIT_COUNT         = 16;
+SORT_FORCEINLINE void evalObjectSplits( Bvh_Split& split , BBox& best_lbox , BBox& best_rbox , const unsigned axis , const Bvh_Primitive* const primitives ,
+                                        const BBox& node_bbox , const BBox& inner , const unsigned start , const unsigned end ){
     static constexpr float      BVH_INV_SPLIT_COUNT     = 1.0f / (float)BVH_SPLIT_COUNT;
 
-    BBox inner;
-    for(auto i = start ; i < end ; i++ )
-        inner.Union( primitives[i].m_centroid );
-
     auto primitive_num = end - start;
-    axis = inner.MaxAxisId();
-    auto min_sah = FLT_MAX;
+    const auto parallel = primitive_num >= BVH_PARALLEL_BINNING_THRESHOLD;
 
     // distribute the primitives into bins
-    unsigned    bin[BVH_SPLIT_COUNT];
-    BBox        bbox[BVH_SPLIT_COUNT];
     BBox        rbox[BVH_SPLIT_COUNT-1];
-    memset( bin , 0 , sizeof( unsigned ) * BVH_SPLIT_COUNT );
     auto split_start = inner.m_Min[axis];
     auto split_delta = inner.Delta(axis) * BVH_INV_SPLIT_COUNT;
     if( split_delta == 0.0f )
-        return FLT_MAX;
+        return;
     auto inv_split_delta = 1.0f / split_delta;
-    for(auto i = start ; i < end ; i++ ){
-        auto index = (int)((primitives[i].m_centroid[axis] - split_start) * inv_split_delta);
-        index = std::min( index , (int)(BVH_SPLIT_COUNT - 1) );
-        ++bin[index];
-        bbox[index].Union( primitives[i].GetBBox() );
+
+    const auto binning = [primitives, axis, split_start, inv_split_delta]( const unsigned s , const unsigned e , Bvh_Bins& bins ){
+        for(auto i = s ; i < e ; i++ ){
+            auto index = (int)((primitives[i].m_centroid[axis] - split_start) * inv_split_delta);
+            index = std::min( index , (int)(BVH_SPLIT_COUNT - 1) );
+            ++bins.cnt[index];
+            bins.bbox[index].Union( primitives[i].GetBBox() );
+        }
+    };
+
+    Bvh_Bins bins;
+    if( parallel ){
+        std::vector<Bvh_Bins> chunk_bins;
+        processPrimitiveChunks( start , end , chunk_bins , binning );
+        for( const auto& cb : chunk_bins )
+            bins.Merge( cb );
+    }else{
+        binning( start , end , bins );
     }
 
+    const auto& bin = bins.cnt;
+    const auto& bbox = bins.bbox;
+
     rbox[BVH_SPLIT_COUNT-2].Union( bbox[BVH_SPLIT_COUNT-1] );
     for( int i = BVH_SPLIT_COUNT-3; i >= 0 ; i-- )
         rbox[i] = Union( rbox[i+1] , bbox[i+1] );
@@ -104,14 +368,290 @@ SORT_FORCEINLINE float pickBestSplit( unsigned& axis , float& splitPos , const B
     auto    pos = split_delta + split_start ;
     for(auto i = 0 ; i < BVH_SPLIT_COUNT - 1 ; i++ ){
         auto sah_value = sah( left , primitive_num - left , lbox , rbox[i] , node_bbox );
-        if( sah_value < min_sah ){
-            min_sah = sah_value;
-            splitPos = pos;
+        if( sah_value < split.sah ){
+            split.sah = sah_value;
+            split.axis = axis;
+            split.pos = pos;
+            split.spatial = false;
+            best_lbox = lbox;
+            best_rbox = rbox[i];
         }
         left += bin[i+1];
         lbox.Union( bbox[i+1] );
         pos += split_delta;
     }
+}
+
+//! @brief Pick the best split among all possible splits.
+//!
+//! Only object splits along the axis with the largest extent of centroids are evaluated.
+//!
+//! @param axis         The selected axis id of the picked split plane.
+//! @param split_pos    Position of the selected split plane.
+//! @param primitives   The buffer hold all primitives.
+//! @param node         The node to be split.
+//! @param start        The start offset of primitives that the node holds.
+//! @param end          The end offset of primitives that the node holds.
+//! @return             The SAH value of the selected best split plane.
+SORT_FORCEINLINE float pickBestSplit( unsigned& axis , float& splitPos , const Bvh_Primitive* const primitives , const BBox& node_bbox , const unsigned start , const unsigned end ){
+    const auto inner = calcCentroidBBox( primitives , start , end );
+
+    Bvh_Split split;
+    BBox lbox , rbox;
+    evalObjectSplits( split , lbox , rbox , inner.MaxAxisId() , primitives , node_bbox , inner , start , end );
+
+    axis = split.axis;
+    splitPos = split.pos;
+    return split.sah;
+}
+
+//! @brief Evaluate spatial splits along an axis.
+//!
+//! Primitives are binned by their bounding boxes instead of centroids, a primitive straddling multiple bins is clipped
+//! against each of them. Splits that create more references than the reserved room allows are ignored.
+//!
+//! @param split        The best split so far, it is updated if there is a better one along the axis.
+//! @param axis         The axis id of split planes.
+//! @param primitives   The buffer hold all primitives.
+//! @param node_bbox    Bounding box of the node to be split.
+//! @param range_bbox   Bounding box of the primitives, split planes are evenly distributed in it.
+//! @param range        The range of primitives that the node holds.
+SORT_FORCEINLINE void evalSpatialSplits( Bvh_Split& split , const unsigned axis , const Bvh_Primitive* const primitives ,
+                                         const BBox& node_bbox , const BBox& range_bbox , const Bvh_Range& range ){
+    static constexpr float      BVH_INV_SPLIT_COUNT     = 1.0f / (float)BVH_SPLIT_COUNT;
+
+    const auto primitive_num = range.Count();
+    const auto room = range.cap - range.end;
+
+    const auto split_start = range_bbox.m_Min[axis];
+    const auto split_delta = range_bbox.Delta(axis) * BVH_INV_SPLIT_COUNT;
+    if( split_delta == 0.0f )
+        return;
+    const auto inv_split_delta = 1.0f / split_delta;
+
+    const auto binning = [primitives, axis, split_start, split_delta, inv_split_delta]( const unsigned s , const unsigned e , Bvh_Spatial_Bins& bins ){
+        for(auto i = s ; i < e ; i++ ){
+            const auto& pri = primitives[i];
+            const auto& bbox = pri.GetBBox();
+            const auto first = std::min( std::max( (int)((bbox.m_Min[axis] - split_start) * inv_split_delta) , 0 ) , (int)(BVH_SPLIT_COUNT - 1) );
+            const auto last = std::min( std::max( (int)((bbox.m_Max[axis] - split_start) * inv_split_delta) , first ) , (int)(BVH_SPLIT_COUNT - 1) );
+            ++bins.entry[first];
+            ++bins.exit[last];
+
+            if( first == last ){
+                bins.bbox[first].Union( bbox );
+                continue;
+            }
+
+            // clip the primitive against each bin it straddles.
+            for( auto j = first ; j <= last ; ++j ){
+                auto clip_box = bbox;
+                if( j > first )
+                    clip_box.m_Min[axis] = split_start + j * split_delta;
+                if( j < last )
+                    clip_box.m_Max[axis] = split_start + ( j + 1 ) * split_delta;
+                bins.bbox[j].Union( pri.ClipBBox( clip_box ) );
+            }
+        }
+    };
+
+    Bvh_Spatial_Bins bins;
+    if( primitive_num >= BVH_PARALLEL_BINNING_THRESHOLD ){
+        std::vector<Bvh_Spatial_Bins> chunk_bins;
+        processPrimitiveChunks( range.start , range.end , chunk_bins , binning );
+        for( const auto& cb : chunk_bins )
+            bins.Merge( cb );
+    }else{
+        binning( range.start , range.end , bins );
+    }
+
+    BBox        rbox[BVH_SPLIT_COUNT-1];
+    unsigned    right[BVH_SPLIT_COUNT-1];
+    rbox[BVH_SPLIT_COUNT-2] = bins.bbox[BVH_SPLIT_COUNT-1];
+    right[BVH_SPLIT_COUNT-2] = bins.exit[BVH_SPLIT_COUNT-1];
+    for( int i = BVH_SPLIT_COUNT-3; i >= 0 ; i-- ){
+        rbox[i] = Union( rbox[i+1] , bins.bbox[i+1] );
+        right[i] = right[i+1] + bins.exit[i+1];
+    }
+
+    auto    left = 0u;
+    BBox    lbox;
+    for(auto i = 0 ; i < BVH_SPLIT_COUNT - 1 ; i++ ){
+        left += bins.entry[i];
+        lbox.Union( bins.bbox[i] );
+
+        // there is no point splitting with nothing on one side, it is also not allowed to run out of room.
+        if( 0 == left || 0 == right[i] || left + right[i] - primitive_num > room )
+            continue;
+
+        const auto sah_value = sah( left , right[i] , lbox , rbox[i] , node_bbox );
+        if( sah_value < split.sah ){
+            split.sah = sah_value;
+            split.axis = axis;
+            split.pos = split_start + ( i + 1 ) * split_delta;
+            split.spatial = true;
+        }
+    }
+}
+
+//! @brief Pick the best split among object splits and spatial splits along all three axes.
+//!
+//! Spatial splits are only evaluated when children of the best object split overlap a lot, this is what the paper
+//! <a href="https://www.nvidia.com/docs/IO/77714/sbvh.pdf">Spatial Splits in Bounding Volume Hierarchies</a>
+//! suggests, most nodes deep in the tree don't need them at all.
+//!
+//! @param primitives   The buffer hold all primitives.
+//! @param node_bbox    Bounding box of the node to be split.
+//! @param range        The range of primitives that the node holds.
+//! @param root_area    Half surface area of the root node.
+//! @return             The best split.
+SORT_FORCEINLINE Bvh_Split pickBestSplitSBVH( const Bvh_Primitive* const primitives , const BBox& node_bbox , const Bvh_Range& range , const float root_area ){
+    const auto inner = calcCentroidBBox( primitives , range.start , range.end );
+
+    Bvh_Split split;
+    BBox lbox , rbox;
+    for( auto axis = 0u ; axis < 3 ; ++axis )
+        evalObjectSplits( split , lbox , rbox , axis , primitives , node_bbox , inner , range.start , range.end );
+
+    if( range.cap == range.end )
+        return split;
+
+    // primitives with the same centroid can only be separated by spatial splits.
+    if( split.sah != FLT_MAX ){
+        const auto overlap = Intersection( lbox , rbox );
+        if( !overlap.IsValid() || overlap.HalfSurfaceArea() <= BVH_SPATIAL_SPLIT_ALPHA * root_area )
+            return split;
+    }
+
+    BBox range_bbox;
+    for( auto i = range.start ; i < range.end ; ++i )
+        range_bbox.Union( primitives[i].GetBBox() );
+
+    for( auto axis = 0u ; axis < 3 ; ++axis )
+        evalSpatialSplits( split , axis , primitives , node_bbox , range_bbox , range );
+    return split;
+}
+
+//! @brief Split a range of primitives in place.
+//!
+//! Primitives straddling the plane of a spatial split are referred by both sides, unless moving the whole primitive to
+//! one side is cheaper, which is called reference unsplitting in the SBVH paper. References on the right side are moved
+//! backward to hand over part of the room to the left side, in proportion to the number of references on each side.
+//!
+//! @param split        The split to be applied.
+//! @param primitives   The buffer hold all primitives.
+//! @param range        The range of primitives to be split.
+//! @param left         The range of primitives on the left side.
+//! @param right        The range of primitives on the right side.
+//! @return             Whether there are primitives on both sides, the range is not split if it is false.
+SORT_FORCEINLINE bool splitPrimitives( const Bvh_Split& split , Bvh_Primitive* const primitives , const Bvh_Range& range , Bvh_Range& left , Bvh_Range& right ){
+    const auto axis = split.axis;
+    const auto pos = split.pos;
+    const auto begin = primitives + range.start;
+    const auto end = primitives + range.end;
+
+    auto mid = range.start;
+    auto new_end = range.end;
+    if( !split.spatial ){
+        const auto compare = [pos, axis](const Bvh_Primitive& pri) {return pri.m_centroid[axis] < pos; };
+        const auto middle = std::partition( begin , end , compare );
+        mid = (unsigned)( middle - primitives );
+    }else{
+        // primitives are partitioned into three groups, the ones on the left side, the straddling ones and the ones on the right side.
+        const auto straddle_begin = std::partition( begin , end , [pos, axis](const Bvh_Primitive& pri) {return pri.GetBBox().m_Max[axis] <= pos; } );
+        const auto straddle_end = std::partition( straddle_begin , end , [pos, axis](const Bvh_Primitive& pri) {return pri.GetBBox().m_Min[axis] < pos; } );
+
+        std::vector<Bvh_Primitive>  straddling( straddle_begin , straddle_end );
+        std::vector<BBox>           lparts( straddling.size() ) , rparts( straddling.size() );
+        std::vector<unsigned char>  sides( straddling.size() );
+
+        BBox lbox , rbox;
+        for( auto p = begin ; p < straddle_begin ; ++p )
+            lbox.Union( p->GetBBox() );
+        for( auto p = straddle_end ; p < end ; ++p )
+            rbox.Union( p->GetBBox() );
+        auto lcnt = (unsigned)( straddle_begin - begin ) + (unsigned)straddling.size();
+        auto rcnt = (unsigned)( end - straddle_end ) + (unsigned)straddling.size();
+
+        for( auto i = 0u ; i < straddling.size() ; ++i ){
+            auto lclip = straddling[i].GetBBox();
+            auto rclip = lclip;
+            lclip.m_Max[axis] = pos;
+            rclip.m_Min[axis] = pos;
+            lparts[i] = straddling[i].ClipBBox( lclip );
+            rparts[i] = straddling[i].ClipBBox( rclip );
+            lbox.Union( lparts[i] );
+            rbox.Union( rparts[i] );
+        }
+
+        // 0 means the left side, 1 means the right side and 2 means both sides.
+        const auto room = range.cap - range.end;
+        auto duplicated = 0u;
+        for( auto i = 0u ; i < straddling.size() ; ++i ){
+            const auto bbox = straddling[i].GetBBox();
+
+            // the bounding box is conservative, the part of the primitive that it refers to could be on one side only.
+            if( !lparts[i].IsValid() || !rparts[i].IsValid() ){
+                sides[i] = rparts[i].IsValid() ? 1 : 0;
+                if( sides[i] ){
+                    straddling[i].SetBBox( rparts[i] );
+                    --lcnt;
+                }else{
+                    if( lparts[i].IsValid() )
+                        straddling[i].SetBBox( lparts[i] );
+                    --rcnt;
+                }
+                continue;
+            }
+
+            const auto c_split = lbox.HalfSurfaceArea() * lcnt + rbox.HalfSurfaceArea() * rcnt;
+            const auto c_left = Union( lbox , bbox ).HalfSurfaceArea() * lcnt + rbox.HalfSurfaceArea() * ( rcnt - 1 );
+            const auto c_right = lbox.HalfSurfaceArea() * ( lcnt - 1 ) + Union( rbox , bbox ).HalfSurfaceArea() * rcnt;
+            if( c_split < std::min( c_left , c_right ) && duplicated < room ){
+                sides[i] = 2;
+                ++duplicated;
+            }else if( c_left <= c_right ){
+                sides[i] = 0;
+                lbox.Union( bbox );
+                --rcnt;
+            }else{
+                sides[i] = 1;
+                rbox.Union( bbox );
+                --lcnt;
+            }
+        }
+
+        // straddling primitives are written back in the order of the ones moved to the left side, the left parts of the
+        // split ones and the ones moved to the right side, the right parts of the split ones are appended at the end.
+        auto p = straddle_begin;
+        for( const auto side : { 0 , 2 , 1 } ){
+            if( 1 == side )
+                mid = (unsigned)( p - primitives );
+            for( auto i = 0u ; i < straddling.size() ; ++i ){
+                if( sides[i] != side )
+                    continue;
+                *p = straddling[i];
+                if( 2 == side ){
+                    p->SetBBox( lparts[i] );
+                    primitives[new_end] = straddling[i];
+                    primitives[new_end++].SetBBox( rparts[i] );
+                }
+                ++p;
+            }
+        }
+    }
+
+    if( mid == range.start || mid == new_end )
+        return false;
+
+    // hand the room over to both sides in proportion to the number of their primitives.
+    const auto left_cnt = mid - range.start;
+    const auto right_cnt = new_end - mid;
+    const auto left_room = (unsigned)( (unsigned long long)( range.cap - new_end ) * left_cnt / ( left_cnt + right_cnt ) );
+    if( left_room > 0 )
+        std::move_backward( primitives + mid , primitives + new_end , primitives + new_end + left_room );
 
-    return min_sah;
+    left = Bvh_Range( range.start , mid , mid + left_room );
+    right = Bvh_Range( mid + left_room , new_end + left_room , range.cap );
+    return true;
 }
\ No newline at end of file
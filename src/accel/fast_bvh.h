@@ -19,6 +19,7 @@
 
 #include "accelerator.h"
 #include "bvh_utils.h"
+#include "fast_bvh_dispatch.h"
 #include "core/primitive.h"
 
 #if defined(SIMD_SSE_IMPLEMENTATION) && defined(SIMD_AVX_IMPLEMENTATION)
@@ -28,23 +29,31 @@ static_assert(false, "More than one SIMD version is defined before including fas
 #if defined(QBVH_IMPLEMENTATION) || defined(OBVH_IMPLEMENTATION)
 
 #if defined(QBVH_IMPLEMENTATION)
-#define Fast_Bvh_Node   Qbvh_Node
-#define FBVH_CHILD_CNT  4
+#define Fast_Bvh_Node           Qbvh_Node
+#define Fast_Bvh_Linear_Node    Qbvh_Linear_Node
+#define FBVH_CHILD_CNT          4
+#define FBVH_CACHE_CATEGORY     "qbvh"
 #endif
 
 #if defined(OBVH_IMPLEMENTATION)
-#define Fast_Bvh_Node   Obvh_Node
-#define FBVH_CHILD_CNT  8
+#define Fast_Bvh_Node           Obvh_Node
+#define Fast_Bvh_Linear_Node    Obvh_Linear_Node
+#define FBVH_CHILD_CNT          8
+#define FBVH_CACHE_CATEGORY     "obvh"
 #endif
 
+// Flattened nodes are aligned to cache lines.
+#define FBVH_NODE_ALIGNMENT     64
+
+// Maximum number of rays traced together in packet traversal, active rays are tracked in a 32 bits mask.
+#define FBVH_PACKET_SIZE        32u
+
 #ifdef SIMD_BVH_IMPLEMENTATION
+struct Fast_Bvh_Node;
 struct Fast_Bvh_Node_Deallocator{
-    void operator()(void* p){
-        free_aligned(p);
-    }
+    void operator()(Fast_Bvh_Node* p);
 };
 
-struct Fast_Bvh_Node;
 using Fast_Bvh_Node_Ptr = std::unique_ptr<Fast_Bvh_Node,Fast_Bvh_Node_Deallocator>;
 
 #else
@@ -52,16 +61,17 @@ struct Fast_Bvh_Node;
 using Fast_Bvh_Node_Ptr = std::unique_ptr<Fast_Bvh_Node>;
 #endif
 
+//! @brief  QBVH/OBVH node used during construction.
+/**
+ * This is only a temporary data structure during construction. Once the construction is done, the whole tree will
+ * be flattened into a linear buffer of Fast_Bvh_Linear_Node, which is what ray traversal works on.
+ */
 struct Fast_Bvh_Node {
 #ifdef SIMD_BVH_IMPLEMENTATION
-    using Simd_Triangle_Container   = std::unique_ptr<Simd_Triangle[]>;
-    using Simd_Line_Container       = std::unique_ptr<Simd_Line[]>;
     Simd_BBox                       bbox;                       /**< Bounding boxes of its four children. */
-    Simd_Triangle_Container         tri_list;
-    Simd_Line_Container             line_list;
-    unsigned int                    tri_cnt = 0;
-    unsigned int                    line_cnt = 0;
-    std::vector<const Primitive*>   other_list;
+    std::vector<Simd_Triangle>      tri_list;                   /**< Packed triangles in the leaf node. */
+    std::vector<Simd_Line>          line_list;                  /**< Packed lines in the leaf node. */
+    std::vector<const Primitive*>   other_list;                 /**< Other primitives in the leaf node. */
 #else
     BBox                            bbox[FBVH_CHILD_CNT];       /**< Bounding boxes of its children. */
 #endif
@@ -70,21 +80,103 @@ struct Fast_Bvh_Node {
 
     unsigned                        pri_cnt = 0;                /**< Number of primitives in the node. */
     unsigned                        pri_offset = 0;             /**< Offset of primitives in the buffer. */
+    unsigned                        pri_cap = 0;                /**< End offset of the room reserved for the node, see Bvh_Range. */
     unsigned                        child_cnt = 0;              /**< 0 means it is a leaf node. */
 
     //! @brief  Constructor.
     //!
     //! @param  offset      The offset of the first primitive in the whole buffer.
     //! @param  cnt         Number of primitives in the node.
-    Fast_Bvh_Node(unsigned offset, unsigned cnt) : pri_cnt(cnt), pri_offset(offset) {}
+    //! @param  cap         End offset of the room reserved for references created by spatial splits.
+    Fast_Bvh_Node(unsigned offset, unsigned cnt, unsigned cap) : pri_cnt(cnt), pri_offset(offset), pri_cap(cap) {}
 
     //! @brief  Default constructor.
-    Fast_Bvh_Node() : pri_cnt(0), pri_offset(0), child_cnt(0) {}  
+    Fast_Bvh_Node() : pri_cnt(0), pri_offset(0), pri_cap(0), child_cnt(0) {}  
 };
 
 #ifdef SIMD_BVH_IMPLEMENTATION
     static_assert( sizeof( Fast_Bvh_Node ) % SIMD_ALIGNMENT == 0 , "Incorrect size of Fast_Bvh_Node." );
+
+// Nodes are allocated with aligned memory and placement new, the destructor needs to be called explicitly so that
+// children and primitive lists are released too.
+inline void Fast_Bvh_Node_Deallocator::operator()(Fast_Bvh_Node* p){
+    if( p ){
+        p->~Fast_Bvh_Node();
+        free_aligned(p);
+    }
+}
+#endif
+
+//! @brief  Flattened QBVH/OBVH node used during ray traversal.
+/**
+ * All nodes are kept in one contiguous buffer in depth-first order, children are referred by their offsets in the
+ * buffer instead of pointers. Primitives in leaf nodes are also packed in contiguous buffers shared by all leaf
+ * nodes. This avoids chasing pointers scattered in the heap during traversal.
+ */
+#ifdef ENABLE_COMPRESSED_BVH
+// Interior nodes and leaf nodes share the same memory, a QBVH node takes one cache line and an OBVH node takes two.
+struct alignas(FBVH_NODE_ALIGNMENT) Fast_Bvh_Linear_Node {
+    union{
+        struct{
+            Quantized_BBox<FBVH_CHILD_CNT>  bbox;                       /**< Quantized bounding boxes of its children. */
+            unsigned                        children[FBVH_CHILD_CNT];   /**< Offsets of its children in the node buffer. */
+        };
+        struct{
+            unsigned                        pri_cnt;                    /**< Number of primitives in the node. */
+            unsigned                        pri_offset;                 /**< Offset of primitives in the buffer. */
+            unsigned                        tri_offset;                 /**< Offset of the first packed triangle in the triangle buffer. */
+            unsigned                        tri_cnt;                    /**< Number of packed triangles in the leaf node. */
+            unsigned                        line_offset;                /**< Offset of the first packed line in the line buffer. */
+            unsigned                        line_cnt;                   /**< Number of packed lines in the leaf node. */
+            unsigned                        other_offset;               /**< Offset of the first other primitive in the buffer. */
+            unsigned                        other_cnt;                  /**< Number of other primitives in the leaf node. */
+        };
+    };
+
+    unsigned                        child_cnt = 0;              /**< 0 means it is a leaf node. */
+};
+#else
+struct alignas(FBVH_NODE_ALIGNMENT) Fast_Bvh_Linear_Node {
+#ifdef SIMD_BVH_IMPLEMENTATION
+    Simd_BBox                       bbox;                       /**< Bounding boxes of its children. */
+#else
+    BBox                            bbox[FBVH_CHILD_CNT];       /**< Bounding boxes of its children. */
+#endif
+
+    unsigned                        children[FBVH_CHILD_CNT];   /**< Offsets of its children in the node buffer. */
+    unsigned                        child_cnt = 0;              /**< 0 means it is a leaf node. */
+
+    unsigned                        pri_cnt = 0;                /**< Number of primitives in the node. */
+    unsigned                        pri_offset = 0;             /**< Offset of primitives in the buffer. */
+
+#ifdef SIMD_BVH_IMPLEMENTATION
+    unsigned                        tri_offset = 0;             /**< Offset of the first packed triangle in the triangle buffer. */
+    unsigned                        tri_cnt = 0;                /**< Number of packed triangles in the leaf node. */
+    unsigned                        line_offset = 0;            /**< Offset of the first packed line in the line buffer. */
+    unsigned                        line_cnt = 0;               /**< Number of packed lines in the leaf node. */
+    unsigned                        other_offset = 0;           /**< Offset of the first other primitive in the buffer. */
+    unsigned                        other_cnt = 0;              /**< Number of other primitives in the leaf node. */
 #endif
+};
+#endif
+
+static_assert( sizeof( Fast_Bvh_Linear_Node ) % FBVH_NODE_ALIGNMENT == 0 , "Incorrect size of Fast_Bvh_Linear_Node." );
+#ifdef ENABLE_COMPRESSED_BVH
+static_assert( sizeof( Fast_Bvh_Linear_Node ) == FBVH_CHILD_CNT / 4 * FBVH_NODE_ALIGNMENT , "Compressed Fast_Bvh_Linear_Node doesn't fit in cache lines." );
+#endif
+
+//! @brief  A node of a tree loaded from the disk cache, evaluated with primitives where they are now.
+/**
+ * The SAH of a sub-tree here is the sum of the surface areas of all nodes in it, weighted by the number of primitives
+ * in leaf nodes. It is not normalized by the surface area of the root of the sub-tree.
+ */
+struct Fbvh_Refit_Node {
+    BBox                            bbox;                       /**< Bounding box of the node after refitting. */
+    float                           sah_before = 0.0f;          /**< SAH of the sub-tree before refitting. */
+    float                           sah_after = 0.0f;           /**< SAH of the sub-tree after refitting. */
+    unsigned                        depth = 0;                  /**< Depth of the node, starting from 1 for root node. */
+    bool                            rebuild = false;            /**< Whether the sub-tree degrades too much to be refitted. */
+};
 
 #endif
 
@@ -100,11 +192,21 @@ struct Fast_Bvh_Node {
  */
 class Fbvh : public Accelerator{
 public:
+#if !defined(SIMD_DISPATCH_ENABLED)
 #ifdef QBVH_IMPLEMENTATION
     DEFINE_RTTI( Qbvh , Accelerator );
 #endif
 #ifdef OBVH_IMPLEMENTATION
     DEFINE_RTTI( Obvh , Accelerator );
+#endif
+#elif !defined(SIMD_KERNEL_NAMESPACE)
+    // The one with the best SIMD kernels that the CPU supports is created, kernels themselves are not registered.
+#ifdef QBVH_IMPLEMENTATION
+    DEFINE_RTTI_CREATOR( Qbvh , Accelerator , CreateQbvh );
+#endif
+#ifdef OBVH_IMPLEMENTATION
+    DEFINE_RTTI_CREATOR( Obvh , Accelerator , CreateObvh );
+#endif
 #endif
 
     //! @brief Get intersection between the ray and the primitive set using QBVH/OBVH.
@@ -146,8 +248,32 @@ public:
     //! @param  matID       We are only interested in intersection with the same material, whose material id should be set to matID.
     void    GetIntersect( const Ray& r , BSSRDFIntersections& intersect , const StringID matID = INVALID_SID ) const override;
 
+#ifdef SIMD_BVH_IMPLEMENTATION
+    //! @brief Get the nearest intersections of a stream of rays with packet traversal.
+    //!
+    //! Rays are traced in packets of FBVH_PACKET_SIZE. Each node is fetched only once for all active rays in the packet,
+    //! each of its children bounding boxes is tested against SIMD_CHANNEL rays at a time. A child is visited by the
+    //! sub-set of rays that hit its bounding box. This is only efficient for coherent rays, like primary rays in a tile.
+    //!
+    //! @param rays         The rays to be tested.
+    //! @param intersects   The intersection results, one for each ray.
+    //! @param cnt          The number of rays in the stream.
+    void    IntersectStream( const Ray* rays , SurfaceInteraction* intersects , unsigned cnt ) const override;
+
+    //! @brief Check whether each ray in a stream hits anything with packet traversal.
+    //!
+    //! @param rays         The rays to be tested.
+    //! @param occluded     Whether each ray is occluded by anything.
+    //! @param cnt          The number of rays in the stream.
+    void    OccludedStream( const Ray* rays , bool* occluded , unsigned cnt ) const override;
+#endif
+
     //! @brief Build BVH structure in O(N*lg(N)).
     //!
+    //! With SIMD, the built tree is kept in the disk cache if it is enabled. It is loaded from the cache instead of
+    //! being built again as long as the primitives and the configuration don't change. If only some primitives have
+    //! moved, the cached tree is refitted instead, see 'refit'.
+    //!
     //! @param primitives       A vector holding all primitives.
     //! @param bbox             The bounding box of the scene.
     void    Build(const std::vector<const Primitive*>& primitives, const BBox& bbox) override;
@@ -159,8 +285,21 @@ public:
     void    Serialize( IStreamBase& stream ) override{
         stream >> m_maxNodeDepth;
         stream >> m_maxPriInLeaf;
+        stream >> m_spatialSplit;
+        stream >> m_spatialSplitBudget;
+        stream >> m_refitThreshold;
     }
 
+#ifdef SIMD_BVH_IMPLEMENTATION
+    //! @brief      Serializing the built tree to stream.
+    //!
+    //! Unlike serializing from stream, which only loads the configuration, this streams out the nodes and packed
+    //! primitives of the built tree. It is what the disk cache keeps for the tree.
+    //!
+    //! @param      Stream where the serialization data goes to.
+    void    Serialize( OStreamBase& stream ) override;
+#endif
+
 	//! @brief	Clone the accelerator.
 	//!
 	//! Only configuration will be cloned, not the data inside the accelerator, this is for primitives that has volumes attached.
@@ -172,23 +311,52 @@ private:
     /**< Primitive list during QBVH/OBVH construction. */
     std::unique_ptr<Bvh_Primitive[]>    m_bvhpri = nullptr;
 
-    /**< Root node of the BVH. */
+    /**< Root node of the BVH, it is only valid during construction. */
     Fast_Bvh_Node_Ptr                   m_root;
 
+    /**< Flattened nodes in depth-first order, the first one is the root node. */
+    std::vector<Fast_Bvh_Linear_Node>   m_nodes;
+#ifdef SIMD_BVH_IMPLEMENTATION
+    /**< Primitives in the order of leaf nodes, packed triangles and lines refer to them by indices. */
+    std::vector<const Primitive*>       m_leafPrimitives;
+    /**< Packed triangles of all leaf nodes. */
+    std::vector<Simd_Triangle>          m_triangles;
+    /**< Packed lines of all leaf nodes. */
+    std::vector<Simd_Line>              m_lines;
+    /**< Other primitives of all leaf nodes. */
+    std::vector<const Primitive*>       m_others;
+#endif
+
     /**< Maximum primitives in a leaf node. During BVH construction, a node with less primitives will be marked as a leaf node. */
     unsigned                            m_maxPriInLeaf = 8;
     /**< Maximum depth of node in BVH. */
     unsigned                            m_maxNodeDepth = 16;
+    /**< Whether spatial splits are enabled, primitives straddling split planes could be referred by both sides. */
+    bool                                m_spatialSplit = false;
+    /**< Maximum number of extra references created by spatial splits, relative to the number of primitives. */
+    float                               m_spatialSplitBudget = 0.3f;
+    /**< Sub-trees whose relative SAH grows by more than this factor after refitting are rebuilt. */
+    float                               m_refitThreshold = 1.5f;
+#ifdef SIMD_BVH_IMPLEMENTATION
+    /**< Hash of the geometry of all primitives that the tree is built for, it is kept in the disk cache with the tree. */
+    std::uint64_t                       m_geometryHash = 0;
+#endif
 
-    /**< Depth of the QBVH/OBVH. */
-    unsigned                            m_depth = 0;
+    /**< Depth of the QBVH/OBVH. It is updated by multiple threads during construction. */
+    std::atomic<unsigned>               m_depth = { 0 };
+    /**< Maximum number of primitives in a leaf node, this is purely for stats. */
+    std::atomic<unsigned>               m_maxLeafPriCnt = { 0 };
 
     //! @brief Split current QBVH/OBVH node.
     //!
+    //! Sub-trees with enough primitives will be split in separate tasks so that idle worker threads can
+    //! help constructing the QBVH/OBVH.
+    //!
     //! @param node         The QBVH/OBVH node to be split.
     //! @param node_bbox    The bounding box of the node.
     //! @param depth        The current depth of the node. Starting from 1 for root node.
-    void    splitNode( Fbvh_Node* const node , const BBox& node_bbox , unsigned depth );
+    //! @param task_group   The task group that sub-tree splitting tasks are forked in.
+    void    splitNode( Fbvh_Node* const node , const BBox& node_bbox , unsigned depth , TaskGroup& task_group );
 
     //! @brief Mark the current node as leaf node.
     //!
@@ -198,12 +366,79 @@ private:
     //! @param depth        Depth of the current node.
     void    makeLeaf( Fbvh_Node* const node , unsigned start , unsigned end , unsigned depth );
 
+    //! @brief Flatten the (sub)tree into the linear node buffer in depth-first order.
+    //!
+    //! @param node         The root node of the (sub)tree to be flattened.
+    //! @return             The offset of the flattened node in the node buffer.
+    unsigned flattenNode( const Fbvh_Node* node );
+
 #ifdef SIMD_BVH_IMPLEMENTATION
+    //! @brief Evaluate the key of the tree in the disk cache.
+    //!
+    //! The key covers the layout of the nodes, the configuration of the construction and the topology of primitives,
+    //! which is the number of primitives, their shape types and identities, see 'Shape::SerializeTopology'. Geometry
+    //! of primitives is not part of it so that the cached tree can be refitted once some primitives move, see
+    //! 'calcGeometryHash'.
+    //!
+    //! @return             Key of the tree in the disk cache.
+    std::uint64_t calcCacheKey() const;
+
+    //! @brief Evaluate the hash of the geometry of all primitives.
+    //!
+    //! @return             Hash of the bounding box of the scene, bounding boxes and geometry of all primitives.
+    std::uint64_t calcGeometryHash() const;
+
+    //! @brief Load the built tree streamed out by 'Serialize'.
+    //!
+    //! @param stream           Stream of the cached tree.
+    //! @param geometry_hash    Hash of the geometry that the cached tree was built for.
+    //! @return                 Whether the tree is loaded, nothing is kept if it fails.
+    bool        loadCache( IStreamBase& stream , std::uint64_t& geometry_hash );
+
+    //! @brief Update the tree loaded from the disk cache for primitives that have moved.
+    //!
+    //! The tree has to be built for the same topology of primitives, which is guaranteed by the key of the tree.
+    //! Bounding boxes of nodes are updated bottom-up and primitives in leaf nodes are packed again, the topology of
+    //! the tree is kept. A sub-tree is rebuilt from scratch instead if its SAH, relative to its surface area, grows by
+    //! more than the refit threshold since refitting doesn't fix nodes that start to overlap a lot.
+    void        refit();
+
+    //! @brief Evaluate bounding boxes and SAH of a (sub)tree before and after refitting.
+    //!
+    //! @param offset       Offset of the root of the (sub)tree in the node buffer.
+    //! @param bbox         Bounding box of the root of the (sub)tree before refitting.
+    //! @param depth        Depth of the root of the (sub)tree, starting from 1 for root node.
+    //! @param refit        Refitted nodes, one for each node in the node buffer.
+    void        refitNode( unsigned offset , const BBox& bbox , unsigned depth , std::vector<Fbvh_Refit_Node>& refit ) const;
+
+    //! @brief Turn a refitted (sub)tree back into nodes used during construction.
+    //!
+    //! Primitives of leaf nodes and degraded sub-trees are gathered in 'references' in the order of the new primitive
+    //! buffer, the nodes are only filled once the buffer is ready, see 'refit'.
+    //!
+    //! @param offset       Offset of the root of the (sub)tree in the node buffer.
+    //! @param refit        Refitted nodes, one for each node in the node buffer.
+    //! @param references   Primitives in the new primitive buffer.
+    //! @param pending      Nodes to be filled once the new primitive buffer is ready, with their offsets in the node buffer.
+    //! @return             The root of the (sub)tree.
+    Fast_Bvh_Node_Ptr unflattenNode( unsigned offset , const std::vector<Fbvh_Refit_Node>& refit , std::vector<const Primitive*>& references ,
+                                     std::vector<std::pair<Fbvh_Node*, unsigned>>& pending ) const;
+
     //! @brief A helper function calculating bounding box of a node.
     //!
-    //! @param children     The children nodes
-    //! @return             The 4/8 bounding box of the node, there could be degenerated ones if there is no four children.
-    Simd_BBox   calcBoundingBoxSIMD(const Fast_Bvh_Node_Ptr* children) const;
+    //! @param children_bbox    Bounding boxes of the children nodes.
+    //! @param child_cnt        Number of children nodes.
+    //! @return                 The 4/8 bounding box of the node, there could be degenerated ones if there is no four children.
+    Simd_BBox   calcBoundingBoxSIMD(const BBox* children_bbox, unsigned child_cnt) const;
+
+    //! @brief Traverse the BVH with a packet of rays.
+    //!
+    //! @param rays         The rays in the packet, there could be at most FBVH_PACKET_SIZE rays.
+    //! @param intersects   The intersection results, it is only used when it is not an occlusion query.
+    //! @param occluded     The occlusion results, it is only used when it is an occlusion query.
+    //! @param cnt          The number of rays in the packet.
+    template<bool occlusion>
+    void        traversePacket( const Ray* rays , SurfaceInteraction* intersects , bool* occluded , unsigned cnt ) const;
 #endif
 
 #ifdef QBVH_IMPLEMENTATION
@@ -16,27 +16,76 @@
  */
 
 #include <queue>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
 #include "core/memory.h"
 #include "core/stats.h"
+#include "core/diskcache.h"
+#include "core/timer.h"
+#include "stream/hstream.h"
 #include "scatteringevent/bssrdf/bssrdf.h"
 
-SORT_STATIC_FORCEINLINE Fast_Bvh_Node_Ptr makeFastBvhNode( unsigned int start , unsigned int end ){
-#ifdef SIMD_BVH_IMPLEMENTATION
-    auto* address = malloc_aligned( sizeof(Fast_Bvh_Node) , SIMD_ALIGNMENT );
-    auto* node = new (address) Fast_Bvh_Node( start , end );
-    return std::move(Fast_Bvh_Node_Ptr(node));
-#else
-    return std::move( std::make_unique<Fast_Bvh_Node>( start , end ) );
-#endif
-}
+// Sub-trees with more primitives than this will be split in separate tasks during construction.
+static constexpr unsigned FBVH_PARALLEL_SPLIT_THRESHOLD = 4096;
 
+//! @brief  Stack used during BVH traversal.
+/**
+ * std::stack is by no means an option during traversal due to its overhead under the hood, each thread keeps its own
+ * memory for the stack instead. BVH traversal can be nested, the bottom level BVH of an instance is traversed in the
+ * middle of traversing the top level BVH in the same thread, each level of nesting gets its own memory so that they
+ * don't overwrite each other. Memory is only allocated when a deeper BVH than any visited before shows up.
+ */
 template<class T>
-SORT_STATIC_FORCEINLINE std::unique_ptr<T[]> makePrimitiveList( unsigned int cnt ){
+class Fbvh_Traversal_Stack{
+public:
+    //! @brief  Acquire the memory of the stack for this level of nesting.
+    //!
+    //! @param  size    The maximum number of entries that could be pushed in the stack.
+    Fbvh_Traversal_Stack( unsigned size ){
+        auto& stacks = getStacks();
+        auto& level = getLevel();
+        if( level == stacks.size() )
+            stacks.emplace_back( nullptr , 0u );
+
+        auto& stack = stacks[level++];
+        if( UNLIKELY( stack.second < size ) ){
+            stack.first = std::make_unique<T[]>( size );
+            stack.second = size;
+        }
+        m_data = stack.first.get();
+    }
+
+    //! @brief  Release the memory for the next traversal on this level of nesting.
+    ~Fbvh_Traversal_Stack(){
+        --getLevel();
+    }
+
+    //! @brief  Access an entry in the stack.
+    SORT_FORCEINLINE T& operator []( int i ){
+        return m_data[i];
+    }
+
+private:
+    T*  m_data = nullptr;   /**< Memory of the stack. */
+
+    static std::vector<std::pair<std::unique_ptr<T[]>, unsigned>>& getStacks(){
+        static thread_local std::vector<std::pair<std::unique_ptr<T[]>, unsigned>> stacks;
+        return stacks;
+    }
+    static unsigned& getLevel(){
+        static thread_local unsigned level = 0;
+        return level;
+    }
+};
+
+SORT_STATIC_FORCEINLINE Fast_Bvh_Node_Ptr makeFastBvhNode( const Bvh_Range& range ){
 #ifdef SIMD_BVH_IMPLEMENTATION
-    auto* address = malloc_aligned( sizeof(T) * cnt , SIMD_ALIGNMENT );
-    return std::move(std::unique_ptr<T[]>((T*)address));
+    auto* address = malloc_aligned( sizeof(Fast_Bvh_Node) , SIMD_ALIGNMENT );
+    auto* node = new (address) Fast_Bvh_Node( range.start , range.Count() , range.cap );
+    return std::move(Fast_Bvh_Node_Ptr(node));
 #else
-    return std::move(std::unique_ptr<T[]>(cnt));
+    return std::move( std::make_unique<Fast_Bvh_Node>( range.start , range.Count() , range.cap ) );
 #endif
 }
 
@@ -46,11 +95,21 @@ static_assert(false, "More than one SIMD version is defined before including fas
 
 #ifdef QBVH_IMPLEMENTATION
 
+// Kernels compiled for specific instruction sets share the counters with the default QBVH, see fast_bvh_kernel.hpp.
+#ifndef SIMD_KERNEL_NAMESPACE
 SORT_STATS_DEFINE_COUNTER(sQbvhNodeCount)
 SORT_STATS_DEFINE_COUNTER(sQbvhLeafNodeCount)
 SORT_STATS_DEFINE_COUNTER(sQbvhDepth)
 SORT_STATS_DEFINE_COUNTER(sQbvhMaxPriCountInLeaf)
 SORT_STATS_DEFINE_COUNTER(sQbvhPrimitiveCount)
+SORT_STATS_DEFINE_COUNTER(sQbvhBuildTaskCount)
+SORT_STATS_DEFINE_COUNTER(sQbvhMemory)
+SORT_STATS_DEFINE_COUNTER(sQbvhSpatialSplitReferenceCount)
+SORT_STATS_DEFINE_COUNTER(sQbvhRefitNodeCount)
+SORT_STATS_DEFINE_COUNTER(sQbvhRebuiltSubtreeCount)
+SORT_STATS_DEFINE_COUNTER(sQbvhBuildTimeMS)
+SORT_STATS_DEFINE_COUNTER(sQbvhSplitWorkTimeUS)
+SORT_STATS_DEFINE_COUNTER(sQbvhSplitTimeUS)
 
 SORT_STATS_COUNTER("Spatial-Structure(QBVH)", "Total Ray Count", sRayCount);
 SORT_STATS_COUNTER("Spatial-Structure(QBVH)", "Shadow Ray Count", sShadowRayCount);
@@ -61,22 +120,48 @@ SORT_STATS_COUNTER("Spatial-Structure(QBVH)", "BVH Depth", sQbvhDepth);
 SORT_STATS_COUNTER("Spatial-Structure(QBVH)", "Maximum Primitive in Leaf", sQbvhMaxPriCountInLeaf);
 SORT_STATS_AVG_COUNT("Spatial-Structure(QBVH)", "Average Primitive Count in Leaf", sQbvhPrimitiveCount , sQbvhLeafNodeCount );
 SORT_STATS_AVG_COUNT("Spatial-Structure(QBVH)", "Average Primitive Tested per Ray", sIntersectionTest, sRayCount);
+SORT_STATS_COUNTER("Spatial-Structure(QBVH)", "Parallel Construction Task Count", sQbvhBuildTaskCount);
+SORT_STATS_TIME("Spatial-Structure(QBVH)", "Construction Time", sQbvhBuildTimeMS);
+SORT_STATS_AVG_COUNT("Spatial-Structure(QBVH)", "Parallel Construction Speedup", sQbvhSplitWorkTimeUS, sQbvhSplitTimeUS);
+SORT_STATS_MEMORY("Spatial-Structure(QBVH)", "Memory Footprint", sQbvhMemory);
+SORT_STATS_COUNTER("Spatial-Structure(QBVH)", "Extra References by Spatial Splits", sQbvhSpatialSplitReferenceCount);
+SORT_STATS_COUNTER("Spatial-Structure(QBVH)", "Refitted Node Count", sQbvhRefitNodeCount);
+SORT_STATS_COUNTER("Spatial-Structure(QBVH)", "Rebuilt Sub-tree Count", sQbvhRebuiltSubtreeCount);
+#endif
 
 #define sFbvhNodeCount          sQbvhNodeCount
 #define sFbvhLeafNodeCount      sQbvhLeafNodeCount
 #define sFbvhDepth              sQbvhDepth
 #define sFbvhMaxPriCountInLeaf  sQbvhMaxPriCountInLeaf
 #define sFbvhPrimitiveCount     sQbvhPrimitiveCount
+#define sFbvhBuildTaskCount     sQbvhBuildTaskCount
+#define sFbvhMemory             sQbvhMemory
+#define sFbvhSpatialSplitReferenceCount sQbvhSpatialSplitReferenceCount
+#define sFbvhRefitNodeCount     sQbvhRefitNodeCount
+#define sFbvhRebuiltSubtreeCount sQbvhRebuiltSubtreeCount
+#define sFbvhBuildTimeMS        sQbvhBuildTimeMS
+#define sFbvhSplitWorkTimeUS    sQbvhSplitWorkTimeUS
+#define sFbvhSplitTimeUS        sQbvhSplitTimeUS
 
 #endif
 
 #ifdef OBVH_IMPEMENTATION
 
+// Kernels compiled for specific instruction sets share the counters with the default OBVH, see fast_bvh_kernel.hpp.
+#ifndef SIMD_KERNEL_NAMESPACE
 SORT_STATS_DEFINE_COUNTER(sObvhNodeCount)
 SORT_STATS_DEFINE_COUNTER(sObvhLeafNodeCount)
 SORT_STATS_DEFINE_COUNTER(sObvhDepth)
 SORT_STATS_DEFINE_COUNTER(sObvhMaxPriCountInLeaf)
 SORT_STATS_DEFINE_COUNTER(sObvhPrimitiveCount)
+SORT_STATS_DEFINE_COUNTER(sObvhBuildTaskCount)
+SORT_STATS_DEFINE_COUNTER(sObvhMemory)
+SORT_STATS_DEFINE_COUNTER(sObvhSpatialSplitReferenceCount)
+SORT_STATS_DEFINE_COUNTER(sObvhRefitNodeCount)
+SORT_STATS_DEFINE_COUNTER(sObvhRebuiltSubtreeCount)
+SORT_STATS_DEFINE_COUNTER(sObvhBuildTimeMS)
+SORT_STATS_DEFINE_COUNTER(sObvhSplitWorkTimeUS)
+SORT_STATS_DEFINE_COUNTER(sObvhSplitTimeUS)
 
 SORT_STATS_COUNTER("Spatial-Structure(OBVH)", "Total Ray Count", sRayCount);
 SORT_STATS_COUNTER("Spatial-Structure(OBVH)", "Shadow Ray Count", sShadowRayCount);
@@ -87,12 +172,28 @@ SORT_STATS_COUNTER("Spatial-Structure(OBVH)", "BVH Depth", sObvhDepth);
 SORT_STATS_COUNTER("Spatial-Structure(OBVH)", "Maximum Primitive in Leaf", sObvhMaxPriCountInLeaf);
 SORT_STATS_AVG_COUNT("Spatial-Structure(OBVH)", "Average Primitive Count in Leaf", sObvhPrimitiveCount , sObvhLeafNodeCount );
 SORT_STATS_AVG_COUNT("Spatial-Structure(OBVH)", "Average Primitive Tested per Ray", sIntersectionTest, sRayCount);
+SORT_STATS_COUNTER("Spatial-Structure(OBVH)", "Parallel Construction Task Count", sObvhBuildTaskCount);
+SORT_STATS_TIME("Spatial-Structure(OBVH)", "Construction Time", sObvhBuildTimeMS);
+SORT_STATS_AVG_COUNT("Spatial-Structure(OBVH)", "Parallel Construction Speedup", sObvhSplitWorkTimeUS, sObvhSplitTimeUS);
+SORT_STATS_MEMORY("Spatial-Structure(OBVH)", "Memory Footprint", sObvhMemory);
+SORT_STATS_COUNTER("Spatial-Structure(OBVH)", "Extra References by Spatial Splits", sObvhSpatialSplitReferenceCount);
+SORT_STATS_COUNTER("Spatial-Structure(OBVH)", "Refitted Node Count", sObvhRefitNodeCount);
+SORT_STATS_COUNTER("Spatial-Structure(OBVH)", "Rebuilt Sub-tree Count", sObvhRebuiltSubtreeCount);
+#endif
 
 #define sFbvhNodeCount          sObvhNodeCount
 #define sFbvhLeafNodeCount      sObvhLeafNodeCount
 #define sFbvhDepth              sObvhDepth
 #define sFbvhMaxPriCountInLeaf  sObvhMaxPriCountInLeaf
 #define sFbvhPrimitiveCount     sObvhPrimitiveCount
+#define sFbvhBuildTaskCount     sObvhBuildTaskCount
+#define sFbvhMemory             sObvhMemory
+#define sFbvhSpatialSplitReferenceCount sObvhSpatialSplitReferenceCount
+#define sFbvhRefitNodeCount     sObvhRefitNodeCount
+#define sFbvhRebuiltSubtreeCount sObvhRebuiltSubtreeCount
+#define sFbvhBuildTimeMS        sObvhBuildTimeMS
+#define sFbvhSplitWorkTimeUS    sObvhSplitWorkTimeUS
+#define sFbvhSplitTimeUS        sObvhSplitTimeUS
 
 #endif
 
@@ -105,36 +206,110 @@ SORT_STATIC_FORCEINLINE BBox calcBoundingBox(const Fbvh_Node* const node , const
     return node_bbox;
 }
 
+#ifdef SIMD_BVH_IMPLEMENTATION
+SORT_STATIC_FORCEINLINE BBox getChildBBox( const Fast_Bvh_Linear_Node& node , unsigned i ){
+#ifdef ENABLE_COMPRESSED_BVH
+    return node.bbox[i];
+#else
+    return BBox( Point( node.bbox.m_min_x[i] , node.bbox.m_min_y[i] , node.bbox.m_min_z[i] ) ,
+                 Point( node.bbox.m_max_x[i] , node.bbox.m_max_y[i] , node.bbox.m_max_z[i] ) );
+#endif
+}
+#endif
+
 void Fbvh::Build(const std::vector<const Primitive*>& primitives, const BBox& bbox){
     SORT_PROFILE("Build Fbvh");
+    Timer build_timer;
 
     m_primitives = &primitives;
 	if( primitives.empty() )
 		return;
 
-    m_bvhpri = std::make_unique<Bvh_Primitive[]>(m_primitives->size());
-
     m_bbox = bbox;
 
-    // generate BVH primitives
+    // spatial splits need room for extra references of primitives straddling split planes.
     const auto primitive_cnt = m_primitives->size();
-    for (auto i = 0u; i < primitive_cnt; ++i)
-        m_bvhpri[i].SetPrimitive((*m_primitives)[i]);
-    
-    // recursively split node
-    m_root = makeFastBvhNode( 0 , (unsigned)m_primitives->size() );
-    splitNode( m_root.get() , m_bbox , 1u );
+    const auto capacity = m_spatialSplit ? primitive_cnt + (size_t)( primitive_cnt * std::max( m_spatialSplitBudget , 0.0f ) ) : primitive_cnt;
+
+#ifdef SIMD_BVH_IMPLEMENTATION
+    // the tree is loaded from the disk cache if possible. It is used as it is if the geometry is the same, which is the
+    // case if only camera, lights or materials change. Otherwise it is refitted to where the primitives are now, this
+    // only happens for the same primitives since the key covers their topology. Other primitives end up with a tree of
+    // their own built from scratch.
+    auto& cache = DiskCache::GetSingleton();
+    const auto cache_key = cache.IsEnabled() ? calcCacheKey() : 0;
+    const auto geometry_hash = cache.IsEnabled() ? calcGeometryHash() : 0;
+    const auto cache_stream = cache.Load( FBVH_CACHE_CATEGORY , cache_key );
+    if( cache_stream && loadCache( *cache_stream , m_geometryHash ) ){
+        if( m_geometryHash == geometry_hash ){
+            // the root node is counted below.
+            SORT_STATS(sFbvhNodeCount += (StatsInt)m_nodes.size() - 1);
+            SORT_STATS(sFbvhLeafNodeCount += (StatsInt)std::count_if( m_nodes.begin() , m_nodes.end() , []( const Fast_Bvh_Linear_Node& node ){ return 0 == node.child_cnt; } ));
+        }else{
+            refit();
+
+            m_geometryHash = geometry_hash;
+            cache.Save( FBVH_CACHE_CATEGORY , cache_key , *this );
+        }
+    }else
+#endif
+    {
+        m_bvhpri = std::make_unique<Bvh_Primitive[]>(capacity);
+
+        // generate BVH primitives
+        for (auto i = 0u; i < primitive_cnt; ++i)
+            m_bvhpri[i].SetPrimitive((*m_primitives)[i]);
+
+#ifdef SIMD_BVH_IMPLEMENTATION
+        // leaf nodes fill their own ranges of it, which could happen in different threads.
+        m_leafPrimitives.resize( capacity );
+#endif
+
+        // recursively split node, large sub-trees are split in parallel. Time spent in each task adds up to the time
+        // it would take to split all nodes in one thread, comparing it with the elapsed time tells the speedup.
+        m_root = makeFastBvhNode( Bvh_Range( 0u , (unsigned)primitive_cnt , (unsigned)capacity ) );
+        {
+            Timer split_timer;
+            TaskGroup task_group;
+            splitNode( m_root.get() , m_bbox , 1u , task_group );
+            SORT_STATS(sFbvhSplitWorkTimeUS += split_timer.GetElapsedTimeUS());
+            task_group.Wait();
+            SORT_STATS(sFbvhSplitTimeUS += split_timer.GetElapsedTimeUS());
+        }
+
+        // flatten the tree so that traversal only touches contiguous memory, the tree itself is not needed anymore.
+        flattenNode( m_root.get() );
+        m_root = nullptr;
+
+#ifdef SIMD_BVH_IMPLEMENTATION
+        // packed primitives refer to primitives in m_leafPrimitives, BVH primitives are only needed during construction.
+        m_bvhpri = nullptr;
+
+        if( cache.IsEnabled() ){
+            m_geometryHash = geometry_hash;
+            cache.Save( FBVH_CACHE_CATEGORY , cache_key , *this );
+        }
+#endif
+    }
+
+#ifdef SIMD_BVH_IMPLEMENTATION
+    SORT_STATS(sFbvhMemory += (StatsInt)( m_nodes.size() * sizeof( Fast_Bvh_Linear_Node ) + m_triangles.size() * sizeof( Simd_Triangle ) + m_lines.size() * sizeof( Simd_Line ) +
+                                          ( m_others.size() + m_leafPrimitives.size() ) * sizeof( const Primitive* ) ) );
+#else
+    SORT_STATS(sFbvhMemory += (StatsInt)( m_nodes.size() * sizeof( Fast_Bvh_Linear_Node ) + capacity * sizeof( Bvh_Primitive ) ) );
+#endif
 
     // if the algorithm reaches here, it is a valid QBVH
     m_isValid = true;
 
     SORT_STATS(++sFbvhNodeCount);
     SORT_STATS(sFbvhPrimitiveCount += (StatsInt)primitive_cnt);
+    SORT_STATS(sFbvhDepth = std::max( sFbvhDepth , (StatsInt)m_depth ) );
+    SORT_STATS(sFbvhMaxPriCountInLeaf = std::max( sFbvhMaxPriCountInLeaf , (StatsInt)m_maxLeafPriCnt ) );
+    SORT_STATS(sFbvhBuildTimeMS += build_timer.GetElapsedTime());
 }
 
-void Fbvh::splitNode( Fbvh_Node* const node , const BBox& node_bbox , unsigned depth ){
-    SORT_STATS(sFbvhDepth = std::max( sFbvhDepth , (StatsInt)depth ) );
-
+void Fbvh::splitNode( Fbvh_Node* const node , const BBox& node_bbox , unsigned depth , TaskGroup& task_group ){
     const auto start    = node->pri_offset;
     const auto end      = start + node->pri_cnt;
 
@@ -143,33 +318,28 @@ void Fbvh::splitNode( Fbvh_Node* const node , const BBox& node_bbox , unsigned d
         return;
     }
 
-    std::queue< std::pair<unsigned int, unsigned int> > to_split, done_splitting;
-    to_split.push( std::make_pair( start , end ) );
+    std::queue<Bvh_Range> to_split, done_splitting;
+    to_split.push( Bvh_Range( start , end , node->pri_cap ) );
 
     while( !to_split.empty() && to_split.size() + done_splitting.size() < (unsigned int)FBVH_CHILD_CNT ){
-        auto cur_split = to_split.front();
+        const auto cur_split = to_split.front();
         to_split.pop();
 
-        const auto start    = cur_split.first;
-        const auto end      = cur_split.second;
-        const auto prim_cnt = end - start;
+        const auto prim_cnt = cur_split.Count();
 
-        unsigned    split_axis;
-        float       split_pos;
-        const auto sah = pickBestSplit(split_axis, split_pos, m_bvhpri.get(), node_bbox, start, end);
-        if (sah >= prim_cnt || prim_cnt <= m_maxPriInLeaf )
-            done_splitting.push( std::make_pair( start , end ) );
-        else{
-            const auto compare = [split_pos, split_axis](const Bvh_Primitive& pri) {return pri.m_centroid[split_axis] < split_pos; };
-            const auto middle = std::partition(m_bvhpri.get() + start, m_bvhpri.get() + end, compare);
-            const auto mid = (unsigned)(middle - m_bvhpri.get());
+        Bvh_Split split;
+        if( m_spatialSplit )
+            split = pickBestSplitSBVH(m_bvhpri.get(), node_bbox, cur_split, m_bbox.HalfSurfaceArea());
+        else
+            split.sah = pickBestSplit(split.axis, split.pos, m_bvhpri.get(), node_bbox, cur_split.start, cur_split.end);
 
-            if (mid == start || mid == end){
-                done_splitting.push( std::make_pair( start , end ) );
-            }else{
-                to_split.push( std::make_pair( start , mid ) );
-                to_split.push( std::make_pair( mid , end ) );
-            }
+        Bvh_Range left, right;
+        if (split.sah >= prim_cnt || prim_cnt <= m_maxPriInLeaf || !splitPrimitives(split, m_bvhpri.get(), cur_split, left, right))
+            done_splitting.push( cur_split );
+        else{
+            SORT_STATS(sFbvhSpatialSplitReferenceCount += left.Count() + right.Count() - prim_cnt);
+            to_split.push( left );
+            to_split.push( right );
         }
     }
 
@@ -177,11 +347,11 @@ void Fbvh::splitNode( Fbvh_Node* const node , const BBox& node_bbox , unsigned d
         makeLeaf( node , start , end , depth );
         return;
     }else{
-        const auto populate_child = [&] ( Fbvh_Node* node , std::queue<std::pair<unsigned,unsigned>>& q ){
+        const auto populate_child = [&] ( Fbvh_Node* node , std::queue<Bvh_Range>& q ){
             while (!q.empty()) {
                 const auto cur = q.front();
                 q.pop();
-                node->children[node->child_cnt++] = makeFastBvhNode( cur.first , cur.second - cur.first );
+                node->children[node->child_cnt++] = makeFastBvhNode( cur );
             }
         };
 
@@ -189,20 +359,34 @@ void Fbvh::splitNode( Fbvh_Node* const node , const BBox& node_bbox , unsigned d
         populate_child( node , done_splitting );
     }
 
-    // split children if needed.
-    for( auto j = 0u ; j < node->child_cnt ; ++j ){
+    // Bounding boxes of all children need to be evaluated before splitting any of them since splitting a child
+    // will re-order its primitives, which could happen in a different thread.
+    BBox children_bbox[FBVH_CHILD_CNT];
+    for( auto j = 0u ; j < node->child_cnt ; ++j )
+        children_bbox[j] = calcBoundingBox( node->children[j].get() , m_bvhpri.get() );
+
 #ifdef SIMD_BVH_IMPLEMENTATION
-        const auto bbox = calcBoundingBox(node->children[j].get(), m_bvhpri.get());
-        splitNode(node->children[j].get(), bbox, depth + 1);
+    node->bbox = calcBoundingBoxSIMD( children_bbox , node->child_cnt );
 #else
-        node->bbox[j] = calcBoundingBox( node->children[j].get() , m_bvhpri.get() );
-        splitNode( node->children[j].get() , node->bbox[j] , depth + 1 );
+    for( auto j = 0u ; j < node->child_cnt ; ++j )
+        node->bbox[j] = children_bbox[j];
 #endif
-    }
 
-#ifdef SIMD_BVH_IMPLEMENTATION
-    node->bbox = calcBoundingBoxSIMD( node->children );
-#endif
+    // split children if needed, all children except the last one are split in separate tasks if they are large enough.
+    for( auto j = 0u ; j < node->child_cnt ; ++j ){
+        const auto child = node->children[j].get();
+        const auto child_bbox = children_bbox[j];
+        if( child->pri_cnt > FBVH_PARALLEL_SPLIT_THRESHOLD && j + 1 < node->child_cnt ){
+            SORT_STATS(++sFbvhBuildTaskCount);
+            task_group.Fork( [this, child, child_bbox, depth, &task_group](){
+                Timer timer;
+                splitNode( child , child_bbox , depth + 1 , task_group );
+                SORT_STATS(sFbvhSplitWorkTimeUS += timer.GetElapsedTimeUS());
+            } , "Fbvh Split Node" );
+        }else{
+            splitNode( child , child_bbox , depth + 1 , task_group );
+        }
+    }
 
     SORT_STATS(sFbvhNodeCount+=node->child_cnt);
 }
@@ -212,7 +396,8 @@ void Fbvh::makeLeaf( Fbvh_Node* const node , unsigned start , unsigned end , uns
     node->pri_offset = start;
     node->child_cnt = 0;
 
-    m_depth = fmax( m_depth , depth );
+    atomicMax( m_depth , depth );
+    atomicMax( m_maxLeafPriCnt , node->pri_cnt );
 
 #ifdef SIMD_BVH_IMPLEMENTATION
     Simd_Triangle   sind_tri;
@@ -221,19 +406,22 @@ void Fbvh::makeLeaf( Fbvh_Node* const node , unsigned start , unsigned end , uns
     std::vector<Simd_Line>      line_list;
     const auto _start = node->pri_offset;
     const auto _end = _start + node->pri_cnt;
+    const auto primitives = m_leafPrimitives.data();
     for(auto i = _start ; i < _end ; i++ ){
         const Primitive* primitive = m_bvhpri[i].primitive;
+        m_leafPrimitives[i] = primitive;
+
         const auto shape_type = primitive->GetShapeType();
         if( SHAPE_TRIANGLE == shape_type ){
-            if( sind_tri.PushTriangle( primitive ) ){
-                if( sind_tri.PackData() ){
+            if( sind_tri.PushTriangle( i ) ){
+                if( sind_tri.PackData( primitives ) ){
                     tri_list.push_back( sind_tri );
                     sind_tri.Reset();
                 }
             }
         }else if( SHAPE_LINE == shape_type ){
-            if( simd_line.PushLine( primitive ) ){
-                if( simd_line.PackData() ){
+            if( simd_line.PushLine( i ) ){
+                if( simd_line.PackData( primitives ) ){
                     line_list.push_back( simd_line );
                     simd_line.Reset();
                 }
@@ -243,38 +431,346 @@ void Fbvh::makeLeaf( Fbvh_Node* const node , unsigned start , unsigned end , uns
             node->other_list.push_back( primitive );
         }
     }
-    if (sind_tri.PackData())
+    if (sind_tri.PackData( primitives ))
         tri_list.push_back(sind_tri);
-    if (simd_line.PackData())
+    if (simd_line.PackData( primitives ))
         line_list.push_back(simd_line);
     
-    if( tri_list.size() ){
-        node->tri_list = makePrimitiveList<Simd_Triangle>( (unsigned int)tri_list.size() );
-        node->tri_cnt = (unsigned int)tri_list.size();
-        for( auto i = 0u ; i < tri_list.size() ; ++i )
-            node->tri_list[i] = tri_list[i];
-    }
-    if( line_list.size() ){
-        node->line_list = makePrimitiveList<Simd_Line>( (unsigned int)line_list.size() );
-        node->line_cnt = (unsigned int)line_list.size();
-        for( auto i = 0u ; i < line_list.size() ; ++i )
-            node->line_list[i] = line_list[i];
-    }
+    node->tri_list = std::move( tri_list );
+    node->line_list = std::move( line_list );
 #endif
 
     SORT_STATS(++sFbvhLeafNodeCount);
-    SORT_STATS(sFbvhMaxPriCountInLeaf = std::max( sFbvhMaxPriCountInLeaf , (StatsInt)node->pri_cnt) );
+}
+
+unsigned Fbvh::flattenNode( const Fbvh_Node* node ){
+    const auto offset = (unsigned)m_nodes.size();
+    m_nodes.emplace_back();
+
+    // don't hold a reference of the linear node here, the buffer could be re-allocated when flattening children.
+    // with compressed nodes, interior nodes and leaf nodes share the same memory, only one of them can be filled.
+    Fast_Bvh_Linear_Node linear_node;
+    linear_node.child_cnt = node->child_cnt;
+
+    if( 0 == node->child_cnt ){
+        linear_node.pri_cnt = node->pri_cnt;
+        linear_node.pri_offset = node->pri_offset;
+
+#ifdef SIMD_BVH_IMPLEMENTATION
+        linear_node.tri_offset = (unsigned)m_triangles.size();
+        linear_node.tri_cnt = (unsigned)node->tri_list.size();
+        m_triangles.insert( m_triangles.end() , node->tri_list.begin() , node->tri_list.end() );
+
+        linear_node.line_offset = (unsigned)m_lines.size();
+        linear_node.line_cnt = (unsigned)node->line_list.size();
+        m_lines.insert( m_lines.end() , node->line_list.begin() , node->line_list.end() );
+
+        linear_node.other_offset = (unsigned)m_others.size();
+        linear_node.other_cnt = (unsigned)node->other_list.size();
+        m_others.insert( m_others.end() , node->other_list.begin() , node->other_list.end() );
+#endif
+    }else{
+#if defined(ENABLE_COMPRESSED_BVH)
+        BBox children_bbox[FBVH_CHILD_CNT];
+        for( auto i = 0u ; i < node->child_cnt ; ++i ){
+#ifdef SIMD_BVH_IMPLEMENTATION
+            children_bbox[i] = BBox( Point( node->bbox.m_min_x[i] , node->bbox.m_min_y[i] , node->bbox.m_min_z[i] ) ,
+                                     Point( node->bbox.m_max_x[i] , node->bbox.m_max_y[i] , node->bbox.m_max_z[i] ) );
+#else
+            children_bbox[i] = node->bbox[i];
+#endif
+        }
+        linear_node.bbox.Quantize( children_bbox , node->child_cnt );
+#elif defined(SIMD_BVH_IMPLEMENTATION)
+        linear_node.bbox = node->bbox;
+#else
+        for( auto i = 0u ; i < node->child_cnt ; ++i )
+            linear_node.bbox[i] = node->bbox[i];
+#endif
+
+        for( auto i = 0u ; i < node->child_cnt ; ++i )
+            linear_node.children[i] = flattenNode( node->children[i].get() );
+    }
+
+    m_nodes[offset] = linear_node;
+    return offset;
 }
 
 #ifdef SIMD_BVH_IMPLEMENTATION
-Simd_BBox Fbvh::calcBoundingBoxSIMD(const Fast_Bvh_Node_Ptr* children) const {
+void Fbvh::Serialize( OStreamBase& stream ){
+    // primitives are referred by their indices in the primitive list, which is the same as long as the key matches.
+    std::unordered_map<const Primitive*, unsigned> indices;
+    for( auto i = 0u ; i < m_primitives->size() ; ++i )
+        indices[(*m_primitives)[i]] = i;
+
+    const auto to_indices = [&]( const std::vector<const Primitive*>& primitives ){
+        std::vector<unsigned> ret( primitives.size() , INVALID_PRIMITIVE_ID );
+        for( auto i = 0u ; i < primitives.size() ; ++i ){
+            if( IS_PTR_VALID(primitives[i]) )
+                ret[i] = indices[primitives[i]];
+        }
+        return ret;
+    };
+
+    stream << (unsigned)( m_geometryHash >> 32 ) << (unsigned)m_geometryHash;
+    stream << (unsigned)m_depth << (unsigned)m_maxLeafPriCnt;
+    SerializeBuffer( stream , m_nodes );
+    SerializeBuffer( stream , m_triangles );
+    SerializeBuffer( stream , m_lines );
+    SerializeBuffer( stream , to_indices( m_leafPrimitives ) );
+    SerializeBuffer( stream , to_indices( m_others ) );
+}
+
+std::uint64_t Fbvh::calcCacheKey() const{
+    OHashStream hash;
+
+    // the layout of nodes and packed primitives, kernels of different instruction sets with the same layout share the cache.
+    hash << (unsigned)FBVH_CHILD_CNT << (unsigned)SIMD_CHANNEL;
+    hash << (unsigned)sizeof( Fast_Bvh_Linear_Node ) << (unsigned)sizeof( Simd_Triangle ) << (unsigned)sizeof( Simd_Line );
+#ifdef ENABLE_COMPRESSED_BVH
+    hash << true;
+#else
+    hash << false;
+#endif
+
+    // the configuration of the construction, the refit threshold doesn't matter until the tree is refitted.
+    hash << m_maxNodeDepth << m_maxPriInLeaf << m_spatialSplit << m_spatialSplitBudget;
+
+    // the topology of the primitives, leaf nodes refer to primitives by their indices. Where the primitives are is
+    // left out so that moved primitives still find the tree, as long as they are the same ones.
+    hash << (unsigned)m_primitives->size();
+    for( const auto primitive : *m_primitives ){
+        hash << (unsigned)primitive->GetShapeType();
+        primitive->GetShape()->SerializeTopology( hash );
+    }
+
+    return hash.GetHash();
+}
+
+std::uint64_t Fbvh::calcGeometryHash() const{
+    OHashStream hash;
+    hash << m_bbox.m_Min << m_bbox.m_Max;
+
+    // the tree itself only depends on bounding boxes of primitives, packed primitives need their geometry too.
+    for( const auto primitive : *m_primitives ){
+        const auto& bbox = primitive->GetBBox();
+        hash << bbox.m_Min << bbox.m_Max;
+        primitive->GetShape()->SerializeGeometry( hash );
+    }
+
+    return hash.GetHash();
+}
+
+bool Fbvh::loadCache( IStreamBase& stream , std::uint64_t& geometry_hash ){
+    unsigned hash_hi = 0 , hash_lo = 0 , depth = 0 , max_leaf_pri_cnt = 0;
+    stream >> hash_hi >> hash_lo >> depth >> max_leaf_pri_cnt;
+
+    const auto to_primitives = [&]( const std::vector<unsigned>& indices , std::vector<const Primitive*>& primitives ){
+        primitives.resize( indices.size() , nullptr );
+        for( auto i = 0u ; i < indices.size() ; ++i ){
+            if( INVALID_PRIMITIVE_ID == indices[i] )
+                continue;
+            if( indices[i] >= m_primitives->size() )
+                return false;
+            primitives[i] = (*m_primitives)[indices[i]];
+        }
+        return true;
+    };
+
+    // offsets in nodes are not validated by the buffers, a broken tree would crash during traversal or refitting.
+    const auto valid_node = [&]( const Fast_Bvh_Linear_Node& node ){
+        if( 0 == node.child_cnt )
+            return (size_t)node.pri_offset + node.pri_cnt <= m_leafPrimitives.size();
+        if( node.child_cnt > FBVH_CHILD_CNT )
+            return false;
+        for( auto i = 0u ; i < node.child_cnt ; ++i ){
+            if( node.children[i] >= m_nodes.size() )
+                return false;
+        }
+        return true;
+    };
+
+    std::vector<unsigned> leaf_primitives , others;
+    if( !SerializeBuffer( stream , m_nodes ) || !SerializeBuffer( stream , m_triangles ) || !SerializeBuffer( stream , m_lines ) ||
+        !SerializeBuffer( stream , leaf_primitives ) || !SerializeBuffer( stream , others ) ||
+        !to_primitives( leaf_primitives , m_leafPrimitives ) || !to_primitives( others , m_others ) ||
+        m_nodes.empty() || !std::all_of( m_nodes.begin() , m_nodes.end() , valid_node ) ){
+        // the tree will be built from scratch
+        m_nodes.clear();
+        m_triangles.clear();
+        m_lines.clear();
+        m_leafPrimitives.clear();
+        m_others.clear();
+        return false;
+    }
+
+    geometry_hash = ( (std::uint64_t)hash_hi << 32 ) | hash_lo;
+    m_depth = depth;
+    m_maxLeafPriCnt = max_leaf_pri_cnt;
+    return true;
+}
+
+void Fbvh::refit(){
+    SORT_PROFILE("Refit Fbvh");
+
+    // bounding boxes and SAH of all nodes are evaluated first, the bounding box of the root is not kept in the tree.
+    std::vector<Fbvh_Refit_Node> refit( m_nodes.size() );
+    BBox root_bbox;
+    const auto& root = m_nodes[0];
+    if( 0 == root.child_cnt )
+        root_bbox = m_bbox;
+    for( auto i = 0u ; i < root.child_cnt ; ++i )
+        root_bbox.Union( getChildBBox( root , i ) );
+    refitNode( 0u , root_bbox , 1u , refit );
+
+    // turn the tree back into nodes during construction, all primitives are gathered in a new primitive buffer.
+    std::vector<const Primitive*> references;
+    std::vector<std::pair<Fbvh_Node*, unsigned>> pending;
+    references.reserve( m_leafPrimitives.size() );
+    m_root = unflattenNode( 0u , refit , references , pending );
+
+    m_bvhpri = std::make_unique<Bvh_Primitive[]>( references.size() );
+    for( auto i = 0u ; i < references.size() ; ++i ){
+        if( references[i] )
+            m_bvhpri[i].SetPrimitive( references[i] );
+    }
+
+    m_nodes.clear();
+    m_triangles.clear();
+    m_lines.clear();
+    m_others.clear();
+    m_leafPrimitives.clear();
+    m_leafPrimitives.resize( references.size() );
+    m_depth = 0;
+    m_maxLeafPriCnt = 0;
+
+    // leaf nodes are packed again, degraded sub-trees are built from scratch the same way a whole tree is built.
+    {
+        TaskGroup task_group;
+        for( const auto& node : pending ){
+            const auto& refit_node = refit[node.second];
+            if( !refit_node.rebuild ){
+                makeLeaf( node.first , node.first->pri_offset , node.first->pri_offset + node.first->pri_cnt , refit_node.depth );
+                continue;
+            }
+
+            SORT_STATS(++sFbvhRebuiltSubtreeCount);
+            if( node.first->pri_cnt > FBVH_PARALLEL_SPLIT_THRESHOLD ){
+                SORT_STATS(++sFbvhBuildTaskCount);
+                task_group.Fork( [this, node, &refit_node, &task_group](){
+                    splitNode( node.first , refit_node.bbox , refit_node.depth , task_group );
+                } , "Fbvh Split Node" );
+            }else{
+                splitNode( node.first , refit_node.bbox , refit_node.depth , task_group );
+            }
+        }
+        task_group.Wait();
+    }
+
+    flattenNode( m_root.get() );
+    m_root = nullptr;
+    m_bvhpri = nullptr;
+}
+
+void Fbvh::refitNode( unsigned offset , const BBox& bbox , unsigned depth , std::vector<Fbvh_Refit_Node>& refit ) const{
+    const auto& node = m_nodes[offset];
+    auto& refit_node = refit[offset];
+    refit_node.depth = depth;
+
+    if( 0 == node.child_cnt ){
+        for( auto i = node.pri_offset ; i < node.pri_offset + node.pri_cnt ; ++i )
+            refit_node.bbox.Union( m_leafPrimitives[i]->GetBBox() );
+        refit_node.sah_before = bbox.HalfSurfaceArea() * node.pri_cnt;
+        refit_node.sah_after = refit_node.bbox.HalfSurfaceArea() * node.pri_cnt;
+        return;
+    }
+
+    for( auto i = 0u ; i < node.child_cnt ; ++i ){
+        const auto child = node.children[i];
+        refitNode( child , getChildBBox( node , i ) , depth + 1 , refit );
+        refit_node.bbox.Union( refit[child].bbox );
+        refit_node.sah_before += refit[child].sah_before;
+        refit_node.sah_after += refit[child].sah_after;
+    }
+    refit_node.sah_before += bbox.HalfSurfaceArea();
+    refit_node.sah_after += refit_node.bbox.HalfSurfaceArea();
+
+    // the SAH is relative to the surface area of the node so that a node simply moving around doesn't count.
+    const auto area_before = std::max( bbox.HalfSurfaceArea() , FLT_MIN );
+    const auto area_after = std::max( refit_node.bbox.HalfSurfaceArea() , FLT_MIN );
+    refit_node.rebuild = refit_node.sah_after / area_after > m_refitThreshold * refit_node.sah_before / area_before;
+}
+
+Fast_Bvh_Node_Ptr Fbvh::unflattenNode( unsigned offset , const std::vector<Fbvh_Refit_Node>& refit , std::vector<const Primitive*>& references ,
+                                       std::vector<std::pair<Fbvh_Node*, unsigned>>& pending ) const{
+    const auto& node = m_nodes[offset];
+    const auto& refit_node = refit[offset];
+
+    if( refit_node.rebuild ){
+        // primitives referred by multiple leaf nodes because of spatial splits are only kept once.
+        const auto start = (unsigned)references.size();
+        std::unordered_set<const Primitive*> visited;
+        std::vector<unsigned> to_visit = { offset };
+        while( !to_visit.empty() ){
+            const auto& cur = m_nodes[to_visit.back()];
+            to_visit.pop_back();
+            if( 0 == cur.child_cnt ){
+                for( auto i = cur.pri_offset ; i < cur.pri_offset + cur.pri_cnt ; ++i ){
+                    if( visited.insert( m_leafPrimitives[i] ).second )
+                        references.push_back( m_leafPrimitives[i] );
+                }
+                continue;
+            }
+
+            // children are visited in order so that primitives keep the order of leaf nodes.
+            for( auto i = cur.child_cnt ; i > 0 ; --i )
+                to_visit.push_back( cur.children[i - 1] );
+        }
+
+        // spatial splits need room for extra references of primitives straddling split planes.
+        const auto cnt = (unsigned)references.size() - start;
+        const auto cap = m_spatialSplit ? cnt + (unsigned)( cnt * std::max( m_spatialSplitBudget , 0.0f ) ) : cnt;
+        references.resize( start + cap , nullptr );
+
+        auto ret = makeFastBvhNode( Bvh_Range( start , start + cnt , start + cap ) );
+        pending.push_back( std::make_pair( ret.get() , offset ) );
+        return ret;
+    }
+
+    if( 0 == node.child_cnt ){
+        const auto start = (unsigned)references.size();
+        references.insert( references.end() , m_leafPrimitives.begin() + node.pri_offset , m_leafPrimitives.begin() + node.pri_offset + node.pri_cnt );
+
+        auto ret = makeFastBvhNode( Bvh_Range( start , start + node.pri_cnt , start + node.pri_cnt ) );
+        pending.push_back( std::make_pair( ret.get() , offset ) );
+
+        SORT_STATS(++sFbvhRefitNodeCount);
+        return ret;
+    }
+
+    // the node keeps its children, only their bounding boxes are updated.
+    auto ret = makeFastBvhNode( Bvh_Range( 0u , 0u , 0u ) );
+    BBox children_bbox[FBVH_CHILD_CNT];
+    for( auto i = 0u ; i < node.child_cnt ; ++i ){
+        children_bbox[i] = refit[node.children[i]].bbox;
+        ret->children[i] = unflattenNode( node.children[i] , refit , references , pending );
+    }
+    ret->child_cnt = node.child_cnt;
+    ret->bbox = calcBoundingBoxSIMD( children_bbox , node.child_cnt );
+
+    SORT_STATS(sFbvhNodeCount += node.child_cnt);
+    SORT_STATS(++sFbvhRefitNodeCount);
+    return ret;
+}
+
+Simd_BBox Fbvh::calcBoundingBoxSIMD(const BBox* children_bbox, unsigned child_cnt) const {
     Simd_BBox node_bbox;
 
     float   min_x[SIMD_CHANNEL] , min_y[SIMD_CHANNEL] , min_z[SIMD_CHANNEL];
     float   max_x[SIMD_CHANNEL] , max_y[SIMD_CHANNEL] , max_z[SIMD_CHANNEL];
     bool    bb_valid[SIMD_CHANNEL] = { false };
     for( auto i = 0 ; i < SIMD_CHANNEL ; ++i ){
-        const auto bb = calcBoundingBox( children[i].get() , m_bvhpri.get() );
+        const auto bb = ( i < (int)child_cnt ) ? children_bbox[i] : BBox();
         min_x[i] = bb.m_Min.x;
         min_y[i] = bb.m_Min.y;
         min_z[i] = bb.m_Min.z;
@@ -282,7 +778,7 @@ Simd_BBox Fbvh::calcBoundingBoxSIMD(const Fast_Bvh_Node_Ptr* children) const {
         max_y[i] = bb.m_Max.y;
         max_z[i] = bb.m_Max.z;
 
-        bb_valid[i] = (IS_PTR_VALID(children[i].get()));
+        bb_valid[i] = ( i < (int)child_cnt );
     }
 
     node_bbox.m_min_x = simd_set_ps( min_x );
@@ -300,10 +796,7 @@ Simd_BBox Fbvh::calcBoundingBoxSIMD(const Fast_Bvh_Node_Ptr* children) const {
 #endif
 
 bool Fbvh::GetIntersect( const Ray& ray , SurfaceInteraction& intersect ) const{
-    // std::stack is by no means an option here due to its overhead under the hood.
-    static thread_local std::unique_ptr<std::pair<Fbvh_Node*, float>[]> bvh_stack = nullptr;
-    if (UNLIKELY(IS_PTR_INVALID(bvh_stack)))
-        bvh_stack = std::make_unique<std::pair<Fbvh_Node*, float>[]>(m_depth * FBVH_CHILD_CNT);
+    Fbvh_Traversal_Stack<std::pair<const Fast_Bvh_Linear_Node*, float>> bvh_stack( m_depth * FBVH_CHILD_CNT );
 
 #ifdef QBVH_IMPLEMENTATION
     SORT_PROFILE("Traverse Qbvh");
@@ -323,6 +816,7 @@ bool Fbvh::GetIntersect( const Ray& ray , SurfaceInteraction& intersect ) const{
 #ifdef SIMD_BVH_IMPLEMENTATION
     Simd_Ray_Data   simd_ray;
     resolveRayData( ray , simd_ray );
+    const auto primitives = m_leafPrimitives.data();
 #endif
 
     const auto fmin = Intersect(ray, m_bbox);
@@ -331,7 +825,7 @@ bool Fbvh::GetIntersect( const Ray& ray , SurfaceInteraction& intersect ) const{
 
     // stack index
     auto si = 0;
-    bvh_stack[si++] = std::make_pair( m_root.get() , fmin );
+    bvh_stack[si++] = std::make_pair( &m_nodes[0] , fmin );
 
     while( si > 0 ){
         const auto top = bvh_stack[--si];
@@ -345,7 +839,7 @@ bool Fbvh::GetIntersect( const Ray& ray , SurfaceInteraction& intersect ) const{
         // check if it is a leaf node
         if( 0 == node->child_cnt ){
             for( auto i = 0u ; i < node->tri_cnt ; ++i ){
-                const auto blocked = intersectTriangle_SIMD( ray , simd_ray , node->tri_list[i] , &intersect );
+                const auto blocked = intersectTriangle_SIMD( ray , simd_ray , m_triangles[node->tri_offset + i] , primitives , &intersect );
 
 #ifdef ENABLE_TRANSPARENT_SHADOW
                 // A quick branching out for shadow ray if there is no semi-transparent shadow
@@ -372,7 +866,7 @@ bool Fbvh::GetIntersect( const Ray& ray , SurfaceInteraction& intersect ) const{
 #endif
             }
             for( auto i = 0u ; i < node->line_cnt ; ++i ){
-                const auto blocked = intersectLine_SIMD( ray , simd_ray , node->line_list[i] , &intersect );
+                const auto blocked = intersectLine_SIMD( ray , simd_ray , m_lines[node->line_offset + i] , primitives , &intersect );
 
 #ifdef ENABLE_TRANSPARENT_SHADOW
                 if( intersect.query_shadow && blocked ){
@@ -385,9 +879,9 @@ bool Fbvh::GetIntersect( const Ray& ray , SurfaceInteraction& intersect ) const{
                 }
 #endif
             }
-            if( UNLIKELY(!node->other_list.empty()) ){
-                for( auto i = 0u ; i < node->other_list.size() ; ++i ){
-                    const auto blocked = node->other_list[i]->GetIntersect( ray , &intersect );
+            if( UNLIKELY(node->other_cnt > 0) ){
+                for( auto i = 0u ; i < node->other_cnt ; ++i ){
+                    const auto blocked = m_others[node->other_offset + i]->GetIntersect( ray , &intersect );
 
 #ifdef ENABLE_TRANSPARENT_SHADOW
                     if( intersect.query_shadow && blocked ){
@@ -416,7 +910,7 @@ bool Fbvh::GetIntersect( const Ray& ray , SurfaceInteraction& intersect ) const{
         m &= m - 1;
         if( LIKELY( 0 == m ) ){
             sAssert( t0 >= 0.0f , SPATIAL_ACCELERATOR );
-            bvh_stack[si++] = std::make_pair( node->children[k0].get() , t0 );
+            bvh_stack[si++] = std::make_pair( &m_nodes[node->children[k0]] , t0 );
         }else{
             const int k1 = __bsf( m );
             m &= m - 1;
@@ -426,11 +920,11 @@ bool Fbvh::GetIntersect( const Ray& ray , SurfaceInteraction& intersect ) const{
                 sAssert( t1 >= 0.0f , SPATIAL_ACCELERATOR );
 
                 if( t0 < t1 ){
-                    bvh_stack[si++] = std::make_pair(node->children[k1].get(), t1 );
-                    bvh_stack[si++] = std::make_pair(node->children[k0].get(), t0 );
+                    bvh_stack[si++] = std::make_pair(&m_nodes[node->children[k1]], t1 );
+                    bvh_stack[si++] = std::make_pair(&m_nodes[node->children[k0]], t0 );
                 }else{
-                    bvh_stack[si++] = std::make_pair(node->children[k0].get(), t0);
-                    bvh_stack[si++] = std::make_pair(node->children[k1].get(), t1);
+                    bvh_stack[si++] = std::make_pair(&m_nodes[node->children[k0]], t0);
+                    bvh_stack[si++] = std::make_pair(&m_nodes[node->children[k1]], t1);
                 }
             }else{
                 for (auto i = 0u; i < node->child_cnt; ++i) {
@@ -447,7 +941,7 @@ bool Fbvh::GetIntersect( const Ray& ray , SurfaceInteraction& intersect ) const{
                         break;
 
                     sse_f_min[k] = -1.0f;
-                    bvh_stack[si++] = std::make_pair(node->children[k].get(), maxDist);
+                    bvh_stack[si++] = std::make_pair(&m_nodes[node->children[k]], maxDist);
                 }
             }
         }
@@ -494,7 +988,7 @@ bool Fbvh::GetIntersect( const Ray& ray , SurfaceInteraction& intersect ) const{
                 break;
 
             f_min[k] = -1.0f;
-            bvh_stack[si++] = std::make_pair( node->children[k].get() , maxDist );
+            bvh_stack[si++] = std::make_pair( &m_nodes[node->children[k]] , maxDist );
         }
 #endif
     }
@@ -503,11 +997,8 @@ bool Fbvh::GetIntersect( const Ray& ray , SurfaceInteraction& intersect ) const{
 
 #ifndef ENABLE_TRANSPARENT_SHADOW
 bool  Fbvh::IsOccluded(const Ray& ray) const{
-    // std::stack is by no means an option here due to its overhead under the hood.
-    using Fbvh_Node_Ptr = Fbvh_Node*;
-    static thread_local std::unique_ptr<Fbvh_Node_Ptr[]> bvh_stack = nullptr;
-    if (UNLIKELY(IS_PTR_INVALID(bvh_stack)))
-        bvh_stack = std::make_unique<Fbvh_Node_Ptr[]>(m_depth * FBVH_CHILD_CNT);
+    using Fbvh_Node_Ptr = const Fast_Bvh_Linear_Node*;
+    Fbvh_Traversal_Stack<Fbvh_Node_Ptr> bvh_stack( m_depth * FBVH_CHILD_CNT );
 
 #ifdef QBVH_IMPLEMENTATION
     SORT_PROFILE("Traverse Qbvh");
@@ -523,6 +1014,7 @@ bool  Fbvh::IsOccluded(const Ray& ray) const{
 #ifdef SIMD_BVH_IMPLEMENTATION
     Simd_Ray_Data   simd_ray;
     resolveRayData( ray , simd_ray );
+    const auto primitives = m_leafPrimitives.data();
 #endif
 
     const auto fmin = Intersect(ray, m_bbox);
@@ -531,7 +1023,7 @@ bool  Fbvh::IsOccluded(const Ray& ray) const{
 
     // stack index
     auto si = 0;
-    bvh_stack[si++] = m_root.get();
+    bvh_stack[si++] = &m_nodes[0];
 
     while (si > 0) {
         const auto node = bvh_stack[--si];
@@ -540,20 +1032,20 @@ bool  Fbvh::IsOccluded(const Ray& ray) const{
         // check if it is a leaf node
         if (0 == node->child_cnt) {
             for (auto i = 0u; i < node->tri_cnt; ++i) {
-                if (intersectTriangleFast_SIMD(ray, simd_ray , node->tri_list[i])) {
+                if (intersectTriangleFast_SIMD(ray, simd_ray , m_triangles[node->tri_offset + i] , primitives)) {
                     SORT_STATS(sIntersectionTest += ( i + 1 ) * 4);
                     return true;
                 }
             }
             for (auto i = 0u; i < node->line_cnt; ++i) {
-                if (intersectLineFast_SIMD(ray, simd_ray , node->line_list[i])) {
+                if (intersectLineFast_SIMD(ray, simd_ray , m_lines[node->line_offset + i] , primitives)) {
                     SORT_STATS(sIntersectionTest += (i + 1 + node->tri_cnt) * 4);
                     return true;
                 }
             }
-            if (UNLIKELY(!node->other_list.empty())) {
-                for (auto i = 0u; i < node->other_list.size(); ++i) {
-                    if (node->other_list[i]->GetIntersect(ray, nullptr)) {
+            if (UNLIKELY(node->other_cnt > 0)) {
+                for (auto i = 0u; i < node->other_cnt; ++i) {
+                    if (m_others[node->other_offset + i]->GetIntersect(ray, nullptr)) {
                         SORT_STATS(sIntersectionTest += i + 1 + ( node->tri_cnt + node->line_cnt ) * 4);
                         return true;
                     }
@@ -572,7 +1064,7 @@ bool  Fbvh::IsOccluded(const Ray& ray) const{
         m &= m - 1;
         if (LIKELY(0 == m)) {
             sAssert(sse_f_min[k0] >= 0.0f, SPATIAL_ACCELERATOR);
-            bvh_stack[si++] = node->children[k0].get();
+            bvh_stack[si++] = &m_nodes[node->children[k0]];
         }
         else {
             const int k1 = __bsf(m);
@@ -581,8 +1073,8 @@ bool  Fbvh::IsOccluded(const Ray& ray) const{
             sAssert(sse_f_min[k1] >= 0.0f, SPATIAL_ACCELERATOR);
 
             if (LIKELY(0 == m)) {
-                bvh_stack[si++] = node->children[k1].get();
-                bvh_stack[si++] = node->children[k0].get();
+                bvh_stack[si++] = &m_nodes[node->children[k1]];
+                bvh_stack[si++] = &m_nodes[node->children[k0]];
             } else {
                 const int k2 = __bsf(m);
                 sAssert(sse_f_min[k2] >= 0.0f, SPATIAL_ACCELERATOR);
@@ -590,9 +1082,9 @@ bool  Fbvh::IsOccluded(const Ray& ray) const{
                 m &= m - 1;
 
                 if( LIKELY(0==m) ){
-                    bvh_stack[si++] = node->children[k2].get();
-                    bvh_stack[si++] = node->children[k1].get();
-                    bvh_stack[si++] = node->children[k0].get();
+                    bvh_stack[si++] = &m_nodes[node->children[k2]];
+                    bvh_stack[si++] = &m_nodes[node->children[k1]];
+                    bvh_stack[si++] = &m_nodes[node->children[k0]];
                 }else{
 #if defined(SIMD_AVX_IMPLEMENTATION)
                     for (auto i = 0u; i < node->child_cnt; ++i) {
@@ -609,17 +1101,17 @@ bool  Fbvh::IsOccluded(const Ray& ray) const{
                             break;
 
                         sse_f_min[k] = -1.0f;
-                        bvh_stack[si++] = node->children[k].get();
+                        bvh_stack[si++] = &m_nodes[node->children[k]];
                     }
 #endif
 #if defined(SIMD_SSE_IMPLEMENTATION)
                     const int k3 = __bsf(m);
                     sAssert(sse_f_min[k3] >= 0.0f, SPATIAL_ACCELERATOR);
 
-                    bvh_stack[si++] = node->children[k3].get();
-                    bvh_stack[si++] = node->children[k2].get();
-                    bvh_stack[si++] = node->children[k1].get();
-                    bvh_stack[si++] = node->children[k0].get();
+                    bvh_stack[si++] = &m_nodes[node->children[k3]];
+                    bvh_stack[si++] = &m_nodes[node->children[k2]];
+                    bvh_stack[si++] = &m_nodes[node->children[k1]];
+                    bvh_stack[si++] = &m_nodes[node->children[k0]];
 #endif
                 }
             }
@@ -646,7 +1138,7 @@ bool  Fbvh::IsOccluded(const Ray& ray) const{
 
         for (auto i = 0u; i < node->child_cnt; ++i)
             if( f_min[i] >= 0.0f )
-                bvh_stack[si++] = node->children[i].get();
+                bvh_stack[si++] = &m_nodes[node->children[i]];
 #endif
     }
     return false;
@@ -654,10 +1146,7 @@ bool  Fbvh::IsOccluded(const Ray& ray) const{
 #endif
 
 void Fbvh::GetIntersect( const Ray& ray , BSSRDFIntersections& intersect , const StringID matID ) const{
-    // std::stack is by no means an option here due to its overhead under the hood.
-    static thread_local std::unique_ptr<std::pair<Fbvh_Node*, float>[]> bvh_stack = nullptr;
-    if ( UNLIKELY(IS_PTR_INVALID(bvh_stack) ) )
-        bvh_stack = std::make_unique<std::pair<Fbvh_Node*, float>[]>(m_depth * FBVH_CHILD_CNT);
+    Fbvh_Traversal_Stack<std::pair<const Fast_Bvh_Linear_Node*, float>> bvh_stack( m_depth * FBVH_CHILD_CNT );
 
 #ifdef QBVH_IMPLEMENTATION
     SORT_PROFILE("Traverse Qbvh");
@@ -672,6 +1161,7 @@ void Fbvh::GetIntersect( const Ray& ray , BSSRDFIntersections& intersect , const
 #ifdef SIMD_BVH_IMPLEMENTATION
     Simd_Ray_Data   simd_ray;
     resolveRayData( ray , simd_ray );
+    const auto primitives = m_leafPrimitives.data();
 #endif
 
     intersect.cnt = 0;
@@ -683,7 +1173,7 @@ void Fbvh::GetIntersect( const Ray& ray , BSSRDFIntersections& intersect , const
 
     // stack index
     auto si = 0;
-    bvh_stack[si++] = std::make_pair(m_root.get(), fmin);
+    bvh_stack[si++] = std::make_pair(&m_nodes[0], fmin);
 
     while (si > 0) {
         const auto top = bvh_stack[--si];
@@ -700,7 +1190,7 @@ void Fbvh::GetIntersect( const Ray& ray , BSSRDFIntersections& intersect , const
             // Line is usually used for hair, which has its own hair shader.
             // Triangle is the only major primitive that has SSS.
             for ( auto i = 0u ; i < node->tri_cnt ; ++i )
-                intersectTriangleMulti_SIMD(ray, simd_ray, node->tri_list[i] , matID, intersect);
+                intersectTriangleMulti_SIMD(ray, simd_ray, m_triangles[node->tri_offset + i] , primitives , matID, intersect);
             SORT_STATS(sIntersectionTest += node->tri_cnt);
             continue;
         }
@@ -715,7 +1205,7 @@ void Fbvh::GetIntersect( const Ray& ray , BSSRDFIntersections& intersect , const
         m &= m - 1;
         if (LIKELY(0 == m)) {
             sAssert(t0 >= 0.0f, SPATIAL_ACCELERATOR);
-            bvh_stack[si++] = std::make_pair(node->children[k0].get(), t0);
+            bvh_stack[si++] = std::make_pair(&m_nodes[node->children[k0]], t0);
         }
         else {
             const int k1 = __bsf(m);
@@ -726,12 +1216,12 @@ void Fbvh::GetIntersect( const Ray& ray , BSSRDFIntersections& intersect , const
                 sAssert(t1 >= 0.0f, SPATIAL_ACCELERATOR);
 
                 if (t0 < t1) {
-                    bvh_stack[si++] = std::make_pair(node->children[k1].get(), t1);
-                    bvh_stack[si++] = std::make_pair(node->children[k0].get(), t0);
+                    bvh_stack[si++] = std::make_pair(&m_nodes[node->children[k1]], t1);
+                    bvh_stack[si++] = std::make_pair(&m_nodes[node->children[k0]], t0);
                 }
                 else {
-                    bvh_stack[si++] = std::make_pair(node->children[k0].get(), t0);
-                    bvh_stack[si++] = std::make_pair(node->children[k1].get(), t1);
+                    bvh_stack[si++] = std::make_pair(&m_nodes[node->children[k0]], t0);
+                    bvh_stack[si++] = std::make_pair(&m_nodes[node->children[k1]], t1);
                 }
             }
             else {
@@ -750,7 +1240,7 @@ void Fbvh::GetIntersect( const Ray& ray , BSSRDFIntersections& intersect , const
                         break;
 
                     sse_f_min[k] = -1.0f;
-                    bvh_stack[si++] = std::make_pair(node->children[k].get(), maxDist);
+                    bvh_stack[si++] = std::make_pair(&m_nodes[node->children[k]], maxDist);
                 }
             }
         }
@@ -766,6 +1256,10 @@ void Fbvh::GetIntersect( const Ray& ray , BSSRDFIntersections& intersect , const
                 if (matID != m_bvhpri[i].primitive->GetMaterial()->GetUniqueID())
                     continue;
 
+                // spatial splits could put the primitive in other leaf nodes too, make sure it is not checked before
+                if (intersect.HasPrimitive(m_bvhpri[i].primitive))
+                    continue;
+
                 SORT_STATS(++sIntersectionTest);
 
                 intersection.Reset();
@@ -813,16 +1307,166 @@ void Fbvh::GetIntersect( const Ray& ray , BSSRDFIntersections& intersect , const
                 break;
 
             f_min[k] = -1.0f;
-            bvh_stack[si++] = std::make_pair(node->children[k].get(), maxDist);
+            bvh_stack[si++] = std::make_pair(&m_nodes[node->children[k]], maxDist);
         }
 #endif
     }
 }
 
+#ifdef SIMD_BVH_IMPLEMENTATION
+void Fbvh::IntersectStream( const Ray* rays , SurfaceInteraction* intersects , unsigned cnt ) const{
+    for( auto offset = 0u ; offset < cnt ; offset += FBVH_PACKET_SIZE )
+        traversePacket<false>( rays + offset , intersects + offset , nullptr , std::min( cnt - offset , FBVH_PACKET_SIZE ) );
+}
+
+void Fbvh::OccludedStream( const Ray* rays , bool* occluded , unsigned cnt ) const{
+    for( auto offset = 0u ; offset < cnt ; offset += FBVH_PACKET_SIZE )
+        traversePacket<true>( rays + offset , nullptr , occluded + offset , std::min( cnt - offset , FBVH_PACKET_SIZE ) );
+}
+
+template<bool occlusion>
+void Fbvh::traversePacket( const Ray* rays , SurfaceInteraction* intersects , bool* occluded , unsigned cnt ) const{
+    // each entry keeps the node to be visited and the rays visiting it.
+    Fbvh_Traversal_Stack<std::pair<const Fast_Bvh_Linear_Node*, unsigned>> bvh_stack( m_depth * FBVH_CHILD_CNT );
+
+#ifdef QBVH_IMPLEMENTATION
+    SORT_PROFILE("Traverse Qbvh Packet");
+#endif
+#ifdef OBVH_IMPLEMENTATION
+    SORT_PROFILE("Traverse Obvh Packet");
+#endif
+
+    sAssert( cnt <= FBVH_PACKET_SIZE , SPATIAL_ACCELERATOR );
+
+    SORT_STATS(sRayCount += cnt);
+    SORT_STATS(sShadowRayCount += occlusion ? cnt : 0);
+
+    // rays that are still active in the packet, occluded rays are retired as soon as they hit anything.
+    auto active = 0u;
+    Simd_Ray_Data simd_rays[FBVH_PACKET_SIZE];
+    Simd_Ray_Packet<FBVH_PACKET_SIZE> packet;
+    const auto primitives = m_leafPrimitives.data();
+    for( auto i = 0u ; i < cnt ; ++i ){
+        if( occlusion )
+            occluded[i] = false;
+#ifdef ENABLE_TRANSPARENT_SHADOW
+        else
+            sAssert( !intersects[i].query_shadow , SPATIAL_ACCELERATOR );
+#endif
+
+        rays[i].Prepare();
+        resolveRayData( rays[i] , simd_rays[i] );
+        packet.Set( i , rays[i] , simd_rays[i] , occlusion ? FLT_MAX : intersects[i].t );
+
+        if( Intersect( rays[i] , m_bbox ) >= 0.0f )
+            active |= 1u << i;
+    }
+    if( 0 == active )
+        return;
+
+    // stack index
+    auto si = 0;
+    bvh_stack[si++] = std::make_pair( &m_nodes[0] , active );
+
+    while( si > 0 ){
+        const auto top = bvh_stack[--si];
+
+        const auto node = top.first;
+        const auto mask = top.second & active;
+        if( 0 == mask )
+            continue;
+
+        // check if it is a leaf node
+        if( 0 == node->child_cnt ){
+            for( auto m = mask ; m ; m &= m - 1 ){
+                const auto r = __bsf( m );
+                const auto& ray = rays[r];
+                const auto& simd_ray = simd_rays[r];
+
+                if( occlusion ){
+                    auto blocked = false;
+                    for( auto i = 0u ; i < node->tri_cnt && !blocked ; ++i )
+                        blocked = intersectTriangleFast_SIMD( ray , simd_ray , m_triangles[node->tri_offset + i] , primitives );
+                    for( auto i = 0u ; i < node->line_cnt && !blocked ; ++i )
+                        blocked = intersectLineFast_SIMD( ray , simd_ray , m_lines[node->line_offset + i] , primitives );
+                    for( auto i = 0u ; i < node->other_cnt && !blocked ; ++i )
+                        blocked = m_others[node->other_offset + i]->GetIntersect( ray , nullptr );
+
+                    if( blocked ){
+                        occluded[r] = true;
+                        active &= ~( 1u << r );
+                    }
+                }else{
+                    auto& intersect = intersects[r];
+                    for( auto i = 0u ; i < node->tri_cnt ; ++i )
+                        intersectTriangle_SIMD( ray , simd_ray , m_triangles[node->tri_offset + i] , primitives , &intersect );
+                    for( auto i = 0u ; i < node->line_cnt ; ++i )
+                        intersectLine_SIMD( ray , simd_ray , m_lines[node->line_offset + i] , primitives , &intersect );
+                    for( auto i = 0u ; i < node->other_cnt ; ++i )
+                        m_others[node->other_offset + i]->GetIntersect( ray , &intersect );
+
+                    // there is no need to visit a node behind the nearest intersection found so far.
+                    packet.t_max[r] = std::min( packet.t_max[r] , intersect.t );
+                }
+
+                SORT_STATS(sIntersectionTest+=node->pri_cnt);
+            }
+            continue;
+        }
+
+        // gather the rays visiting each child, the nearest distance among them is used to sort the children.
+        // each child bounding box is tested against SIMD_CHANNEL rays at a time, groups without active rays are skipped.
+        unsigned    child_mask[FBVH_CHILD_CNT] = { 0 };
+        float       child_dist[FBVH_CHILD_CNT];
+        for( auto k = 0u ; k < node->child_cnt ; ++k ){
+            const auto bbox = ChildBBox( node->bbox , k );
+
+            child_dist[k] = FLT_MAX;
+            for( auto offset = 0u ; offset < FBVH_PACKET_SIZE ; offset += SIMD_CHANNEL ){
+                const auto lanes = ( mask >> offset ) & ( ( 1u << SIMD_CHANNEL ) - 1 );
+                if( 0 == lanes )
+                    continue;
+
+                simd_data sse_f_min;
+                auto hit = (unsigned)IntersectBBox_SIMD( packet , offset , bbox , sse_f_min ) & lanes;
+                child_mask[k] |= hit << offset;
+                while( hit ){
+                    const auto r = __bsf( hit );
+                    hit &= hit - 1;
+
+                    child_dist[k] = std::min( child_dist[k] , (float)sse_f_min[r] );
+                }
+            }
+        }
+
+        // push the children from far to near so that the nearest one is visited first.
+        for( auto i = 0u ; i < node->child_cnt ; ++i ){
+            auto k = -1;
+            auto maxDist = -1.0f;
+            for( auto j = 0u ; j < node->child_cnt ; ++j ){
+                if( child_mask[j] && child_dist[j] > maxDist ){
+                    maxDist = child_dist[j];
+                    k = j;
+                }
+            }
+
+            if( k == -1 )
+                break;
+
+            bvh_stack[si++] = std::make_pair( &m_nodes[node->children[k]] , child_mask[k] );
+            child_mask[k] = 0;
+        }
+    }
+}
+#endif
+
 std::unique_ptr<Accelerator> Fbvh::Clone() const {
 	auto ret = std::make_unique<Fbvh>();
 	ret->m_maxNodeDepth = m_maxNodeDepth;
 	ret->m_maxPriInLeaf = m_maxPriInLeaf;
+	ret->m_spatialSplit = m_spatialSplit;
+	ret->m_spatialSplitBudget = m_spatialSplitBudget;
+	ret->m_refitThreshold = m_refitThreshold;
 
 	return ret;
 }
\ No newline at end of file
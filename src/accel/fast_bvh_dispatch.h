@@ -0,0 +1,51 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include <memory>
+#include "core/define.h"
+#include "simd/simd_dispatch.h"
+
+class Accelerator;
+
+#ifdef SIMD_DISPATCH_ENABLED
+
+//! @brief  Create a QBVH with the best traversal kernels that the CPU supports.
+//!
+//! This is what is created when a scene asks for a QBVH.
+//!
+//! @return     The created QBVH.
+std::unique_ptr<Accelerator>    CreateQbvh();
+
+//! @brief  Create an OBVH with the best traversal kernels that the CPU supports.
+//!
+//! This is what is created when a scene asks for an OBVH.
+//!
+//! @return     The created OBVH.
+std::unique_ptr<Accelerator>    CreateObvh();
+
+//! @brief  Create a QBVH with traversal kernels compiled for SSE4.1.
+std::unique_ptr<Accelerator>    MakeQbvh_SSE41();
+
+//! @brief  Create an OBVH with traversal kernels compiled for AVX2.
+std::unique_ptr<Accelerator>    MakeObvh_AVX2();
+
+//! @brief  Create an OBVH with traversal kernels compiled for AVX-512.
+std::unique_ptr<Accelerator>    MakeObvh_AVX512();
+
+#endif
@@ -0,0 +1,131 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+// QBVH/OBVH compiled for one specific instruction set, this file is included by one translation unit per instruction
+// set when SIMD_DISPATCH_ENABLED is defined, see simd/simd_dispatch.h. Following macros need to be defined before
+// including this file,
+//  - QBVH_IMPLEMENTATION or OBVH_IMPLEMENTATION, which tree to compile.
+//  - SIMD_KERNEL_NAMESPACE, the namespace of the kernels.
+//  - SIMD_KERNEL_TARGET, the instruction set to generate code for.
+//  - SIMD_KERNEL_FACTORY, the function creating the tree, it is declared in fast_bvh_dispatch.h.
+
+#include <queue>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <float.h>
+#include <nmmintrin.h>
+#include <immintrin.h>
+#include "core/define.h"
+#include "core/memory.h"
+#include "core/primitive.h"
+#include "core/stats.h"
+#include "core/diskcache.h"
+#include "core/timer.h"
+#include "stream/hstream.h"
+#include "math/bbox.h"
+#include "math/interaction.h"
+#include "math/point.h"
+#include "math/ray.h"
+#include "shape/triangle.h"
+#include "shape/line.h"
+#include "entity/visual.h"
+#include "scatteringevent/bssrdf/bssrdf.h"
+#include "accelerator.h"
+#include "bvh_utils.h"
+#include "fast_bvh_dispatch.h"
+
+// Everything above is shared with the rest of the binary and is not compiled for the instruction set. Anything that
+// the kernels include is supposed to be included above, otherwise it would end up in the namespace of the kernels.
+
+// The counters are defined by the default QBVH/OBVH.
+SORT_STATS_DECLARE_COUNTER(sRayCount)
+SORT_STATS_DECLARE_COUNTER(sShadowRayCount)
+SORT_STATS_DECLARE_COUNTER(sIntersectionTest)
+
+#ifdef QBVH_IMPLEMENTATION
+SORT_STATS_DECLARE_COUNTER(sQbvhNodeCount)
+SORT_STATS_DECLARE_COUNTER(sQbvhLeafNodeCount)
+SORT_STATS_DECLARE_COUNTER(sQbvhDepth)
+SORT_STATS_DECLARE_COUNTER(sQbvhMaxPriCountInLeaf)
+SORT_STATS_DECLARE_COUNTER(sQbvhPrimitiveCount)
+SORT_STATS_DECLARE_COUNTER(sQbvhBuildTaskCount)
+SORT_STATS_DECLARE_COUNTER(sQbvhMemory)
+SORT_STATS_DECLARE_COUNTER(sQbvhSpatialSplitReferenceCount)
+SORT_STATS_DECLARE_COUNTER(sQbvhRefitNodeCount)
+SORT_STATS_DECLARE_COUNTER(sQbvhRebuiltSubtreeCount)
+SORT_STATS_DECLARE_COUNTER(sQbvhBuildTimeMS)
+SORT_STATS_DECLARE_COUNTER(sQbvhSplitWorkTimeUS)
+SORT_STATS_DECLARE_COUNTER(sQbvhSplitTimeUS)
+
+#define Fbvh        Qbvh
+#define Fbvh_Node   Qbvh_Node
+
+#ifndef SSE_ENABLED
+#define SSE_ENABLED
+#endif
+#define SIMD_SSE_IMPLEMENTATION
+#endif
+
+#ifdef OBVH_IMPLEMENTATION
+SORT_STATS_DECLARE_COUNTER(sObvhNodeCount)
+SORT_STATS_DECLARE_COUNTER(sObvhLeafNodeCount)
+SORT_STATS_DECLARE_COUNTER(sObvhDepth)
+SORT_STATS_DECLARE_COUNTER(sObvhMaxPriCountInLeaf)
+SORT_STATS_DECLARE_COUNTER(sObvhPrimitiveCount)
+SORT_STATS_DECLARE_COUNTER(sObvhBuildTaskCount)
+SORT_STATS_DECLARE_COUNTER(sObvhMemory)
+SORT_STATS_DECLARE_COUNTER(sObvhSpatialSplitReferenceCount)
+SORT_STATS_DECLARE_COUNTER(sObvhRefitNodeCount)
+SORT_STATS_DECLARE_COUNTER(sObvhRebuiltSubtreeCount)
+SORT_STATS_DECLARE_COUNTER(sObvhBuildTimeMS)
+SORT_STATS_DECLARE_COUNTER(sObvhSplitWorkTimeUS)
+SORT_STATS_DECLARE_COUNTER(sObvhSplitTimeUS)
+
+#define OBVH_IMPEMENTATION
+#define Fbvh        Obvh
+#define Fbvh_Node   Obvh_Node
+
+#ifndef AVX_ENABLED
+#define AVX_ENABLED
+#endif
+#define SIMD_AVX_IMPLEMENTATION
+#endif
+
+#define SIMD_BVH_IMPLEMENTATION
+
+SIMD_KERNEL_BEGIN( SIMD_KERNEL_NAMESPACE , SIMD_KERNEL_TARGET )
+
+#include "simd/simd_ray_utils.h"
+#ifdef QBVH_IMPLEMENTATION
+#include "simd/sse_bbox.h"
+#include "simd/sse_triangle.h"
+#include "simd/sse_line.h"
+#endif
+#ifdef OBVH_IMPLEMENTATION
+#include "simd/avx_bbox.h"
+#include "simd/avx_triangle.h"
+#include "simd/avx_line.h"
+#endif
+#include "fast_bvh.h"
+#include "fast_bvh.hpp"
+
+SIMD_KERNEL_END
+
+std::unique_ptr<Accelerator> SIMD_KERNEL_FACTORY(){
+    return std::make_unique<SIMD_KERNEL_NAMESPACE::Fbvh>();
+}
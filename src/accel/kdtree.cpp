@@ -345,14 +345,7 @@ void KDTree::traverse( const Kd_Node* node , const Ray& ray , BSSRDFIntersection
                 continue;
             
             // make sure the primitive is not checked before
-            auto checked = false;
-            for( auto i = 0u ; i < intersect.cnt ; ++i ){
-                if( primitive == intersect.intersections[i]->intersection.primitive ){
-                    checked = true;
-                    break;
-                }
-            }
-            if( checked )
+            if( intersect.HasPrimitive( primitive ) )
                 continue;
 
             SORT_STATS(++sIntersectionTest);
@@ -34,4 +34,28 @@
 #endif
 
 #undef  Fbvh
-#undef  Fbvh_Node
\ No newline at end of file
+#undef  Fbvh_Node
+
+#ifdef SIMD_DISPATCH_ENABLED
+
+SORT_STATS_DECLARE_COUNTER(sSimdIsa)
+
+std::unique_ptr<Accelerator> CreateObvh(){
+    const auto isa = GetSupportedSimdIsa();
+    SORT_STATS( sSimdIsa = (StatsInt)isa );
+
+    // A QBVH with SSE4.1 kernels is a lot faster than an OBVH without any SIMD kernel, both take the same configuration.
+    if( isa == SIMD_ISA_SSE41 ){
+        slog( INFO , SPATIAL_ACCELERATOR , "OBVH needs AVX2, QBVH with SIMD kernels of %s is used instead." , GetSimdIsaName( isa ) );
+        return MakeQbvh_SSE41();
+    }
+
+    slog( INFO , SPATIAL_ACCELERATOR , "SIMD kernels of OBVH: %s." , GetSimdIsaName( isa ) );
+    if( isa == SIMD_ISA_AVX512 )
+        return MakeObvh_AVX512();
+    if( isa == SIMD_ISA_AVX2 )
+        return MakeObvh_AVX2();
+    return std::make_unique<Obvh>();
+}
+
+#endif
\ No newline at end of file
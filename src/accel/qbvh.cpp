@@ -15,6 +15,7 @@
     this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
  */
 
+#include <algorithm>
 #include "qbvh.h"
 
 #define QBVH_IMPLEMENTATION
@@ -34,4 +35,23 @@
 #endif
 
 #undef  Fbvh
-#undef  Fbvh_Node
\ No newline at end of file
+#undef  Fbvh_Node
+
+#ifdef SIMD_DISPATCH_ENABLED
+
+SORT_STATS_DECLARE_COUNTER(sSimdIsa)
+
+std::unique_ptr<Accelerator> CreateQbvh(){
+    // There is no kernel wider than four lanes for QBVH, SSE4.1 is the best it can get.
+    const auto isa = std::min( GetSupportedSimdIsa() , SIMD_ISA_SSE41 );
+    slog( INFO , SPATIAL_ACCELERATOR , "SIMD kernels of QBVH: %s." , GetSimdIsaName( isa ) );
+    SORT_STATS( sSimdIsa = (StatsInt)isa );
+
+    if( isa == SIMD_ISA_SSE41 )
+        return MakeQbvh_SSE41();
+
+    // The default QBVH is compiled with SSE2 only, it is still faster than no SIMD at all.
+    return std::make_unique<Qbvh>();
+}
+
+#endif
\ No newline at end of file
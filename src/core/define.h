@@ -97,8 +97,14 @@
 // This is disabled since it is significantly slower on my 2015 Macbook.
 // #define ENABLE_MULTI_THREAD_SHADER_COMPILATION_CHEAP
 
-// This is a temporary quick solution to enable multi-thread texture loading. It is by no means a very good idea to 
-// parallel a bunch of IO bound threads. However, my newly planned job system is far from being ready yet, I'll live 
-// with it for now. This async loading eventually will be less useful since I'm planning to implement a texture cache
-// system in the future to do lazy texture loading in the future.
-#define ENABLE_ASYNC_TEXTURE_LOADING
\ No newline at end of file
+// Multi-thread texture loading. Textures are loaded as tasks, each of them is decoded, mip-mapped and then handed over
+// to the texture cache, which pages the tiles out to disk. Since no more than the number of worker threads textures are
+// decoded at the same time, the peak memory during loading is bounded too.
+#define ENABLE_ASYNC_TEXTURE_LOADING
+
+// Compressed QBVH/OBVH nodes. Bounding boxes of children are quantized to 8 bits relative to the bounding box of their
+// parent, which shrinks a QBVH node to one cache line and an OBVH node to two. It pays off in big scenes that don't fit
+// in cache, where traversal is bound by memory bandwidth. However, the quantized bounding boxes are slightly larger than
+// the original ones, rays will visit a few more nodes than before, this is not worth it for scenes that fit in cache.
+// For which reason, it is disabled by default.
+// #define ENABLE_COMPRESSED_BVH
\ No newline at end of file
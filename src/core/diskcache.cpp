@@ -0,0 +1,110 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include <chrono>
+#include <thread>
+#include <filesystem>
+#include "diskcache.h"
+#include "core/log.h"
+#include "core/stats.h"
+#include "core/strid.h"
+#include "stream/fstream.h"
+
+SORT_STATS_DEFINE_COUNTER(sDiskCacheLookups)
+SORT_STATS_DEFINE_COUNTER(sDiskCacheHits)
+SORT_STATS_DEFINE_COUNTER(sDiskCacheWrites)
+
+SORT_STATS_COUNTER("Disk Cache", "Lookups", sDiskCacheLookups);
+SORT_STATS_COUNTER("Disk Cache", "Hits", sDiskCacheHits);
+SORT_STATS_COUNTER("Disk Cache", "Writes", sDiskCacheWrites);
+
+// Every cache file starts with it so that random files in the cache directory are not mistaken as cache files.
+static const StringID disk_cache_sid( "disk cache" );
+
+void DiskCache::SetDirectory( const std::string& directory ){
+    m_directory = directory;
+    if( m_directory.empty() )
+        return;
+
+    std::error_code ec;
+    std::filesystem::create_directories( m_directory , ec );
+    if( !std::filesystem::is_directory( m_directory , ec ) ){
+        slog( WARNING , STREAM , "Cache directory %s can't be created, disk cache is disabled." , directory.c_str() );
+        m_directory.clear();
+        return;
+    }
+
+    slog( INFO , STREAM , "Disk cache is enabled in %s." , m_directory.c_str() );
+}
+
+std::unique_ptr<IMappedFileStream> DiskCache::Load( const std::string& category , std::uint64_t key ) const{
+    if( !IsEnabled() )
+        return nullptr;
+
+    SORT_STATS(++sDiskCacheLookups);
+
+    auto stream = std::make_unique<IMappedFileStream>();
+    if( !stream->Open( getFilePath( category , key ) ) )
+        return nullptr;
+
+    // different keys could end up with the same file name, though it is very unlikely.
+    IStreamBase& header = *stream;
+    StringID sid;
+    unsigned int version = 0 , key_hi = 0 , key_lo = 0;
+    header >> sid >> version >> key_hi >> key_lo;
+    if( disk_cache_sid != sid || DISK_CACHE_VERSION != version || ( ( (std::uint64_t)key_hi << 32 ) | key_lo ) != key )
+        return nullptr;
+
+    SORT_STATS(++sDiskCacheHits);
+    return stream;
+}
+
+bool DiskCache::Save( const std::string& category , std::uint64_t key , SerializableObject& object ) const{
+    if( !IsEnabled() )
+        return false;
+
+    const auto path = getFilePath( category , key );
+
+    // the same data could be saved by multiple threads or processes at the same time, each writes its own file.
+    const auto thread_hash = std::hash<std::thread::id>()( std::this_thread::get_id() );
+    const auto time = (std::uint64_t)std::chrono::high_resolution_clock::now().time_since_epoch().count();
+    const auto tmp_path = path + "." + std::to_string( thread_hash ^ time ) + ".tmp";
+    {
+        OFileStream file( tmp_path );
+        OStreamBase& stream = file;
+        stream << disk_cache_sid << DISK_CACHE_VERSION << (unsigned int)( key >> 32 ) << (unsigned int)key;
+        object.Serialize( stream );
+        stream.Flush();
+    }
+
+    std::error_code ec;
+    std::filesystem::rename( tmp_path , path , ec );
+    if( ec ){
+        std::filesystem::remove( tmp_path , ec );
+        slog( WARNING , STREAM , "Failed to save cache file %s." , path.c_str() );
+        return false;
+    }
+
+    SORT_STATS(++sDiskCacheWrites);
+    return true;
+}
+
+std::string DiskCache::getFilePath( const std::string& category , std::uint64_t key ) const{
+    char name[32];
+    snprintf( name , sizeof( name ) , "%016llx" , (unsigned long long)key );
+    return ( std::filesystem::path( m_directory ) / ( category + "_" + name + ".cache" ) ).string();
+}
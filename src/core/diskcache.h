@@ -0,0 +1,151 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <climits>
+#include <string.h>
+#include <type_traits>
+#include "core/define.h"
+#include "core/singleton.h"
+#include "stream/stream.h"
+#include "stream/mmapstream.h"
+
+//! @brief  Version of the layout of cache files.
+//!
+//! This needs to be updated every time the layout of any cached data changes, or the way the data is generated changes,
+//! like a different algorithm generating tangents of meshes. Cache files of other versions are ignored.
+constexpr unsigned int DISK_CACHE_VERSION = 2;
+
+//! @brief  Persistent cache of render-ready data.
+/**
+ * Some data takes quite some time to generate during loading even if the scene doesn't change at all, like vertices
+ * transformed to world space or a built BVH. The disk cache keeps such data in files across runs so that rendering the
+ * same scene again, with only the camera or materials changed, doesn't need to generate it again.
+ *
+ * Cached data is identified by a category and a key. The key is the hash of everything the data depends on, including
+ * the configuration used to generate it, a change in any of them ends up with a different key. Stale cache files are
+ * never read again, they are left in the cache directory though, it is up to the user to clean it up.
+ *
+ * Cache files are memory mapped when loaded, big buffers in them are copied out in one go without parsing anything.
+ * The cache is disabled if there is no cache directory.
+ */
+class DiskCache : public Singleton<DiskCache>{
+public:
+    //! @brief  Set the directory of cache files, it will be created if it doesn't exist.
+    //!
+    //! @param  directory   Directory of the cache files, an empty one disables the cache.
+    void    SetDirectory( const std::string& directory );
+
+    //! @brief  Whether the disk cache is enabled.
+    //!
+    //! @return             Whether there is a directory for the cache files.
+    bool    IsEnabled() const {
+        return !m_directory.empty();
+    }
+
+    //! @brief  Load cached data.
+    //!
+    //! @param  category    Category of the data, like 'mesh' or 'qbvh'.
+    //! @param  key         Hash of everything the data depends on.
+    //! @return             Stream of the cached data, nullptr if there is no such data in the cache.
+    std::unique_ptr<IMappedFileStream>  Load( const std::string& category , std::uint64_t key ) const;
+
+    //! @brief  Save data in the cache.
+    //!
+    //! The data is streamed out through 'Serialize' of the object. It is written to a temporary file first, which
+    //! replaces the cache file once it is complete, other threads or processes never see a partially written one.
+    //!
+    //! @param  category    Category of the data, like 'mesh' or 'qbvh'.
+    //! @param  key         Hash of everything the data depends on.
+    //! @param  object      Object streaming out the data to be cached.
+    //! @return             Whether the data is saved.
+    bool    Save( const std::string& category , std::uint64_t key , SerializableObject& object ) const;
+
+private:
+    /**< Directory of the cache files, the cache is disabled if it is empty. */
+    std::string     m_directory;
+
+    //! @brief  Get the full path of the cache file.
+    //!
+    //! @param  category    Category of the data.
+    //! @param  key         Hash of everything the data depends on.
+    //! @return             Full path of the cache file.
+    std::string     getFilePath( const std::string& category , std::uint64_t key ) const;
+
+    //! @brief  Make constructor private.
+    DiskCache() = default;
+
+    friend class Singleton<DiskCache>;
+};
+
+//! @brief  Stream out a buffer of plain data in one go.
+//!
+//! The number of elements and the size of each of them are streamed out before the raw data. Elements are copied
+//! bit by bit, they can't have any pointer or virtual function in them. Math types, like Point, are not trivially
+//! copyable in the strict sense because of their copy constructors, they are still plain data though.
+//!
+//! @param  stream      Stream to write to.
+//! @param  buffer      Buffer to be streamed out.
+template<class T>
+void SerializeBuffer( OStreamBase& stream , const std::vector<T>& buffer ){
+    static_assert( std::is_standard_layout<T>::value , "Only plain data can be streamed out in one go." );
+
+    stream << (unsigned int)buffer.size() << (unsigned int)sizeof( T );
+
+    // big buffers could take more bytes than what 'Write' can take in one call.
+    auto data = (char*)buffer.data();
+    auto size = buffer.size() * sizeof( T );
+    while( size > 0 ){
+        const auto chunk = std::min( size , (size_t)INT_MAX );
+        stream.Write( data , (int)chunk );
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+//! @brief  Stream in a buffer of plain data in one go.
+//!
+//! Only streams that have all data in memory are supported, see 'IStreamBase::Map'. Nothing is loaded if the layout
+//! of the element doesn't match or there is not enough data left in the stream.
+//!
+//! @param  stream      Stream to read from.
+//! @param  buffer      Buffer to be filled.
+//! @return             Whether the buffer is loaded.
+template<class T>
+bool SerializeBuffer( IStreamBase& stream , std::vector<T>& buffer ){
+    static_assert( std::is_standard_layout<T>::value , "Only plain data can be streamed in one go." );
+
+    unsigned int cnt = 0 , stride = 0;
+    stream >> cnt >> stride;
+    if( sizeof( T ) != stride )
+        return false;
+
+    const auto size = (size_t)cnt * stride;
+    const auto data = stream.Map( size );
+    if( IS_PTR_INVALID(data) )
+        return false;
+
+    buffer.resize( cnt );
+    if( size > 0 )
+        memcpy( (void*)buffer.data() , data , size );
+    return true;
+}
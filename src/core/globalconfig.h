@@ -27,9 +27,11 @@
 #include "core/rtti.h"
 #include "imagesensor/blenderimage.h"
 #include "imagesensor/rendertargetimage.h"
+#include "texture/texturecache.h"
+#include "core/diskcache.h"
 
 //! @brief  This needs to be update every time the content of GlobalConfiguration changes.
-constexpr unsigned int GLOBAL_CONFIGURATION_VERSION = 0;
+constexpr unsigned int GLOBAL_CONFIGURATION_VERSION = 4;
 
 //! @brief  GlobalConfiguration saves some global state.
 class GlobalConfiguration : public Singleton<GlobalConfiguration> , SerializableObject {
@@ -153,6 +155,61 @@ public:
         return m_clampping;
     }
 
+    //! @brief      Whether adaptive sampling is enabled.
+    //!
+    //! With adaptive sampling, tiles are rendered in multiple passes. Pixels stop taking samples once their
+    //! relative error is low enough, tiles stop being rendered once all pixels are done or the time budget
+    //! runs out. Sample per pixel is the maximum number of samples a pixel could take then.
+    //!
+    //! @return     Whether adaptive sampling is enabled.
+    bool            GetAdaptiveSampling() const{
+        return m_adaptiveSampling;
+    }
+
+    //! @brief      Get the number of samples per pixel taken in each pass of adaptive sampling.
+    //!
+    //! @return     Number of samples per pixel in each pass.
+    unsigned int    GetAdaptiveSamplePerPass() const{
+        return m_adaptiveSamplePerPass;
+    }
+
+    //! @brief      Get the relative error threshold of adaptive sampling.
+    //!
+    //! A pixel is converged once the standard error of its mean luminance relative to the mean is below it.
+    //!
+    //! @return     Relative error threshold.
+    float           GetAdaptiveErrorThreshold() const{
+        return m_adaptiveErrorThreshold;
+    }
+
+    //! @brief      Get the time budget of adaptive sampling in seconds.
+    //!
+    //! Once the time budget runs out, no more passes will be rendered. Zero means there is no time budget.
+    //!
+    //! @return     Time budget in seconds.
+    float           GetAdaptiveTimeBudget() const{
+        return m_adaptiveTimeBudget;
+    }
+
+    //! @brief      Get the capacity of the texture cache in megabytes.
+    //!
+    //! Texture tiles resident in memory will never take more memory than this.
+    //!
+    //! @return     Capacity of the texture cache in megabytes.
+    unsigned int    GetTextureCacheSize() const{
+        return m_textureCacheSize;
+    }
+
+    //! @brief      Get the storage mode of texels in the texture cache.
+    //!
+    //! LDR textures are always stored with 8 bits per channel unless full precision is requested, the mode mainly
+    //! decides the precision of HDR textures.
+    //!
+    //! @return     Storage mode of texels.
+    TEXTURE_STORAGE_MODE    GetTextureStorageMode() const{
+        return (TEXTURE_STORAGE_MODE)m_textureStorageMode;
+    }
+
     //! @brief      Parse command line.
     //!
     //! This is not a perfect way to parse command line arguments. If there is a space in the path,
@@ -218,6 +275,12 @@ public:
         stream >> m_samplePerPixel;
         stream >> m_resWidth >> m_resHeight;
         stream >> m_clampping;
+        stream >> m_adaptiveSampling >> m_adaptiveSamplePerPass >> m_adaptiveErrorThreshold >> m_adaptiveTimeBudget;
+        stream >> m_textureCacheSize >> m_textureStorageMode;
+        TextureCache::GetSingleton().SetCapacity( (size_t)std::max( 1u , m_textureCacheSize ) * 1024 * 1024 );
+        TextureCache::GetSingleton().SetStorageMode( GetTextureStorageMode() );
+        stream >> m_diskCachePath;
+        DiskCache::GetSingleton().SetDirectory( m_diskCachePath );
         StringID accelType , integratorType;
         stream >> accelType;
         m_accelerator = MakeUniqueInstance<Accelerator>(accelType);
@@ -230,10 +293,19 @@ public:
         if(IS_PTR_VALID(m_integrator))
             m_integrator->Serialize( stream );
 
+        // Integrators splatting radiance to arbitrary pixels can't tell how many samples each pixel takes.
+        if( m_adaptiveSampling && IS_PTR_VALID(m_integrator) && !m_integrator->SupportAdaptiveSampling() ){
+            slog( WARNING , GENERAL , "Adaptive sampling is not supported by the integrator, it is disabled." );
+            m_adaptiveSampling = false;
+        }
+        m_adaptiveSamplePerPass = std::max( 1u , std::min( m_adaptiveSamplePerPass , m_samplePerPixel ) );
+
         if( m_blenderMode )
-            m_imageSensor = std::make_unique<BlenderImage>( m_resWidth , m_resHeight );
+            m_imageSensor = std::make_unique<BlenderImage>( m_resWidth , m_resHeight , m_threadCnt );
         else
-            m_imageSensor = std::make_unique<RenderTargetImage>( m_resWidth , m_resHeight );
+            m_imageSensor = std::make_unique<RenderTargetImage>( m_resWidth , m_resHeight , m_threadCnt );
+        if( m_adaptiveSampling )
+            m_imageSensor->EnableAdaptiveSampling();
         m_imageSensor->PreProcess();
     };
 
@@ -256,6 +328,13 @@ private:
     bool                            m_noMaterialSupport = false;    /**< Disable material support in SORT. */
     std::string                     m_inputFile;                    /**< Full path of the input file. */
     float                           m_clampping = 0.0f;             /**< Clapping value of evaluated radiance. */
+    bool                            m_adaptiveSampling = false;     /**< Whether adaptive sampling is enabled. */
+    unsigned int                    m_adaptiveSamplePerPass = 4;    /**< Sample per pixel in each pass of adaptive sampling. */
+    float                           m_adaptiveErrorThreshold = 0.01f;   /**< Relative error threshold for a pixel to be converged. */
+    float                           m_adaptiveTimeBudget = 0.0f;    /**< Time budget of adaptive sampling in seconds, zero means no budget. */
+    unsigned int                    m_textureCacheSize = 1024;      /**< Capacity of the texture cache in megabytes. */
+    unsigned int                    m_textureStorageMode = TSM_HALF_PRECISION;  /**< Storage mode of texels in the texture cache. */
+    std::string                     m_diskCachePath;                /**< Directory of the disk cache, it is disabled if empty. */
 
     //! @brief  Make constructor private
     GlobalConfiguration(){}
@@ -282,4 +361,10 @@ private:
 #define g_imageSensor               GlobalConfiguration::GetSingleton().GetImageSensor()
 #define g_profilingEnabled          GlobalConfiguration::GetSingleton().GetIsProfilingEnabled()
 #define g_noMaterial                GlobalConfiguration::GetSingleton().GetNoMaterial()
-#define g_clammping                 GlobalConfiguration::GetSingleton().GetClampping()
\ No newline at end of file
+#define g_clammping                 GlobalConfiguration::GetSingleton().GetClampping()
+#define g_adaptiveSampling          GlobalConfiguration::GetSingleton().GetAdaptiveSampling()
+#define g_adaptiveSamplePerPass     GlobalConfiguration::GetSingleton().GetAdaptiveSamplePerPass()
+#define g_adaptiveErrorThreshold    GlobalConfiguration::GetSingleton().GetAdaptiveErrorThreshold()
+#define g_adaptiveTimeBudget        GlobalConfiguration::GetSingleton().GetAdaptiveTimeBudget()
+#define g_textureCacheSize          GlobalConfiguration::GetSingleton().GetTextureCacheSize()
+#define g_textureStorageMode        GlobalConfiguration::GetSingleton().GetTextureStorageMode()
\ No newline at end of file
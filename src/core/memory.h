@@ -88,15 +88,47 @@ private:
     std::list<std::unique_ptr<MemoryBlock>>  m_usedBlocks;
 };
 
-//! @brief Get static allocator.
+//! @brief Get the memory allocator that the current thread allocates memory from.
 //!
-//! @return Thread based memory allocator.
-SORT_FORCEINLINE ::MemoryAllocator& GetStaticAllocator() {
+//! @return Reference to the pointer of the memory allocator, it points to the thread based allocator by default.
+SORT_FORCEINLINE ::MemoryAllocator*& GetCurrentAllocator() {
     // Each thread has their own memory allocator.
     static thread_local ::MemoryAllocator memoryAllocator;
-    return memoryAllocator;
+    static thread_local ::MemoryAllocator* currentAllocator = &memoryAllocator;
+    return currentAllocator;
 }
 
+//! @brief Get static allocator.
+//!
+//! @return Thread based memory allocator, unless it is redirected by ScopedMemoryAllocator.
+SORT_FORCEINLINE ::MemoryAllocator& GetStaticAllocator() {
+    return *GetCurrentAllocator();
+}
+
+//! @brief  Redirect memory allocation of the current thread to another allocator during the life time of its instance.
+/**
+ * Memory allocated through the thread based allocator is recycled once a sample is done. This is for the rare cases
+ * where memory allocated through SORT_MALLOC needs to outlive that, like the bxdfs shared by all intersections of a
+ * material.
+ */
+class ScopedMemoryAllocator {
+public:
+    //! @brief  Constructor redirecting memory allocation.
+    //!
+    //! @param  allocator   The allocator to allocate memory from.
+    ScopedMemoryAllocator(::MemoryAllocator& allocator) : m_previous(GetCurrentAllocator()) {
+        GetCurrentAllocator() = &allocator;
+    }
+
+    //! @brief  Destructor restoring the previous allocator.
+    ~ScopedMemoryAllocator() {
+        GetCurrentAllocator() = m_previous;
+    }
+
+private:
+    ::MemoryAllocator*  m_previous;     /**< The allocator used before. */
+};
+
 #define SORT_MALLOC(T)              new (GetStaticAllocator().Allocate<T>()) T
 #define SORT_MALLOC_ARRAY(T,cnt)    new (GetStaticAllocator().Allocate<T>(cnt)) T
 #define SORT_CLEAR_MEMPOOL()        GetStaticAllocator().Reset()
@@ -15,12 +15,17 @@
     this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
  */
 
+#include <string.h>
+#include <climits>
+#include <algorithm>
 #include "mesh.h"
 #include "entity/visual.h"
 #include "stream/stream.h"
 #include "material/matmanager.h"
 #include "entity/entity.h"
 #include "stream/stream.h"
+#include "stream/hstream.h"
+#include "core/diskcache.h"
 #include "scatteringevent/bsdf/bxdf_utils.h"
 
 void Mesh::ApplyTransform( const Transform& transform ){
@@ -74,6 +79,33 @@ void Mesh::GenUV(){
     }
 }
 
+void Mesh::Prepare( const Transform& transform ){
+    auto& cache = DiskCache::GetSingleton();
+
+    // render-ready vertices are identified by the raw chunks of the mesh and the transform.
+    OHashStream hash( m_contentHash );
+    hash << transform;
+    const auto key = hash.GetHash();
+
+    if( cache.IsEnabled() ){
+        const auto stream = cache.Load( "mesh" , key );
+
+        std::vector<MeshVertex> vertices;
+        if( stream && SerializeBuffer( *stream , vertices ) && vertices.size() == m_vertices.size() ){
+            m_vertices = std::move( vertices );
+            m_world2Volume = m_local2Volume * transform.invMatrix;
+            return;
+        }
+    }
+
+    ApplyTransform( transform );
+    GenUV();
+    GenSmoothTagent();
+
+    if( cache.IsEnabled() )
+        cache.Save( "mesh" , key , *this );
+}
+
 Vector Mesh::genTagentForTri( const MeshFaceIndex& mi ) const{
     const auto& _v0 = m_vertices[mi.m_id[0]];
     const auto& _v1 = m_vertices[mi.m_id[1]];
@@ -108,24 +140,94 @@ Vector Mesh::genTagentForTri( const MeshFaceIndex& mi ) const{
     return ( dv2 * dp1 - dv1 * dp2 ) / determinant;
 }
 
+// Load a whole chunk of the mesh from stream.
+// Streams with all data in memory expose the chunk directly, otherwise it is loaded into the buffer in one go.
+static const char* loadChunk(IStreamBase& stream, size_t size, std::unique_ptr<char[]>& buffer) {
+    if (const auto data = stream.Map(size))
+        return data;
+
+    buffer = std::make_unique<char[]>(size);
+
+    // big meshes could take more bytes than what 'Load' can take in one call.
+    auto data = buffer.get();
+    while (size > 0) {
+        const auto chunk = std::min(size, (size_t)INT_MAX);
+        stream.Load(data, (int)chunk);
+        data += chunk;
+        size -= chunk;
+    }
+    return buffer.get();
+}
+
+// Hash a whole chunk of the mesh, the same way it is loaded in pieces that 'Write' can take in one call.
+static void hashChunk(OHashStream& hash, const char* data, size_t size) {
+    while (size > 0) {
+        const auto chunk = std::min(size, (size_t)INT_MAX);
+        hash.Write((char*)data, (int)chunk);
+        data += chunk;
+        size -= chunk;
+    }
+}
+
 void Mesh::Serialize(IStreamBase& stream) {
     stream >> m_hasUV;
-    unsigned int vb_cnt, ib_cnt;
-    stream >> vb_cnt;
+
+    // the raw chunks are what identifies the mesh in the disk cache, there is no need to hash them without the cache.
+    const auto hashing = DiskCache::GetSingleton().IsEnabled();
+    OHashStream hash;
+    hash << m_hasUV;
+
+    unsigned int version = 0;
+    stream >> version;
+    sAssertMsg(MESH_CHUNK_VERSION == version, STREAM, "Incompatible mesh chunk version %d.", version);
+
+    // vertex chunk, the stride is there so that the layout could be extended without breaking the reading code.
+    unsigned int vb_cnt = 0, vb_stride = 0;
+    stream >> vb_cnt >> vb_stride;
+    sAssertMsg(sizeof(MeshVertexChunk) == vb_stride, STREAM, "Unexpected vertex stride %d.", vb_stride);
+
+    std::unique_ptr<char[]> buffer;
+    const auto vertices = loadChunk(stream, (size_t)vb_cnt * vb_stride, buffer);
+    if (hashing) {
+        hash << vb_cnt;
+        hashChunk(hash, vertices, (size_t)vb_cnt * vb_stride);
+    }
     m_vertices.resize(vb_cnt);
-    for (MeshVertex& mv : m_vertices)
-        stream >> mv.m_position >> mv.m_normal >> mv.m_texCoord;
+    for (auto i = 0u; i < vb_cnt; ++i) {
+        // the chunk could be anywhere in the stream, there is no guarantee on alignment.
+        MeshVertexChunk vc;
+        memcpy(&vc, vertices + (size_t)i * vb_stride, sizeof(vc));
+
+        auto& mv = m_vertices[i];
+        mv.m_position = Point(vc.m_position[0], vc.m_position[1], vc.m_position[2]);
+        mv.m_normal = Vector(vc.m_normal[0], vc.m_normal[1], vc.m_normal[2]);
+        mv.m_texCoord = Vector2f(vc.m_texCoord[0], vc.m_texCoord[1]);
+    }
 
     // mapping from original material to material proxy
     std::unordered_map<const MaterialBase*, const MaterialBase*> mapping;
 
-    stream >> ib_cnt;
+    // index chunk
+    unsigned int ib_cnt = 0, ib_stride = 0;
+    stream >> ib_cnt >> ib_stride;
+    sAssertMsg(sizeof(MeshFaceChunk) == ib_stride, STREAM, "Unexpected index stride %d.", ib_stride);
+
+    const auto indices = loadChunk(stream, (size_t)ib_cnt * ib_stride, buffer);
+    if (hashing) {
+        hash << ib_cnt;
+        hashChunk(hash, indices, (size_t)ib_cnt * ib_stride);
+        m_contentHash = hash.GetHash();
+    }
     m_indices.resize(ib_cnt);
-    for (auto& mi : m_indices) {
-        stream >> mi.m_id[0] >> mi.m_id[1] >> mi.m_id[2];
-        int mat_id = -1;
-        stream >> mat_id;
-        mi.m_mat = MatManager::GetSingleton().GetMaterial(mat_id);
+    for (auto i = 0u; i < ib_cnt; ++i) {
+        MeshFaceChunk fc;
+        memcpy(&fc, indices + (size_t)i * ib_stride, sizeof(fc));
+
+        auto& mi = m_indices[i];
+        mi.m_id[0] = fc.m_id[0];
+        mi.m_id[1] = fc.m_id[1];
+        mi.m_id[2] = fc.m_id[2];
+        mi.m_mat = MatManager::GetSingleton().GetMaterial(fc.m_matId);
 
         // If there is SSS in the material or volume is attached to the material, it is necessary to create a material proxy to
         // prevent the same material used in multiple places being recognized as the same one.
@@ -177,6 +279,10 @@ void Mesh::Serialize(IStreamBase& stream) {
     sAssert(eom_sid == end_of_mesh, GENERAL);
 }
 
+void Mesh::Serialize(OStreamBase& stream) {
+    SerializeBuffer(stream, m_vertices);
+}
+
 float Mesh::SampleVolumeDensity(const Point& pos) const {
     if (IS_PTR_INVALID(m_volumeDensity))
         return 0.0f;
@@ -189,4 +295,27 @@ Spectrum Mesh::SampleVolumeColor(const Point& pos) const {
         return 0.0f;
     const auto uvw = m_world2Volume.TransformPoint(pos);
     return m_volumeColor->Sample(uvw);
+}
+
+const MajorantGrid* Mesh::GetMajorantGrid(const MaterialBase* material) const {
+    const auto* grid = m_lastMajorantGrid.load(std::memory_order_acquire);
+    if (IS_PTR_VALID(grid) && grid->GetMaterial() == material)
+        return grid;
+
+    std::lock_guard<std::mutex> lock(m_majorantMutex);
+    grid = nullptr;
+    for (const auto& majorant_grid : m_majorantGrids) {
+        if (majorant_grid->GetMaterial() == material) {
+            grid = majorant_grid.get();
+            break;
+        }
+    }
+
+    if (IS_PTR_INVALID(grid)) {
+        m_majorantGrids.push_back(std::make_unique<MajorantGrid>(m_volumeDensity.get(), m_world2Volume, material));
+        grid = m_majorantGrids.back().get();
+    }
+
+    m_lastMajorantGrid.store(grid, std::memory_order_release);
+    return grid;
 }
\ No newline at end of file
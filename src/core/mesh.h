@@ -20,11 +20,15 @@
 #include "core/define.h"
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
 #include "math/point.h"
 #include "math/vector3.h"
 #include "math/transform.h"
 #include "stream/stream.h"
 #include "medium/mediumdata.h"
+#include "medium/majorantgrid.h"
 
 class MaterialBase;
 
@@ -42,6 +46,24 @@ struct MeshFaceIndex {
     const MaterialBase*     m_mat = nullptr;    /**< Materials attached to the triangle. */
 };
 
+//! @brief  Version of the mesh chunk layout in the stream, this needs to be updated every time the layout changes.
+constexpr unsigned int MESH_CHUNK_VERSION = 1;
+
+//! @brief  Layout of a vertex in the vertex chunk of a mesh in the stream.
+struct MeshVertexChunk {
+    float       m_position[3];  /**< Position of the vertex in local space. */
+    float       m_normal[3];    /**< Normal of the vertex in local space. */
+    float       m_texCoord[2];  /**< Texture coordinate of the vertex. */
+};
+static_assert( sizeof( MeshVertexChunk ) == 32 , "Vertex layout doesn't match the one in the stream." );
+
+//! @brief  Layout of a triangle in the index chunk of a mesh in the stream.
+struct MeshFaceChunk {
+    int         m_id[3];        /**< Indices of the three vertices. */
+    int         m_matId;        /**< Index of the material, -1 for the default one. */
+};
+static_assert( sizeof( MeshFaceChunk ) == 16 , "Index layout doesn't match the one in the stream." );
+
 //! @brief  A wrapper for mesh information.
 //!
 //! Instead of using obj style memory layout, an approach that is similar to vertex buffer and index buffer
@@ -68,12 +90,34 @@ public:
     //! @brief      Generate tangent for the triangle mesh.
     void    GenSmoothTagent();
 
+    //! @brief      Get the mesh ready for rendering.
+    //!
+    //! Vertices are transformed to world space, UV and tangents are generated for them. Since the result only depends
+    //! on the data of the mesh and the transform, it is loaded from the disk cache instead if it is there.
+    //!
+    //! @param  transform   Transform from local space to world space.
+    void    Prepare( const Transform& transform );
+
     //! @brief      Serializing data from stream.
     //!
     //! @param      Stream where the serialization data comes from. Depending on different situation,
     //!             it could come from different places.
     void    Serialize( IStreamBase& stream ) override;
 
+    //! @brief      Serializing render-ready vertices to stream.
+    //!
+    //! Only the vertices are streamed out, this is what the disk cache keeps for the mesh.
+    //!
+    //! @param      Stream where the serialization data goes to.
+    void    Serialize( OStreamBase& stream ) override;
+
+    //! @brief      Get the hash of the vertex and index chunks loaded from stream.
+    //!
+    //! It identifies the mesh before it is transformed, it is only evaluated if the disk cache is enabled.
+    //!
+    //! @return     Hash of the content of the mesh.
+    std::uint64_t   GetContentHash() const { return m_contentHash; }
+
     //! @brief      Sample volume density
     //!
     //! For meshes that don't have volume inside, this function should not even be called.
@@ -89,6 +133,15 @@ public:
     //! @return         The color of the volume.
     Spectrum    SampleVolumeColor(const Point& pos) const;
 
+    //! @brief      Get the majorant grid of the volume inside the mesh.
+    //!
+    //! Since extinction is driven by the volume shader, the majorant grid is built the first time it is
+    //! requested for a material and reused afterward.
+    //!
+    //! @param  material    Material that drives the extinction of the volume.
+    //! @return             The majorant grid of the volume for the material.
+    const MajorantGrid* GetMajorantGrid(const MaterialBase* material) const;
+
 private:
     //! @brief      Generate tangent for the triangles.
     //!
@@ -106,8 +159,18 @@ private:
     /**< Whether the world2localvolume matrix is cached or not. */
     mutable bool    m_w2lvCached = false;
 
+    /**< Hash of the vertex and index chunks loaded from stream, it is only evaluated if the disk cache is enabled. */
+    std::uint64_t   m_contentHash = 0;
+
     /**< The density of volume data insize this mesh. */
     std::unique_ptr<MediumDensity>  m_volumeDensity;
     /**< The color of the volume data inside this mesh. */
     std::unique_ptr<MediumColor>    m_volumeColor;
+
+    /**< Majorant grids of the volume, one for each material attached to the volume. */
+    mutable std::vector<std::unique_ptr<MajorantGrid>>  m_majorantGrids;
+    /**< The most recently used majorant grid, which avoids locking in the common case. */
+    mutable std::atomic<const MajorantGrid*>            m_lastMajorantGrid = { nullptr };
+    /**< Mutex protecting building majorant grids. */
+    mutable std::mutex                                  m_majorantMutex;
 };
\ No newline at end of file
@@ -26,6 +26,9 @@
 class Light;
 class Mesh;
 
+// Accelerators referring primitives by their indices mark empty slots with it.
+#define INVALID_PRIMITIVE_ID    0xFFFFFFFFu
+
 //! @brief  Primitive of SORT world.
 /**
  * Like primitives in rasterization program, which are usually triangle, point and lines, primitives can have many more different shapes.
@@ -42,7 +45,7 @@ public:
     //! @param  shape   Shape of the material.
     //! @param  light   Light source attached to the material.
     Primitive(const Mesh* mesh, const MaterialBase* mat , const Shape* shape , class Light* light = nullptr ):
-        m_mesh(mesh), m_mat(mat), m_shape(shape), m_light(light){}
+        m_mesh(mesh), m_mat(mat), m_shape(shape), m_light(light), m_isInstance(SHAPE_INSTANCE == shape->GetShapeType()){}
 
     //! @brief  Get the intersection between a ray and the primitive.
     //!
@@ -53,7 +56,14 @@ public:
     SORT_FORCEINLINE bool GetIntersect( const Ray& r , SurfaceInteraction* intersect ) const{
         auto ret = m_shape->GetIntersect( r , intersect );
         if( ret && intersect ){
-            intersect->primitive = this;
+            // An instance reports the primitive it hits inside itself, the only exception is an opaque hit found by a shadow
+            // ray, which comes without any detail. The instance itself, with no material attached, stands for it then.
+            if( !m_isInstance ){
+                intersect->primitive = this;
+                intersect->instance = nullptr;
+            }else if( IS_PTR_INVALID(intersect->primitive) ){
+                intersect->primitive = this;
+            }
             return true;
         }
         return ret;
@@ -131,4 +141,5 @@ private:
     const Shape*            m_shape;    /**< The shape of the primitive. */
     class Light*            m_light;    /**< Light source attached to the primitive. */
     const Mesh*             m_mesh;     /**< The mesh that owns this primitive. */
+    bool                    m_isInstance;   /**< Whether the shape is an instance of other primitives. */
 };
\ No newline at end of file
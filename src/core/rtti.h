@@ -108,3 +108,21 @@ std::unique_ptr<T> MakeUniqueInstance( const StringID sid ) {
     std::unique_ptr<B> CreateUniqueInstance() const { return std::make_unique<T>(); }\
 };\
 inline static T::T##FactoryMethod g_factoryMethod##T;
+
+// Same as DEFINE_RTTI, except that instances are created by 'creator', a function returning an unique pointer of the
+// base class. This is for classes with multiple implementations where the best one is picked at runtime.
+#define DEFINE_RTTI_CREATOR( T , B , creator )     class T##FactoryMethod : public FactoryMethod<B>\
+{public: \
+    T##FactoryMethod(){\
+        StringID sid(#T);\
+        auto& factoryMap = Factory<B>::GetSingleton().GetFactoryMap();\
+        if( factoryMap.count(sid) ){\
+            slog( WARNING , GENERAL , "The class with specific name of %s already exxisted." , #T );\
+            return;\
+        }\
+        factoryMap[sid] = this;\
+    }\
+    std::shared_ptr<B> CreateSharedInstance() const { return std::shared_ptr<B>( creator() ); }\
+    std::unique_ptr<B> CreateUniqueInstance() const { return creator(); }\
+};\
+inline static T::T##FactoryMethod g_factoryMethod##T;
@@ -125,12 +125,178 @@ SORT_FORCEINLINE float UniformSpherePdf(){
     return INV_TWOPI * 0.5f;
 }
 
+// solid angle of a spherical triangle, the algorithm comes from Van Oosterom and Strackee
+// para 'a' : the first vertex of the triangle on unit sphere
+// para 'b' : the second vertex of the triangle on unit sphere
+// para 'c' : the third vertex of the triangle on unit sphere
+SORT_FORCEINLINE float SphericalTriangleArea( const Vector& a , const Vector& b , const Vector& c ){
+    return fabs( 2.0f * atan2( dot( a , cross( b , c ) ) , 1.0f + dot( a , b ) + dot( a , c ) + dot( b , c ) ) );
+}
+
+// sampling a vector in a spherical triangle uniformly, the algorithm comes from Arvo's paper
+// 'Stratified Sampling of Spherical Triangles'
+// para 'a' : the first vertex of the triangle on unit sphere
+// para 'b' : the second vertex of the triangle on unit sphere
+// para 'c' : the third vertex of the triangle on unit sphere
+// para 'u' : a canonical random variable
+// para 'v' : a canonical random variable
+// para 'pdf' : pdf w.r.t solid angle of the sample, zero for degenerated triangles
+SORT_FORCEINLINE Vector UniformSampleSphericalTriangle( const Vector& a , const Vector& b , const Vector& c , float u , float v , float* pdf ){
+    if( pdf ) *pdf = 0.0f;
+
+    // normals of the planes containing the great arcs
+    auto n_ab = cross( a , b );
+    auto n_bc = cross( b , c );
+    auto n_ca = cross( c , a );
+    if( n_ab.SquaredLength() == 0.0f || n_bc.SquaredLength() == 0.0f || n_ca.SquaredLength() == 0.0f )
+        return Vector();
+    n_ab = normalize( n_ab );
+    n_bc = normalize( n_bc );
+    n_ca = normalize( n_ca );
+
+    // interior angles of the spherical triangle
+    const auto alpha = acos( clamp( -dot( n_ab , n_ca ) , -1.0f , 1.0f ) );
+    const auto beta = acos( clamp( -dot( n_bc , n_ab ) , -1.0f , 1.0f ) );
+    const auto gamma = acos( clamp( -dot( n_ca , n_bc ) , -1.0f , 1.0f ) );
+
+    const auto area = alpha + beta + gamma - PI;
+    if( area <= 0.0f )
+        return Vector();
+    if( pdf ) *pdf = 1.0f / area;
+
+    // pick the sub-triangle with the area proportional to the first canonical number
+    const auto area_s = u * area;
+    const auto sin_s = sin( area_s - alpha );
+    const auto cos_s = cos( area_s - alpha );
+    const auto sin_alpha = sin( alpha );
+    const auto cos_alpha = cos( alpha );
+    const auto k1 = cos_s - cos_alpha;
+    const auto k2 = sin_s + sin_alpha * dot( a , b );
+    const auto denom = ( k2 * sin_s + k1 * cos_s ) * sin_alpha;
+    const auto cos_bs = denom != 0.0f ? clamp( ( ( k2 * cos_s - k1 * sin_s ) * cos_alpha - k2 ) / denom , -1.0f , 1.0f ) : 1.0f;
+    const auto sin_bs = ssqrt( 1.0f - SQR( cos_bs ) );
+
+    // the third vertex of the sub-triangle on the great arc between 'a' and 'c'
+    const auto c_perp = c - dot( c , a ) * a;
+    const auto cs = cos_bs * a + sin_bs * ( c_perp.SquaredLength() > 0.0f ? normalize( c_perp ) : Vector() );
+
+    // pick a point on the arc between 'b' and the third vertex of the sub-triangle
+    const auto cos_theta = 1.0f - v * ( 1.0f - dot( cs , b ) );
+    const auto sin_theta = ssqrt( 1.0f - SQR( cos_theta ) );
+    const auto cs_perp = cs - dot( cs , b ) * b;
+    return cos_theta * b + sin_theta * ( cs_perp.SquaredLength() > 0.0f ? normalize( cs_perp ) : Vector() );
+}
+
+// alias table, it takes a discrete sample in constant time, the construction follows Vose's method
+class AliasTable{
+public:
+    // constructor
+    // para 'f' : weights of the buckets, they don't need to be normalized
+    // para 'n' : number of buckets
+    AliasTable( const float* f , unsigned n ){
+        m_sum = 0.0f;
+        if( f == 0 || n == 0 )
+            return;
+
+        m_bins.resize( n );
+        for( unsigned i = 0 ; i < n ; ++i )
+            m_sum += f[i];
+
+        for( unsigned i = 0 ; i < n ; ++i )
+            m_bins[i].pmf = ( m_sum != 0.0f ) ? f[i] / m_sum : 1.0f / (float)n;
+
+        // scaled probabilities are split into buckets that are under-full and over-full
+        std::vector<unsigned> under, over;
+        std::vector<double> p( n );
+        for( unsigned i = 0 ; i < n ; ++i ){
+            p[i] = (double)m_bins[i].pmf * n;
+            ( p[i] < 1.0 ? under : over ).push_back( i );
+        }
+
+        // fill each under-full bucket with the excess of an over-full one
+        while( !under.empty() && !over.empty() ){
+            const auto u = under.back();
+            const auto o = over.back();
+            under.pop_back();
+            over.pop_back();
+
+            m_bins[u].q = (float)p[u];
+            m_bins[u].alias = o;
+
+            p[o] -= 1.0 - p[u];
+            ( p[o] < 1.0 ? under : over ).push_back( o );
+        }
+
+        // the rest of the buckets are full, up to numerical error
+        for( const auto i : under ){
+            m_bins[i].q = 1.0f;
+            m_bins[i].alias = i;
+        }
+        for( const auto i : over ){
+            m_bins[i].q = 1.0f;
+            m_bins[i].alias = i;
+        }
+    }
+
+    // get a discrete sample
+    // para 'u' : a canonical random variable
+    // para 'pmf' : probability of picking the bucket
+    // para 'remapped' : a new canonical random variable remapped from the unused part of 'u', it can be used for further sampling
+    // result   : index of the picked bucket, -1 if there is no data in the table
+    int Sample( float u , float* pmf , float* remapped = nullptr ) const{
+        sAssert( u <= 1.0f && u >= 0.0f , SAMPLING );
+        if( m_bins.empty() ){
+            if( pmf ) *pmf = 0.0f;
+            return -1;
+        }
+
+        const auto n = (unsigned)m_bins.size();
+        const auto scaled = u * n;
+        const auto i = std::min( (unsigned)scaled , n - 1 );
+        const auto du = scaled - i;
+        const auto q = m_bins[i].q;
+        const auto offset = ( du < q ) ? i : m_bins[i].alias;
+        if( pmf )
+            *pmf = m_bins[offset].pmf;
+        if( remapped )
+            *remapped = std::min( ( du < q ) ? du / q : ( du - q ) / ( 1.0f - q ) , 0x1.fffffep-1f );
+        return (int)offset;
+    }
+
+    // get the sum of the original data
+    float GetSum() const{
+        return m_sum;
+    }
+
+    // get the count
+    unsigned GetCount() const{
+        return (unsigned)m_bins.size();
+    }
+
+    // get property of the unit
+    float GetProperty( unsigned i ) const{
+        sAssert( i < m_bins.size() , GENERAL );
+        return m_bins[i].pmf;
+    }
+
+private:
+    // a bucket in the alias table
+    struct Bin{
+        float       q = 0.0f;       // the probability of picking the bucket itself instead of its alias
+        float       pmf = 0.0f;     // the probability of the bucket in the original distribution
+        unsigned    alias = 0;      // the alias of the bucket
+    };
+
+    std::vector<Bin>    m_bins;
+    float               m_sum;
+};
+
 // one dimensional distribution
 class Distribution1D{
 public:
     // constructor
     Distribution1D( const float* f , unsigned n ):
-        count(n)
+        count(n), alias(f, n)
     {
         cdf = 0;
         sum = 0.0f;
@@ -201,6 +367,29 @@ public:
         return ( du + (float)offset ) / (float)count;
     }
 
+    // get a discrete sample through the alias table, it takes constant time while the pdf is the same with 'SampleDiscrete'
+    // the mapping from 'u' to the buckets is not monotonic though, stratification of 'u' is partially lost.
+    // para 'u' : a canonical random variable
+    // para 'pdf' : probability density function value for the sample
+    // result   : corresponding bucket, -1 if there is no data in the distribution
+    int SampleDiscreteAlias( float u , float* pdf ) const{
+        sAssert( count != 0 && cdf != 0 , SAMPLING );
+        return alias.Sample( u , pdf );
+    }
+
+    // get a continuous sample through the alias table, it takes constant time while the pdf is the same with 'SampleContinuous'
+    // para 'u' : a canonical random variable
+    // para 'pdf' : property density function value for the sample
+    float SampleContinuousAlias( float u , float* pdf ) const{
+        sAssert( count != 0 && cdf != 0 , SAMPLING );
+
+        float pmf , du;
+        const auto offset = alias.Sample( u , &pmf , &du );
+        if( pdf )
+            *pdf = pmf * count;
+        return ( du + (float)offset ) / (float)count;
+    }
+
     // get the sum of the original data
     float GetSum() const{
         return sum;
@@ -221,6 +410,7 @@ private:
     const unsigned              count;
     std::unique_ptr<float[]>    cdf;
     float                       sum;
+    AliasTable                  alias;
 };
 
 // two dimensional distribution
@@ -256,6 +446,18 @@ public:
         if( pdf )
             *pdf = pdf0 * pdf1;
     }
+    // get a sample point through alias tables, the pdf is the same with 'SampleContinuous'
+    void SampleContinuousAlias( float u , float v , float uv[2] , float* pdf ) const{
+        float pdf0 , pdf1;
+        uv[1] = marginal->SampleContinuousAlias( v , &pdf1 );
+        int vi = (int)(uv[1] * m_nv);
+        if( vi > (int)(m_nv - 1) )
+            vi = (int)(m_nv - 1);
+        uv[0] = pConditions[vi]->SampleContinuousAlias( u , &pdf0 );
+
+        if( pdf )
+            *pdf = pdf0 * pdf1;
+    }
     // get pdf
     float Pdf( float u , float v ) const{
         u = clamp( u , 0.0f , 1.0f );
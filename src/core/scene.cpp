@@ -16,6 +16,7 @@
  */
 
 #include <memory>
+#include <algorithm>
 #include "scene.h"
 #include "math/interaction.h"
 #include "accel/accelerator.h"
@@ -30,15 +31,18 @@
 #include "core/primitive.h"
 #include "entity/visual_entity.h"
 #include "entity/visual.h"
-#include "stream/fstream.h"
+#include "stream/mmapstream.h"
+#include "task/task.h"
 #include "light/light.h"
 #include "shape/shape.h"
 
 SORT_STATS_DEFINE_COUNTER(sScenePrimitiveCount)
 SORT_STATS_DEFINE_COUNTER(sSceneLightCount)
+SORT_STATS_DEFINE_COUNTER(sSceneEntityCount)
 
 SORT_STATS_COUNTER("Statistics", "Total Primitive Count", sScenePrimitiveCount);
 SORT_STATS_COUNTER("Statistics", "Total Light Count", sSceneLightCount);
+SORT_STATS_COUNTER("Statistics", "Total Entity Count", sSceneEntityCount);
 
 bool Scene::LoadScene( IStreamBase& stream ){
     const StringID verificationBit( "verification bits" );
@@ -47,6 +51,14 @@ bool Scene::LoadScene( IStreamBase& stream ){
     stream >> checkingBit;
     sAssertMsg( checkingBit == verificationBit , RESOURCE , "Serialization is broken." );
 
+    unsigned int version = 0;
+    stream >> version;
+    sAssertMsg( SCENE_FORMAT_VERSION == version , RESOURCE , "Incompatible scene format version %d." , version );
+
+    // Build the offset table of all entities first, the data of each entity is either accessed in place, if the stream
+    // supports it, or copied out of the stream.
+    std::vector<IMemoryViewStream>          views;
+    std::vector<std::unique_ptr<char[]>>    buffers;
     while( true ){
         StringID class_id;
         stream >> class_id;
@@ -56,16 +68,45 @@ bool Scene::LoadScene( IStreamBase& stream ){
         auto entity = MakeUniqueInstance<Entity>( class_id );
         sAssertMsg( entity , RESOURCE , "Serialization is broken." );
 
-        entity->Serialize(stream);
+        unsigned int size = 0;
+        stream >> size;
+
+        auto data = stream.Map( size );
+        if( IS_PTR_INVALID(data) ){
+            buffers.push_back( std::make_unique<char[]>( size ) );
+            stream.Load( buffers.back().get() , size );
+            data = buffers.back().get();
+        }
+
+        views.emplace_back( data , size );
         m_entities.push_back(std::move(entity));
     }
 
+    // Deserialize all entities in parallel. Big meshes take most of the loading time, they get higher priority so that
+    // they won't be the last ones to start.
+    std::vector<unsigned int> order( m_entities.size() );
+    for( auto i = 0u ; i < order.size() ; ++i )
+        order[i] = i;
+    std::stable_sort( order.begin() , order.end() , [&]( unsigned int i0 , unsigned int i1 ){
+        return views[i0].Size() > views[i1].Size();
+    });
+
+    TaskGroup task_group;
+    for( auto k = 0u ; k < order.size() ; ++k ){
+        auto& entity = m_entities[order[k]];
+        auto& view = views[order[k]];
+        const auto priority = DEFAULT_TASK_PRIORITY + (unsigned int)( order.size() - k );
+        task_group.Fork( [&entity, &view](){ entity->Serialize( view ); } , "Load Entity" , priority );
+    }
+    task_group.Wait();
+
     // generate triangle buffer after parsing from stream
     generatePriBuf();
     genLightDistribution();
 
     SORT_STATS(sScenePrimitiveCount=(StatsInt)m_primitives.size());
     SORT_STATS(sSceneLightCount=(StatsInt)m_lights.size());
+    SORT_STATS(sSceneEntityCount=(StatsInt)m_entities.size());
 
     return true;
 }
@@ -75,6 +116,16 @@ bool Scene::GetIntersect( const Ray& r , SurfaceInteraction& intersect ) const{
     return g_accelerator->GetIntersect( r , intersect );
 }
 
+void Scene::IntersectStream( const Ray* rays , SurfaceInteraction* intersects , unsigned cnt ) const{
+    for( auto i = 0u ; i < cnt ; ++i )
+        intersects[i].t = FLT_MAX;
+    g_accelerator->IntersectStream( rays , intersects , cnt );
+}
+
+void Scene::OccludedStream( const Ray* rays , bool* occluded , unsigned cnt ) const{
+    g_accelerator->OccludedStream( rays , occluded , cnt );
+}
+
 #ifndef ENABLE_TRANSPARENT_SHADOW
 bool Scene::IsOccluded(const Ray& r) const{
     return g_accelerator->IsOccluded(r);
@@ -157,6 +208,23 @@ void Scene::genLightDistribution(){
         m_lights[i]->SetPickPDF( pdf[i] / total_pdf );
 
     m_lightsDis = std::make_unique<Distribution1D>( pdf.get() , count );
+
+    // lights with bounds go to the light BVH, which picks lights given a shading point
+    m_bvhLights.clear();
+    m_unboundedLights.clear();
+    m_lightBVHIndices.clear();
+    std::vector<LightBounds> bounds;
+    for( const auto light : m_lights ){
+        LightBounds light_bounds;
+        if( light->GetBounds( light_bounds ) ){
+            m_lightBVHIndices[light] = (unsigned)m_bvhLights.size();
+            m_bvhLights.push_back( light );
+            bounds.push_back( light_bounds );
+        }else{
+            m_unboundedLights.push_back( light );
+        }
+    }
+    m_lightBVH.Build( bounds );
 }
 
 const Light* Scene::SampleLight( float u , float* pdf ) const{
@@ -164,7 +232,7 @@ const Light* Scene::SampleLight( float u , float* pdf ) const{
     sAssertMsg(IS_PTR_VALID(m_lightsDis), SAMPLING , "No light in the scene." );
 
     float _pdf;
-    int id = m_lightsDis->SampleDiscrete( u , &_pdf );
+    int id = m_lightsDis->SampleDiscreteAlias( u , &_pdf );
     if( id >= 0 && id < (int)m_lights.size() && _pdf != 0.0f ){
         if( pdf ) *pdf = _pdf;
         return m_lights[id];
@@ -177,6 +245,48 @@ float Scene::LightProperbility( unsigned i ) const{
     return m_lightsDis->GetProperty( i );
 }
 
+const Light* Scene::SampleLight( const Point& p , const Vector& n , float u , float* pdf ) const{
+    sAssert( u >= 0.0f && u <= 1.0f , SAMPLING );
+
+    if( pdf )
+        *pdf = 0.0f;
+
+    // the light BVH is treated as one light when picking between it and unbounded lights
+    const auto unbounded_cnt = (unsigned)m_unboundedLights.size();
+    const auto candidate_cnt = unbounded_cnt + ( m_lightBVH.IsEmpty() ? 0 : 1 );
+    if( 0 == candidate_cnt )
+        return nullptr;
+
+    const auto unbounded_prob = (float)unbounded_cnt / (float)candidate_cnt;
+    if( u < unbounded_prob ){
+        const auto id = std::min( (unsigned)( u * candidate_cnt ) , unbounded_cnt - 1 );
+        if( pdf )
+            *pdf = 1.0f / (float)candidate_cnt;
+        return m_unboundedLights[id];
+    }
+
+    const auto remapped_u = std::min( ( u - unbounded_prob ) / ( 1.0f - unbounded_prob ) , 0x1.fffffep-1f );
+    auto pmf = 0.0f;
+    const auto id = m_lightBVH.Sample( p , n , remapped_u , &pmf );
+    if( id < 0 )
+        return nullptr;
+
+    if( pdf )
+        *pdf = pmf / (float)candidate_cnt;
+    return m_bvhLights[id];
+}
+
+float Scene::LightProperbility( const Point& p , const Vector& n , const Light* light ) const{
+    const auto candidate_cnt = (unsigned)m_unboundedLights.size() + ( m_lightBVH.IsEmpty() ? 0 : 1 );
+    if( 0 == candidate_cnt )
+        return 0.0f;
+
+    const auto it = m_lightBVHIndices.find( light );
+    if( it == m_lightBVHIndices.end() )
+        return std::find( m_unboundedLights.begin() , m_unboundedLights.end() , light ) != m_unboundedLights.end() ? 1.0f / (float)candidate_cnt : 0.0f;
+    return m_lightBVH.Pmf( p , n , it->second ) / (float)candidate_cnt;
+}
+
 Spectrum Scene::Le( const Ray& ray ) const{
     if( m_skyLight ){
         Spectrum r;
@@ -186,6 +296,15 @@ Spectrum Scene::Le( const Ray& ray ) const{
     return 0.0f;
 }
 
+void Scene::LeStream( const Ray* rays , unsigned cnt , Spectrum* radiance ) const{
+    if( m_skyLight ){
+        m_skyLight->LeStream( rays , cnt , radiance );
+        return;
+    }
+    for( auto i = 0u ; i < cnt ; ++i )
+        radiance[i] = 0.0f;
+}
+
 void Scene::AddLight( Light* light ){
     if( light ){
         m_lights.push_back( light );
@@ -19,6 +19,7 @@
 
 #include "core/define.h"
 #include <vector>
+#include <unordered_map>
 #include "core/sassert.h"
 #include "math/bbox.h"
 #include "spectrum/spectrum.h"
@@ -28,10 +29,14 @@
 #include "entity/entity.h"
 #include "core/primitive.h"
 #include "core/samplemethod.h"
+#include "light/lightbvh.h"
 
 class Light;
 struct BSSRDFIntersections;
 
+//! @brief  Version of the scene layout in the stream, this needs to be updated every time the layout changes.
+constexpr unsigned int SCENE_FORMAT_VERSION = 2;
+
 //! @brief  Data structure representing the whole scene.
 /**
  * Scene is responsible for maintaining all of the lifetime of its own data structure.
@@ -40,6 +45,10 @@ class   Scene{
 public:
     //! @brief Serialize scene from stream.
     //!
+    //! Every entity in the stream is prefixed with the size of its data. Entities don't depend on each other during
+    //! deserialization, they are loaded in parallel, including the transformation and tangent generation of meshes.
+    //! Entities are still added to the scene in the order they appear in the stream.
+    //!
     //! @param  stream      The streaming source where scene information is loaded from.
     //! @return             Whether the scene is loaded correctly.
     bool    LoadScene( class IStreamBase& stream );
@@ -52,6 +61,20 @@ public:
     //! @return             Whether there is an intersection between the ray and the scene.
     bool    GetIntersect( const Ray& r , SurfaceInteraction& intersect ) const;
 
+    //! @brief  Find the first intersections between a stream of rays and the whole scene.
+    //!
+    //! @param  rays        The rays to be tested.
+    //! @param  intersects  The intersection results, one for each ray. A ray hits the scene if its primitive is valid.
+    //! @param  cnt         The number of rays in the stream.
+    void    IntersectStream( const Ray* rays , SurfaceInteraction* intersects , unsigned cnt ) const;
+
+    //! @brief  Check whether each ray in a stream is occluded by anything in the scene, transparency is not considered.
+    //!
+    //! @param  rays        The rays to be tested.
+    //! @param  occluded    Whether each ray is occluded.
+    //! @param  cnt         The number of rays in the stream.
+    void    OccludedStream( const Ray* rays , bool* occluded , unsigned cnt ) const;
+
 #ifndef ENABLE_TRANSPARENT_SHADOW
     //! @brief  This is a dedicated interface for detecting shadow rays.
     //!
@@ -113,6 +136,26 @@ public:
     const Light* SampleLight( float u , float* pdf ) const;
     // get the properbility of the sample
     float LightProperbility( unsigned i ) const;
+
+    //! @brief  Pick a light according to its estimated contribution at a shading point.
+    //!
+    //! Lights with bounds are picked with the light BVH, the rest of them, like infinite lights, are picked
+    //! uniformly with the same chance of picking the light BVH as a whole.
+    //!
+    //! @param  p           The shading point.
+    //! @param  n           The normal at the shading point, zero vector for points in medium.
+    //! @param  u           A canonical random number.
+    //! @param  pdf         The probability of picking the light, zero if no light is picked.
+    //! @return             The light picked, nullptr if there is no light that contributes to the point.
+    const Light* SampleLight( const Point& p , const Vector& n , float u , float* pdf ) const;
+
+    //! @brief  Get the probability of picking a light with 'SampleLight' at a shading point.
+    //!
+    //! @param  p           The shading point.
+    //! @param  n           The normal at the shading point, zero vector for points in medium.
+    //! @param  light       The light of interest.
+    //! @return             The probability of picking the light.
+    float LightProperbility( const Point& p , const Vector& n , const Light* light ) const;
     // get the number of lights
     unsigned LightNum() const{
         return (unsigned)m_lights.size();
@@ -158,6 +201,13 @@ public:
     // Evaluate sky
     Spectrum    Le( const Ray& ray ) const;
 
+    //! @brief  Evaluate sky for a stream of rays that miss the whole scene.
+    //!
+    //! @param  rays        The rays to be evaluated.
+    //! @param  cnt         The number of rays in the stream.
+    //! @param  radiance    The radiance from the sky, one for each ray.
+    void        LeStream( const Ray* rays , unsigned cnt , Spectrum* radiance ) const;
+
     // Setup scene camera
     void SetupCamera(Camera* camera) {
         m_camera = camera;
@@ -180,6 +230,15 @@ private:
     /**< distribution of light power */
     std::unique_ptr<Distribution1D>             m_lightsDis = nullptr;
 
+    /**< Light BVH of all lights with bounds. */
+    LightBVH                                    m_lightBVH;
+    /**< Lights in the light BVH, in the same order of the indices in the BVH. */
+    std::vector<const Light*>                   m_bvhLights;
+    /**< Lights that can't be bounded, like infinite lights. */
+    std::vector<const Light*>                   m_unboundedLights;
+    /**< Index of lights in the light BVH. */
+    std::unordered_map<const Light*, unsigned>  m_lightBVHIndices;
+
     // bounding box for the scene
     BBox    m_bbox;
     BBox    m_bboxVol;
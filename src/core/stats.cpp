@@ -17,6 +17,7 @@
 
 #include <string>
 #include "stats.h"
+#include "simd/simd_dispatch.h"
 
 #ifdef SORT_ENABLE_STATS_COLLECTION
 
@@ -147,6 +148,17 @@ std::string StatsFormatter_RayPerSecond::ToString( StatsData_Ratio ratio ){
     return stringFormat("%.2f(MRay/s)",r);
 }
 
+std::string StatsFormatter_SimdIsa::ToString( StatsInt v ){
+    return GetSimdIsaName( (SIMD_ISA)v );
+}
+
+std::string StatsFormatter_Memory::ToString( StatsInt v ){
+    if( v < 1024 ) return stringFormat( "%d(B)" , (int)v );
+    if( v < 1024 * 1024 ) return stringFormat( "%.2f(KB)" , (StatsFloat)v / 1024.0f );
+    if( v < 1024 * 1024 * 1024 ) return stringFormat( "%.2f(MB)" , (StatsFloat)v / ( 1024.0f * 1024.0f ) );
+    return stringFormat( "%.2f(GB)" , (StatsFloat)v / ( 1024.0f * 1024.0f * 1024.0f ) );
+}
+
 #endif
 
 void SortStatsFlushData( bool mainThread ){
@@ -134,6 +134,8 @@ public:\
 #define SORT_STATS_RATIO( cat , name , var0 , var1 ) SORT_STATS_RATIO_TYPE( cat , name , var0 , var1 , StatsFormatter_Ratio )
 #define SORT_STATS_AVG_COUNT( cat , name , var0 , var1 ) SORT_STATS_RATIO_TYPE( cat , name , var0 , var1 , StatsFormatter_FloatRatio )
 #define SORT_STATS_AVG_RAY_SECOND( cat , name , var0 , var1 ) SORT_STATS_RATIO_TYPE( cat , name , var0 , var1 , StatsFormatter_RayPerSecond )
+#define SORT_STATS_SIMD_ISA( cat , name , var ) SORT_STATS_INT_TYPE( cat , name , var , StatsFormatter_SimdIsa )
+#define SORT_STATS_MEMORY( cat , name , var ) SORT_STATS_INT_TYPE( cat , name , var , StatsFormatter_Memory )
 
 #define SORT_STATS_FORMATTER( name , type ) class name{ public: static std::string ToString( type v ); };
 SORT_STATS_FORMATTER( StatsFormatter_ElaspedTime , StatsInt )
@@ -142,6 +144,8 @@ SORT_STATS_FORMATTER( StatsFormatter_Float , StatsFloat )
 SORT_STATS_FORMATTER( StatsFormatter_FloatRatio , StatsData_Ratio  )
 SORT_STATS_FORMATTER( StatsFormatter_Ratio , StatsData_Ratio )
 SORT_STATS_FORMATTER( StatsFormatter_RayPerSecond , StatsData_Ratio  )
+SORT_STATS_FORMATTER( StatsFormatter_SimdIsa , StatsInt )
+SORT_STATS_FORMATTER( StatsFormatter_Memory , StatsInt )
 
 // StatsSummary keeps all stats data after the rendering is done
 class StatsSummary {
@@ -177,6 +181,8 @@ private:
 #define SORT_STATS_RATIO( cat , name , var0 , var1 )
 #define SORT_STATS_AVG_COUNT( cat , name , var0 , var1 )
 #define SORT_STATS_AVG_RAY_SECOND( cat , name , var0 , var1 )
+#define SORT_STATS_SIMD_ISA( cat , name , var )
+#define SORT_STATS_MEMORY( cat , name , var )
 #define SORT_STATS_DEFINE_COUNTER( var )
 #define SORT_STATS_DEFINE_FCOUNTER( var )
 #define SORT_STATS_DECLARE_COUNTER( var )
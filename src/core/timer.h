@@ -52,6 +52,15 @@ public:
         return (unsigned int)std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - m_start).count();
     }
 
+    //! @brief  Get elapsed time in microseconds since last time the timer is reset.
+    //!
+    //! This is for operations that are too short to be measured in milliseconds.
+    //!
+    //! @return Get the elapsed time in microseconds since last time the timer is reset.
+    SORT_FORCEINLINE long long GetElapsedTimeUS() const {
+        return (long long)std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - m_start).count();
+    }
+
 private:
     std::chrono::time_point<clock>  m_start;        /**< Start point of last time timer is triggered. */
 };
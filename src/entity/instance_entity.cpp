@@ -0,0 +1,85 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "instance_entity.h"
+#include "core/globalconfig.h"
+#include "core/scene.h"
+#include "core/stats.h"
+
+SORT_STATS_DEFINE_COUNTER(sInstanceCount)
+
+SORT_STATS_COUNTER("Statistics", "Total Instance Count", sInstanceCount);
+
+void InstanceEntity::Serialize( IStreamBase& stream ){
+    unsigned int visual_cnt = 0;
+    stream >> visual_cnt;
+
+    auto has_sss = false;
+
+    while( visual_cnt-- > 0 ){
+        StringID class_name;
+        stream >> class_name;
+        auto visual = MakeUniqueInstance<Visual>( class_name );
+        visual->Serialize( stream );
+
+        // The visual stays in its local space, this still gives it a chance to generate missing data, like tangents.
+        visual->ApplyTransform( Transform() );
+
+        visual->CreatePrimitives();
+        for( const auto& primitive : visual->GetPrimitives() ){
+            has_sss |= primitive->GetMaterial()->HasSSS();
+            m_primitives.push_back( primitive.get() );
+        }
+
+        m_visuals.push_back( std::move(visual) );
+    }
+
+    if( has_sss )
+        slog( WARNING , MATERIAL , "Subsurface scattering is not supported in instances, it is ignored. Export the mesh without instancing instead." );
+
+    unsigned int instance_cnt = 0;
+    stream >> instance_cnt;
+
+    // the acceleration structure takes the same configuration as the one of the whole scene
+    m_accelerator = g_accelerator->Clone();
+
+    for( auto i = 0u ; i < instance_cnt ; ++i ){
+        Transform transform;
+        stream >> transform;
+        m_instances.push_back( std::make_unique<Instance>( m_accelerator.get() , transform ) );
+    }
+
+    if( m_primitives.empty() )
+        return;
+
+    BBox bbox;
+    for( const auto primitive : m_primitives )
+        bbox.Union( primitive->GetBBox() );
+    m_accelerator->Build( m_primitives , bbox );
+}
+
+void InstanceEntity::FillScene( Scene& scene ){
+    if( !m_accelerator || !m_accelerator->GetIsValid() )
+        return;
+
+    for( const auto& instance : m_instances ){
+        m_instancePrimitives.push_back( std::make_unique<Primitive>( nullptr , nullptr , instance.get() ) );
+        scene.AddPrimitive( m_instancePrimitives.back().get() );
+    }
+
+    SORT_STATS(sInstanceCount += (StatsInt)m_instances.size());
+}
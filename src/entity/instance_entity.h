@@ -0,0 +1,57 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include <vector>
+#include "entity.h"
+#include "shape/instance.h"
+
+class Accelerator;
+
+//! @brief  Instance entity places the same visuals multiple times in the world.
+/**
+ * Visuals of an instance entity stay in their own local space, primitives of them are organized in a bottom level
+ * acceleration structure, which is shared by all instances of the entity. Each instance only has a transform, the
+ * scene sees it as a single primitive. This saves a lot of memory and construction time for scenes with lots of
+ * duplicated objects, like trees, chairs or hair clumps.
+ * Subsurface scattering of instanced primitives is not supported for now, rays looking for neighbouring surfaces
+ * with the same material won't find them inside instances. The exporter never instances meshes with subsurface
+ * scattering for this reason.
+ */
+class InstanceEntity : public Entity{
+public:
+    DEFINE_RTTI( InstanceEntity , Entity );
+
+    //! @brief  Fill the scene with one primitive for each instance.
+    //!
+    //! @param  scene       The scene to be filled.
+    void    FillScene( class Scene& scene ) override;
+
+    //! @brief  Serialization interface. Loading data from stream.
+    //!
+    //! The bottom level acceleration structure is also built here, it happens in parallel with loading other entities.
+    //!
+    //! @param  stream      Input stream for data.
+    void    Serialize( IStreamBase& stream ) override;
+
+private:
+    std::vector<const Primitive*>               m_primitives;           /**< Primitives of the visuals in their local space. */
+    std::unique_ptr<Accelerator>                m_accelerator;          /**< Bottom level acceleration structure shared by all instances. */
+    std::vector<std::unique_ptr<Instance>>      m_instances;            /**< Instances of the visuals. */
+    std::vector<std::unique_ptr<Primitive>>     m_instancePrimitives;   /**< Primitives in the scene, one for each instance. */
+};
@@ -16,15 +16,60 @@
  */
 
 #include <numeric>
+#include <unordered_map>
 #include "visual.h"
 #include "material/matmanager.h"
 #include "core/scene.h"
+#include "light/meshlight.h"
+
+void Visual::FillScene( Scene& scene ){
+    const auto offset = m_primitives.size();
+    CreatePrimitives();
+    for( auto i = offset ; i < m_primitives.size() ; ++i )
+        scene.AddPrimitive(m_primitives[i].get());
+}
+
+MeshVisual::MeshVisual() = default;
+MeshVisual::~MeshVisual() = default;
 
 void MeshVisual::FillScene( Scene& scene ){
-    for (const auto& mi : m_memory->m_indices){
+    Visual::FillScene( scene );
+    for( const auto& light : m_lights )
+        scene.AddLight( light.get() );
+}
+
+void MeshVisual::CreatePrimitives(){
+    const auto offset = m_triangles.size();
+    for (const auto& mi : m_memory->m_indices)
         m_triangles.push_back( std::make_unique<Triangle>( this , mi ) );
-        m_primitives.push_back(std::make_unique<Primitive>(m_memory.get(), mi.m_mat, m_triangles.back().get()));
-        scene.AddPrimitive(m_primitives.back().get());
+
+    // faces sharing the same emissive material are gathered as one light source, in the order they appear in the mesh
+    std::unordered_map<const MaterialBase*, unsigned> light_indices;
+    std::vector<std::vector<const Triangle*>> emissive_triangles;
+    std::vector<const MaterialBase*> emissive_materials;
+    for( auto i = 0u ; i < m_memory->m_indices.size() ; ++i ){
+        const auto mat = m_memory->m_indices[i].m_mat;
+        if( IS_PTR_INVALID(mat) || mat->GetEmission().IsBlack() )
+            continue;
+
+        const auto it = light_indices.find( mat );
+        const auto light_index = ( it == light_indices.end() ) ? ( light_indices[mat] = (unsigned)emissive_materials.size() ) : it->second;
+        if( light_index == emissive_materials.size() ){
+            emissive_materials.push_back( mat );
+            emissive_triangles.emplace_back();
+        }
+        emissive_triangles[light_index].push_back( m_triangles[offset + i].get() );
+    }
+
+    const auto light_offset = m_lights.size();
+    for( auto i = 0u ; i < emissive_materials.size() ; ++i )
+        m_lights.push_back( std::make_unique<MeshLight>( emissive_triangles[i] , emissive_materials[i]->GetEmission() ) );
+
+    for( auto i = 0u ; i < m_memory->m_indices.size() ; ++i ){
+        const auto& mi = m_memory->m_indices[i];
+        const auto it = light_indices.find( mi.m_mat );
+        const auto light = ( it == light_indices.end() ) ? nullptr : m_lights[light_offset + it->second].get();
+        m_primitives.push_back(std::make_unique<Primitive>(m_memory.get(), mi.m_mat, m_triangles[offset + i].get(), light));
     }
 }
 
@@ -34,16 +79,13 @@ void MeshVisual::Serialize( IStreamBase& stream ){
 }
 
 void MeshVisual::ApplyTransform( const Transform& transform ){
-    m_memory->ApplyTransform( transform );
-    m_memory->GenUV();
-    m_memory->GenSmoothTagent();
+    m_memory->Prepare( transform );
 }
 
-void HairVisual::FillScene( Scene& scene ){
+void HairVisual::CreatePrimitives(){
     for( const auto& line : m_lines ){
         auto mat = MatManager::GetSingleton().GetMaterial(line->GetMaterialId());
         m_primitives.push_back(std::make_unique<Primitive>(nullptr, mat, line.get()));
-        scene.AddPrimitive(m_primitives.back().get());
     }
 }
 
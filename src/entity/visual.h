@@ -23,6 +23,8 @@
 #include "shape/line.h"
 #include "core/primitive.h"
 
+class MeshLight;
+
 //! @brief Visual is the container for a specific type of shape that can be seen in SORT.
 /**
  * Visual could be a single shape, like sphere, triangle. It could also be a set of triangles,
@@ -30,10 +32,22 @@
  */
 class Visual : public SerializableObject {
 public:
-    //! @brief  Fill the scene with triangles.
+    //! @brief  Fill the scene with primitives of the visual.
     //!
     //! @param  scene       The scene to be filled.
-    virtual void        FillScene( class Scene& scene ) = 0;
+    virtual void        FillScene( class Scene& scene );
+
+    //! @brief  Create primitives of the visual without adding them in a scene.
+    //!
+    //! This is used by instances, whose primitives are not directly visible in the scene.
+    virtual void        CreatePrimitives() = 0;
+
+    //! @brief  Get primitives created by the visual.
+    //!
+    //! @return             Primitives of the visual.
+    const std::vector<std::unique_ptr<Primitive>>& GetPrimitives() const {
+        return m_primitives;
+    }
 
     //! @brief  Some visual will apply transformation earlier for better performance.
     //!
@@ -54,11 +68,20 @@ class MeshVisual : public Visual{
 public:
     DEFINE_RTTI( MeshVisual , Visual );
 
-    //! @brief  Fill the scene with triangles.
+    //! @brief  Constructor and destructor are defined where mesh light is a complete type.
+    MeshVisual();
+    ~MeshVisual() override;
+
+    //! @brief  Fill the scene with primitives and light sources of the visual.
     //!
     //! @param  scene       The scene to be filled.
     void        FillScene( class Scene& scene ) override;
 
+    //! @brief  Create a triangle primitive for each face in the mesh.
+    //!
+    //! Faces with the same emissive material are also gathered as a mesh light, which is attached to their primitives.
+    void        CreatePrimitives() override;
+
     //! @brief  Serialization interface. Loading data from stream.
     //!
     //! Serialize the visual. Loading from an IStreamBase, which could be coming from file, memory or network.
@@ -76,6 +99,8 @@ public:
     std::unique_ptr<Mesh>                 m_memory;
     /**< This is to make sure the memory of triangles will be properly cleared. */
     std::vector<std::unique_ptr<Triangle>>      m_triangles;
+    /**< Light sources made of emissive faces in the mesh. */
+    std::vector<std::unique_ptr<MeshLight>>     m_lights;
 };
 
 //! HairVisual has a bunch of lines.
@@ -87,10 +112,8 @@ class HairVisual : public Visual{
 public:
     DEFINE_RTTI( HairVisual , Visual );
 
-    //! @brief  Fill the scene with triangles.
-    //!
-    //! @param  scene       The scene to be filled.
-    void        FillScene( class Scene& scene ) override;
+    //! @brief  Create a line primitive for each hair segment.
+    void        CreatePrimitives() override;
 
     //! @brief  Serialization interface. Loading data from stream.
     //!
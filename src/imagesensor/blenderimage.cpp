@@ -22,39 +22,41 @@
 
 static std::mutex g_cntLock;
 
-void BlenderImage::StorePixel( int x , int y , const Spectrum& color , const Render_Task& rt ){
+void BlenderImage::FinishTile( int tile_x , int tile_y , const Render_Task& rt ){
+    // for final update
+    ImageSensor::FinishTile( tile_x , tile_y , rt );
+
     if (!m_sharedMemory.sharedmemory.bytes)
         return;
 
-    int tile_w = rt.GetTileSize().x;
+    const auto tl = rt.GetTopLeft();
+    const auto size = rt.GetTileSize();
     int tile_size = g_tileSize * g_tileSize;
-    int x_off = (int)(rt.GetTopLeft().x / g_tileSize);
-    int y_off = (int)(floor((m_height - 1 - rt.GetTopLeft().y) / (float)g_tileSize));
+    int x_off = (int)(tl.x / g_tileSize);
+    int y_off = (int)(floor((m_height - 1 - tl.y) / (float)g_tileSize));
     int tile_offset = y_off * m_tilenum_x + x_off;
     int offset = 4 * tile_offset * tile_size;
 
     // get the data pointer
     float* data = (float*)(m_sharedMemory.sharedmemory.bytes + m_header_offset);
 
-    // get offset
-    int inner_offset = offset + 4 * (x - rt.GetTopLeft().x + (g_tileSize - 1 - (y - rt.GetTopLeft().y)) * tile_w);
+    // copy data of the whole tile
+    for( int y = tl.y ; y < tl.y + size.y ; ++y ){
+        for( int x = tl.x ; x < tl.x + size.x ; ++x ){
+            const auto& color = rt.GetPixelRadiance( x , y );
 
-    // copy data
-    data[ inner_offset ] = color.r;
-    data[ inner_offset + 1 ] = color.g;
-    data[ inner_offset + 2 ] = color.b;
-    data[ inner_offset + 3 ] = 1.0f;
+            // get offset
+            int inner_offset = offset + 4 * (x - tl.x + (g_tileSize - 1 - (y - tl.y)) * size.x);
 
-    // for final update
-    {
-        std::lock_guard<spinlock_mutex> lock(m_mutex[y*m_width+x]);
-        Spectrum _color = m_rendertarget.GetColor(x,y);
-        m_rendertarget.SetColor(x, y, color+_color);
+            data[ inner_offset ] = color.r;
+            data[ inner_offset + 1 ] = color.g;
+            data[ inner_offset + 2 ] = color.b;
+            data[ inner_offset + 3 ] = 1.0f;
+        }
     }
-}
 
-void BlenderImage::FinishTile( int tile_x , int tile_y , const Render_Task& rt ){
-    if (!m_sharedMemory.sharedmemory.bytes)
+    // integrators without live update only show the result in the final update
+    if( !g_integrator->NeedRefreshTile() )
         return;
 
     m_sharedMemory.sharedmemory.bytes[tile_y * m_tilenum_x + tile_x] = 1;
@@ -82,6 +84,9 @@ void BlenderImage::PreProcess(){
 }
 
 void BlenderImage::PostProcess(){
+    // merge splatted radiance before copying the final result
+    ImageSensor::PostProcess();
+
     // perform a copy from render target to shared memory
     float* data = (float*)(m_sharedMemory.sharedmemory.bytes + m_header_offset + m_header_offset * g_tileSize * g_tileSize * 4 * sizeof(float));
 
@@ -97,6 +102,4 @@ void BlenderImage::PostProcess(){
 
     // signal a final update
     m_sharedMemory.sharedmemory.bytes[m_final_update_flag_offset] = 1;
-
-    ImageSensor::PostProcess();
 }
@@ -26,10 +26,7 @@ class BlenderImage : public ImageSensor
 {
 public:
     // constructor
-    BlenderImage( int w , int h ) : ImageSensor( w , h ) {}
-
-    // store pixel information
-    void StorePixel( int x , int y , const Spectrum& color , const Render_Task& rt ) override;
+    BlenderImage( int w , int h , unsigned thread_cnt ) : ImageSensor( w , h , thread_cnt ) {}
 
     // finish image tile
     void FinishTile( int tile_x , int tile_y , const Render_Task& rt ) override;
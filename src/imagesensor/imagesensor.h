@@ -21,24 +21,86 @@
 #include "texture/rendertarget.h"
 #include "task/render_task.h"
 #include "core/thread.h"
-#include <mutex>
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <string>
+
+// minimum number of samples a pixel needs to take before its error estimation is trusted in adaptive sampling
+#define ADAPTIVE_SAMPLING_MIN_SPP   16
+
+// statistics of samples taken in a pixel, this is only used in adaptive sampling
+struct PixelStatistics{
+    Spectrum    sum;                    /**< Sum of radiance of all samples. */
+    double      lum_sum = 0.0;          /**< Sum of luminance of all samples. */
+    double      lum_sq_sum = 0.0;       /**< Sum of squared luminance of all samples. */
+    unsigned    cnt = 0;                /**< Number of samples taken. */
+};
+
+// size of the square blocks that splat buffers are allocated in
+#define SPLAT_BLOCK_SIZE            64
+
+// radiance splatted to arbitrary pixels by one thread
+// the buffer is divided into blocks that are only allocated once any pixel in it is touched, so that threads splatting
+// to a small part of the image don't need a whole image in memory.
+class SplatBuffer{
+public:
+    SplatBuffer( int w , int h ) : m_blockCntX( ( w + SPLAT_BLOCK_SIZE - 1 ) / SPLAT_BLOCK_SIZE ) ,
+                                   m_blocks( m_blockCntX * ( ( h + SPLAT_BLOCK_SIZE - 1 ) / SPLAT_BLOCK_SIZE ) ) {}
+
+    // add radiance to a pixel
+    SORT_FORCEINLINE void Add( int x , int y , const Spectrum& color ){
+        auto& block = m_blocks[( y / SPLAT_BLOCK_SIZE ) * m_blockCntX + x / SPLAT_BLOCK_SIZE];
+        if( IS_PTR_INVALID(block) )
+            block = std::make_unique<Spectrum[]>( SPLAT_BLOCK_SIZE * SPLAT_BLOCK_SIZE );
+        block[( y % SPLAT_BLOCK_SIZE ) * SPLAT_BLOCK_SIZE + x % SPLAT_BLOCK_SIZE] += color;
+    }
+
+    // add all radiance in the buffer to the render target
+    void MergeTo( RenderTarget& rt ) const{
+        for( auto i = 0u ; i < m_blocks.size() ; ++i ){
+            if( IS_PTR_INVALID(m_blocks[i]) )
+                continue;
+
+            const auto ox = (int)( i % m_blockCntX ) * SPLAT_BLOCK_SIZE;
+            const auto oy = (int)( i / m_blockCntX ) * SPLAT_BLOCK_SIZE;
+            const auto w = std::min( SPLAT_BLOCK_SIZE , rt.GetWidth() - ox );
+            const auto h = std::min( SPLAT_BLOCK_SIZE , rt.GetHeight() - oy );
+            for( auto y = 0 ; y < h ; ++y )
+                for( auto x = 0 ; x < w ; ++x )
+                    rt.SetColor( ox + x , oy + y , rt.GetColor( ox + x , oy + y ) + m_blocks[i][y * SPLAT_BLOCK_SIZE + x] );
+        }
+    }
+
+private:
+    const int                                   m_blockCntX;    /**< Number of blocks in a row. */
+    std::vector<std::unique_ptr<Spectrum[]>>    m_blocks;       /**< Blocks of pixels, nullptr if nothing is splatted in it. */
+};
 
 // generate output
+// Render tasks accumulate radiance in their own tile buffers, which are merged into the image once the tile is finished.
+// Since tiles never overlap, there is no need to lock anything. Radiance splatted to arbitrary pixels, like the one from
+// light tracing, goes to per-thread splat buffers, which are merged in post process.
 class ImageSensor{
 public:
-    ImageSensor( int w , int h ) : m_width(w) , m_height(h) , m_rendertarget( w , h ) {
-        m_mutex = std::make_unique<spinlock_mutex[]>( m_width * m_height );
+    ImageSensor( int w , int h , unsigned thread_cnt ) : m_width(w) , m_height(h) , m_rendertarget( w , h ) {
+        for( auto i = 0u ; i < thread_cnt ; ++i )
+            m_splatBuffers.push_back( std::make_unique<SplatBuffer>( w , h ) );
     }
     virtual ~ImageSensor(){}
 
     // pre process
     virtual void PreProcess() {}
 
-    // finish image tile
-    virtual void FinishTile( int tile_x , int tile_y , const Render_Task& rt ){}
-
-    // store pixel information
-    virtual void StorePixel( int x , int y , const Spectrum& color , const Render_Task& rt ) = 0;
+    // finish image tile, radiance in the tile buffer of the render task is merged into the image
+    virtual void FinishTile( int tile_x , int tile_y , const Render_Task& rt ){
+        const auto tl = rt.GetTopLeft();
+        const auto size = rt.GetTileSize();
+        for( auto y = tl.y ; y < tl.y + size.y ; ++y )
+            for( auto x = tl.x ; x < tl.x + size.x ; ++x )
+                m_rendertarget.SetColor( x , y , m_rendertarget.GetColor( x , y ) + rt.GetPixelRadiance( x , y ) );
+    }
 
     // get width
     SORT_FORCEINLINE int GetWidth() const {
@@ -50,23 +112,89 @@ public:
         return m_height;
     }
 
-    // post process
-    virtual void PostProcess(){}
+    // post process, splatted radiance is merged into the image
+    virtual void PostProcess(){
+        for( auto& splat : m_splatBuffers )
+            splat->MergeTo( m_rendertarget );
+        m_splatBuffers.clear();
+    }
 
-    // add radiance
+    // add radiance to an arbitrary pixel, this goes to the splat buffer of the current thread
     virtual void UpdatePixel(int x, int y, const Spectrum& color){
-        std::lock_guard<spinlock_mutex> lock(m_mutex[y * m_width + x]);
-        Spectrum _color = m_rendertarget.GetColor(x, y);
-        m_rendertarget.SetColor(x, y, _color + color);
+        m_splatBuffers[ThreadId() % m_splatBuffers.size()]->Add( x , y , color );
+    }
+
+    // keep statistics of samples in each pixel for adaptive sampling
+    void EnableAdaptiveSampling(){
+        m_pixelStats = std::make_unique<PixelStatistics[]>( m_width * m_height );
+    }
+
+    // whether adaptive sampling statistics are kept
+    SORT_FORCEINLINE bool IsAdaptiveSamplingEnabled() const {
+        return IS_PTR_VALID(m_pixelStats);
+    }
+
+    // accumulate samples of a pass in a pixel for adaptive sampling
+    // passes of a tile are executed one after another, there is no need to lock the pixel
+    void AddPixelSamples( int x , int y , const PixelStatistics& samples ){
+        auto& stats = m_pixelStats[y * m_width + x];
+        stats.sum += samples.sum;
+        stats.lum_sum += samples.lum_sum;
+        stats.lum_sq_sum += samples.lum_sq_sum;
+        stats.cnt += samples.cnt;
+    }
+
+    // get the statistics of samples taken in a pixel so far
+    SORT_FORCEINLINE const PixelStatistics& GetPixelStatistics( int x , int y ) const {
+        return m_pixelStats[y * m_width + x];
+    }
+
+    // standard error of the mean luminance relative to the mean luminance of a pixel
+    float GetPixelRelativeError( int x , int y ) const {
+        const auto& stats = m_pixelStats[y * m_width + x];
+        if( stats.cnt < 2 )
+            return FLT_MAX;
+
+        const auto mean = stats.lum_sum / stats.cnt;
+        const auto variance = std::max( 0.0 , ( stats.lum_sq_sum - stats.cnt * mean * mean ) / ( stats.cnt - 1 ) );
+
+        // a small offset avoids dark pixels, which are quite likely noisy, from never being converged
+        return (float)( sqrt( variance / stats.cnt ) / ( mean + 1e-3 ) );
+    }
+
+    // whether the pixel has taken enough samples to reach the error threshold
+    SORT_FORCEINLINE bool IsPixelConverged( int x , int y , float threshold ) const {
+        return m_pixelStats[y * m_width + x].cnt >= ADAPTIVE_SAMPLING_MIN_SPP && GetPixelRelativeError( x , y ) < threshold;
+    }
+
+    // output the convergence map of adaptive sampling
+    // red channel is the number of samples taken relative to the maximum, green channel is the relative error and
+    // blue channel is one for converged pixels.
+    void OutputConvergenceMap( const std::string& filename , unsigned max_spp , float threshold ) const {
+        if( !IsAdaptiveSamplingEnabled() )
+            return;
+
+        RenderTarget convergence( m_width , m_height );
+        for( auto y = 0 ; y < m_height ; ++y ){
+            for( auto x = 0 ; x < m_width ; ++x ){
+                const auto converged = IsPixelConverged( x , y , threshold );
+                const auto error = std::min( GetPixelRelativeError( x , y ) , 1.0f );
+                convergence.SetColor( x , y , Spectrum( GetPixelStatistics( x , y ).cnt / (float)max_spp , error , converged ? 1.0f : 0.0f ) );
+            }
+        }
+        convergence.Output( filename );
     }
 
 protected:
     const int m_width;
     const int m_height;
 
-    // the mutex
-    std::unique_ptr<spinlock_mutex[]>   m_mutex;
+    // splat buffers, one for each thread
+    std::vector<std::unique_ptr<SplatBuffer>>   m_splatBuffers;
 
     // the render target
     RenderTarget m_rendertarget;
+
+    // statistics of samples in each pixel, only available with adaptive sampling
+    std::unique_ptr<PixelStatistics[]>  m_pixelStats;
 };
@@ -19,13 +19,15 @@
 #include "core/globalconfig.h"
 #include "core/path.h"
 
-void RenderTargetImage::StorePixel( int x , int y , const Spectrum& color , const Render_Task& rt ){
-    std::lock_guard<spinlock_mutex> lock(m_mutex[y*m_width + x]);
-    Spectrum _color = m_rendertarget.GetColor(x, y);
-    m_rendertarget.SetColor(x, y, color + _color);
-}
-
 void RenderTargetImage::PostProcess(){
     ImageSensor::PostProcess();
     m_rendertarget.Output(GetFilePathInExeFolder(g_outputFileName));
+
+    // convergence map is saved next to the result, 'result.exr' comes with 'result_convergence.exr'.
+    if( IsAdaptiveSamplingEnabled() ){
+        std::string filename = g_outputFileName;
+        const auto ext = filename.find_last_of( '.' );
+        filename.insert( ext == std::string::npos ? filename.size() : ext , "_convergence" );
+        OutputConvergenceMap( GetFilePathInExeFolder(filename) , g_samplePerPixel , g_adaptiveErrorThreshold );
+    }
 }
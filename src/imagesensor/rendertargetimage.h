@@ -23,10 +23,7 @@
 class RenderTargetImage : public ImageSensor{
 public:
     // constructor
-    RenderTargetImage( int w , int h ):ImageSensor(w,h){}
-
-    // store pixel information
-    void StorePixel( int x , int y , const Spectrum& color , const Render_Task& rt ) override;
+    RenderTargetImage( int w , int h , unsigned thread_cnt ):ImageSensor(w,h,thread_cnt){}
 
     // post process
     void PostProcess() override;
@@ -76,6 +76,11 @@ public:
     //! @brief  The samples generated in this interface is not well used in this integrator for now.
     void RequestSample( Sampler* sampler , PixelSample* ps , unsigned ps_num ) override;
 
+    //! @brief  Light paths connecting to the camera splat radiance to other pixels, adaptive sampling doesn't work with it.
+    bool SupportAdaptiveSampling() const override {
+        return false;
+    }
+
     //! @brief      Serializing data from stream
     //!
     //! @param      Stream where the serialization data comes from. Depending on different situation, it could come from different places.
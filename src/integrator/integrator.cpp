@@ -18,3 +18,10 @@
 #include "integrator.h"
 
 SORT_STATS_DEFINE_COUNTER(sPrimaryRayCount)
+
+void Integrator::LiStream( const Ray* rays , const PixelSample* ps , Spectrum* radiance , unsigned cnt , const Scene& scene ) const{
+    for( auto i = 0u ; i < cnt ; ++i ){
+        SORT_CLEAR_MEMPOOL();
+        radiance[i] = Li( rays[i] , ps[i] , scene );
+    }
+}
@@ -53,6 +53,23 @@ public:
     //! @return         The spectrum of the radiance along the opposite direction of the ray.
     virtual Spectrum    Li( const Ray& ray , const PixelSample& ps , const Scene& scene) const = 0;
 
+    //! @brief  Evaluate the radiance of a batch of rays.
+    //!
+    //! By default, rays are evaluated one by one through 'Li'. Integrators that advance all paths in a batch together
+    //! could override this interface to take advantage of coherence among the paths.
+    //!
+    //! @param  rays        The extent rays in rendering equation.
+    //! @param  ps          The pixel samples, one for each ray.
+    //! @param  radiance    The radiance along the opposite direction of each ray.
+    //! @param  cnt         The number of rays in the batch.
+    //! @param  scene       The rendering scene.
+    virtual void        LiStream( const Ray* rays , const PixelSample* ps , Spectrum* radiance , unsigned cnt , const Scene& scene ) const;
+
+    //! @brief  Whether the integrator prefers evaluating rays in a batch through 'LiStream'.
+    virtual bool        IsWavefront() const {
+        return false;
+    }
+
     //! @brief Pre-process before rendering.
     //!
     //! By default , nothing is done in pre-process some integrator, such as Photon Mapping use pre-process step to
@@ -67,6 +84,14 @@ public:
         return true;
     }
 
+    //! @brief  Whether the integrator works with adaptive sampling.
+    //!
+    //! Adaptive sampling needs to know how many samples each pixel takes, integrators splatting radiance to
+    //! arbitrary pixels don't work with it.
+    virtual bool SupportAdaptiveSampling() const {
+        return true;
+    }
+
     //! @brief      Serializing data from stream
     //!
     //! @param      Stream where the serialization data comes from. Depending on different situation, it could come from different places.
@@ -25,10 +25,6 @@
 #include "light/light.h"
 #include "medium/phasefunction.h"
 
-SORT_FORCEINLINE float MisFactor( float f, float g ){
-    return (f*f) / (f*f + g*g);
-}
-
 Spectrum    EvaluateDirect( const ScatteringEvent& se , const Ray& r , const Scene& scene , const Light* light , const LightSample& ls ,const BsdfSample& bs ){
     const auto& ip = se.GetInteraction();
     Spectrum radiance;
@@ -218,9 +214,9 @@ Spectrum    EvaluateDirect(const Point& ip, const PhaseFunction* ph, const Vecto
 
 // This is only used by SSS for now, since it is a smooth BRDF, there is no need to do MIS.
 Spectrum SampleOneLight( const ScatteringEvent& se , const Ray& r, const SurfaceInteraction& inter, const Scene& scene, const MaterialBase* material, const MediumStack& ms) {
-    // Uniformly choose a light, this may not be the optimal solution in case of more lights, need more research in this topic later.
+    // Pick a light based on its estimated contribution to the shading point.
     float light_pick_pdf = 0.0f;
-    const auto light = scene.SampleLight( sort_canonical() , &light_pick_pdf );
+    const auto light = scene.SampleLight( inter.intersect , inter.normal , sort_canonical() , &light_pick_pdf );
     if(IS_PTR_INVALID(light))
         return 0.0f;
 
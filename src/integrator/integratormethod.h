@@ -23,6 +23,11 @@ struct	SurfaceInteraction;
 class	Light;
 class   MediumStack;
 
+//! @brief  Power heuristic of multiple importance sampling.
+SORT_FORCEINLINE float MisFactor( float f, float g ){
+    return (f*f) / (f*f + g*g);
+}
+
 // evaluate direct lighting
 Spectrum    EvaluateDirect(const ScatteringEvent& se, const Ray& r, const Scene& scene, const Light* light, const LightSample& ls, const BsdfSample& bs, const MaterialBase* material, const MediumStack& ms);
 Spectrum    EvaluateDirect(const ScatteringEvent& se, const Ray& r, const Scene& scene, const Light* light, const LightSample& ls, const BsdfSample& bs);
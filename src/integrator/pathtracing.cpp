@@ -84,8 +84,9 @@ Spectrum PathTracing::li( const Ray& ray , const PixelSample& ps , const Scene&
 
             // evaluate direct light illumination
             float light_pdf = 0.0f;
-            const auto  light = scene.SampleLight(sort_canonical(), &light_pdf);
-            L += throughput * EvaluateDirect(pMi->intersect, pMi->phaseFunction, -r.m_Dir, scene, light, ms) / light_pdf;
+            const auto  light = scene.SampleLight(pMi->intersect, Vector(0.0f, 0.0f, 0.0f), sort_canonical(), &light_pdf);
+            if (light_pdf > 0.0f)
+                L += throughput * EvaluateDirect(pMi->intersect, pMi->phaseFunction, -r.m_Dir, scene, light, ms) / light_pdf;
 
             // update path weight
             throughput *= pf / pdf;
@@ -136,7 +137,7 @@ Spectrum PathTracing::li( const Ray& ray , const PixelSample& ps , const Scene&
             auto        light_pdf = 0.0f;
             const auto  light_sample = LightSample(true);
             const auto  bsdf_sample = BsdfSample(true);
-            const auto  light = scene.SampleLight( light_sample.t , &light_pdf );
+            const auto  light = scene.SampleLight( inter.intersect , inter.normal , light_sample.t , &light_pdf );
             if( light_pdf > 0.0f )
                 L += throughput * EvaluateDirect( se , r , scene, light , light_sample , bsdf_sample , material , ms ) / light_pdf / pdf_scattering_type;
         }else if(scattering_type_flag & SE_EVALUATE_BSSRDF) {
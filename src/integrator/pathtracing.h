@@ -46,7 +46,7 @@ public:
 
     SORT_STATS_ENABLE( "Path Tracing" )
 
-private:
+protected:
     // Maximum bounces supported in BSSRDF path.
     // BSSRDF solutions usually makes aggressive approximations resulting in less accuracy, multiple BSSRDF bounces will even make it worse.
     // Most importantly, it kills the performance and introduces quite some fireflies with bounces more than 2.
@@ -0,0 +1,333 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include <algorithm>
+#include <functional>
+#include "wavefrontpath.h"
+#include "math/interaction.h"
+#include "core/scene.h"
+#include "core/profile.h"
+#include "integratormethod.h"
+#include "light/light.h"
+#include "material/material.h"
+#include "scatteringevent/scatteringevent.h"
+#include "medium/medium.h"
+
+SORT_STATS_DEFINE_COUNTER(sMaterialBatchCount)
+SORT_STATS_DEFINE_COUNTER(sShadedHitCount)
+SORT_STATS_DEFINE_COUNTER(sQueuedShadowRayCount)
+SORT_STATS_DEFINE_COUNTER(sHandedOverPathCount)
+SORT_STATS_DECLARE_COUNTER(sPrimaryRayCount)
+SORT_STATS_DECLARE_COUNTER(sTotalPathLength)
+
+SORT_STATS_COUNTER("Wavefront Path Tracing", "Material Batch Count", sMaterialBatchCount);
+SORT_STATS_AVG_COUNT("Wavefront Path Tracing", "Average Hits per Material Batch", sShadedHitCount, sMaterialBatchCount);
+SORT_STATS_COUNTER("Wavefront Path Tracing", "Queued Shadow Ray Count", sQueuedShadowRayCount);
+SORT_STATS_COUNTER("Wavefront Path Tracing", "Path Handed over to Path Tracing", sHandedOverPathCount);
+
+namespace {
+    //! @brief  Shadow rays spawned during shading, they are traced together after all hits of a bounce are shaded.
+    struct ShadowRayQueue{
+        std::vector<Ray>            rays;           /**< Shadow rays to be traced. */
+        std::vector<Spectrum>       radiance;       /**< Contribution of each shadow ray if it is not occluded. */
+        std::vector<unsigned>       path;           /**< The path that each shadow ray contributes to. */
+        std::vector<MediumStack>    ms;             /**< Medium stack at the origin of each shadow ray. */
+
+        //! @brief  Queue a shadow ray.
+        void Push( const Ray& ray , const Spectrum& contribution , unsigned path_id , const MediumStack& medium_stack ){
+            rays.push_back( ray );
+            radiance.push_back( contribution );
+            path.push_back( path_id );
+            ms.push_back( medium_stack );
+        }
+
+        //! @brief  Clear all queued shadow rays.
+        void Clear(){
+            rays.clear();
+            radiance.clear();
+            path.clear();
+            ms.clear();
+        }
+    };
+
+    // Medium stack of a ray leaving the surface along 'wi', it is only different from the current one if the ray passes
+    // through the surface.
+    MediumStack mediumStackAlong( const ScatteringEvent& se , const Vector& wo , const Vector& wi , const MaterialBase* material , const MediumStack& ms ){
+        MediumStack ms_copy = ms;
+        const auto& inter = se.GetInteraction();
+        const auto interaction_flag = update_interaction_flag(dot(wi, inter.gnormal), dot(wo, inter.gnormal));
+        if (SE_Interaction::SE_REFLECTION != interaction_flag) {
+            MediumInteraction mi;
+            mi.intersect = inter.intersect;
+            mi.mesh = inter.primitive->GetMesh();
+            material->UpdateMediumStack(mi, interaction_flag, ms_copy);
+        }
+        return ms_copy;
+    }
+
+    // This is exactly the same with 'EvaluateDirect', except that shadow rays are queued instead of being traced immediately.
+    void queueDirectIllumination( const ScatteringEvent& se , const Ray& r , const Scene& scene , const Light* light , const LightSample& ls ,
+                                  const BsdfSample& bs , const MaterialBase* material , const MediumStack& ms , const Spectrum& scale ,
+                                  unsigned path , ShadowRayQueue& queue ){
+        const auto& ip = se.GetInteraction();
+        Visibility visibility(scene);
+        float light_pdf;
+        float bsdf_pdf;
+        const auto wo = -r.m_Dir;
+        Vector wi;
+        const auto li = light->sample_l(ip.intersect, &ls, wi, 0, &light_pdf, 0, 0, visibility);
+        if (light_pdf > 0.0f && !li.IsBlack()) {
+            const auto f = se.Evaluate_BSDF(wo, wi);
+            if (!f.IsBlack()) {
+                auto weight = 1.0f;
+                if (!light->IsDelta()) {
+                    bsdf_pdf = se.Pdf_BSDF(wo, wi);
+                    weight = MisFactor(light_pdf, bsdf_pdf);
+                }
+                queue.Push(visibility.ray, scale * li * f * weight / light_pdf, path, mediumStackAlong(se, wo, wi, material, ms));
+            }
+        }
+
+        if (!light->IsDelta()) {
+            const auto f = se.Sample_BSDF(wo, wi, bs, bsdf_pdf);
+            if (!f.IsBlack() && bsdf_pdf != 0.0f) {
+                const auto light_pdf = light->Pdf(ip.intersect, wi);
+                if (light_pdf <= 0.0f)
+                    return;
+                const auto weight = MisFactor(bsdf_pdf, light_pdf);
+
+                Spectrum li;
+                SurfaceInteraction _ip;
+                if (false == light->Le(Ray(ip.intersect, wi), &_ip, li))
+                    return;
+
+                if (!li.IsBlack())
+                    queue.Push(Ray(ip.intersect, wi, 0, 0.001f, _ip.t - 0.001f), scale * li * f * weight / bsdf_pdf, path, mediumStackAlong(se, wo, wi, material, ms));
+            }
+        }
+    }
+
+    // Trace all queued shadow rays together and accumulate the contribution of the visible ones.
+    void traceShadowRays( ShadowRayQueue& queue , Spectrum* radiance , const Scene& scene ){
+        const auto cnt = (unsigned)queue.rays.size();
+        if( 0 == cnt )
+            return;
+
+        SORT_STATS(sQueuedShadowRayCount += cnt);
+
+        auto occluded = std::make_unique<bool[]>(cnt);
+        scene.OccludedStream( queue.rays.data() , occluded.get() , cnt );
+
+        for( auto i = 0u ; i < cnt ; ++i ){
+#ifdef ENABLE_TRANSPARENT_SHADOW
+            if( !occluded[i] && 0 == queue.ms[i].m_mediumCnt ){
+                radiance[queue.path[i]] += queue.radiance[i];
+                continue;
+            }
+
+            // the light could still be partially visible through semi-transparent surfaces or attenuated by mediums.
+            const auto attenuation = scene.GetAttenuation( queue.rays[i] , &queue.ms[i] );
+            if( !attenuation.IsBlack() )
+                radiance[queue.path[i]] += attenuation * queue.radiance[i];
+#else
+            if( !occluded[i] )
+                radiance[queue.path[i]] += queue.radiance[i];
+#endif
+        }
+    }
+}
+
+Spectrum WavefrontPathTracing::Li( const Ray& ray , const PixelSample& ps , const Scene& scene ) const{
+    Spectrum radiance;
+    LiStream( &ray , &ps , &radiance , 1 , scene );
+    return radiance;
+}
+
+void WavefrontPathTracing::LiStream( const Ray* rays , const PixelSample* ps , Spectrum* radiance , unsigned cnt , const Scene& scene ) const{
+    SORT_PROFILE("Wavefront path tracing");
+    SORT_STATS(sPrimaryRayCount += cnt);
+
+    // states of all paths in the batch, kept in structure of arrays.
+    std::vector<Ray>            path_ray( rays , rays + cnt );
+    std::vector<Spectrum>       throughput( cnt , Spectrum( 1.0f ) );
+    std::vector<MediumStack>    ms( cnt );
+
+    // paths that are still alive, all of them have the same number of bounces.
+    std::vector<unsigned>       alive( cnt );
+    std::vector<unsigned>       next_alive;
+    for( auto i = 0u ; i < cnt ; ++i ){
+        radiance[i] = 0.0f;
+        alive[i] = i;
+        scene.RestoreMediumStack( rays[i].m_Ori , ms[i] );
+    }
+
+    std::vector<Ray>                                        stream_rays;
+    std::vector<SurfaceInteraction>                         stream_inters;
+    std::vector<std::pair<const MaterialBase*, unsigned>>   hits;
+    std::vector<Ray>                                        escaped_rays;
+    std::vector<unsigned>                                   escaped_paths;
+    std::vector<Spectrum>                                   escaped_radiance;
+    ShadowRayQueue                                          shadow_queue;
+
+    // this is the same with path tracing when there is no previous bounce on BSSRDF surfaces.
+    const auto replace_sss = m_maxBouncesInBSSRDFPath < 1;
+    const auto se_flag = replace_sss ? SE_Flag( SE_EVALUATE_ALL | SE_REPLACE_BSSRDF ) : SE_EVALUATE_ALL;
+
+    // This introduces bias in the algorithm. 'max_recursive_depth' could be set very large to reduce the side-effect.
+    for( auto bounces = 0 ; bounces < max_recursive_depth && !alive.empty() ; ++bounces ){
+        const auto alive_cnt = (unsigned)alive.size();
+        SORT_STATS(sTotalPathLength += alive_cnt);
+
+        // intersect rays of all alive paths together.
+        stream_rays.resize( alive_cnt );
+        stream_inters.assign( alive_cnt , SurfaceInteraction() );
+        for( auto i = 0u ; i < alive_cnt ; ++i )
+            stream_rays[i] = path_ray[alive[i]];
+        scene.IntersectStream( stream_rays.data() , stream_inters.data() , alive_cnt );
+
+        hits.clear();
+        escaped_rays.clear();
+        escaped_paths.clear();
+        for( auto i = 0u ; i < alive_cnt ; ++i ){
+            const auto  path = alive[i];
+            const auto& r = stream_rays[i];
+            const auto& inter = stream_inters[i];
+
+            if( IS_PTR_INVALID(inter.primitive) ){
+                if( 0 == bounces ){
+                    escaped_rays.push_back( r );
+                    escaped_paths.push_back( path );
+                }
+                continue;
+            }
+
+            // paths in participating media are handed over to path tracing for the rest of their bounces.
+            if( ms[path].m_mediumCnt > 0 ){
+                SORT_STATS(++sHandedOverPathCount);
+                radiance[path] += throughput[path] * li( r , ps[path] , scene , bounces , bounces > 0 , 0 , false , ms[path] );
+                continue;
+            }
+
+            if( 0 == bounces )
+                radiance[path] += inter.Le( -r.m_Dir );
+
+            const MaterialBase* material = inter.primitive->GetMaterial();
+            sAssert(IS_PTR_VALID(material), INTEGRATOR);
+            hits.push_back( std::make_pair( material , i ) );
+        }
+
+        // the sky is evaluated for all escaped rays together.
+        if( !escaped_rays.empty() ){
+            escaped_radiance.resize( escaped_rays.size() );
+            scene.LeStream( escaped_rays.data() , (unsigned)escaped_rays.size() , escaped_radiance.data() );
+            for( auto i = 0u ; i < escaped_paths.size() ; ++i )
+                radiance[escaped_paths[i]] += escaped_radiance[i];
+        }
+
+        // sort the hits by material so that the shader of each material is executed for all of its hits in a row.
+        std::sort( hits.begin() , hits.end() , []( const std::pair<const MaterialBase*, unsigned>& h0 , const std::pair<const MaterialBase*, unsigned>& h1 ){
+            if( h0.first != h1.first )
+                return std::less<const MaterialBase*>()( h0.first , h1.first );
+            return h0.second < h1.second;
+        });
+
+        next_alive.clear();
+        shadow_queue.Clear();
+        for( auto h = 0u ; h < hits.size() ; ++h ){
+            const auto  material = hits[h].first;
+            const auto  i = hits[h].second;
+            const auto  path = alive[i];
+            const auto& r = stream_rays[i];
+            const auto& inter = stream_inters[i];
+            auto&       beta = throughput[path];
+
+            SORT_STATS(sMaterialBatchCount += ( 0 == h || hits[h-1].first != material ) ? 1 : 0);
+            SORT_STATS(++sShadedHitCount);
+
+            // Parse the material and populate the results into a scatteringEvent.
+            ScatteringEvent se( inter , se_flag );
+            material->UpdateScatteringEvent( se );
+
+            // SSS is not supported in wavefront fashion, the rest of the path is evaluated by path tracing.
+            if( se.HasBssrdf() ){
+                SORT_STATS(++sHandedOverPathCount);
+                radiance[path] += beta * li( r , ps[path] , scene , bounces , true , 0 , false , ms[path] );
+                continue;
+            }
+
+            SE_Flag scattering_type_flag;
+            auto pdf_scattering_type = se.SampleScatteringType( scattering_type_flag );
+
+            if( scattering_type_flag & SE_EVALUATE_BXDF ){
+                // evaluate the light, shadow rays are queued instead of being traced immediately.
+                auto        light_pdf = 0.0f;
+                const auto  light_sample = LightSample(true);
+                const auto  bsdf_sample = BsdfSample(true);
+                const auto  light = scene.SampleLight( inter.intersect , inter.normal , light_sample.t , &light_pdf );
+                if( light_pdf > 0.0f )
+                    queueDirectIllumination( se , r , scene , light , light_sample , bsdf_sample , material , ms[path] , beta / light_pdf / pdf_scattering_type , path , shadow_queue );
+            }
+
+            // pick another time for the next path
+            pdf_scattering_type = se.SampleScatteringType( scattering_type_flag );
+            if( pdf_scattering_type == 0.0f )
+                continue;
+            beta /= pdf_scattering_type;
+
+            // sample the next direction using bsdf, there is no other option since there is no bssrdf at all.
+            float   path_pdf;
+            Vector  wi;
+            const auto f = se.Sample_BSDF( -r.m_Dir , wi , BsdfSample(true) , path_pdf );
+            if( f.IsBlack() || path_pdf == 0.0f )
+                continue;
+
+            // as long as the ray is passing through the surface, it is necessary to update the medium stack.
+            const auto interaction_flag = update_interaction_flag(dot(wi,inter.gnormal), dot(-r.m_Dir,inter.gnormal));
+            if (SE_Interaction::SE_REFLECTION != interaction_flag) {
+                MediumInteraction mi;
+                mi.intersect = inter.intersect;
+                mi.mesh = inter.primitive->GetMesh();
+                material->UpdateMediumStack(mi, interaction_flag, ms[path]);
+            }
+
+            // update path weight
+            beta *= f / path_pdf;
+            if( 0.0f == beta.GetIntensity() )
+                continue;
+
+            auto& next_ray = path_ray[path];
+            next_ray.m_Ori = inter.intersect;
+            next_ray.m_Dir = wi;
+            next_ray.m_fMin = 0.0001f;
+
+            if( bounces > 3 && beta.GetMaxComponent() < 0.1f ){
+                auto continueProperbility = std::max( 0.05f , 1.0f - beta.GetMaxComponent() );
+                if( sort_canonical() < continueProperbility )
+                    continue;
+                beta /= 1 - continueProperbility;
+            }
+
+            next_alive.push_back( path );
+        }
+
+        traceShadowRays( shadow_queue , radiance , scene );
+
+        // keep the paths in their original order, neighbouring paths are more likely to be coherent.
+        std::sort( next_alive.begin() , next_alive.end() );
+        std::swap( alive , next_alive );
+    }
+}
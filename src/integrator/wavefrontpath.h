@@ -0,0 +1,61 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "pathtracing.h"
+
+//! @brief  Wavefront path tracing.
+/**
+ * This is the same algorithm as path tracing, except that all paths in a batch advance one bounce at a time instead
+ * of tracing each path to completion before starting the next one. Rays of each bounce are intersected together as a
+ * ray stream, the hits are then sorted by material so that the shader of each material is executed for all of its hits
+ * in a row, which is a lot more friendly to instruction cache when there are lots of materials in the scene. Shadow
+ * rays spawned during shading are queued and traced together after all hits are shaded.
+ * Paths that go through participating media or hit surfaces with SSS are handed over to path tracing for the rest of
+ * their bounces, they are usually a small fraction of all paths and don't fit in the wavefront fashion well.
+ */
+class   WavefrontPathTracing : public PathTracing{
+public:
+    DEFINE_RTTI( WavefrontPathTracing , Integrator );
+
+    //! @brief  Evaluate the radiance along a specific direction.
+    //!
+    //! This simply evaluates a batch with only one ray in it.
+    //!
+    //! @param  ray             The ray to be tested with.
+    //! @param  ps              Pixel sample used to evaluate Monte Carlo method.
+    //! @param  scene           The scene to be evaluated.
+    //! @return                 The radiance along the opposite direction that the ray points to.
+    Spectrum    Li( const Ray& ray , const PixelSample& ps , const Scene& scene ) const override;
+
+    //! @brief  Evaluate the radiance of a batch of rays in a wavefront fashion.
+    //!
+    //! @param  rays            The rays to be tested with.
+    //! @param  ps              The pixel samples, one for each ray.
+    //! @param  radiance        The radiance along the opposite direction of each ray.
+    //! @param  cnt             The number of rays in the batch.
+    //! @param  scene           The scene to be evaluated.
+    void        LiStream( const Ray* rays , const PixelSample* ps , Spectrum* radiance , unsigned cnt , const Scene& scene ) const override;
+
+    //! @brief  Wavefront path tracing always prefers evaluating rays in a batch.
+    bool        IsWavefront() const override {
+        return true;
+    }
+
+    SORT_STATS_ENABLE( "Wavefront Path Tracing" )
+};
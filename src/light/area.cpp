@@ -74,6 +74,18 @@ float AreaLight::Pdf( const Point& p , const Vector& wi ) const{
     return m_shape->Pdf( p , wi );
 }
 
+bool AreaLight::GetBounds( LightBounds& bounds ) const{
+    sAssert(IS_PTR_VALID(m_shape), LIGHT );
+
+    // area light only emits light on the front side of the shape
+    bounds.m_bbox = m_shape->GetBBox();
+    bounds.m_axis = normalize( m_light2world.TransformVector( DIR_UP ) );
+    bounds.m_cosThetaO = 1.0f;
+    bounds.m_cosThetaE = 0.0f;
+    bounds.m_power = Power().GetIntensity();
+    return true;
+}
+
 Spectrum AreaLight::Power() const{
     sAssert(IS_PTR_VALID(m_shape), LIGHT );
     return m_shape->SurfaceArea() * intensity.GetIntensity() * TWO_PI;
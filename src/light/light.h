@@ -21,6 +21,7 @@
 #include "math/transform.h"
 #include "core/scene.h"
 #include "math/vector3.h"
+#include "light/lightbvh.h"
 
 struct SurfaceInteraction;
 class LightSample;
@@ -111,6 +112,17 @@ public:
         return nullptr;
     }
 
+    //! @brief  Get the bounds of the emission of the light.
+    //!
+    //! Lights with bounds are sampled with light BVH given a shading point, the rest of them, like infinite
+    //! lights, are sampled separately.
+    //!
+    //! @param  bounds  The bounds of the emission of the light.
+    //! @return         Whether the light could be bounded.
+    virtual bool        GetBounds( LightBounds& bounds ) const {
+        return false;
+    }
+
     //! @brief  The pdf w.r.t solid angle if the ray starting from 'p', tracing through 'wi' hits the light source.
     //!
     //! @param  p       The point in world space to be shaded.
@@ -192,6 +204,20 @@ public:
         return false;
     }
 
+    //! @brief  Evaluate the radiance of a batch of rays that miss everything else in the scene.
+    //!
+    //! This is only meaningful for infinite lights. By default, it simply evaluates the rays one by one.
+    //!
+    //! @param  rays            The rays to be evaluated.
+    //! @param  cnt             The number of rays in the batch.
+    //! @param  radiance        The radiance goes from the light source to each ray origin.
+    virtual void LeStream( const Ray* rays , unsigned cnt , Spectrum* radiance ) const {
+        for( auto i = 0u ; i < cnt ; ++i ){
+            radiance[i] = 0.0f;
+            Le( rays[i] , nullptr , radiance[i] );
+        }
+    }
+
 protected:
     /**< The rendering scene. */
     const Scene* m_scene = nullptr;
@@ -0,0 +1,329 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "lightbvh.h"
+#include "math/utils.h"
+
+// Number of buckets along each axis to evaluate splits when building light BVH.
+#define LIGHT_BVH_SPLIT_BUCKET_CNT  12
+
+// Beyond this depth, lights are split by count to guarantee the bit trail has enough bits.
+#define LIGHT_BVH_MAX_SAH_DEPTH     32
+
+// The largest float number that is smaller than one.
+static constexpr float ONE_MINUS_EPSILON = 0x1.fffffep-1f;
+
+// cos(max(0, a - b)) given the sin and cos of both angles.
+SORT_STATIC_FORCEINLINE float cosSubClamped( const float sin_a , const float cos_a , const float sin_b , const float cos_b ){
+    if( cos_a > cos_b )
+        return 1.0f;
+    return cos_a * cos_b + sin_a * sin_b;
+}
+
+// sin(max(0, a - b)) given the sin and cos of both angles.
+SORT_STATIC_FORCEINLINE float sinSubClamped( const float sin_a , const float cos_a , const float sin_b , const float cos_b ){
+    if( cos_a > cos_b )
+        return 0.0f;
+    return sin_a * cos_b - cos_a * sin_b;
+}
+
+// Rotate a vector around an axis by an angle.
+SORT_STATIC_FORCEINLINE Vector rotate( const Vector& v , const Vector& axis , const float theta ){
+    const auto k = normalize( axis );
+    const auto cos_theta = cos( theta );
+    const auto sin_theta = sin( theta );
+    return v * cos_theta + cross( k , v ) * sin_theta + k * ( dot( k , v ) * ( 1.0f - cos_theta ) );
+}
+
+// Measure of the solid angle of the emission, it is what the surface area is to the spatial bounds.
+SORT_STATIC_FORCEINLINE float orientationMeasure( const LightBounds& bounds ){
+    const auto theta_o = acos( clamp( bounds.m_cosThetaO , -1.0f , 1.0f ) );
+    const auto theta_e = acos( clamp( bounds.m_cosThetaE , -1.0f , 1.0f ) );
+    const auto theta_w = std::min( theta_o + theta_e , PI );
+    const auto sin_theta_o = ssqrt( 1.0f - SQR( bounds.m_cosThetaO ) );
+    return TWO_PI * ( 1.0f - bounds.m_cosThetaO ) +
+           PI * 0.5f * ( 2.0f * theta_w * sin_theta_o - cos( theta_o - 2.0f * theta_w ) - 2.0f * theta_o * sin_theta_o + bounds.m_cosThetaO );
+}
+
+float LightBounds::Importance( const Point& p , const Vector& n ) const{
+    if( m_power <= 0.0f )
+        return 0.0f;
+
+    // the lights are right at the shading point
+    const auto center = Centroid();
+    auto wi = p - center;
+    const auto d2 = std::max( wi.SquaredLength() , ( m_bbox.m_Max - m_bbox.m_Min ).Length() * 0.5f );
+    if( wi.SquaredLength() > 0.0f )
+        wi = normalize( wi );
+
+    // angle between the axis and the direction to the shading point
+    auto cos_theta_w = dot( m_axis , wi );
+    if( m_twoSided )
+        cos_theta_w = fabs( cos_theta_w );
+    const auto sin_theta_w = ssqrt( 1.0f - SQR( cos_theta_w ) );
+
+    // angle subtended by the bounding box from the shading point
+    auto cos_theta_b = -1.0f;
+    if( !m_bbox.IsInBBox( p , 0.0f ) ){
+        const auto radius2 = ( m_bbox.m_Max - center ).SquaredLength();
+        const auto dist2 = ( p - center ).SquaredLength();
+        if( dist2 > radius2 )
+            cos_theta_b = ssqrt( 1.0f - radius2 / dist2 );
+    }
+    const auto sin_theta_b = ssqrt( 1.0f - SQR( cos_theta_b ) );
+
+    // minimum angle between the emission and the direction to the shading point
+    const auto sin_theta_o = ssqrt( 1.0f - SQR( m_cosThetaO ) );
+    const auto cos_theta_x = cosSubClamped( sin_theta_w , cos_theta_w , sin_theta_o , m_cosThetaO );
+    const auto sin_theta_x = sinSubClamped( sin_theta_w , cos_theta_w , sin_theta_o , m_cosThetaO );
+    const auto cos_theta_p = cosSubClamped( sin_theta_x , cos_theta_x , sin_theta_b , cos_theta_b );
+    if( cos_theta_p <= m_cosThetaE )
+        return 0.0f;
+
+    auto importance = m_power * cos_theta_p / d2;
+
+    // account for the cos factor at the shading point
+    if( n.SquaredLength() > 0.0f ){
+        const auto cos_theta_i = absDot( wi , n );
+        const auto sin_theta_i = ssqrt( 1.0f - SQR( cos_theta_i ) );
+        importance *= cosSubClamped( sin_theta_i , cos_theta_i , sin_theta_b , cos_theta_b );
+    }
+
+    return std::max( importance , 0.0f );
+}
+
+LightBounds Union( const LightBounds& b0 , const LightBounds& b1 ){
+    if( b0.m_power <= 0.0f )
+        return b1;
+    if( b1.m_power <= 0.0f )
+        return b0;
+
+    LightBounds ret;
+    ret.m_bbox = Union( b0.m_bbox , b1.m_bbox );
+    ret.m_power = b0.m_power + b1.m_power;
+    ret.m_cosThetaE = std::min( b0.m_cosThetaE , b1.m_cosThetaE );
+    ret.m_twoSided = b0.m_twoSided || b1.m_twoSided;
+
+    // merge the two cones of normals
+    const auto theta_0 = acos( clamp( b0.m_cosThetaO , -1.0f , 1.0f ) );
+    const auto theta_1 = acos( clamp( b1.m_cosThetaO , -1.0f , 1.0f ) );
+    const auto theta_d = acos( clamp( dot( b0.m_axis , b1.m_axis ) , -1.0f , 1.0f ) );
+    if( std::min( theta_d + theta_1 , PI ) <= theta_0 ){
+        ret.m_axis = b0.m_axis;
+        ret.m_cosThetaO = b0.m_cosThetaO;
+        return ret;
+    }
+    if( std::min( theta_d + theta_0 , PI ) <= theta_1 ){
+        ret.m_axis = b1.m_axis;
+        ret.m_cosThetaO = b1.m_cosThetaO;
+        return ret;
+    }
+
+    const auto theta_o = ( theta_0 + theta_d + theta_1 ) * 0.5f;
+    const auto rotation_axis = cross( b0.m_axis , b1.m_axis );
+    if( theta_o >= PI || rotation_axis.SquaredLength() == 0.0f ){
+        ret.m_axis = b0.m_axis;
+        ret.m_cosThetaO = -1.0f;
+        return ret;
+    }
+
+    ret.m_axis = normalize( rotate( b0.m_axis , rotation_axis , theta_o - theta_0 ) );
+    ret.m_cosThetaO = cos( theta_o );
+    return ret;
+}
+
+void LightBVH::Build( const std::vector<LightBounds>& bounds ){
+    m_nodes.clear();
+    m_bitTrails.assign( bounds.size() , 0 );
+
+    std::vector<BuildLight> lights;
+    for( auto i = 0u ; i < bounds.size() ; ++i ){
+        // lights that don't emit anything are never picked
+        if( bounds[i].m_power <= 0.0f )
+            continue;
+        lights.push_back( { i , bounds[i] , bounds[i].Centroid() } );
+    }
+
+    if( lights.empty() )
+        return;
+
+    m_nodes.reserve( 2 * lights.size() - 1 );
+    build( lights , 0 , (unsigned)lights.size() , 0 , 0 );
+}
+
+unsigned LightBVH::build( std::vector<BuildLight>& lights , unsigned start , unsigned end , std::uint64_t bit_trail , unsigned depth ){
+    const auto node_id = (unsigned)m_nodes.size();
+    m_nodes.push_back( Node() );
+
+    if( end - start == 1 ){
+        auto& node = m_nodes[node_id];
+        node.m_bounds = lights[start].m_bounds;
+        node.m_childOrLight = lights[start].m_light;
+        node.m_isLeaf = true;
+        m_bitTrails[lights[start].m_light] = bit_trail;
+        return node_id;
+    }
+
+    LightBounds bounds;
+    BBox centroid_bbox;
+    for( auto i = start ; i < end ; ++i ){
+        bounds = Union( bounds , lights[i].m_bounds );
+        centroid_bbox.Union( lights[i].m_centroid );
+    }
+
+    // Pick the split with the lowest cost, the cost is the product of power, spatial and directional measure of both
+    // children, similar to surface area heuristic in BVH for primitives.
+    auto split_axis = -1;
+    auto split_bucket = 0;
+    auto min_cost = FLT_MAX;
+    if( depth < LIGHT_BVH_MAX_SAH_DEPTH ){
+        const auto extent = bounds.m_bbox.m_Max - bounds.m_bbox.m_Min;
+        const auto max_extent = std::max( extent[0] , std::max( extent[1] , extent[2] ) );
+        for( auto axis = 0 ; axis < 3 ; ++axis ){
+            const auto axis_min = centroid_bbox.m_Min[axis];
+            const auto axis_max = centroid_bbox.m_Max[axis];
+            if( axis_max <= axis_min )
+                continue;
+
+            LightBounds buckets[LIGHT_BVH_SPLIT_BUCKET_CNT];
+            for( auto i = start ; i < end ; ++i ){
+                const auto b = std::min( (int)( LIGHT_BVH_SPLIT_BUCKET_CNT * ( lights[i].m_centroid[axis] - axis_min ) / ( axis_max - axis_min ) ) , LIGHT_BVH_SPLIT_BUCKET_CNT - 1 );
+                buckets[b] = Union( buckets[b] , lights[i].m_bounds );
+            }
+
+            // thin bounds along an axis are penalized since they make the directional measure less meaningful
+            const auto kr = extent[axis] > 0.0f ? max_extent / extent[axis] : 1.0f;
+            const auto cost = [&]( const LightBounds& b ){
+                return b.m_power * orientationMeasure( b ) * b.m_bbox.SurfaceArea() * kr;
+            };
+
+            for( auto i = 0 ; i < LIGHT_BVH_SPLIT_BUCKET_CNT - 1 ; ++i ){
+                LightBounds b0, b1;
+                for( auto j = 0 ; j <= i ; ++j )
+                    b0 = Union( b0 , buckets[j] );
+                for( auto j = i + 1 ; j < LIGHT_BVH_SPLIT_BUCKET_CNT ; ++j )
+                    b1 = Union( b1 , buckets[j] );
+                const auto c = cost( b0 ) + cost( b1 );
+                if( c > 0.0f && c < min_cost ){
+                    min_cost = c;
+                    split_axis = axis;
+                    split_bucket = i;
+                }
+            }
+        }
+    }
+
+    auto mid = start;
+    if( split_axis >= 0 ){
+        const auto axis_min = centroid_bbox.m_Min[split_axis];
+        const auto axis_max = centroid_bbox.m_Max[split_axis];
+        const auto it = std::partition( lights.begin() + start , lights.begin() + end , [&]( const BuildLight& light ){
+            const auto b = std::min( (int)( LIGHT_BVH_SPLIT_BUCKET_CNT * ( light.m_centroid[split_axis] - axis_min ) / ( axis_max - axis_min ) ) , LIGHT_BVH_SPLIT_BUCKET_CNT - 1 );
+            return b <= split_bucket;
+        });
+        mid = (unsigned)( it - lights.begin() );
+    }
+
+    // fall back to splitting by count if there is no valid split
+    if( mid == start || mid == end ){
+        mid = ( start + end ) / 2;
+        const auto axis = centroid_bbox.MaxAxisId();
+        std::nth_element( lights.begin() + start , lights.begin() + mid , lights.begin() + end , [&]( const BuildLight& l0 , const BuildLight& l1 ){
+            return l0.m_centroid[axis] < l1.m_centroid[axis];
+        });
+    }
+
+    build( lights , start , mid , bit_trail , depth + 1 );
+    const auto second_child = build( lights , mid , end , bit_trail | ( (std::uint64_t)1 << depth ) , depth + 1 );
+
+    auto& node = m_nodes[node_id];
+    node.m_bounds = bounds;
+    node.m_childOrLight = second_child;
+    node.m_isLeaf = false;
+    return node_id;
+}
+
+int LightBVH::Sample( const Point& p , const Vector& n , float u , float* pmf ) const{
+    if( pmf )
+        *pmf = 0.0f;
+    if( m_nodes.empty() )
+        return -1;
+
+    auto node_id = 0u;
+    auto prob = 1.0f;
+    while( true ){
+        const auto& node = m_nodes[node_id];
+        if( node.m_isLeaf ){
+            if( node.m_bounds.Importance( p , n ) <= 0.0f )
+                return -1;
+            if( pmf )
+                *pmf = prob;
+            return (int)node.m_childOrLight;
+        }
+
+        const auto importance0 = m_nodes[node_id + 1].m_bounds.Importance( p , n );
+        const auto importance1 = m_nodes[node.m_childOrLight].m_bounds.Importance( p , n );
+        if( importance0 == 0.0f && importance1 == 0.0f )
+            return -1;
+
+        // pick a child and remap the random number so that it can be used in the next level
+        const auto p0 = importance0 / ( importance0 + importance1 );
+        if( u < p0 ){
+            node_id = node_id + 1;
+            u = std::min( u / p0 , ONE_MINUS_EPSILON );
+            prob *= p0;
+        }else{
+            node_id = node.m_childOrLight;
+            u = std::min( ( u - p0 ) / ( 1.0f - p0 ) , ONE_MINUS_EPSILON );
+            prob *= 1.0f - p0;
+        }
+    }
+}
+
+float LightBVH::Pmf( const Point& p , const Vector& n , unsigned light ) const{
+    if( m_nodes.empty() || light >= m_bitTrails.size() )
+        return 0.0f;
+
+    auto bit_trail = m_bitTrails[light];
+    auto node_id = 0u;
+    auto prob = 1.0f;
+    while( true ){
+        const auto& node = m_nodes[node_id];
+        if( node.m_isLeaf ){
+            if( node.m_childOrLight != light || node.m_bounds.Importance( p , n ) <= 0.0f )
+                return 0.0f;
+            return prob;
+        }
+
+        const auto importance0 = m_nodes[node_id + 1].m_bounds.Importance( p , n );
+        const auto importance1 = m_nodes[node.m_childOrLight].m_bounds.Importance( p , n );
+        if( importance0 == 0.0f && importance1 == 0.0f )
+            return 0.0f;
+
+        const auto p0 = importance0 / ( importance0 + importance1 );
+        if( bit_trail & 1 ){
+            node_id = node.m_childOrLight;
+            prob *= 1.0f - p0;
+        }else{
+            node_id = node_id + 1;
+            prob *= p0;
+        }
+        bit_trail >>= 1;
+    }
+}
@@ -0,0 +1,136 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "core/define.h"
+#include "math/bbox.h"
+#include "math/point.h"
+#include "math/vector3.h"
+
+//! @brief  Bounds of the emission of a light, or a cluster of lights.
+/**
+ * Other than the spatial bounds, the directions of emission are bounded by two cones. The normals of all emitters
+ * are bounded in a cone around an axis, while each emitter emits light within an extra spread around its normal.
+ * This is what it takes to estimate how much a cluster of lights contributes to a shading point without touching
+ * any of the lights in it.
+ * 'Importance Sampling of Many Lights With Adaptive Tree Splitting', Estevez & Kulla
+ * http://www.aconty.com/pdf/many-lights-hpg2018.pdf
+ */
+struct LightBounds {
+    BBox    m_bbox;                 /**< Bounding box of all emitters. */
+    Vector  m_axis = DIR_UP;        /**< Axis of the cone bounding the normals of all emitters. */
+    float   m_cosThetaO = 1.0f;     /**< Cos of the spread of the normals around the axis. */
+    float   m_cosThetaE = 0.0f;     /**< Cos of the spread of the emission around each normal. */
+    float   m_power = 0.0f;         /**< Total power of all emitters. */
+    bool    m_twoSided = false;     /**< Whether the emitters emit light on both sides. */
+
+    //! @brief  Estimate the contribution of the emitters to a shading point.
+    //!
+    //! The estimation is conservative in a way that it is never zero if any emitter could contribute to the point.
+    //!
+    //! @param  p       The shading point.
+    //! @param  n       The normal at the shading point, zero vector for points in medium.
+    //! @return         The importance of the emitters at the shading point.
+    float   Importance( const Point& p , const Vector& n ) const;
+
+    //! @brief  Centroid of the spatial bounds.
+    //!
+    //! @return         The centroid of the bounding box.
+    Point   Centroid() const {
+        return ( m_bbox.m_Min + m_bbox.m_Max ) * 0.5f;
+    }
+};
+
+//! @brief  Merge two light bounds.
+//!
+//! @param  b0      The first light bounds.
+//! @param  b1      The second light bounds.
+//! @return         Light bounds that bound both of them.
+LightBounds Union( const LightBounds& b0 , const LightBounds& b1 );
+
+//! @brief  Light BVH is a binary tree of light bounds for sampling lights given a shading point.
+/**
+ * Picking a light based on its power only is far from optimal when there are lots of lights, most of them are either
+ * too far away or facing away from the shading point. Light BVH descends from the root to a light, choosing a child
+ * at each node proportional to the importance of the child at the shading point.
+ * Lights are identified by their indices in the array used to build the BVH, only lights with finite bounds can be
+ * put in a light BVH.
+ */
+class LightBVH {
+public:
+    //! @brief  Build the light BVH.
+    //!
+    //! @param  bounds      The bounds of all lights.
+    void    Build( const std::vector<LightBounds>& bounds );
+
+    //! @brief  Whether there is no light in the BVH.
+    //!
+    //! @return             True if there is no light in the BVH.
+    bool    IsEmpty() const {
+        return m_nodes.empty();
+    }
+
+    //! @brief  Sample a light given a shading point.
+    //!
+    //! @param  p           The shading point.
+    //! @param  n           The normal at the shading point, zero vector for points in medium.
+    //! @param  u           A canonical random number.
+    //! @param  pmf         The probability of picking the light.
+    //! @return             Index of the light picked, -1 if no light could contribute to the point.
+    int     Sample( const Point& p , const Vector& n , float u , float* pmf ) const;
+
+    //! @brief  Get the probability of picking a light given a shading point.
+    //!
+    //! @param  p           The shading point.
+    //! @param  n           The normal at the shading point, zero vector for points in medium.
+    //! @param  light       Index of the light.
+    //! @return             The probability of picking the light with 'Sample'.
+    float   Pmf( const Point& p , const Vector& n , unsigned light ) const;
+
+private:
+    //! @brief  Node in the light BVH.
+    struct Node {
+        LightBounds     m_bounds;           /**< Bounds of all lights under the node. */
+        unsigned        m_childOrLight;     /**< Index of the second child for interior node, the first one is right after it. Index of the light for leaf node. */
+        bool            m_isLeaf;           /**< Whether this is a leaf node. */
+    };
+
+    //! @brief  Light to be sorted during building.
+    struct BuildLight {
+        unsigned        m_light;            /**< Index of the light. */
+        LightBounds     m_bounds;           /**< Bounds of the light. */
+        Point           m_centroid;         /**< Centroid of the light bounds. */
+    };
+
+    //! @brief  Build the sub-tree of a range of lights recursively.
+    //!
+    //! @param  lights      All lights to be built.
+    //! @param  start       The first light in the range.
+    //! @param  end         One after the last light in the range.
+    //! @param  bit_trail   Bits indicating which child is taken at each level to reach the node.
+    //! @param  depth       Depth of the node.
+    //! @return             Index of the node.
+    unsigned    build( std::vector<BuildLight>& lights , unsigned start , unsigned end , std::uint64_t bit_trail , unsigned depth );
+
+    /**< All nodes in depth-first order. */
+    std::vector<Node>           m_nodes;
+    /**< Bits indicating which child is taken at each level to reach each light. */
+    std::vector<std::uint64_t>  m_bitTrails;
+};
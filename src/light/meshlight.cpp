@@ -0,0 +1,185 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "meshlight.h"
+#include "sampler/sample.h"
+#include "shape/triangle.h"
+
+// Offset to avoid self intersection when tracing rays from a surface to the light.
+static constexpr float LIGHT_RAY_OFFSET = 0.001f;
+
+MeshLight::MeshLight( const std::vector<const Triangle*>& triangles , const Spectrum& radiance ): m_triangles(triangles){
+    intensity = radiance;
+
+    std::vector<float> areas( m_triangles.size() );
+    for( auto i = 0u ; i < m_triangles.size() ; ++i ){
+        areas[i] = m_triangles[i]->SurfaceArea();
+        m_area += areas[i];
+        m_triangleIndices[m_triangles[i]] = i;
+    }
+    m_triangleDis = std::make_unique<AliasTable>( areas.data() , (unsigned)areas.size() );
+}
+
+Spectrum MeshLight::sample_l(const Point& ip, const LightSample* ls , Vector& dirToLight , float* distance , float* pdfW , float* emissionPdf , float* cosAtLight , Visibility& visibility ) const{
+    sAssert(IS_PTR_VALID(ls), LIGHT );
+
+    if( pdfW )
+        *pdfW = 0.0f;
+
+    // pick a triangle, the rest of the canonical number is used to sample the triangle
+    auto pmf = 0.0f;
+    LightSample triangle_sample = *ls;
+    const auto id = m_triangleDis->Sample( ls->u , &pmf , &triangle_sample.u );
+    if( id < 0 || pmf == 0.0f )
+        return 0.0f;
+
+    // sample a point on the triangle
+    Vector normal;
+    auto pdf = 0.0f;
+    const auto ps = m_triangles[id]->Sample_l( triangle_sample , ip , dirToLight , normal , &pdf );
+
+    // only the front side of the triangles emits light
+    const auto cos = dot( -dirToLight , normal );
+    if( pdf == 0.0f || cos <= 0.0f )
+        return 0.0f;
+
+    if( pdfW )
+        *pdfW = pmf * pdf;
+
+    if( cosAtLight )
+        *cosAtLight = cos;
+
+    const auto len = ( ps - ip ).Length();
+    if( distance )
+        *distance = len;
+
+    // product of pdf of sampling a point w.r.t surface area and a direction w.r.t direction
+    if( emissionPdf )
+        *emissionPdf = UniformHemispherePdf() / m_area;
+
+    // setup visibility tester
+    const float delta = 0.01f;
+    visibility.ray = Ray( ip , dirToLight , 0 , delta , len - delta );
+
+    return intensity;
+}
+
+Spectrum MeshLight::sample_l( const LightSample& ls , Ray& r , float* pdfW , float* pdfA , float* cosAtLight ) const{
+    // pick a triangle proportional to its surface area, points are uniformly distributed on the light then
+    auto pmf = 0.0f;
+    LightSample triangle_sample = ls;
+    const auto id = m_triangleDis->Sample( ls.u , &pmf , &triangle_sample.u );
+    if( id < 0 || pmf == 0.0f ){
+        if( pdfW ) *pdfW = 0.0f;
+        return 0.0f;
+    }
+
+    Vector n;
+    m_triangles[id]->Sample_l( triangle_sample , r , n , nullptr );
+
+    if( pdfW )
+        *pdfW = UniformHemispherePdf() / m_area;
+
+    if( pdfA )
+        *pdfA = 1.0f / m_area;
+
+    if( cosAtLight )
+        *cosAtLight = satDot( r.m_Dir , n );
+
+    // to avoid self intersection
+    r.m_fMin = 0.01f;
+
+    return intensity;
+}
+
+float MeshLight::Pdf( const Point& p , const Vector& wi ) const{
+    sAssert(IS_PTR_VALID(m_scene), LIGHT);
+
+    // the triangle that the direction samples is the closest one along the ray
+    SurfaceInteraction inter;
+    if( !m_scene->GetIntersect( Ray( p , wi , 0 , LIGHT_RAY_OFFSET ) , inter ) || inter.primitive->GetLight() != this )
+        return 0.0f;
+
+    const auto it = m_triangleIndices.find( inter.primitive->GetShape() );
+    if( it == m_triangleIndices.end() )
+        return 0.0f;
+    return m_triangleDis->GetProperty( it->second ) * m_triangles[it->second]->Pdf( p , wi );
+}
+
+bool MeshLight::GetBounds( LightBounds& bounds ) const{
+    if( m_triangles.empty() )
+        return false;
+
+    // the axis of the cone is the area weighted average of the triangle normals
+    Vector axis;
+    BBox bbox;
+    for( const auto triangle : m_triangles ){
+        axis += triangle->GetNormal() * triangle->SurfaceArea();
+        bbox.Union( triangle->GetBBox() );
+    }
+
+    auto cos_theta_o = -1.0f;
+    if( axis.SquaredLength() > 0.0f ){
+        axis = normalize( axis );
+        cos_theta_o = 1.0f;
+        for( const auto triangle : m_triangles )
+            cos_theta_o = std::min( cos_theta_o , dot( axis , triangle->GetNormal() ) );
+    }else{
+        axis = DIR_UP;
+    }
+
+    bounds.m_bbox = bbox;
+    bounds.m_axis = axis;
+    bounds.m_cosThetaO = cos_theta_o;
+    bounds.m_cosThetaE = 0.0f;
+    bounds.m_power = Power().GetIntensity();
+    return true;
+}
+
+Spectrum MeshLight::Power() const{
+    return m_area * intensity.GetIntensity() * TWO_PI;
+}
+
+Spectrum MeshLight::Le( const SurfaceInteraction& intersect , const Vector& wo , float* directPdfA , float* emissionPdf ) const{
+    const float cos = satDot( wo , intersect.normal );
+    if( cos == 0.0f )
+        return 0.0f;
+
+    if( directPdfA )
+        *directPdfA = 1.0f / m_area;
+
+    if( emissionPdf )
+        *emissionPdf = UniformHemispherePdf() / m_area;
+
+    return intensity;
+}
+
+bool MeshLight::Le( const Ray& ray , SurfaceInteraction* intersect , Spectrum& radiance ) const{
+    sAssert(IS_PTR_VALID(m_scene), LIGHT );
+
+    SurfaceInteraction inter;
+    auto& ret = IS_PTR_VALID(intersect) ? *intersect : inter;
+    if( !m_scene->GetIntersect( Ray( ray.m_Ori , ray.m_Dir , 0 , std::max( ray.m_fMin , LIGHT_RAY_OFFSET ) , ray.m_fMax ) , ret ) )
+        return false;
+
+    // the ray hits something else before reaching the light
+    if( ret.primitive->GetLight() != this )
+        return false;
+
+    radiance = Le( ret , -ray.m_Dir , 0 , 0 );
+    return true;
+}
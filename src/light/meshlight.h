@@ -0,0 +1,129 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include "light.h"
+#include "core/samplemethod.h"
+
+class Triangle;
+
+//! @brief  Definition of mesh light source.
+/**
+ * Mesh light is made of the triangles of a mesh that share the same emissive material. A triangle is picked
+ * with the probability proportional to its surface area through an alias table first, the spherical triangle
+ * subtended by it is then uniformly sampled given the shading point. Like area light, only the front side of
+ * the triangles, where the vertex normals point to, emits light.
+ */
+class   MeshLight : public Light{
+public:
+    //! @brief  Constructor.
+    //!
+    //! @param  triangles       Emissive triangles of the light source, they are all in world space already.
+    //! @param  radiance        Radiance emitted by the triangles.
+    MeshLight( const std::vector<const Triangle*>& triangles , const Spectrum& radiance );
+
+    //! @brief  Sample a direction given the intersection.
+    //!
+    //! Given an intersection, do importance sampling to pick a direction from intersection to light source.
+    //! For some light sources, light point light, spot light and distant light, it is trival. However, it
+    //! needs some decent algorithm to make it efficient for some other light sources like area light.
+    //!
+    //! @param  ip              The point where we are interested in shading at.
+    //! @param  ls              The light sample information.
+    //! @param  dirToLight      The resulting direction goes from the intersection to light source.
+    //! @param  distance        The distance from the intersected point to the sampled point, which is the intersection
+    //!                         between the out-going direction and the light source.
+    //! @param  pdfw            The resulting pdf w.r.t solid angle to pick such a direction.
+    //! @param  emissionPdf     The pdf w.r.t solid angle if such a direction and position ( which is the intersection
+    //!                         between the resulting direction to the light source ) is picked by the light source.
+    //! @param  cosAtLight      The cos of the angle between the light out-going direction, the opposite of 'dirToLight'.
+    //! @param  visibility      The visibility data structured filled by the light source.
+    //! @return                 The radiance goes from the light source to the intersected point.
+    Spectrum sample_l(const Point& ip, const LightSample* ls , Vector& dirToLight , float* distance , float* pdfw , float* emissionPdf , float* cosAtLight , Visibility& visibility ) const override;
+
+    //! @brief      Sample a point and light out-going direction.
+    //!
+    //! The difference of this version the the above one is there is no intersection data given.
+    //!
+    //! @param  ls              The light sample.
+    //! @param  r               The resulting sampled ray.
+    //! @param  pdfA            The pdf w.r.t area of picking such a light out-going ray. It is simply one for delta light.
+    //! @param  cosAtLight      The cos of the angle between the light out-going direction, the opposite of 'dirToLight'.
+    //! @return                 The radiance goes from the light source to the intersected point.
+    Spectrum sample_l( const LightSample& ls , Ray& r , float* pdfW , float* pdfA , float* cosAtLight ) const override;
+
+    //! @brief  Get the radiance light starting from the light source and ending at the intersection point.
+    //!
+    //! @param  intersect       The intersection information.
+    //! @param  wo              The direction goes from the intersection to the light source.
+    //! @param  directPdfA      The pdf w.r.t area to pick the point, intersection between the direction and the light source.
+    //! @param  emissionPdf     The pdf w.r.t solid angle to pick to sample such a position and direction goes to the intersection.
+    //! @return                 The radiance goes from the light source to the intersection, black if there is no intersection.
+    Spectrum Le( const SurfaceInteraction& intersect , const Vector& wo , float* directPdfA , float* emissionPdf ) const override;
+
+    //! @brief  Given a ray, sample the light source if there is any intersection between the ray and the light source.
+    //!
+    //! Instead of testing the ray against all triangles of the light, the ray is traced in the scene and the
+    //! intersection only counts if the closest primitive belongs to this light.
+    //!
+    //! @param  ray             The ray to be evaluated.
+    //! @param  intersect       The intersection between the ray and the light source.
+    //! @param  radiance        The radiance goes from the light source to the ray origin.
+    //! @return                 Whether there is an intersection between the ray and the light source.
+    bool Le( const Ray& ray , SurfaceInteraction* intersect , Spectrum& radiance ) const override;
+
+    //! @brief  Approximation of total power of the light.
+    //!
+    //! @return     Approximation of the light power.
+    Spectrum Power() const override;
+
+    //! @brief  Get the bounds of the emission of the light.
+    //!
+    //! The normals of the triangles are bounded by a cone around their area weighted average.
+    //!
+    //! @param  bounds  The bounds of the emission of the light.
+    //! @return         Whether the light could be bounded.
+    bool GetBounds( LightBounds& bounds ) const override;
+
+    //! @brief  Whether mesh light is a delta light.
+    //!
+    //! @return     Always return 'False' for mesh light because it is not delta light.
+    bool    IsDelta() const override{
+        return false;
+    }
+
+    //! @brief  The pdf w.r.t solid angle if the ray starting from 'p', tracing through 'wi' hits the light source.
+    //!
+    //! @param  p       The point in world space to be shaded.
+    //! @param  wi      The direction pointing from the point.
+    //! @return         The pdf w.r.t solid angle if the ray starting from 'p', tracing through 'wi' hits the light source.
+    float Pdf( const Point& p , const Vector& wi ) const override;
+
+private:
+    /**< Emissive triangles of the light source. */
+    std::vector<const Triangle*>                m_triangles;
+    /**< Index of each triangle in the light source. */
+    std::unordered_map<const Shape*, unsigned>  m_triangleIndices;
+    /**< Alias table to pick triangles proportional to their surface area. */
+    std::unique_ptr<AliasTable>                 m_triangleDis;
+    /**< Total surface area of the triangles. */
+    float                                       m_area = 0.0f;
+};
@@ -20,6 +20,17 @@
 #include "core/samplemethod.h"
 #include "sampler/sample.h"
 
+bool PointLight::GetBounds( LightBounds& bounds ) const{
+    const auto light_pos = Point( m_light2world.matrix.m[3] , m_light2world.matrix.m[7] , m_light2world.matrix.m[11] );
+
+    // point light emits light in all directions
+    bounds.m_bbox = BBox( light_pos , light_pos );
+    bounds.m_cosThetaO = -1.0f;
+    bounds.m_cosThetaE = 0.0f;
+    bounds.m_power = Power().GetIntensity();
+    return true;
+}
+
 // sample ray from light
 Spectrum PointLight::sample_l(const Point& ip, const LightSample* ls , Vector& dirToLight , float* distance , float* pdfw , float* emissionPdf , float* cosAtLight , Visibility& visibility ) const{
     const auto light_pos = Point( m_light2world.matrix.m[3] , m_light2world.matrix.m[7] , m_light2world.matrix.m[11] );
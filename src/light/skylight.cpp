@@ -112,6 +112,22 @@ bool SkyLight::Le( const Ray& ray , SurfaceInteraction* intersect , Spectrum& ra
     return true;
 }
 
+void SkyLight::LeStream( const Ray* rays , unsigned cnt , Spectrum* radiance ) const{
+    const auto world2light = m_light2world.GetInversed();
+
+    // directions are transformed in small chunks so that they stay on the stack.
+    constexpr unsigned CHUNK_SIZE = 64;
+    Vector dirs[CHUNK_SIZE];
+    for( auto offset = 0u ; offset < cnt ; offset += CHUNK_SIZE ){
+        const auto chunk = std::min( CHUNK_SIZE , cnt - offset );
+        for( auto i = 0u ; i < chunk ; ++i )
+            dirs[i] = world2light.TransformVector( rays[offset + i].m_Dir );
+        sky.Evaluate( dirs , chunk , radiance + offset );
+        for( auto i = 0u ; i < chunk ; ++i )
+            radiance[offset + i] *= intensity;
+    }
+}
+
 float SkyLight::Pdf( const Point& p , const Vector& wi ) const{
     return sky.Pdf( m_light2world.GetInversed().TransformVector(wi) );
 }
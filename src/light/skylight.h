@@ -80,6 +80,15 @@ public:
     //! @return                 Whether there is an intersection between the ray and the light source.
     bool Le( const Ray& ray , SurfaceInteraction* intersect , Spectrum& radiance ) const override;
 
+    //! @brief  Evaluate the radiance of a batch of rays that miss everything else in the scene.
+    //!
+    //! The sky texture is looked up for all rays in one batch.
+    //!
+    //! @param  rays            The rays to be evaluated.
+    //! @param  cnt             The number of rays in the batch.
+    //! @param  radiance        The radiance goes from the light source to each ray origin.
+    void LeStream( const Ray* rays , unsigned cnt , Spectrum* radiance ) const override;
+
     //! @brief  Whether the light is an infinite light source.
     //!
     //! @return     Whether the light is an infinite light.
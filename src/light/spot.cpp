@@ -20,6 +20,19 @@
 #include "sampler/sample.h"
 #include "core/samplemethod.h"
 
+bool SpotLight::GetBounds( LightBounds& bounds ) const{
+    const auto light_dir = Vector3f( m_light2world.matrix.m[1] , m_light2world.matrix.m[5] , m_light2world.matrix.m[9] );
+    const auto light_pos = Point( m_light2world.matrix.m[3] , m_light2world.matrix.m[7] , m_light2world.matrix.m[11] );
+
+    // full intensity within the falloff start, the rest of the range is the spread of the emission
+    bounds.m_bbox = BBox( light_pos , light_pos );
+    bounds.m_axis = normalize( light_dir );
+    bounds.m_cosThetaO = cos_falloff_start;
+    bounds.m_cosThetaE = cos( acos( cos_total_range ) - acos( cos_falloff_start ) );
+    bounds.m_power = Power().GetIntensity();
+    return true;
+}
+
 // sample ray from light
 Spectrum SpotLight::sample_l(const Point& ip, const LightSample* ls , Vector& dirToLight , float* distance , float* pdfw , float* emissionPdf , float* cosAtLight , Visibility& visibility ) const{
     const auto light_dir = Vector3f( m_light2world.matrix.m[1] , m_light2world.matrix.m[5] , m_light2world.matrix.m[9] );
@@ -111,6 +111,14 @@ namespace {
          virtual Spectrum EvaluateOpacity(const ClosureParamPtr comp, const float3& w) const {
              return w;
          }
+
+         //! @brief     Whether the closure populates the same scattering event for all intersections.
+         //!
+         //! @param param       Closure parameter.
+         //! @return            False if the result depends on the intersection or the scattering event.
+         virtual bool IsShareable(const ClosureParamPtr param) const {
+             return true;
+         }
      };
 
      //! @brief     Volume closures
@@ -244,6 +252,12 @@ namespace {
                  se.AddBxdf(SORT_MALLOC(DisneyBRDF)(params, weight, sample_weight));
              }
          }
+
+         bool IsShareable(const Tsl_Namespace::ClosureParamPtr param) const override {
+             // there is no sss without scatter distance, which is the only part depending on the intersection
+             const auto& mfp = ((const ClosureTypeDisney*)param)->scatterDistance;
+             return 0.0f == mfp.x && 0.0f == mfp.y && 0.0f == mfp.z;
+         }
      };
 
      struct Surface_Closure_MicrofacetReflectionGGX : public Surface_Closure_Base {
@@ -390,6 +404,10 @@ namespace {
              ProcessSurfaceClosure((const ClosureTreeNodeBase*)params.closure, make_float3(1.0f, 1.0f, 1.0f), *bottom);
              se.AddBxdf(SORT_MALLOC(Coat)(params, w, bottom));
          }
+
+         bool IsShareable(const Tsl_Namespace::ClosureParamPtr param) const override {
+             return false;
+         }
      };
 
      struct Surface_Closure_DoubleSided : public Surface_Closure_Base {
@@ -403,6 +421,10 @@ namespace {
              ProcessSurfaceClosure((const ClosureTreeNodeBase*)params.closure1, make_float3(1.0f, 1.0f, 1.0f), *se1);
              se.AddBxdf(SORT_MALLOC(DoubleSided)(se0, se1, w));
          }
+
+         bool IsShareable(const Tsl_Namespace::ClosureParamPtr param) const override {
+             return false;
+         }
      };
 
      struct Surface_Closure_DistributionBRDF : public Surface_Closure_Base {
@@ -481,6 +503,10 @@ namespace {
                  se.AddBxdf(SORT_MALLOC(Lambert)(params.base_color, weight , params.normal));
              }
          }
+
+         bool IsShareable(const Tsl_Namespace::ClosureParamPtr param) const override {
+             return false;
+         }
      };
 
      struct Surface_Closure_Transparent : public Surface_Closure_Base {
@@ -578,6 +604,23 @@ void ProcessSurfaceClosure(const ClosureTreeNodeBase* closure, const float3& w,
     }
 }
 
+bool IsSurfaceClosureShareable(const ClosureTreeNodeBase* closure) {
+    if (!closure)
+        return true;
+
+    switch (closure->m_id) {
+        case Tsl_Namespace::CLOSURE_ADD:
+            {
+                const ClosureTreeNodeAdd* closure_add = (const ClosureTreeNodeAdd*)closure;
+                return IsSurfaceClosureShareable(closure_add->m_closure0) && IsSurfaceClosureShareable(closure_add->m_closure1);
+            }
+        case Tsl_Namespace::CLOSURE_MUL:
+            return IsSurfaceClosureShareable(((const ClosureTreeNodeMul*)closure)->m_closure);
+        default:
+            return getSurfaceClosureBase(closure->m_id)->IsShareable(closure->m_params);
+    }
+}
+
 void ProcessVolumeClosure(const ClosureTreeNodeBase* closure, const float3& w, MediumStack& mediumStack, const SE_Interaction flag, const MaterialBase* material, const Mesh* mesh) {
     if (!closure)
         return;
@@ -37,6 +37,15 @@ void RegisterClosures();
 //! @param  se              The result scattering event.
 void ProcessSurfaceClosure(const Tsl_Namespace::ClosureTreeNodeBase* closure, const Tsl_Namespace::float3& w, ScatteringEvent& se);
 
+//! @brief  Whether the closure tree populates the same scattering event for all intersections.
+//!
+//! Some closures, like SSS, either keep the intersection or behave differently depending on the scattering event, they
+//! need to be processed for each intersection even if their parameters are constant.
+//!
+//! @param  closure         The closure tree in the tsl shader.
+//! @return                 True if the scattering event populated by the closure tree could be shared.
+bool IsSurfaceClosureShareable(const Tsl_Namespace::ClosureTreeNodeBase* closure);
+
 //! @brief  Process the closure tree result and populate the MediumStack.
 //!
 //! @param  closure         The closure tree in the tsl shader.
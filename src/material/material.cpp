@@ -16,6 +16,7 @@
  */
 
 #include <string.h>
+#include <algorithm>
 #include <tsl_system.h>
 #include "material.h"
 #include "matmanager.h"
@@ -26,9 +27,32 @@
 #include "scatteringevent/bsdf/lambert.h"
 #include "scatteringevent/bsdf/transparent.h"
 #include "texture/imagetexture2d.h"
+#include "core/timer.h"
 
 USE_TSL_NAMESPACE
 
+SORT_STATS_DEFINE_COUNTER(sConstantSurfaceShader)
+SORT_STATS_COUNTER("Shader Cache", "Constant Surface Shaders", sConstantSurfaceShader);
+
+namespace {
+    // Offset basis of 64 bits FNV-1a hash.
+    constexpr std::uint64_t hash_offset_basis = 0xcbf29ce484222325ull;
+
+    // FNV-1a is good enough to tell identical shaders apart from different ones, there is no need for anything fancier.
+    void hash_combine(std::uint64_t& hash, const void* data, std::size_t size) {
+        const auto bytes = (const unsigned char*)data;
+        for (auto i = 0u; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ull;
+        }
+    }
+
+    // The terminator is hashed too so that adjacent strings are not mixed up.
+    void hash_combine(std::uint64_t& hash, const std::string& str) {
+        hash_combine(hash, str.c_str(), str.size() + 1);
+    }
+}
+
 #ifdef ENABLE_MULTI_THREAD_SHADER_COMPILATION
 bool MaterialBase::IsMaterialBuilt() const{
     // std::memory_order_acquire is needed to make sure compiler doesn't do crazy out-of-order execution thing.
@@ -61,29 +85,28 @@ void Material::BuildMaterial() {
         if (shader_valid) {
             shader_valid = false;
             trying_building_shader_type = true;
-    
+
+            // materials with identical shaders share the shader compiled before
+            auto hash = shader_data.m_hash;
+            hash_combine(hash, prefix);
+            if (auto cached_shader_instance = MatManager::GetSingleton().FindShaderInstance(hash)) {
+                shader_instance = cached_shader_instance;
+                shader_valid = true;
+                return;
+            }
+
+            Timer timer;
+
             for (const auto& shader : shader_data.m_sources)
                 shader_units[shader.name] = MatManager::GetSingleton().GetShaderUnitTemplate(shader.type);
     
-            // build the root shader
+            // the root shader is the same for all materials, it is only compiled once
             auto context = GetShadingContext();
             const auto root_shader_name = prefix + output_node_name;
-            if(auto shader_unit_template = context->begin_shader_unit_template(root_shader_name)){
-                // register tsl global
-                TslGlobal::shader_unit_register(shader_unit_template.get());
-
-                // compile the root shader
-                const auto ret = shader_unit_template->compile_shader_source(root_shader);
-                if (!ret)
-                    return;
-
-                // indicate the shader unit is done
-                context->end_shader_unit_template(shader_unit_template.get());
-
+            if (auto shader_unit_template = MatManager::GetSingleton().GetRootShaderUnitTemplate(prefix + "_Root_Shader", root_shader))
                 shader_units[root_shader_name] = shader_unit_template;
-            } else {
+            else
                 return;
-            }
     
             // begin compiling shader group
             auto shader_group = context->begin_shader_group_template(prefix + m_name);
@@ -124,6 +147,8 @@ void Material::BuildMaterial() {
                 return;
     
             shader_valid = true;
+
+            MatManager::GetSingleton().CacheShaderInstance(hash, shader_instance, timer.GetElapsedTime());
         }
     };
 
@@ -133,6 +158,22 @@ void Material::BuildMaterial() {
     // build volume shader
     build_shader_type(m_volume_shader_data, surface_volume_root, "Volume", m_volume_shader_valid, tried_building_volume_shader, m_volume_shader_units, m_volume_shader);
 
+    // Surface shaders reading none of the shading inputs only depend on default values, which are already folded into
+    // the shader during compilation. They output the same bxdfs for all intersections, there is no need to execute
+    // the shader and process the closures for every single intersection then.
+    if (m_surface_shader_valid) {
+        const auto& sources = m_surface_shader_data.m_sources;
+        const auto reads_shading_input = std::any_of(sources.begin(), sources.end(), [](const ShaderSource& source) {
+            return MatManager::GetSingleton().DependsOnShadingInput(source.type);
+        });
+
+        if (!reads_shading_input) {
+            ScopedMemoryAllocator scoped_allocator(m_constant_memory);
+            m_constant_surface_shader = EvaluateConstantSurfaceShader(m_surface_shader.get(), m_constant_bxdfs, m_constant_transparency);
+            SORT_STATS(sConstantSurfaceShader += m_constant_surface_shader);
+        }
+    }
+
     // if there is volume shader, but no surface shader, a special transparent material will be applied automatically
     // this will make the shader authoring a lot easier.
     if (!m_surface_shader_valid && m_volume_shader_valid && !tried_building_surface_shader)
@@ -170,17 +211,38 @@ void Material::Serialize(IStreamBase& stream){
     const auto message = "Parsing Material '" + m_name + "'";
     SORT_PROFILE(message.c_str());
 
+    // Node names are unique across all materials, they are hashed by their indices in the material instead so that
+    // identical shaders in different materials end up with the same hash. Default values of both surface and volume
+    // shader are applied to both shader groups, they are hashed once for both of them.
+    auto default_values_hash = hash_offset_basis;
+    const auto output_node_name = "ShaderOutput_" + m_name;
+
     auto parse_shader_type = [&](TSL_ShaderData& shader_data, bool& is_shader_valid) {
         is_shader_valid = true;
 
+        std::unordered_map<std::string, unsigned> node_indices;
+        auto hash_node_name = [&](std::uint64_t& hash, const std::string& name) {
+            const auto it = node_indices.find(name);
+            if (it != node_indices.end())
+                hash_combine(hash, &it->second, sizeof(it->second));
+            else
+                hash_combine(hash, name == output_node_name ? std::string("ShaderOutput_") : name);
+        };
+
         unsigned shader_unit_cnt = 0;
         stream >> shader_unit_cnt;
 
+        shader_data.m_hash = hash_offset_basis;
+        hash_combine(default_values_hash, &shader_unit_cnt, sizeof(shader_unit_cnt));
+
         for (auto i = 0u; i < shader_unit_cnt; ++i) {
             // parse surface shader
             ShaderSource shader_source;
             stream >> shader_source.name >> shader_source.type;
 
+            node_indices[shader_source.name] = i;
+            hash_combine(shader_data.m_hash, shader_source.type);
+
             auto parameter_cnt = 0u;
             stream >> parameter_cnt;
             for (auto j = 0u; j < parameter_cnt; ++j) {
@@ -189,21 +251,29 @@ void Material::Serialize(IStreamBase& stream){
                 stream >> default_value.shader_unit_param_name;
                 int channel_num = 0;
                 stream >> channel_num;
+
+                hash_combine(default_values_hash, &i, sizeof(i));
+                hash_combine(default_values_hash, default_value.shader_unit_param_name);
+                hash_combine(default_values_hash, &channel_num, sizeof(channel_num));
+
                 // currently only float and float3 are supported for now
                 if (channel_num == 1) {
                     float x;
                     stream >> x;
                     default_value.default_value = x;
+                    hash_combine(default_values_hash, &x, sizeof(x));
                 }
                 else if (channel_num == 3) {
-                    float x, y, z;
-                    stream >> x >> y >> z;
-                    default_value.default_value = Tsl_Namespace::make_float3(x, y, z);
+                    float x[3];
+                    stream >> x[0] >> x[1] >> x[2];
+                    default_value.default_value = Tsl_Namespace::make_float3(x[0], x[1], x[2]);
+                    hash_combine(default_values_hash, x, sizeof(x));
                 }
                 else if (channel_num == 4) { // this is fairly ugly, but it works, I will find time to refactor it later.
                     std::string str;
                     stream >> str;
                     default_value.default_value = make_tsl_global_ref(str);
+                    hash_combine(default_values_hash, str);
                 }
 
                 m_paramDefaultValues.push_back(default_value);
@@ -219,6 +289,11 @@ void Material::Serialize(IStreamBase& stream){
             stream >> connection.source_shader >> connection.source_property;
             stream >> connection.target_shader >> connection.target_property;
             shader_data.m_connections.push_back(connection);
+
+            hash_node_name(shader_data.m_hash, connection.source_shader);
+            hash_combine(shader_data.m_hash, connection.source_property);
+            hash_node_name(shader_data.m_hash, connection.target_shader);
+            hash_combine(shader_data.m_hash, connection.target_property);
         }
     };
 
@@ -233,11 +308,16 @@ void Material::Serialize(IStreamBase& stream){
     if(volume_shader_tag == "Volume Shader"_sid)
         parse_shader_type(m_volume_shader_data, m_volume_shader_valid);
 
+    hash_combine(m_surface_shader_data.m_hash, &default_values_hash, sizeof(default_values_hash));
+    hash_combine(m_volume_shader_data.m_hash, &default_values_hash, sizeof(default_values_hash));
+
     stream >> m_hasTransparentNode;
     stream >> m_hasSSSNode;
 
     stream >> m_volumeStep;
     stream >> m_volumeStepCnt;
+
+    stream >> m_emission;
 }
 
 void Material::UpdateScatteringEvent( ScatteringEvent& se ) const {
@@ -247,7 +327,10 @@ void Material::UpdateScatteringEvent( ScatteringEvent& se ) const {
         return;
     }
 
-    if( m_surface_shader_valid )
+    if( m_constant_surface_shader ){
+        for( const auto bxdf : m_constant_bxdfs )
+            se.AddBxdf( bxdf );
+    }else if( m_surface_shader_valid )
         ExecuteSurfaceShader(m_surface_shader.get() , se );
     else if( m_special_transparent )
         se.AddBxdf(SORT_MALLOC(Transparent)());
@@ -263,6 +346,11 @@ void Material::EvaluateMediumSample(const MediumInteraction& mi, MediumSample& m
         EvaluateVolumeSample(m_volume_shader.get(), mi, ms);
 }
 
+void Material::EvaluateMediumSample(const float density, MediumSample& ms) const {
+    if (m_volume_shader_valid)
+        EvaluateVolumeSample(m_volume_shader.get(), density, ms);
+}
+
 void MaterialProxy::UpdateScatteringEvent(ScatteringEvent& se) const {
     return m_material.UpdateScatteringEvent(se);
 }
@@ -275,6 +363,10 @@ void MaterialProxy::EvaluateMediumSample(const MediumInteraction& mi, MediumSamp
     return m_material.EvaluateMediumSample(mi, ms);
 }
 
+void MaterialProxy::EvaluateMediumSample(const float density, MediumSample& ms) const {
+    return m_material.EvaluateMediumSample(density, ms);
+}
+
 StringID  MaterialProxy::GetUniqueID() const {
     // Hopefully there is no conflict with the hash key constructed by the name of the material.
     const std::uintptr_t ret = (const std::uintptr_t)this;
@@ -303,4 +395,8 @@ float MaterialProxy::GetVolumeStep() const {
 
 unsigned int MaterialProxy::GetVolumeStepCnt() const {
     return m_material.GetVolumeStepCnt();
+}
+
+Spectrum MaterialProxy::GetEmission() const {
+    return m_material.GetEmission();
 }
\ No newline at end of file
@@ -21,7 +21,9 @@
 #include <list>
 #include <vector>
 #include <string>
+#include <cstdint>
 #include "stream/stream.h"
+#include "core/memory.h"
 #include "tsl_system.h"
 
 #ifdef ENABLE_MULTI_THREAD_SHADER_COMPILATION
@@ -54,6 +56,8 @@ struct TSL_ShaderData {
     std::vector<ShaderSource>           m_sources;
     /**< Shader connections. */
     std::vector<ShaderConnection>       m_connections;
+    /**< Hash of the shader sources, connections and default values, identical shaders have the same hash. */
+    std::uint64_t                       m_hash = 0;
 };
 
 //! @brief  Base interface for material.
@@ -82,6 +86,14 @@ public:
     //! @param      ms              Medium sample taken.
     virtual void       EvaluateMediumSample(const MediumInteraction& mi, MediumSample& ms) const = 0;
 
+    //! @brief      Take sample in a medium given a density.
+    //!
+    //! Density is the only input of volume shaders, this is used to bound the extinction of the volume before rendering.
+    //!
+    //! @param      density         Density of the medium.
+    //! @param      ms              Medium sample taken.
+    virtual void       EvaluateMediumSample(const float density, MediumSample& ms) const = 0;
+
     //! @brief      Evaluate translucency.
     //!
     //! @param      intersection    The intersection.
@@ -123,6 +135,13 @@ public:
     //! @return     Maximum steps to march during ray marching.
     virtual unsigned int GetVolumeStepCnt() const = 0;
 
+    //! @brief  Get the radiance emitted by surfaces with the material.
+    //!
+    //! Meshes with emissive materials are light sources, they are importance sampled like any other area light.
+    //!
+    //! @return     Radiance emitted by the surfaces, black for materials that don't emit light.
+    virtual Spectrum    GetEmission() const = 0;
+
 #ifdef ENABLE_MULTI_THREAD_SHADER_COMPILATION
     //! @brief  Whether the material has been built.
     //!
@@ -167,6 +186,14 @@ public:
     //! @param      ms              Medium sample taken.
     void        EvaluateMediumSample(const MediumInteraction& mi, MediumSample& ms) const override;
 
+    //! @brief      Take sample in a medium given a density.
+    //!
+    //! Density is the only input of volume shaders, this is used to bound the extinction of the volume before rendering.
+    //!
+    //! @param      density         Density of the medium.
+    //! @param      ms              Medium sample taken.
+    void        EvaluateMediumSample(const float density, MediumSample& ms) const override;
+
     //! @brief      Evaluate translucency.
     //!
     //! @param      intersection    The intersection.
@@ -175,6 +202,9 @@ public:
         // this should happen most of the time in the absence of transparent node.
         if (!m_hasTransparentNode)
             return 0.0f;
+
+        if (m_constant_surface_shader)
+            return m_constant_transparency;
         
         return m_special_transparent ? 1.0f : (::EvaluateTransparency(m_surface_shader.get(), intersection));
     }
@@ -233,6 +263,13 @@ public:
         return m_volumeStepCnt;
     }
 
+    //! @brief  Get the radiance emitted by surfaces with the material.
+    //!
+    //! @return Radiance emitted by the surfaces, black for materials that don't emit light.
+    Spectrum    GetEmission() const override{
+        return m_emission;
+    }
+
 private:
     /**< Whether this is a valid material */
     bool                            m_surface_shader_valid = false;
@@ -262,11 +299,23 @@ private:
     /**< Shader unit default values. */
     std::vector<ShaderParamDefaultValue>        m_paramDefaultValues;
 
+    /**< Whether the surface shader outputs the same bxdfs for all intersections, it is only evaluated once if so. */
+    bool                            m_constant_surface_shader = false;
+    /**< Bxdfs of the constant surface shader. */
+    std::vector<const Bxdf*>        m_constant_bxdfs;
+    /**< Transparency of the constant surface shader. */
+    Spectrum                        m_constant_transparency;
+    /**< Memory holding the bxdfs of the constant surface shader. */
+    MemoryAllocator                 m_constant_memory;
+
     bool                            m_hasTransparentNode = false;
     bool                            m_hasSSSNode = false;
 
     float                           m_volumeStep = 0.1f;
     unsigned int                    m_volumeStepCnt = 1024;
+
+    /**< Radiance emitted by surfaces with the material. */
+    Spectrum                        m_emission;
 };
 
 //! @brief  MaterialProxy is nothing but a thin wrapper of another existed material.
@@ -301,6 +350,14 @@ public:
     //! @param      ms              Medium sample taken.
     void        EvaluateMediumSample(const MediumInteraction& mi, MediumSample& ms) const override;
 
+    //! @brief      Take sample in a medium given a density.
+    //!
+    //! Density is the only input of volume shaders, this is used to bound the extinction of the volume before rendering.
+    //!
+    //! @param      density         Density of the medium.
+    //! @param      ms              Medium sample taken.
+    void        EvaluateMediumSample(const float density, MediumSample& ms) const override;
+
     //! @brief  Just an empty interface, there is no serialization support for this type of material.
     //!
     //! @param  stream      Input stream for data.
@@ -347,6 +404,11 @@ public:
     //! @return Maximum steps to march during ray marching.
     unsigned int GetVolumeStepCnt() const override;
 
+    //! @brief  Get the radiance emitted by surfaces with the material.
+    //!
+    //! @return Radiance emitted by the surfaces, black for materials that don't emit light.
+    Spectrum    GetEmission() const override;
+
 private:
     /**< Material to be referred. */
     const MaterialBase& m_material;
@@ -26,10 +26,20 @@
 #include "scatteringevent/bsdf/fourierbxdf.h"
 #include "texture/imagetexture2d.h"
 
-#ifdef ENABLE_ASYNC_TEXTURE_LOADING
+#ifdef ENABLE_MULTI_THREAD_SHADER_COMPILATION_CHEAP
 #include <future>
 #endif
 
+SORT_STATS_DEFINE_COUNTER(sShaderCompiled)
+SORT_STATS_DEFINE_COUNTER(sShaderReused)
+SORT_STATS_DEFINE_COUNTER(sShaderCompilationTimeMS)
+SORT_STATS_DEFINE_COUNTER(sShaderCompilationTimeSavedMS)
+
+SORT_STATS_COUNTER("Shader Cache", "Shaders Compiled", sShaderCompiled);
+SORT_STATS_COUNTER("Shader Cache", "Shaders Reused", sShaderReused);
+SORT_STATS_TIME("Shader Cache", "Compilation Time", sShaderCompilationTimeMS);
+SORT_STATS_TIME("Shader Cache", "Compilation Time Saved", sShaderCompilationTimeSavedMS);
+
 #ifdef ENABLE_MULTI_THREAD_SHADER_COMPILATION
 #include "task/task.h"
 #endif
@@ -62,12 +72,6 @@ namespace {
     };
 }
 
-#ifdef ENABLE_ASYNC_TEXTURE_LOADING
-static bool async_load_resource(Resource* resource, std::string filename) {
-    return resource->LoadResource(filename);
-}
-#endif
-
 #ifdef ENABLE_MULTI_THREAD_SHADER_COMPILATION_CHEAP
 static void async_build_material(MaterialBase* material) {
     material->BuildMaterial();
@@ -85,7 +89,9 @@ unsigned MatManager::ParseMatFile( IStreamBase& stream ){
     stream >> resource_cnt;
 
 #ifdef ENABLE_ASYNC_TEXTURE_LOADING
-    std::vector<std::future<bool>>      async_resource_reading;
+    // Resources are loaded as tasks so that no more than the number of worker threads are decoded at the same time,
+    // decoded textures are not paged out to the texture cache until they are fully loaded.
+    TaskGroup   async_resource_reading;
 #endif
 
 #ifdef ENABLE_MULTI_THREAD_SHADER_COMPILATION_CHEAP
@@ -118,7 +124,7 @@ unsigned MatManager::ParseMatFile( IStreamBase& stream ){
             }
             else {
 #ifdef ENABLE_ASYNC_TEXTURE_LOADING
-                async_resource_reading.push_back(std::async(std::launch::async, async_load_resource, ptr_resource, resource_file));
+                async_resource_reading.Fork([ptr_resource, resource_file]() { ptr_resource->LoadResource(resource_file); }, "Load Resource");
 #else
                 ptr_resource->LoadResource(resource_file);
 #endif
@@ -166,9 +172,19 @@ unsigned MatManager::ParseMatFile( IStreamBase& stream ){
             // bind shader resources
             for (auto sr : m_shader_resources_binding) {
                 auto resource = MatManager::GetSingleton().GetResource(sr.shader_resource_name);
-                shader_unit_template->register_shader_resource(sr.resource_handle_name, (const Tsl_Namespace::ShaderResourceHandle*)resource);
+
+                // Textures are bound through their samplers, the texture type and its texture coordinate filter are only
+                // resolved once here instead of during every single texture lookup.
+                const void* handle = resource;
+                if (const auto texture = dynamic_cast<const ImageTexture2D*>(resource))
+                    handle = &texture->GetSampler();
+                shader_unit_template->register_shader_resource(sr.resource_handle_name, (const Tsl_Namespace::ShaderResourceHandle*)handle);
             }
 
+            // shader units reading tsl globals or sampling textures produce different results at different intersections
+            if (ReadsShadingInput(source_code, (unsigned)m_shader_resources_binding.size()))
+                m_shading_input_dependent_units.insert(shader_node_type);
+
             // compile the shader unit
             const auto ret = shader_unit_template->compile_shader_source(source_code.c_str());
 
@@ -236,8 +252,11 @@ unsigned MatManager::ParseMatFile( IStreamBase& stream ){
 
             // compiling the shader group template
             std::unordered_map<std::string, std::shared_ptr<Tsl_Namespace::ShaderUnitTemplate>> shader_units;
-            for (const auto& shader : shader_data.m_sources)
+            for (const auto& shader : shader_data.m_sources) {
                 shader_units[shader.name] = MatManager::GetSingleton().GetShaderUnitTemplate(shader.type);
+                if (DependsOnShadingInput(shader.type))
+                    m_shading_input_dependent_units.insert(shader_template_type);
+            }
 
             auto context = GetShadingContext();
 
@@ -328,7 +347,7 @@ unsigned MatManager::ParseMatFile( IStreamBase& stream ){
     }
 
 #ifdef ENABLE_ASYNC_TEXTURE_LOADING
-    std::for_each(async_resource_reading.begin(), async_resource_reading.end(), [](std::future<bool>& promise) { promise.wait(); });
+    async_resource_reading.Wait();
 #endif
 
 #ifdef ENABLE_MULTI_THREAD_SHADER_COMPILATION_CHEAP
@@ -352,8 +371,10 @@ const Resource* MatManager::GetResource(const std::string& name) const {
 }
 
 const MaterialBase* MatManager::CreateMaterialProxy(const MaterialBase& material) {
-    m_matPool.push_back(std::move(std::make_unique<MaterialProxy>(material)));
-    return m_matPool.back().get();
+    // proxies are kept in a separate pool so that looking up materials by id never races with this
+    std::lock_guard<std::mutex> lock(m_proxyMutex);
+    m_proxyPool.push_back(std::move(std::make_unique<MaterialProxy>(material)));
+    return m_proxyPool.back().get();
 }
 
 std::shared_ptr<Tsl_Namespace::ShaderUnitTemplate> MatManager::GetShaderUnitTemplate(const std::string& name_id) const {
@@ -363,6 +384,60 @@ std::shared_ptr<Tsl_Namespace::ShaderUnitTemplate> MatManager::GetShaderUnitTemp
     return it->second;
 }
 
+std::shared_ptr<Tsl_Namespace::ShaderUnitTemplate> MatManager::GetRootShaderUnitTemplate(const std::string& name, const char* source) {
+    std::lock_guard<std::mutex> lock(m_shaderCacheMutex);
+
+    auto it = m_root_shader_units.find(name);
+    if (it != m_root_shader_units.end())
+        return it->second;
+
+    auto context = GetShadingContext();
+    auto shader_unit_template = context->begin_shader_unit_template(name);
+    if (!shader_unit_template)
+        return nullptr;
+
+    // register tsl global
+    TslGlobal::shader_unit_register(shader_unit_template.get());
+
+    // compile the root shader
+    const auto ret = shader_unit_template->compile_shader_source(source);
+
+    // indicate the shader unit is done
+    context->end_shader_unit_template(shader_unit_template.get());
+
+    if (!ret)
+        return nullptr;
+
+    m_root_shader_units[name] = shader_unit_template;
+    return shader_unit_template;
+}
+
+std::shared_ptr<Tsl_Namespace::ShaderInstance> MatManager::FindShaderInstance(std::uint64_t hash) {
+    std::lock_guard<std::mutex> lock(m_shaderCacheMutex);
+
+    auto it = m_shader_instances.find(hash);
+    if (it == m_shader_instances.end()) {
+        SORT_STATS(++sShaderCompiled);
+        return nullptr;
+    }
+
+    SORT_STATS(++sShaderReused);
+    SORT_STATS(sShaderCompilationTimeSavedMS += it->second.compilation_time);
+    return it->second.shader_instance;
+}
+
+void MatManager::CacheShaderInstance(std::uint64_t hash, std::shared_ptr<Tsl_Namespace::ShaderInstance> shader_instance, unsigned int compilation_time) {
+    SORT_STATS(sShaderCompilationTimeMS += compilation_time);
+
+    // the first one wins if the same shader is compiled in multiple threads at the same time
+    std::lock_guard<std::mutex> lock(m_shaderCacheMutex);
+    auto& cached = m_shader_instances[hash];
+    if (!cached.shader_instance) {
+        cached.shader_instance = shader_instance;
+        cached.compilation_time = compilation_time;
+    }
+}
+
 #ifdef ENABLE_MULTI_THREAD_SHADER_COMPILATION
 void MatManager::WaitForMaterialBuilding() const {
     std::for_each(m_matPool.begin(), m_matPool.end(), [](const std::unique_ptr<MaterialBase>& mat) {
@@ -20,10 +20,13 @@
 #include "core/define.h"
 #include <vector>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 #include "core/singleton.h"
 #include "material/material.h"
 #include "core/resource.h"
+#include "core/stats.h"
 #include "task/task.h"
 
 //! @brief Material manager.
@@ -47,6 +50,8 @@ public:
 
     //! @brief  Create a material proxy given a material.
     //!
+    //! Meshes are deserialized in different threads during scene loading, this method is thread safe.
+    //!
     //! @param  material    The material to be proxied.
     //! @return             A material proxy that refers the to provided material.
     const MaterialBase* CreateMaterialProxy(const MaterialBase& material);
@@ -73,6 +78,45 @@ public:
     //! @return             The shader unit template returned, nullptr if it doesn't exist.
     std::shared_ptr<Tsl_Namespace::ShaderUnitTemplate> GetShaderUnitTemplate(const std::string& name) const;
 
+    //! @brief  Whether a shader unit template reads any shading input.
+    //!
+    //! Shading inputs are the tsl globals, like uv coordinate and normal, and also textures. A shader composed only by
+    //! shader units reading none of them outputs the same closures everywhere.
+    //!
+    //! @param  name        The name of the template.
+    //! @return             True if the shader unit template, or any shader unit in it, reads shading inputs.
+    bool DependsOnShadingInput(const std::string& name) const {
+        return m_shading_input_dependent_units.count(name) > 0;
+    }
+
+    //! @brief  Get the shader unit template of the root shader of materials.
+    //!
+    //! All materials share the same root shader, it is compiled the first time it is needed.
+    //! This method is thread safe.
+    //!
+    //! @param  name        The name of the root shader.
+    //! @param  source      The source code of the root shader.
+    //! @return             The shader unit template returned, nullptr if it doesn't compile.
+    std::shared_ptr<Tsl_Namespace::ShaderUnitTemplate> GetRootShaderUnitTemplate(const std::string& name, const char* source);
+
+    //! @brief  Find a shader instance compiled before with the same hash.
+    //!
+    //! Materials with identical shader sources, connections and default values, which often only differ in their names,
+    //! share the same shader instance instead of compiling it again. This method is thread safe.
+    //!
+    //! @param  hash        Hash of the shader data.
+    //! @return             The shader instance, nullptr if no shader with the hash is compiled yet.
+    std::shared_ptr<Tsl_Namespace::ShaderInstance> FindShaderInstance(std::uint64_t hash);
+
+    //! @brief  Cache a shader instance so that materials with identical shaders could reuse it.
+    //!
+    //! This method is thread safe.
+    //!
+    //! @param  hash                Hash of the shader data.
+    //! @param  shader_instance     The resolved shader instance.
+    //! @param  compilation_time    Time spent compiling the shader in milliseconds.
+    void CacheShaderInstance(std::uint64_t hash, std::shared_ptr<Tsl_Namespace::ShaderInstance> shader_instance, unsigned int compilation_time);
+
 #ifdef ENABLE_MULTI_THREAD_SHADER_COMPILATION
     //! @brief  Wait for all materials to be built before moving forward
     void WaitForMaterialBuilding() const;
@@ -80,13 +124,28 @@ public:
 
 private:
     std::vector<std::unique_ptr<MaterialBase>>       m_matPool;         /**< Material pool holding all materials. */
+    std::vector<std::unique_ptr<MaterialBase>>       m_proxyPool;       /**< Material proxies created during scene loading. */
+    std::mutex                                       m_proxyMutex;      /**< Mutex protecting the proxy pool. */
 
     std::unordered_map<std::string, std::unique_ptr<Resource>>  m_resources;       /**< Resources used during BXDF evaluation. */
 
     std::unordered_map<std::string, std::shared_ptr<Tsl_Namespace::ShaderUnitTemplate>>     m_shader_units;
+    std::unordered_set<std::string>                                                         m_shading_input_dependent_units;    /**< Shader unit templates reading shading inputs. */
+
+    //! @brief  A shader instance compiled before.
+    struct CachedShaderInstance {
+        std::shared_ptr<Tsl_Namespace::ShaderInstance>  shader_instance;        /**< The resolved shader instance. */
+        unsigned int                                    compilation_time = 0;   /**< Time spent compiling the shader in milliseconds. */
+    };
+
+    std::unordered_map<std::string, std::shared_ptr<Tsl_Namespace::ShaderUnitTemplate>>     m_root_shader_units;    /**< Root shader unit templates shared by all materials. */
+    std::unordered_map<std::uint64_t, CachedShaderInstance>     m_shader_instances;     /**< Compiled shader instances, keyed by the hash of the shader data. */
+    std::mutex                                                  m_shaderCacheMutex;     /**< Mutex protecting the compiled shaders. */
 
     /**< Shader unit default values. */
     std::vector<ShaderParamDefaultValue>        m_paramDefaultValues;
 
     friend class Singleton<MatManager>;
+
+    SORT_STATS_ENABLE( "Shader Cache" )
 };
@@ -50,17 +50,16 @@ public:
         slog(WARNING, GENERAL, error, dummy);
     }
 
+    // Textures are bound to shaders through their samplers, check out MatManager::ParseMatFile for details.
     void    sample_2d(const void* texture, float u, float v, float3& color) const override {
-        auto resource = (const Resource*)texture;
-        auto sort_texture = dynamic_cast<const ImageTexture2D*>(resource);
-        auto ret = sort_texture->GetColorFromUV(u, v);
+        auto sampler = (const ImageTexture2DSampler*)texture;
+        auto ret = sampler->SampleColor(u, v);
         color = make_float3(ret.x, ret.y, ret.z);
     }
 
     void    sample_alpha_2d(const void* texture, float u, float v, float& alpha) const override {
-        auto resource = (const Resource*)texture;
-        auto sort_texture = dynamic_cast<const ImageTexture2D*>(resource);
-        alpha = sort_texture->GetAlphaFromtUV(u, v);
+        auto sampler = (const ImageTexture2DSampler*)texture;
+        alpha = sampler->SampleAlpha(u, v);
     }
 };
 
@@ -76,6 +75,10 @@ std::shared_ptr<Tsl_Namespace::ShadingContext> GetShadingContext() {
 #endif
 }
 
+bool ReadsShadingInput(const std::string& source_code, unsigned resource_cnt) {
+    return resource_cnt > 0 || source_code.find(TSL_GLOBAL_ACCESSOR) != std::string::npos;
+}
+
 void ExecuteSurfaceShader( Tsl_Namespace::ShaderInstance* shader , ScatteringEvent& se ){
     const SurfaceInteraction& intersection = se.GetInteraction();
     TslGlobal global;
@@ -92,6 +95,33 @@ void ExecuteSurfaceShader( Tsl_Namespace::ShaderInstance* shader , ScatteringEve
     ProcessSurfaceClosure(closure, Tsl_Namespace::make_float3(1.0f, 1.0f, 1.0f) , se );
 }
 
+bool EvaluateConstantSurfaceShader(Tsl_Namespace::ShaderInstance* shader, std::vector<const Bxdf*>& bxdfs, Spectrum& transparency) {
+    // none of the shading inputs is read by the shader, there is no need to fill them
+    TslGlobal global;
+
+    // shader execution
+    ClosureTreeNodeBase* closure = nullptr;
+    auto raw_function = (void(*)(ClosureTreeNodeBase**, TslGlobal*))shader->get_function();
+    raw_function(&closure, &global);
+
+    if (!IsSurfaceClosureShareable(closure))
+        return false;
+
+    // bxdfs are defined in shading coordinate, the intersection is only needed to construct the scattering event.
+    SurfaceInteraction intersection;
+    intersection.normal = DIR_UP;
+    intersection.tangent = Vector(1.0f, 0.0f, 0.0f);
+
+    ScatteringEvent se(intersection);
+    ProcessSurfaceClosure(closure, Tsl_Namespace::make_float3(1.0f, 1.0f, 1.0f), se);
+    for (auto i = 0u; i < se.GetBxdfCnt(); ++i)
+        bxdfs.push_back(se.GetBxdf(i));
+
+    const auto opacity = ProcessOpacity(closure, Tsl_Namespace::make_float3(1.0f, 1.0f, 1.0f));
+    transparency = Spectrum(1.0f - opacity).Clamp(0.0f, 1.0f);
+    return true;
+}
+
 void ExecuteVolumeShader(Tsl_Namespace::ShaderInstance* shader, const MediumInteraction& mi, MediumStack& ms, const SE_Interaction flag, const MaterialBase* material ) {
     //const SurfaceInteraction& intersection = se.GetInteraction();
     TslGlobal global;
@@ -106,8 +136,12 @@ void ExecuteVolumeShader(Tsl_Namespace::ShaderInstance* shader, const MediumInte
 }
 
 void EvaluateVolumeSample(Tsl_Namespace::ShaderInstance* shader, const MediumInteraction& mi, MediumSample& ms) {
+    EvaluateVolumeSample(shader, mi.mesh->SampleVolumeDensity(mi.intersect), ms);
+}
+
+void EvaluateVolumeSample(Tsl_Namespace::ShaderInstance* shader, const float density, MediumSample& ms) {
     TslGlobal global;
-    global.density = mi.mesh->SampleVolumeDensity(mi.intersect);
+    global.density = density;
 
     ClosureTreeNodeBase* closure = nullptr;
     auto raw_function = (void(*)(ClosureTreeNodeBase**, TslGlobal*))shader->get_function();
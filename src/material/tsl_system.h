@@ -22,6 +22,7 @@
 #include <tsl_version.h>
 #include <tsl_system.h>
 #include <string>
+#include <vector>
 #include "core/define.h"
 #include "math/vector3.h"
 #include "spectrum/spectrum.h"
@@ -33,6 +34,7 @@ struct SurfaceInteraction;
 class MediumStack;
 struct MediumInteraction;
 class Mesh;
+class Bxdf;
 
 // In an ideal world, I should have used different memory layout for different type of shaders.
 // The following fields are obviously not valid in certain cases, like there is no normal in 
@@ -51,12 +53,38 @@ DECLARE_TSLGLOBAL_VAR(Tsl_float3, I)            // this is world space input dir
 DECLARE_TSLGLOBAL_VAR(Tsl_float, density)       // volume density
 DECLARE_TSLGLOBAL_END()
 
+// Members of the tsl global above are only accessible in shader source code through this keyword, like 'global_value<uvw>'.
+// Shader units using it read shading inputs, see 'ReadsShadingInput'.
+#define TSL_GLOBAL_ACCESSOR     "global_value"
+
 //! @brief  Get Shading context.
 std::shared_ptr<Tsl_Namespace::ShadingContext> GetShadingContext();
 
+//! @brief  Whether a shader unit reads any shading input.
+//!
+//! Shading inputs are members of the tsl global and shader resources bound to the shader unit. Shader resources are
+//! textures, which are sampled at different positions at different intersections in practice, any shader unit with
+//! resources bound is considered reading shading inputs.
+//!
+//! @param  source_code     Source code of the shader unit.
+//! @param  resource_cnt    Number of shader resources bound to the shader unit.
+//! @return                 True if the shader unit reads any shading input.
+bool ReadsShadingInput(const std::string& source_code, unsigned resource_cnt);
+
 //! @brief  Execute Jited shader code.
 void ExecuteSurfaceShader(Tsl_Namespace::ShaderInstance* shader, ScatteringEvent& se);
 
+//! @brief  Evaluate a surface shader once for all intersections.
+//!
+//! This is only valid for shaders reading none of the shading inputs, like uv coordinate or normal, whose closures are
+//! the same everywhere. Bxdfs are allocated through the current memory allocator of the thread.
+//!
+//! @param  shader          The tsl shader to be evaluated.
+//! @param  bxdfs           The bxdfs populated by the shader.
+//! @param  transparency    The transparency of the surface.
+//! @return                 False if the closures of the shader still need to be processed for each intersection.
+bool EvaluateConstantSurfaceShader(Tsl_Namespace::ShaderInstance* shader, std::vector<const Bxdf*>& bxdfs, Spectrum& transparency);
+
 //! @brief  Execute a shader and populate the medium stack
 //!
 //! @param  shader      The tsl shader to be evaluated.
@@ -73,6 +101,15 @@ void ExecuteVolumeShader(Tsl_Namespace::ShaderInstance* shader, const MediumInte
 //! @param  ms          The medium sample to be returned.
 void EvaluateVolumeSample(Tsl_Namespace::ShaderInstance* shader, const MediumInteraction& mi, MediumSample& ms);
 
+//! @brief  Evaluate the properties of the volume given a density.
+//!
+//! Density is the only input of volume shaders, this allows evaluating the volume without a position in it.
+//!
+//! @param  shader      The tsl shader to be executed.
+//! @param  density     The density of the volume.
+//! @param  ms          The medium sample to be returned.
+void EvaluateVolumeSample(Tsl_Namespace::ShaderInstance* shader, const float density, MediumSample& ms);
+
 //! @brief  Evaluate the transparency of the intersection.
 //!
 //! @param  shader          The tsl shader to be evaluated.
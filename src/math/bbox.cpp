@@ -78,6 +78,10 @@ void BBox::InvalidBBox(){
     m_Max = Point( -FLT_MAX , -FLT_MAX , -FLT_MAX );
 }
 
+bool BBox::IsValid() const{
+    return m_Min.x <= m_Max.x && m_Min.y <= m_Max.y && m_Min.z <= m_Max.z;
+}
+
 float BBox::SurfaceArea() const{
     return 2.0f * HalfSurfaceArea();
 }
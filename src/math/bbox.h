@@ -93,6 +93,11 @@ public:
     //! @brief  Reset the bounding box so that it is an invalid one.
     void        InvalidBBox();
 
+    //! @brief  Whether the bounding box is a valid one.
+    //!
+    //! @return         It returns false if the bounding box is empty, like the one created by the default constructor.
+    bool        IsValid() const;
+
     //! @param  delta   The half delta to expend along each direction.
     //! @brief  Expend the bounding box.
     //!
@@ -125,6 +130,24 @@ SORT_FORCEINLINE BBox Union( const BBox& bbox0 , const BBox& bbox1 ){
     return result;
 }
 
+//! @brief  Intersection of two bounding boxes.
+//!
+//! @param  bbox0   One of the bounding boxes.
+//! @param  bbox1   The other bounding box.
+//! @return         The intersection of the two bounding boxes, it is an invalid one if they don't overlap.
+SORT_FORCEINLINE BBox Intersection( const BBox& bbox0 , const BBox& bbox1 ){
+    BBox result;
+    for( int i = 0 ; i < 3 ; i++ ){
+        result.m_Min[i] = std::max( bbox0.m_Min[i] , bbox1.m_Min[i] );
+        result.m_Max[i] = std::min( bbox0.m_Max[i] , bbox1.m_Max[i] );
+
+        // an invalid bounding box has to be invalid on all axes, otherwise unions with it will be wrong.
+        if( result.m_Min[i] > result.m_Max[i] )
+            return BBox();
+    }
+    return result;
+}
+
 SORT_FORCEINLINE float Intersect( const Ray& ray , const BBox& bb , float* fmax = nullptr ){
     //set default value for tmax and tmin
     float tmax = ray.m_fMax;
@@ -24,6 +24,7 @@
 class Primitive;
 class PhaseFunction;
 class Mesh;
+class Transform;
 
 /**
  * InteractionCommon keeps track of the common field shared by surface interfaction and
@@ -60,6 +61,8 @@ struct SurfaceInteraction : public InteractionCommon{
     float   t = FLT_MAX;
     // the intersected primitive
     const Primitive*  primitive = nullptr;
+    // transform of the instance that the intersected primitive belongs to, nullptr if it is not instanced
+    const Transform*  instance = nullptr;
 
     //! @brief  Reset the intersection.
     //!
@@ -69,6 +72,7 @@ struct SurfaceInteraction : public InteractionCommon{
     SORT_FORCEINLINE void Reset(){
         t = FLT_MAX;
         primitive = nullptr;
+        instance = nullptr;
     }
 };
 
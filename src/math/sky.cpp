@@ -32,6 +32,24 @@ Spectrum Sky::Evaluate( const Vector& wi ) const
     return m_sky.GetColorFromUV( u , 1.0f - v );
 }
 
+// evaluate values of a batch of directions from sky
+void Sky::Evaluate( const Vector* wi , unsigned cnt , Spectrum* radiance ) const
+{
+    // texture coordinates are computed in small chunks so that they stay on the stack.
+    constexpr unsigned CHUNK_SIZE = 64;
+    float u[CHUNK_SIZE] , v[CHUNK_SIZE];
+    for( auto offset = 0u ; offset < cnt ; offset += CHUNK_SIZE )
+    {
+        const auto chunk = std::min( CHUNK_SIZE , cnt - offset );
+        for( auto i = 0u ; i < chunk ; ++i )
+        {
+            u[i] = sphericalPhi( wi[offset + i] ) * INV_TWOPI;
+            v[i] = 1.0f - sphericalTheta( wi[offset + i] ) * INV_PI;
+        }
+        m_sky.GetSampler().SampleColor( u , v , chunk , radiance + offset );
+    }
+}
+
 // get the average radiance
 Spectrum Sky::GetAverage() const
 {
@@ -65,7 +83,7 @@ Vector Sky::sample_v( float u , float v , float* pdf , float* area_pdf ) const
 
     float uv[2] ;
     float apdf = 0.0f;
-    distribution->SampleContinuous( u , v , uv , &apdf );
+    distribution->SampleContinuousAlias( u , v , uv , &apdf );
     if( area_pdf ) *area_pdf = apdf;
     if( apdf == 0.0f )
         return Vector();
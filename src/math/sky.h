@@ -32,6 +32,12 @@ public:
     // result   : the spectrum in the sky
     Spectrum Evaluate(const Vector& r) const;
 
+    // evaluate values of a batch of directions from sky
+    // para 'wi'       : the directions of rays which miss all of the triangles in the scene
+    // para 'cnt'      : the number of directions
+    // para 'radiance' : the spectrums in the sky
+    void Evaluate(const Vector* wi, unsigned cnt, Spectrum* radiance) const;
+
     // get the average radiance
     Spectrum GetAverage() const;
 
@@ -18,6 +18,7 @@
 #include "heterogeneous.h"
 #include "core/rand.h"
 #include "core/memory.h"
+#include "core/mesh.h"
 #include "material/material.h"
 #include "phasefunction.h"
 
@@ -29,105 +30,132 @@ IMPLEMENT_CLOSURE_TYPE_VAR(ClosureTypeHeterogenous, Tsl_float, scattering)
 IMPLEMENT_CLOSURE_TYPE_VAR(ClosureTypeHeterogenous, Tsl_float, anisotropy)
 IMPLEMENT_CLOSURE_TYPE_END(ClosureTypeHeterogenous)
 
-Spectrum HeterogenousMedium::Tr(const Ray& ray, const float max_t) const {
-    // get the step size and count
-    auto        step_size = m_material->GetVolumeStep();
-    const auto  step_cnt = m_material->GetVolumeStepCnt();
-
-    auto t = 0.0f;
-    Spectrum exponent(0.0f);
-
-    // ray marching
-    for (auto i = 0u; i < step_cnt; ++i) {
-        const auto dt = t + step_size <= max_t ? step_size : max_t - t;
-        const auto new_t = t + dt * sort_canonical();
-
-        // take a sample in the medium
-        MediumSample ms;
-        MediumInteraction tmp_mi;
-        tmp_mi.intersect = ray(new_t);
-        tmp_mi.mesh = m_mesh;
-        m_material->EvaluateMediumSample(tmp_mi, ms);
-
-        exponent -= ms.basecolor * ms.extinction * dt;
+// Average of all channels of a spectrum.
+SORT_STATIC_FORCEINLINE float average(const Spectrum& s) {
+    return (s[0] + s[1] + s[2]) / 3.0f;
+}
 
-        t += dt;
+// Average of the absolute value of all channels of a spectrum.
+SORT_STATIC_FORCEINLINE float average_abs(const Spectrum& s) {
+    return (fabs(s[0]) + fabs(s[1]) + fabs(s[2])) / 3.0f;
+}
 
-        if (t >= max_t)
-            break;
-    }
+Spectrum HeterogenousMedium::Tr(const Ray& ray, const float max_t) const {
+    // Ratio Tracking, Jan Novak
+    // https://cs.dartmouth.edu/~wjarosz/publications/novak14residual.pdf
+    const auto grid = m_mesh->GetMajorantGrid(m_material);
+
+    auto transmittance = Spectrum(1.0f);
+
+    // optical depth to travel before the next tentative collision
+    auto tau = -log(1.0f - sort_canonical());
+
+    grid->Traverse(ray, max_t, [&](const float t0, const float t1, const float majorant) {
+        // there is nothing to collide with in empty space
+        if (majorant <= 0.0f)
+            return false;
+
+        auto t = t0;
+        while (true) {
+            t += tau / majorant;
+            if (t >= t1) {
+                // carry the rest of the optical depth over to the next segment
+                tau = (t - t1) * majorant;
+                return false;
+            }
+
+            // take a sample in the medium
+            MediumSample ms;
+            MediumInteraction tmp_mi;
+            tmp_mi.intersect = ray(t);
+            tmp_mi.mesh = m_mesh;
+            m_material->EvaluateMediumSample(tmp_mi, ms);
+
+            transmittance *= Spectrum(1.0f) - ms.basecolor * ms.extinction / majorant;
+
+            // russian roulette to terminate the tracking once it hardly transmits anything
+            if (transmittance.GetMaxComponent() < 0.1f) {
+                if (sort_canonical() < 0.5f) {
+                    transmittance = 0.0f;
+                    return true;
+                }
+                transmittance *= 2.0f;
+            }
+
+            tau = -log(1.0f - sort_canonical());
+        }
+    });
 
-    return exponent.Exp();
+    return transmittance;
 }
 
 Spectrum HeterogenousMedium::Sample(const Ray& ray, const float max_t, MediumInteraction*& mi, Spectrum& emission) const {
-    // Distance Sample, Jan Novak
-    // https://cs.dartmouth.edu/~wjarosz/publications/novak18monte-slides-3-distance-sampling.pdf
-
-    // get the step size and count
-    auto        step_size = m_material->GetVolumeStep();
-    const auto  step_cnt = m_material->GetVolumeStepCnt();
-
-    // always start from 0.0 regardless the min_t value setup in ray
-    auto t = 0.0f;
-
-    // a random value
-    auto r = sort_canonical();
-
-    // accumulative transmittance
-    auto accum_transmittance = Spectrum(1.0f);
-
-    // maybe a better sampling algorithm for channel picking later
-    const auto ch = clamp((int)(sort_canonical() * RGBSPECTRUM_SAMPLE), 0, RGBSPECTRUM_SAMPLE - 1);
-
-    // ray marching
-    for (auto i = 0u; i < step_cnt; ++i) {
-        const auto dt = t + step_size <= max_t ? step_size : max_t - t;
-        const auto new_t = t + dt * sort_canonical();
-
-        // take a sample in the medium
-        MediumSample ms;
-        MediumInteraction tmp_mi;
-        tmp_mi.intersect = ray(new_t);
-        tmp_mi.mesh = m_mesh;
-        m_material->EvaluateMediumSample(tmp_mi, ms);
-
-        // beam transmittance along the ray through the short distance
-        const auto extinction = ms.basecolor * ms.extinction;
-        const auto exponent = -dt * extinction;
-        const auto beam_transmitancy = exponent.Exp();
-
-        if (1.0f - r >= beam_transmitancy[ch]) {
-            // sample a medium and scatter the ray
-            const auto new_dt = -log(1.0f - r) / extinction[ch];
-
-            mi = SORT_MALLOC(MediumInteraction)();
-            mi->intersect = ray(t + new_dt);
-            mi->phaseFunction = SORT_MALLOC(HenyeyGreenstein)(ms.anisotropy);
-            
-            const auto new_exponent = -new_dt * extinction;
-            const auto new_beam_transmitancy = new_exponent.Exp();
-            accum_transmittance *= new_beam_transmitancy;
-            const auto new_pdf = accum_transmittance * extinction;
-            const auto pdf = (new_pdf[0] + new_pdf[1] + new_pdf[2]) / 3.0f;
-            accum_transmittance /= pdf;
-
-            // This model is what is used in PBRT and different from 'Production Volume Rendering' by Disney.
-            emission = ms.emission * ms.basecolor * ms.absorption * accum_transmittance;
-
-            return accum_transmittance * ms.scattering * ms.basecolor;
-        } else {
-            accum_transmittance *= beam_transmitancy;
-            r = 1.0f - (1.0f - r) / beam_transmitancy[ch];
+    // Spectral Tracking, Peter Kutz
+    // https://jannovak.info/publications/SDTracking/SDTracking.pdf
+    // Extinction is chromatic, the probability of a real collision is derived from the average of all channels
+    // weighted by the path history, null collisions with negative weights are supported too in case the majorant
+    // is exceeded.
+    const auto grid = m_mesh->GetMajorantGrid(m_material);
+
+    // accumulative weight of all null collisions
+    auto weight = Spectrum(1.0f);
+
+    // optical depth to travel before the next tentative collision
+    auto tau = -log(1.0f - sort_canonical());
+
+    grid->Traverse(ray, max_t, [&](const float t0, const float t1, const float majorant) {
+        // there is nothing to collide with in empty space
+        if (majorant <= 0.0f)
+            return false;
+
+        auto t = t0;
+        while (true) {
+            t += tau / majorant;
+            if (t >= t1) {
+                // carry the rest of the optical depth over to the next segment
+                tau = (t - t1) * majorant;
+                return false;
+            }
+
+            // take a sample in the medium
+            MediumSample ms;
+            MediumInteraction tmp_mi;
+            tmp_mi.intersect = ray(t);
+            tmp_mi.mesh = m_mesh;
+            m_material->EvaluateMediumSample(tmp_mi, ms);
+
+            const auto extinction = ms.basecolor * ms.extinction;
+            const auto null_extinction = Spectrum(majorant) - extinction;
+
+            const auto real_weight = average(weight * extinction);
+            const auto null_weight = average_abs(weight * null_extinction);
+            if (real_weight + null_weight <= 0.0f) {
+                // the path doesn't carry anything anymore
+                weight = 0.0f;
+                return true;
+            }
+
+            const auto real_pdf = real_weight / (real_weight + null_weight);
+            if (sort_canonical() < real_pdf) {
+                // sample a medium and scatter the ray
+                mi = SORT_MALLOC(MediumInteraction)();
+                mi->intersect = tmp_mi.intersect;
+                mi->phaseFunction = SORT_MALLOC(HenyeyGreenstein)(ms.anisotropy);
+
+                weight /= majorant * real_pdf;
+
+                // This model is what is used in PBRT and different from 'Production Volume Rendering' by Disney.
+                emission = ms.emission * ms.basecolor * ms.absorption * weight;
+
+                weight *= ms.scattering * ms.basecolor;
+                return true;
+            }
+
+            weight *= null_extinction / (majorant * (1.0f - real_pdf));
+            tau = -log(1.0f - sort_canonical());
         }
+    });
 
-        t += dt;
-
-        if (t >= max_t)
-            break;
-    }
-
-    // sampling the surface behind the volume instead of the volume itself.
-    const auto pdf = (accum_transmittance[0] + accum_transmittance[1] + accum_transmittance[2]) / 3.0f;
-    return accum_transmittance / pdf;
-}
\ No newline at end of file
+    // it is either the weight of the medium interaction or the surface behind the volume.
+    return weight;
+}
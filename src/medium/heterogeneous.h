@@ -40,7 +40,7 @@ public:
     //! @param param		Parameter to build the volume.
     //! @param material		Material that spawns the medium.
     HeterogenousMedium(const ClosureTypeHeterogenous& param, const MaterialBase* material) :
-        Medium(param.base_color, param.emission, param.absorption, param.scattering, param.anisotropy, material) {}
+        Medium(param.base_color, param.emission, param.absorption, param.scattering, param.anisotropy, material), m_mesh(nullptr) {}
 
     //! @brief  Constructor.
     //!
@@ -53,6 +53,8 @@ public:
     //!
     //! Beam transmittance is how much percentage of radiance get attenuated during
     //! traveling through the medium. It is a spectrum dependent attenuation.
+    //! It is estimated with ratio tracking against the majorant grid of the volume, which is
+    //! unbiased and skips empty space without evaluating any shader.
     //!
     //! @param  ray         The ray, which it uses to evaluate beam transmittance.
     //! @param  max_t       The maximum distance to be considered, usually this is the distance the ray travels before it hits a surface.
@@ -61,8 +63,9 @@ public:
 
     //! @brief  Importance sampling a point along the ray in the medium.
     //!
-    //! This is no way to use Delta-Tracking algorithm due to the lack of context of maximum density because
-    //! density is a shader driven property, there is no way to explictly evaluate the maximum value.
+    //! Spectral tracking, a variant of delta tracking that supports chromatic extinction, is used against
+    //! the majorant grid of the volume. Since density is the only input of the volume shader, the majorant
+    //! grid is built by bounding the extinction over the density range of each cell.
     //!
     //! @param ray          The ray we use to take sample.
     //! @param max_t        The maximum distance to be considered, usually this is the distance the ray travels before it hits a surface.
@@ -72,5 +75,6 @@ public:
     Spectrum Sample(const Ray& ray, const float max_t, MediumInteraction*& mi, Spectrum& emission) const override;
 
 private:
+    /**< Mesh that wraps the medium. */
     const Mesh* m_mesh;
 };
\ No newline at end of file
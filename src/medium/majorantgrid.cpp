@@ -0,0 +1,73 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include <cmath>
+#include "majorantgrid.h"
+#include "medium.h"
+#include "material/material.h"
+
+MajorantGrid::MajorantGrid(const MediumDensity* density, const Matrix& world2Volume, const MaterialBase* material) :
+    m_material(material), m_world2Volume(world2Volume) {
+    // Maximum extinction among all spectrum channels given a density.
+    const auto extinction = [&](const float d) {
+        MediumSample ms;
+        material->EvaluateMediumSample(d, ms);
+        return std::max((ms.basecolor * ms.extinction).GetMaxComponent(), 0.0f);
+    };
+
+    m_outsideMajorant = extinction(0.0f);
+
+    if (IS_PTR_INVALID(density) || !density->IsValid())
+        return;
+
+    // Rather than evaluating the volume shader for each cell, the extinction is tabulated over the range of density in
+    // the volume. The majorant of a cell is the maximum of all entries that cover the density range of the cell, this is
+    // conservative as long as extinction is monotonic between two adjacent entries, which is true for any reasonable
+    // volume shader. Even if the majorant is exceeded somewhere, delta tracking and ratio tracking stay unbiased since
+    // null collisions with negative weights are supported, it only costs some variance.
+    const auto& bound = density->GetDensityBound();
+    const auto lo = std::min(bound.m_min, 0.0f);
+    const auto hi = std::max(bound.m_max, 0.0f);
+    const auto step = (hi - lo) / (float)(MAJORANT_TABLE_SIZE - 1);
+
+    float table[MAJORANT_TABLE_SIZE];
+    for (auto i = 0u; i < MAJORANT_TABLE_SIZE; ++i)
+        table[i] = extinction(lo + step * i);
+
+    for (auto i = 0; i < 3; ++i)
+        m_res[i] = (int)density->GetCellRes(i);
+    m_majorants.resize(m_res[0] * m_res[1] * m_res[2]);
+
+    for (auto z = 0; z < m_res[2]; ++z) {
+        for (auto y = 0; y < m_res[1]; ++y) {
+            for (auto x = 0; x < m_res[0]; ++x) {
+                const auto& cell_bound = density->GetCellBound(x, y, z);
+
+                auto i0 = 0, i1 = 0;
+                if (step > 0.0f) {
+                    i0 = clamp((int)std::floor((cell_bound.m_min - lo) / step), 0, (int)MAJORANT_TABLE_SIZE - 1);
+                    i1 = clamp((int)std::ceil((cell_bound.m_max - lo) / step), 0, (int)MAJORANT_TABLE_SIZE - 1);
+                }
+
+                auto majorant = 0.0f;
+                for (auto i = i0; i <= i1; ++i)
+                    majorant = std::max(majorant, table[i]);
+                m_majorants[(z * m_res[1] + y) * m_res[0] + x] = majorant;
+            }
+        }
+    }
+}
@@ -0,0 +1,151 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include <vector>
+#include <cfloat>
+#include <algorithm>
+#include "core/define.h"
+#include "math/ray.h"
+#include "math/matrix.h"
+#include "math/utils.h"
+#include "mediumdata.h"
+
+class MaterialBase;
+
+//! @brief  Number of densities at which the volume shader is evaluated to bound the extinction of a volume.
+constexpr unsigned int MAJORANT_TABLE_SIZE = 64;
+
+//! @brief  A coarse grid holding the maximum extinction of a heterogeneous volume in each cell.
+/**
+ * The majorant grid is what makes delta tracking and ratio tracking practical in heterogeneous medium. Instead of
+ * one global majorant of the whole volume, which is usually way too high for the thin part of smoke or cloud, each
+ * cell has its own majorant so that the number of null collisions stays low. Cells with zero majorant are skipped
+ * entirely without evaluating any shader.
+ * Extinction is driven by the volume shader of a material, whose only input is density. Since the same volume data
+ * could be attached with different materials, a majorant grid is built for each pair of mesh and material.
+ */
+class MajorantGrid {
+public:
+    //! @brief  Constructor.
+    //!
+    //! @param  density         Density of the volume.
+    //! @param  world2Volume    Transform from world space to volume texture space.
+    //! @param  material        Material that drives the extinction of the volume.
+    MajorantGrid(const MediumDensity* density, const Matrix& world2Volume, const MaterialBase* material);
+
+    //! @brief  Get the material that the majorant grid is built for.
+    //!
+    //! @return         Material that drives the extinction of the volume.
+    const MaterialBase* GetMaterial() const {
+        return m_material;
+    }
+
+    //! @brief  Walk through the segments of a ray that overlap cells of the grid, front to back.
+    //!
+    //! The whole range of the ray is covered, the part outside the volume is visited with the extinction of zero
+    //! density as its majorant.
+    //!
+    //! @param  ray         The ray in world space.
+    //! @param  max_t       The maximum distance to be considered.
+    //! @param  visitor     Callback taking the range of a segment and its majorant, it returns true to stop walking.
+    template<class Visitor>
+    void    Traverse(const Ray& ray, const float max_t, Visitor&& visitor) const;
+
+private:
+    /**< Material that drives the extinction of the volume. */
+    const MaterialBase*     m_material;
+    /**< Transform from world space to volume texture space. */
+    Matrix                  m_world2Volume;
+    /**< Resolution of the grid. */
+    int                     m_res[3] = { 0 , 0 , 0 };
+    /**< Majorant of each cell in the grid. */
+    std::vector<float>      m_majorants;
+    /**< Majorant outside the volume, where the density is zero. */
+    float                   m_outsideMajorant = 0.0f;
+};
+
+template<class Visitor>
+void MajorantGrid::Traverse(const Ray& ray, const float max_t, Visitor&& visitor) const {
+    // t is the same in both spaces since the transform is affine.
+    const auto o = m_world2Volume.TransformPoint(ray.m_Ori);
+    const auto d = m_world2Volume.TransformVector(ray.m_Dir);
+
+    // clip the ray against the volume, which is a unit cube in volume texture space
+    auto t_enter = 0.0f;
+    auto t_exit = max_t;
+    for (auto i = 0u; i < 3; ++i) {
+        if (d[i] == 0.0f) {
+            if (o[i] < 0.0f || o[i] > 1.0f)
+                t_exit = -1.0f;
+            continue;
+        }
+        const auto inv_d = 1.0f / d[i];
+        const auto t0 = -o[i] * inv_d;
+        const auto t1 = (1.0f - o[i]) * inv_d;
+        t_enter = std::max(t_enter, std::min(t0, t1));
+        t_exit = std::min(t_exit, std::max(t0, t1));
+    }
+
+    if (m_majorants.empty() || t_enter >= t_exit) {
+        visitor(0.0f, max_t, m_outsideMajorant);
+        return;
+    }
+
+    if (t_enter > 0.0f && visitor(0.0f, t_enter, m_outsideMajorant))
+        return;
+
+    // 3D-DDA through the cells of the grid
+    const auto p = o + d * t_enter;
+    int     cell[3], step[3];
+    float   next_t[3], delta_t[3];
+    for (auto i = 0u; i < 3; ++i) {
+        cell[i] = clamp((int)(p[i] * m_res[i]), 0, m_res[i] - 1);
+        if (d[i] > 0.0f) {
+            step[i] = 1;
+            next_t[i] = t_enter + ((float)(cell[i] + 1) / m_res[i] - p[i]) / d[i];
+            delta_t[i] = 1.0f / (m_res[i] * d[i]);
+        } else if (d[i] < 0.0f) {
+            step[i] = -1;
+            next_t[i] = t_enter + ((float)cell[i] / m_res[i] - p[i]) / d[i];
+            delta_t[i] = -1.0f / (m_res[i] * d[i]);
+        } else {
+            step[i] = 0;
+            next_t[i] = FLT_MAX;
+            delta_t[i] = FLT_MAX;
+        }
+    }
+
+    auto t = t_enter;
+    while (true) {
+        const auto axis = (next_t[0] < next_t[1]) ? (next_t[0] < next_t[2] ? 0 : 2) : (next_t[1] < next_t[2] ? 1 : 2);
+        const auto t_next = std::min(next_t[axis], t_exit);
+        const auto majorant = m_majorants[(cell[2] * m_res[1] + cell[1]) * m_res[0] + cell[0]];
+        if (t_next > t && visitor(t, t_next, majorant))
+            return;
+
+        t = t_next;
+        cell[axis] += step[axis];
+        if (t >= t_exit || cell[axis] < 0 || cell[axis] >= m_res[axis])
+            break;
+        next_t[axis] += delta_t[axis];
+    }
+
+    if (t < max_t)
+        visitor(t, max_t, m_outsideMajorant);
+}
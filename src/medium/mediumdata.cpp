@@ -15,6 +15,8 @@
     this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
  */
 
+#include <algorithm>
+#include <cfloat>
 #include "mediumdata.h"
 #include "math/point.h"
 #include "stream/stream.h"
@@ -30,11 +32,68 @@ void MediumDensity::Serialize(IStreamBase& stream) {
     if (m_width == 0 || m_height == 0 || m_depth == 0)
         return;
 
-    const auto tex_cnt = m_width * m_height * m_depth;
+    loadTexels(stream);
 
-    m_memory = std::make_unique<ImgMemory<float>>();
-    m_memory->m_texel = std::make_unique<float[]>(tex_cnt);
-    stream.Load((char*)m_memory->m_texel.get(), sizeof(float) * tex_cnt);
+    buildDensityBounds();
+}
+
+void MediumDensity::buildDensityBounds() {
+    const unsigned int res[] = { m_width , m_height , m_depth };
+    for (auto i = 0; i < 3; ++i)
+        m_cellRes[i] = (res[i] + DENSITY_BOUND_CELL_SIZE - 1) / DENSITY_BOUND_CELL_SIZE;
+    m_cellBounds.resize(m_cellRes[0] * m_cellRes[1] * m_cellRes[2]);
+
+    // Trilinear filtering of a position in a cell touches one more texel on each side of the cell. Positions
+    // outside the volume have zero density, it is not included here since the grid only covers the volume.
+    const auto texel_range = [&](const unsigned int cell, const int axis, unsigned int& lo, unsigned int& hi) {
+        lo = cell * DENSITY_BOUND_CELL_SIZE;
+        lo = lo > 0 ? lo - 1 : 0;
+        hi = std::min((cell + 1) * DENSITY_BOUND_CELL_SIZE, res[axis] - 1);
+    };
+
+    // Cells are aligned with bricks, a cell only touches texels in its own brick and the ones right before it.
+    const auto is_empty = [&](const unsigned int cx, const unsigned int cy, const unsigned int cz) {
+        for (auto bz = cz > 0 ? cz - 1 : 0; bz <= cz; ++bz)
+            for (auto by = cy > 0 ? cy - 1 : 0; by <= cy; ++by)
+                for (auto bx = cx > 0 ? cx - 1 : 0; bx <= cx; ++bx)
+                    if (!IsBrickEmpty(bx, by, bz))
+                        return false;
+        return true;
+    };
+
+    m_densityBound.m_min = FLT_MAX;
+    m_densityBound.m_max = -FLT_MAX;
+    for (auto cz = 0u; cz < m_cellRes[2]; ++cz) {
+        unsigned int z0, z1;
+        texel_range(cz, 2, z0, z1);
+        for (auto cy = 0u; cy < m_cellRes[1]; ++cy) {
+            unsigned int y0, y1;
+            texel_range(cy, 1, y0, y1);
+            for (auto cx = 0u; cx < m_cellRes[0]; ++cx) {
+                unsigned int x0, x1;
+                texel_range(cx, 0, x0, x1);
+
+                DensityBound bound;
+                if (!is_empty(cx, cy, cz)) {
+                    bound.m_min = FLT_MAX;
+                    bound.m_max = -FLT_MAX;
+                    for (auto z = z0; z <= z1; ++z) {
+                        for (auto y = y0; y <= y1; ++y) {
+                            for (auto x = x0; x <= x1; ++x) {
+                                const auto density = ImageTexture3D::Sample((int)x, (int)y, (int)z);
+                                bound.m_min = std::min(bound.m_min, density);
+                                bound.m_max = std::max(bound.m_max, density);
+                            }
+                        }
+                    }
+                }
+
+                m_cellBounds[(cz * m_cellRes[1] + cy) * m_cellRes[0] + cx] = bound;
+                m_densityBound.m_min = std::min(m_densityBound.m_min, bound.m_min);
+                m_densityBound.m_max = std::max(m_densityBound.m_max, bound.m_max);
+            }
+        }
+    }
 }
 
 Spectrum MediumColor::Sample(const Point& uvw) const {
@@ -18,14 +18,24 @@
 #pragma once
 
 #include "core/define.h"
+#include <vector>
 #include "texture/imagetexture3d.h"
 
 struct Point;
 class IStreamBase;
 
+//! @brief  Number of texels along each axis covered by a cell of the coarse density bound grid, cells are aligned with bricks.
+constexpr unsigned int DENSITY_BOUND_CELL_SIZE = TEXTURE3D_BRICK_SIZE;
+
+//! @brief  Range of the density inside a region of the volume.
+struct DensityBound {
+    float   m_min = 0.0f;     /**< Minimum density inside the region. */
+    float   m_max = 0.0f;     /**< Maximum density inside the region. */
+};
+
 //! @brief  Medium density data structure allows variation of density inside a medium volume.
 /**
- * Medium density is essentially a 3D texture.
+ * Medium density is essentially a 3D texture, it is stored sparsely so that empty space takes almost no memory.
  */
 class MediumDensity : public ImageTexture3D<float> {
 public:
@@ -40,6 +50,45 @@ public:
     //! @param  Stream  where the serialization data comes from. Depending on different situation,
     //!                 it could come from different places.
     void    Serialize(IStreamBase& stream);
+
+    //! @brief  Get the resolution of the coarse density bound grid along an axis.
+    //!
+    //! @param  axis    Index of the axis, 0 for x, 1 for y and 2 for z.
+    //! @return         Number of cells along the axis.
+    unsigned int GetCellRes(const int axis) const {
+        return m_cellRes[axis];
+    }
+
+    //! @brief  Get the density bound of a cell in the coarse density bound grid.
+    //!
+    //! The bound is conservative in a way that it covers all texels touched by trilinear filtering of any
+    //! position inside the cell.
+    //!
+    //! @param  x       Index of the cell along x axis.
+    //! @param  y       Index of the cell along y axis.
+    //! @param  z       Index of the cell along z axis.
+    //! @return         The density bound of the cell.
+    const DensityBound& GetCellBound(const unsigned int x, const unsigned int y, const unsigned int z) const {
+        return m_cellBounds[(z * m_cellRes[1] + y) * m_cellRes[0] + x];
+    }
+
+    //! @brief  Get the density bound of the whole volume.
+    //!
+    //! @return         The density bound of the whole volume.
+    const DensityBound& GetDensityBound() const {
+        return m_densityBound;
+    }
+
+private:
+    //! @brief  Build the coarse density bound grid right after the density is loaded.
+    void    buildDensityBounds();
+
+    /**< Resolution of the coarse density bound grid. */
+    unsigned int                m_cellRes[3] = { 0u , 0u , 0u };
+    /**< Density bounds of all cells in the coarse grid. */
+    std::vector<DensityBound>   m_cellBounds;
+    /**< Density bound of the whole volume. */
+    DensityBound                m_densityBound;
 };
 
 //! @brief  Medium color data structure allows variation of color inside a medium volume.
@@ -115,12 +115,15 @@ DisneyBssrdf::DisneyBssrdf( const SurfaceInteraction* intersection , const Spect
     const auto s = Spectrum(1.9f) - R + 3.5f * ( R - Spectrum( 0.8f ) ) * ( R - Spectrum( 0.8f ) );
     
     channels = SPECTRUM_SAMPLE;
+    for( int i = 0 ; i < SPECTRUM_SAMPLE ; ++i )
+        validChannels[i] = i;
 
 #ifdef SSS_REPLACE_WITH_LAMBERT
-    constexpr float delta = 0.0001f;
+    // channels with zero mean free path are never picked, the rest of them are packed in the front of the table.
+    channels = 0;
     for( int i = 0 ; i < SPECTRUM_SAMPLE ; ++i ){
-        if( mfp[i] == 0.0f )
-            --channels;
+        if( mfp[i] != 0.0f )
+            validChannels[channels++] = i;
     }
 #endif
 
@@ -131,16 +134,8 @@ DisneyBssrdf::DisneyBssrdf( const SurfaceInteraction* intersection , const Spect
 }
 
 int DisneyBssrdf::Sample_Ch() const{
-    auto ch = clamp( (int)(sort_canonical() * channels) , 0 , channels - 1 );
-#ifdef SSS_REPLACE_WITH_LAMBERT
-    // Here it is assumed that the spectrum is RGB only. 
-    // This code needs change if SORT needs to support full spectrum rendering, which is not my plan for now.
-    if( ch == 0 )
-        ch = ( d[0] > 0.0f ) ? 0 : ( d[1] > 0.0f ? 1 : 2 );
-    else if( ch == 1 )
-        ch = ( d[1] > 0.0f ) ? 1 : 2;
-#endif
-    return ch;
+    // all valid channels are equally likely to be picked, a table lookup is all it takes.
+    return validChannels[ clamp( (int)(sort_canonical() * channels) , 0 , channels - 1 ) ];
 }
 
 Spectrum DisneyBssrdf::S( const Vector& wo , const Point& po , const Vector& wi , const Point& pi ) const{
@@ -278,4 +278,5 @@ protected:
 
 private:
     Spectrum    d;
+    int         validChannels[SPECTRUM_SAMPLE];    /**< Channels in which mfp is not zero, the first 'channels' of them are valid. */
 };
\ No newline at end of file
@@ -52,6 +52,20 @@ struct BSSRDFIntersections{
         maxt = std::max(maxt, intersections[2]->intersection.t);
         maxt = std::max(maxt, intersections[3]->intersection.t);
     }
+
+    //! @brief  Whether the primitive is intersected already.
+    //!
+    //! Spatial data structures could keep the same primitive in multiple places, which shouldn't be counted more than once.
+    //!
+    //! @param  primitive   The primitive to look for.
+    //! @return             Whether there is an intersection with the primitive.
+    bool    HasPrimitive(const Primitive* primitive) const {
+        for (auto i = 0u; i < cnt; ++i) {
+            if (primitive == intersections[i]->intersection.primitive)
+                return true;
+        }
+        return false;
+    }
 };
 
 //! @brief BSDF implementation.
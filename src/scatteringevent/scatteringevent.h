@@ -102,6 +102,28 @@ public:
         return m_flag;
     }
 
+    //! @brief  Get the number of bxdfs in this scattering event.
+    //!
+    //! @return  The number of bxdfs in this scattering event.
+    SORT_FORCEINLINE unsigned   GetBxdfCnt() const {
+        return m_bxdfCnt;
+    }
+
+    //! @brief  Get a bxdf in this scattering event.
+    //!
+    //! @param  i   Index of the bxdf, it should be smaller than the number of bxdfs.
+    //! @return     The bxdf.
+    SORT_FORCEINLINE const Bxdf* GetBxdf( unsigned i ) const {
+        return m_bxdfs[i];
+    }
+
+    //! @brief  Whether there is any bssrdf in this scattering event.
+    //!
+    //! @return  Whether there is any bssrdf in this scattering event.
+    SORT_FORCEINLINE bool       HasBssrdf() const {
+        return m_bssrdfCnt > 0;
+    }
+
     //! @brief  Randomly pick between bxdf and bssrdf
     //!
     //! @param  flag        Which catagory it picks, it could be SE_EVALUATE_BXDF/SE_EVALUATE_BSSRDF.
@@ -0,0 +1,73 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "instance.h"
+#include "accel/accelerator.h"
+#include "math/interaction.h"
+
+bool Instance::GetIntersect( const Ray& r , SurfaceInteraction* intersect ) const{
+    // The direction of the ray is not normalized after transformation so that the distance along the ray is the same in
+    // both spaces, intersections in the bottom level acceleration structure can be compared with the ones found outside.
+    const auto ray = m_transform.invMatrix( r );
+
+    SurfaceInteraction local;
+#ifdef ENABLE_TRANSPARENT_SHADOW
+    local.query_shadow = intersect ? intersect->query_shadow : true;
+#endif
+    local.t = intersect ? intersect->t : FLT_MAX;
+    if( !m_accelerator->GetIntersect( ray , local ) )
+        return false;
+
+    if( IS_PTR_INVALID(intersect) )
+        return true;
+
+    // a shadow ray is blocked by something opaque, there is no detail in the intersection
+    if( IS_PTR_INVALID(local.primitive) ){
+        intersect->t = local.t;
+        intersect->primitive = nullptr;
+        return true;
+    }
+
+    intersect->intersect = m_transform.TransformPoint( local.intersect );
+    intersect->gnormal = normalize( m_transform.TransformNormal( local.gnormal ) );
+    intersect->normal = normalize( m_transform.TransformNormal( local.normal ) );
+    intersect->tangent = normalize( m_transform.TransformVector( local.tangent ) );
+    intersect->view = -r.m_Dir;
+    intersect->u = local.u;
+    intersect->v = local.v;
+    intersect->t = local.t;
+    intersect->primitive = local.primitive;
+    intersect->instance = &m_transform;
+
+    return true;
+}
+
+const BBox& Instance::GetBBox() const{
+    if( !m_bbox ){
+        m_bbox = std::make_unique<BBox>();
+
+        const auto& bbox = m_accelerator->GetBBox();
+        for( auto i = 0 ; i < 8 ; ++i ){
+            const Point corner( ( i & 1 ) ? bbox.m_Max.x : bbox.m_Min.x ,
+                                ( i & 2 ) ? bbox.m_Max.y : bbox.m_Min.y ,
+                                ( i & 4 ) ? bbox.m_Max.z : bbox.m_Min.z );
+            m_bbox->Union( m_transform.TransformPoint( corner ) );
+        }
+    }
+
+    return *m_bbox;
+}
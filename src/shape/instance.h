@@ -0,0 +1,84 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "shape.h"
+
+class Accelerator;
+
+//! @brief Instance of a group of primitives.
+/**
+ * An instance places a group of primitives, which are organized in their own bottom level acceleration structure, in
+ * the world with a transform. Lots of instances can share the same acceleration structure so that duplicated objects,
+ * like trees in a forest, are only stored once in memory no matter how many times they show up. The top level
+ * acceleration structure treats each instance as a single primitive.
+ * Unlike other shapes, the transform of an instance could have scaling in it.
+ */
+class   Instance : public Shape{
+public:
+    //! @brief Constructor
+    //!
+    //! @param accelerator  The acceleration structure of the instanced primitives in their local space.
+    //! @param transform    The transform from the local space of the primitives to world space.
+    Instance( const Accelerator* accelerator , const Transform& transform ) : m_accelerator( accelerator ) {
+        m_transform = transform;
+    }
+
+    //! @brief Instance can't be used as a light source for now.
+    Point           Sample_l( const LightSample& ls , const Point& p , Vector& wi , Vector& n, float* pdf ) const override{
+        return Point();
+    }
+
+    //! @brief Instance can't be used as a light source for now.
+    void            Sample_l( const LightSample& ls , Ray& r , Vector& n , float* pdf ) const override{
+    }
+
+    //! @brief      Get intersected point between the ray and the instanced primitives.
+    //!
+    //! The ray is transformed to the local space of the instance to traverse the bottom level acceleration structure,
+    //! the intersection found is then transformed back to world space. The primitive returned in the intersection is
+    //! the instanced primitive that is hit, 'instance' of the intersection points to the transform of this instance.
+    //!
+    //! @param ray      The ray to be tested against.
+    //! @param inter    The intersection data to be filled. If it is nullptr, there is no detailed information
+    //!                 for the intersection.
+    //! @return         Whether the ray intersects the shape.
+    bool            GetIntersect( const Ray& ray , SurfaceInteraction* inter = nullptr ) const override;
+
+    //! @brief      Get bounding box of the instance in world space.
+    //!
+    //! @return     The bounding box of the shape.
+    const BBox&     GetBBox() const override;
+
+    //! @brief      Instances are never sampled as light sources, there is no need to know their surface area.
+    //!
+    //! @return     Zero is always returned.
+    float           SurfaceArea() const override{
+        return 0.0f;
+    }
+
+    //! @brief      Get the type of the shape
+    //!
+    //! @return     The type of the shape.
+    SHAPE_TYPE GetShapeType() const override{
+        return SHAPE_INSTANCE;
+    }
+
+private:
+    const Accelerator*      m_accelerator = nullptr;    /**< Bottom level acceleration structure shared by all instances of the same primitives. */
+};
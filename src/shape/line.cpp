@@ -17,6 +17,7 @@
 
 #include "line.h"
 #include "math/utils.h"
+#include "stream/stream.h"
 
 bool Line::GetIntersect( const Ray& r , SurfaceInteraction* intersect ) const{
     // convert it to line space first
@@ -97,6 +98,44 @@ const BBox& Line::GetBBox() const{
     return *m_bbox;
 }
 
+BBox Line::ClipBBox( const BBox& box ) const{
+    // any point on the surface inside the box is within half width from the part of the center line inside the
+    // box expended by half width.
+    const auto w = std::max( m_w0 , m_w1 );
+    const auto d = m_gp1 - m_gp0;
+    auto t0 = 0.0f , t1 = 1.0f;
+    for( auto axis = 0 ; axis < 3 ; ++axis ){
+        const auto lo = box.m_Min[axis] - w;
+        const auto hi = box.m_Max[axis] + w;
+        if( d[axis] == 0.0f ){
+            if( m_gp0[axis] < lo || m_gp0[axis] > hi )
+                return BBox();
+            continue;
+        }
+
+        auto ta = ( lo - m_gp0[axis] ) / d[axis];
+        auto tb = ( hi - m_gp0[axis] ) / d[axis];
+        if( ta > tb )
+            std::swap( ta , tb );
+        t0 = std::max( t0 , ta );
+        t1 = std::min( t1 , tb );
+        if( t0 > t1 )
+            return BBox();
+    }
+
+    BBox ret( m_gp0 + d * t0 , m_gp0 + d * t1 , false );
+    ret.Expend( w );
+    return Intersection( ret , box );
+}
+
+void Line::SerializeGeometry( OStreamBase& stream ) const{
+    stream << m_p0 << m_p1 << m_w0 << m_w1 << m_world2Line.matrix;
+}
+
+void Line::SerializeTopology( OStreamBase& stream ) const{
+    stream << m_p0 << m_p1 << m_w0 << m_w1;
+}
+
 float Line::SurfaceArea() const{
     return m_length * ( m_w0 + m_w1 ) * PI;
 }
@@ -21,12 +21,16 @@
 
 #ifdef SSE_ENABLED
 struct Line4;
-struct Ray4_Data;
 #endif
 
 #ifdef AVX_ENABLED
 struct Line8;
-struct Ray8_Data;
+#endif
+
+#ifdef SIMD_DISPATCH_ENABLED
+namespace simd_sse41{ struct Line4; }
+namespace simd_avx2{ struct Line8; }
+namespace simd_avx512{ struct Line8; }
 #endif
 
 //! @brief  Line is a common type for hair or fur rendering.
@@ -109,6 +113,30 @@ public:
     //! @return     The bounding box of the shape.
     const BBox&     GetBBox() const override;
 
+    //! @brief      Get bounding box of the part of the line inside a bounding box.
+    //!
+    //! The center line is clipped against the bounding box expended by the half width, the clipped segment is then
+    //! expended by half width again. Long hair segments get much tighter bounding boxes this way.
+    //!
+    //! @param box      The bounding box to clip the line against.
+    //! @return         Bounding box of the part of the line inside the box, it is invalid if there is nothing inside.
+    BBox            ClipBBox( const BBox& box ) const override;
+
+    //! @brief      Stream out the geometry of the line.
+    //!
+    //! End points and widths in local space, together with the transform of the line, are streamed out, which is
+    //! everything packed lines are made of.
+    //!
+    //! @param stream   The stream to write the geometry to.
+    void            SerializeGeometry( OStreamBase& stream ) const override;
+
+    //! @brief      Stream out what identifies the line regardless of where it is.
+    //!
+    //! End points and widths in local space are streamed out, the transform of the line is left out.
+    //!
+    //! @param stream   The stream to write the identity to.
+    void            SerializeTopology( OStreamBase& stream ) const override;
+
     //! @brief      Get the surface area of the shape.
     //!
     //! @return     Surface area of the shape.
@@ -166,11 +194,16 @@ private:
 
 #ifdef SSE_ENABLED
     friend struct Line4;
-    friend SORT_FORCEINLINE bool intersectLine_SIMD( const Ray& ray , const Ray4_Data& ray_simd , const Line4& line_simd , SurfaceInteraction* ret );
 #endif
 
 #ifdef AVX_ENABLED
     friend struct Line8;
-    friend SORT_FORCEINLINE bool intersectLine_SIMD( const Ray& ray , const Ray8_Data& ray_simd , const Line8& line_simd , SurfaceInteraction* ret );
+#endif
+
+#ifdef SIMD_DISPATCH_ENABLED
+    // Kernels compiled for each instruction set, see simd/simd_dispatch.h.
+    friend struct simd_sse41::Line4;
+    friend struct simd_avx2::Line8;
+    friend struct simd_avx512::Line8;
 #endif
 };
@@ -25,6 +25,7 @@
 #include "math/interaction.h"
 
 class LightSample;
+class OStreamBase;
 
 enum SHAPE_TYPE{
     SHAPE_TRIANGLE  = 0,
@@ -32,6 +33,7 @@ enum SHAPE_TYPE{
     SHAPE_DISK      = 2,
     SHAPE_QUAD      = 3,
     SHAPE_SPHERE    = 4,
+    SHAPE_INSTANCE  = 5,
 };
 
 //! @brief Shape class defines basic interface of shape.
@@ -121,6 +123,34 @@ public:
     //! @return     The bounding box of the shape.
     virtual const   BBox&   GetBBox() const = 0;
 
+    //! @brief      Get bounding box of the part of the shape inside a bounding box.
+    //!
+    //! This is used by spatial splits during BVH construction, where a primitive straddling the split plane is
+    //! referred by both sides with tighter bounding boxes. The default implementation simply clips the bounding box
+    //! of the shape, which is conservative. Shapes that are commonly long and thin should provide a tighter one.
+    //!
+    //! @param box      The bounding box to clip the shape against.
+    //! @return         Bounding box of the part of the shape inside the box, it is invalid if there is nothing inside.
+    virtual BBox    ClipBBox( const BBox& box ) const { return Intersection( GetBBox() , box ); }
+
+    //! @brief      Stream out the geometry of the shape.
+    //!
+    //! Together with the bounding box, this is what identifies the shape in the disk cache of accelerators. Shapes
+    //! whose geometry is copied into accelerators, like packed triangles and lines, or used during their construction
+    //! other than the bounding box, need to stream out all of it. Nothing is needed for the rest.
+    //!
+    //! @param stream   The stream to write the geometry to.
+    virtual void    SerializeGeometry( OStreamBase& stream ) const {}
+
+    //! @brief      Stream out what identifies the shape regardless of where it is.
+    //!
+    //! Accelerators only refit their cached trees to primitives of the same topology, it is what tells different
+    //! scenes apart in the disk cache. It should not change as the shape moves, which is what 'SerializeGeometry'
+    //! captures. Nothing is needed for shapes that are identified by their types.
+    //!
+    //! @param stream   The stream to write the identity to.
+    virtual void    SerializeTopology( OStreamBase& stream ) const {}
+
     //! @brief      Get the surface area of the shape.
     //!
     //! Get the surface area of the shape. This function is heavily used in the case of picking a area light
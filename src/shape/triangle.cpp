@@ -17,11 +17,140 @@
 
 #include "triangle.h"
 #include "entity/visual.h"
+#include "sampler/sample.h"
+#include "core/samplemethod.h"
+#include "stream/stream.h"
+
+// Solid angle sampling is only used if the solid angle of the triangle is within this range, the algorithm loses precision beyond it.
+static constexpr float MIN_SPHERICAL_SAMPLE_AREA = 3e-4f;
+static constexpr float MAX_SPHERICAL_SAMPLE_AREA = 6.22f;
 
 SORT_STATIC_FORCEINLINE Vector3f Permute( const Vector3f& v , int ax , int ay , int az ){
     return Vector3f( v[ax] , v[ay] , v[az] );
 }
 
+// Solid angle of the triangle from a point, it is zero if the point is on the plane of the triangle.
+SORT_STATIC_FORCEINLINE float solidAngle( const Point& p , const Point& p0 , const Point& p1 , const Point& p2 ){
+    const auto d0 = p0 - p;
+    const auto d1 = p1 - p;
+    const auto d2 = p2 - p;
+    if( d0.SquaredLength() == 0.0f || d1.SquaredLength() == 0.0f || d2.SquaredLength() == 0.0f )
+        return 0.0f;
+    return SphericalTriangleArea( normalize( d0 ) , normalize( d1 ) , normalize( d2 ) );
+}
+
+Point Triangle::Sample_l( const LightSample& ls , const Point& p , Vector& wi , Vector& n , float* pdf ) const{
+    const auto& mem = m_meshVisual->m_memory;
+    const auto& mv0 = mem->m_vertices[m_index.m_id[0]];
+    const auto& mv1 = mem->m_vertices[m_index.m_id[1]];
+    const auto& mv2 = mem->m_vertices[m_index.m_id[2]];
+
+    const auto& p0 = mv0.m_position;
+    const auto& p1 = mv1.m_position;
+    const auto& p2 = mv2.m_position;
+
+    const auto e1 = p1 - p0;
+    const auto e2 = p2 - p0;
+    const auto ng = cross( e1 , e2 );
+    const auto ng_len_sq = ng.SquaredLength();
+    if( pdf ) *pdf = 0.0f;
+    if( ng_len_sq == 0.0f )
+        return p;
+
+    Point ps;
+    const auto solid_angle = solidAngle( p , p0 , p1 , p2 );
+    if( solid_angle > MIN_SPHERICAL_SAMPLE_AREA && solid_angle < MAX_SPHERICAL_SAMPLE_AREA ){
+        float pdf_w;
+        wi = UniformSampleSphericalTriangle( normalize( p0 - p ) , normalize( p1 - p ) , normalize( p2 - p ) , ls.u , ls.v , &pdf_w );
+
+        // the sampled point is where the direction hits the plane of the triangle
+        const auto cos_n = dot( wi , ng );
+        if( pdf_w == 0.0f || cos_n == 0.0f )
+            return p;
+        ps = p + wi * ( dot( p0 - p , ng ) / cos_n );
+
+        if( pdf ) *pdf = pdf_w;
+    }else{
+        // uniformly sample a point on the surface of the triangle
+        const auto su = sqrt( ls.u );
+        ps = ( 1.0f - su ) * p0 + ( ls.v * su ) * p1 + ( ( 1.0f - ls.v ) * su ) * p2;
+
+        const auto delta = ps - p;
+        if( delta.SquaredLength() == 0.0f )
+            return p;
+        wi = normalize( delta );
+
+        const auto cos_at_light = absDot( wi , ng ) / sqrt( ng_len_sq );
+        if( pdf && cos_at_light > 0.0f )
+            *pdf = delta.SquaredLength() / ( SurfaceArea() * cos_at_light );
+    }
+
+    // barycentric coordinate of the sampled point to interpolate the shading normal
+    const auto d = ps - p0;
+    const auto u = clamp( dot( cross( d , e2 ) , ng ) / ng_len_sq , 0.0f , 1.0f );
+    const auto v = clamp( dot( cross( e1 , d ) , ng ) / ng_len_sq , 0.0f , 1.0f );
+    const auto w = std::max( 0.0f , 1.0f - u - v );
+    n = ( w * mv0.m_normal + u * mv1.m_normal + v * mv2.m_normal ).Normalize();
+
+    return ps;
+}
+
+void Triangle::Sample_l( const LightSample& ls , Ray& r , Vector& n , float* pdf ) const{
+    const auto& mem = m_meshVisual->m_memory;
+    const auto& mv0 = mem->m_vertices[m_index.m_id[0]];
+    const auto& mv1 = mem->m_vertices[m_index.m_id[1]];
+    const auto& mv2 = mem->m_vertices[m_index.m_id[2]];
+
+    // uniformly sample a point on the surface of the triangle
+    const auto su = sqrt( ls.u );
+    const auto u = ls.v * su;
+    const auto v = ( 1.0f - ls.v ) * su;
+    const auto w = 1.0f - su;
+    n = ( w * mv0.m_normal + u * mv1.m_normal + v * mv2.m_normal ).Normalize();
+
+    Vector t0 , t1;
+    coordinateSystem( n , t0 , t1 );
+    const auto dir = UniformSampleHemisphere( sort_canonical() , sort_canonical() );
+
+    r.m_fMin = 0.0f;
+    r.m_fMax = FLT_MAX;
+    r.m_Ori = w * mv0.m_position + u * mv1.m_position + v * mv2.m_position;
+    r.m_Dir = t0 * dir.x + n * dir.y + t1 * dir.z;
+
+    if( pdf )
+        *pdf = UniformHemispherePdf() / SurfaceArea();
+}
+
+float Triangle::Pdf( const Point& p , const Vector& wi ) const{
+    SurfaceInteraction inter;
+    if( !GetIntersect( Ray( p , wi ) , &inter ) )
+        return 0.0f;
+
+    const auto& mem = m_meshVisual->m_memory;
+    const auto& p0 = mem->m_vertices[m_index.m_id[0]].m_position;
+    const auto& p1 = mem->m_vertices[m_index.m_id[1]].m_position;
+    const auto& p2 = mem->m_vertices[m_index.m_id[2]].m_position;
+
+    const auto solid_angle = solidAngle( p , p0 , p1 , p2 );
+    if( solid_angle > MIN_SPHERICAL_SAMPLE_AREA && solid_angle < MAX_SPHERICAL_SAMPLE_AREA )
+        return 1.0f / solid_angle;
+
+    const auto cos_at_light = absDot( wi , inter.gnormal );
+    if( cos_at_light <= 0.0f )
+        return 0.0f;
+    return ( inter.intersect - p ).SquaredLength() / ( SurfaceArea() * cos_at_light );
+}
+
+Vector Triangle::GetNormal() const{
+    const auto& mem = m_meshVisual->m_memory;
+    const auto& mv0 = mem->m_vertices[m_index.m_id[0]];
+    const auto& mv1 = mem->m_vertices[m_index.m_id[1]];
+    const auto& mv2 = mem->m_vertices[m_index.m_id[2]];
+
+    const auto ng = normalize( cross( mv1.m_position - mv0.m_position , mv2.m_position - mv0.m_position ) );
+    return dot( ng , mv0.m_normal + mv1.m_normal + mv2.m_normal ) < 0.0f ? -ng : ng;
+}
+
 bool Triangle::GetIntersect( const Ray& r , SurfaceInteraction* intersect ) const{
     // get the memory
     // note : reference is not used here because it's not thread-safe
@@ -135,6 +264,66 @@ const BBox& Triangle::GetBBox() const{
     return *m_bbox;
 }
 
+BBox Triangle::ClipBBox( const BBox& box ) const{
+    const auto& mem = m_meshVisual->m_memory;
+
+    // each plane adds at most one vertex to the clipped polygon, there are no more than nine of them.
+    Point polygon[2][9];
+    polygon[0][0] = mem->m_vertices[m_index.m_id[0]].m_position;
+    polygon[0][1] = mem->m_vertices[m_index.m_id[1]].m_position;
+    polygon[0][2] = mem->m_vertices[m_index.m_id[2]].m_position;
+
+    auto cnt = 3u;
+    auto cur = 0;
+    for( auto axis = 0 ; axis < 3 ; ++axis ){
+        for( auto side = 0 ; side < 2 ; ++side ){
+            const auto plane = side ? box.m_Max[axis] : box.m_Min[axis];
+            const auto* in = polygon[cur];
+            auto* out = polygon[1-cur];
+
+            auto out_cnt = 0u;
+            for( auto i = 0u ; i < cnt ; ++i ){
+                const auto& p0 = in[i];
+                const auto& p1 = in[( i + 1 ) % cnt];
+                const auto d0 = side ? plane - p0[axis] : p0[axis] - plane;
+                const auto d1 = side ? plane - p1[axis] : p1[axis] - plane;
+
+                if( d0 >= 0.0f )
+                    out[out_cnt++] = p0;
+                if( ( d0 < 0.0f ) != ( d1 < 0.0f ) ){
+                    auto p = p0 + ( p1 - p0 ) * ( d0 / ( d0 - d1 ) );
+                    // the new vertex is on the plane, this avoids the clipped box to be slightly smaller due to precision issue.
+                    p[axis] = plane;
+                    out[out_cnt++] = p;
+                }
+            }
+
+            cnt = out_cnt;
+            cur = 1 - cur;
+            if( 0 == cnt )
+                return BBox();
+        }
+    }
+
+    BBox ret;
+    for( auto i = 0u ; i < cnt ; ++i )
+        ret.Union( polygon[cur][i] );
+    return Intersection( ret , box );
+}
+
+void Triangle::SerializeGeometry( OStreamBase& stream ) const{
+    const auto& mem = m_meshVisual->m_memory;
+    stream << mem->m_vertices[m_index.m_id[0]].m_position;
+    stream << mem->m_vertices[m_index.m_id[1]].m_position;
+    stream << mem->m_vertices[m_index.m_id[2]].m_position;
+}
+
+void Triangle::SerializeTopology( OStreamBase& stream ) const{
+    const auto content_hash = m_meshVisual->m_memory->GetContentHash();
+    stream << (unsigned)( content_hash >> 32 ) << (unsigned)content_hash;
+    stream << m_index.m_id[0] << m_index.m_id[1] << m_index.m_id[2];
+}
+
 float Triangle::SurfaceArea() const{
     const auto& mem = m_meshVisual->m_memory;
     const auto id0 = m_index.m_id[0];
@@ -25,16 +25,16 @@ struct  MeshFaceIndex;
 
 #ifdef SSE_ENABLED
     struct Triangle4;
-#ifdef SORT_IN_WINDOWS
-    struct simd_data_sse;
-#endif
 #endif
 
 #ifdef AVX_ENABLED
     struct Triangle8;
-#ifdef SORT_IN_WINDOWS
-    struct simd_data_avx;
 #endif
+
+#ifdef SIMD_DISPATCH_ENABLED
+    namespace simd_sse41{ struct Triangle4; }
+    namespace simd_avx2{ struct Triangle8; }
+    namespace simd_avx512{ struct Triangle8; }
 #endif
 
 //! @brief Triangle class defines the basic behavior of triangle.
@@ -51,19 +51,18 @@ public:
 
     //! @brief Sample a point on the surface of the shape given a shading point.
     //!
-    //! Sample a position on the surface of the shape. This function is heavily
-    //! used in area light, where it is necessary to take random sample on the surface to
-    //! support multiple importance sampling.
+    //! The spherical triangle subtended by the triangle is sampled uniformly, details of the algorithm could be found
+    //! in this paper, <a href="https://www.graphics.cornell.edu/pubs/1995/Arv95c.pdf">Stratified Sampling of Spherical Triangles</a>.
+    //! It falls back to uniformly sampling the surface of the triangle if the triangle is either too small or too large from
+    //! the shading point, where solid angle sampling is not numerically robust.
     //!
     //! @param ls       The light sample.
     //! @param p        The position of shading point to be lit.
     //! @param wi       The vector from shading point to sampled point, it is normalized.
+    //! @param n        The shading normal at the sampled point.
     //! @param pdf      The pdf w.r.t solid angle ( not surface area ) of picking the sampled point.
     //! @return         The sampled point on the surface of the shape.
-    Point           Sample_l( const LightSample& ls , const Point& p , Vector& wi , Vector& n, float* pdf ) const override{
-        // to be implemented
-        return Point();
-    }
+    Point           Sample_l( const LightSample& ls , const Point& p , Vector& wi , Vector& n, float* pdf ) const override;
 
     //! @brief Sample a ray from the light source without a given shading point.
     //!
@@ -74,9 +73,16 @@ public:
     //!                 the direction of the ray will point outward depending on the normal.
     //! @param n        The normal at the surface where the ray shoots from.
     //! @param pdf      The pdf w.r.t solid angle of picking the ray.
-    void            Sample_l( const LightSample& ls , Ray& r , Vector& n , float* pdf ) const override{
-        // to be implemented.
-    }
+    void            Sample_l( const LightSample& ls , Ray& r , Vector& n , float* pdf ) const override;
+
+    //! @brief  Get the pdf w.r.t solid angle of picking a point on the surface where the ray intersects.
+    //!
+    //! It matches the pdf of the above sampling method given a shading point.
+    //!
+    //! @param p        Origin of the ray.
+    //! @param wi       Direction of the ray.
+    //! @return         PDF w.r.t the solid angle of picking this sample point on the surface of the shape.
+    float           Pdf( const Point& p , const Vector& wi ) const override;
 
     //! @brief      Get intersected point between the ray and the shape.
     //!
@@ -106,6 +112,29 @@ public:
     //! @return     The bounding box of the shape.
     const BBox&     GetBBox() const override;
 
+    //! @brief      Get bounding box of the part of the triangle inside a bounding box.
+    //!
+    //! The triangle is clipped against the six planes of the bounding box, the bounding box of the clipped polygon
+    //! is returned.
+    //!
+    //! @param box      The bounding box to clip the triangle against.
+    //! @return         Bounding box of the part of the triangle inside the box, it is invalid if there is nothing inside.
+    BBox            ClipBBox( const BBox& box ) const override;
+
+    //! @brief      Stream out the geometry of the triangle.
+    //!
+    //! Positions of the three vertices in world space are streamed out, they are what packed triangles are made of.
+    //!
+    //! @param stream   The stream to write the geometry to.
+    void            SerializeGeometry( OStreamBase& stream ) const override;
+
+    //! @brief      Stream out what identifies the triangle regardless of where it is.
+    //!
+    //! The content hash of the mesh before transformation and vertex indices of the triangle are streamed out.
+    //!
+    //! @param stream   The stream to write the identity to.
+    void            SerializeTopology( OStreamBase& stream ) const override;
+
     //! @brief      Get the surface area of the shape.
     //!
     //! Get the surface area of the shape. This function is heavily used in the case of picking a area light
@@ -114,6 +143,13 @@ public:
     //! @return     Surface area of the shape.
     float           SurfaceArea() const override;
 
+    //! @brief      Get the normal of the plane of the triangle.
+    //!
+    //! The normal is flipped to the same side with the vertex normals, which is also the side emissive triangles emit light to.
+    //!
+    //! @return     Normalized normal of the plane of the triangle.
+    Vector          GetNormal() const;
+
     //! @brief      Get the type of the shape
     //!
     //! @return     The type of the shape.
@@ -127,19 +163,16 @@ private:
 
 #ifdef SSE_ENABLED
     friend struct Triangle4;
-    #ifdef SORT_IN_WINDOWS
-        friend SORT_FORCEINLINE void setupIntersection(const Triangle4& tri4, const Ray& ray, const simd_data_sse& t4, const simd_data_sse& u4, const simd_data_sse& v4, const int id, SurfaceInteraction* intersection);
-    #else
-        friend SORT_FORCEINLINE void setupIntersection(const Triangle4& tri4, const Ray& ray, const __m128& t4, const __m128& u4, const __m128& v4, const int id, SurfaceInteraction* intersection);
-    #endif
 #endif
 
 #ifdef AVX_ENABLED
     friend struct Triangle8;
-    #ifdef SORT_IN_WINDOWS
-        friend SORT_FORCEINLINE void setupIntersection(const Triangle8& tri4, const Ray& ray, const simd_data_avx& t8, const simd_data_avx& u8, const simd_data_avx& v8, const int id, SurfaceInteraction* intersection);
-    #else
-        friend SORT_FORCEINLINE void setupIntersection(const Triangle8& tri8, const Ray& ray, const __m256& t8, const __m256& u8, const __m256& v8, const int id, SurfaceInteraction* intersection);
-    #endif
+#endif
+
+#ifdef SIMD_DISPATCH_ENABLED
+    // Kernels compiled for each instruction set, see simd/simd_dispatch.h.
+    friend struct simd_sse41::Triangle4;
+    friend struct simd_avx2::Triangle8;
+    friend struct simd_avx512::Triangle8;
 #endif
 };
\ No newline at end of file
@@ -19,6 +19,7 @@
 
 #include "core/define.h"
 #include "math/bbox.h"
+#include "accel/bvh_utils.h"
 
 // Reference implementation is disabled by default, it is only for debugging purposes.
 // #define SIMD_BBOX_REFERENCE_IMPLEMENTATION
@@ -107,4 +108,88 @@ SORT_FORCEINLINE int IntersectBBox_SIMD(const Ray& ray, const Simd_Ray_Data& sim
     return ret;
 #endif
 }
+
+//! @brief  Restore the bounding box of a child.
+//!
+//! @param bb       The 4/8 bounding boxes of the children.
+//! @param i        Index of the child.
+//! @return         The bounding box of the child.
+SORT_FORCEINLINE BBox ChildBBox( const Simd_BBox& bb , unsigned i ){
+    BBox bbox;
+    bbox.m_Min[0] = bb.m_min_x[i];
+    bbox.m_Min[1] = bb.m_min_y[i];
+    bbox.m_Min[2] = bb.m_min_z[i];
+    bbox.m_Max[0] = bb.m_max_x[i];
+    bbox.m_Max[1] = bb.m_max_y[i];
+    bbox.m_Max[2] = bb.m_max_z[i];
+    return bbox;
+}
+
+//! @brief  Test a single bounding box against SIMD_CHANNEL rays of a packet at a time.
+//!
+//! @param packet   The packet of rays.
+//! @param offset   Index of the first ray to be tested, it has to be a multiple of SIMD_CHANNEL.
+//! @param bb       The bounding box to be tested.
+//! @param f_min    The entry distance of each ray, it is -1 for rays missing the box.
+//! @return         Mask of the rays hitting the bounding box.
+template<unsigned N>
+SORT_FORCEINLINE int IntersectBBox_SIMD( const Simd_Ray_Packet<N>& packet , unsigned offset , const BBox& bb , simd_data& f_min ) {
+    f_min = simd_set_ps( packet.t_min + offset );
+    simd_data f_max = simd_set_ps( packet.t_max + offset );
+
+    for( auto axis = 0 ; axis < 3 ; ++axis ){
+        const simd_data ori_dir = simd_set_ps( packet.ori_dir[axis] + offset );
+        const simd_data rcp_dir = simd_set_ps( packet.rcp_dir[axis] + offset );
+        const simd_data t1 = simd_mad_ps( rcp_dir , simd_set_ps1( bb.m_Max[axis] ) , ori_dir );
+        const simd_data t2 = simd_mad_ps( rcp_dir , simd_set_ps1( bb.m_Min[axis] ) , ori_dir );
+        f_min = simd_max_ps( f_min , simd_min_ps( t1 , t2 ) );
+        f_max = simd_min_ps( f_max , simd_max_ps( t1 , t2 ) );
+    }
+
+    const simd_data mask = simd_cmple_ps( f_min , f_max );
+    f_min = simd_pick_ps( mask , f_min , simd_neg_ones );
+
+    return simd_movemask_ps( mask );
+}
+
+#ifdef ENABLE_COMPRESSED_BVH
+SORT_FORCEINLINE BBox ChildBBox( const Quantized_BBox<SIMD_CHANNEL>& bb , unsigned i ){
+    return bb[i];
+}
+
+SORT_FORCEINLINE int IntersectBBox_SIMD(const Ray& ray, const Simd_Ray_Data& simd_ray , const Quantized_BBox<SIMD_CHANNEL>& bb, simd_data& f_min ) {
+    f_min = simd_set_ps1( ray.m_fMin );
+    simd_data f_max = simd_set_ps1( ray.m_fMax );
+
+    // Instead of restoring the planes of children, the ray is transformed into the grid of the node once, the quantized
+    // planes are then tested as they are. It takes the same number of instructions as full precision bounding boxes.
+    //   t = ( origin + q * cell - ray_ori ) / ray_dir = q * ( cell / ray_dir ) + ( origin - ray_ori ) / ray_dir
+    simd_data scale = simd_mul_ps( ray_rcp_dir_x(simd_ray) , simd_set_ps1( bb.Cell(0) ) );
+    simd_data offset = simd_mad_ps( ray_rcp_dir_x(simd_ray) , simd_set_ps1( bb.origin[0] ) , ray_ori_dir_x(simd_ray) );
+    simd_data t1    = simd_mad_ps( scale , simd_set_u8_ps( bb.q_max[0] ) , offset );
+    simd_data t2    = simd_mad_ps( scale , simd_set_u8_ps( bb.q_min[0] ) , offset );
+    f_min           = simd_max_ps( f_min , simd_min_ps( t1 , t2 ) );
+    f_max           = simd_min_ps( f_max , simd_max_ps( t1 , t2 ) );
+
+    scale           = simd_mul_ps( ray_rcp_dir_y(simd_ray) , simd_set_ps1( bb.Cell(1) ) );
+    offset          = simd_mad_ps( ray_rcp_dir_y(simd_ray) , simd_set_ps1( bb.origin[1] ) , ray_ori_dir_y(simd_ray) );
+    t1              = simd_mad_ps( scale , simd_set_u8_ps( bb.q_max[1] ) , offset );
+    t2              = simd_mad_ps( scale , simd_set_u8_ps( bb.q_min[1] ) , offset );
+    f_min           = simd_max_ps( f_min , simd_min_ps( t1 , t2 ) );
+    f_max           = simd_min_ps( f_max , simd_max_ps( t1 , t2 ) );
+
+    scale           = simd_mul_ps( ray_rcp_dir_z(simd_ray) , simd_set_ps1( bb.Cell(2) ) );
+    offset          = simd_mad_ps( ray_rcp_dir_z(simd_ray) , simd_set_ps1( bb.origin[2] ) , ray_ori_dir_z(simd_ray) );
+    t1              = simd_mad_ps( scale , simd_set_u8_ps( bb.q_max[2] ) , offset );
+    t2              = simd_mad_ps( scale , simd_set_u8_ps( bb.q_min[2] ) , offset );
+    f_min           = simd_max_ps( f_min , simd_min_ps( t1 , t2 ) );
+    f_max           = simd_min_ps( f_max , simd_max_ps( t1 , t2 ) );
+
+    const simd_data mask = simd_cmple_ps( f_min , f_max );
+    f_min = simd_pick_ps( mask , f_min , simd_neg_ones );
+
+    // empty slots are degenerated boxes at the origin of the grid, they need to be masked out explicitly.
+    return simd_movemask_ps( mask ) & ( ( 1 << bb.child_cnt ) - 1 );
+}
+#endif
 #endif
\ No newline at end of file
@@ -0,0 +1,110 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include "simd_dispatch.h"
+
+#if defined(SORT_IN_WINDOWS)
+    #include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+    #include <cpuid.h>
+#endif
+
+#if defined(SORT_IN_WINDOWS) || defined(__x86_64__) || defined(__i386__)
+
+// Query a leaf of cpuid, registers are returned in the order of eax, ebx, ecx and edx.
+static void cpuid( unsigned leaf , unsigned sub_leaf , unsigned regs[4] ){
+#if defined(SORT_IN_WINDOWS)
+    __cpuidex( (int*)regs , (int)leaf , (int)sub_leaf );
+#else
+    __cpuid_count( leaf , sub_leaf , regs[0] , regs[1] , regs[2] , regs[3] );
+#endif
+}
+
+// Query which registers the OS saves during context switches, it is only valid when OSXSAVE is supported.
+static unsigned long long xgetbv( unsigned index ){
+#if defined(SORT_IN_WINDOWS)
+    return _xgetbv( index );
+#else
+    unsigned eax = 0 , edx = 0;
+    __asm__ __volatile__( "xgetbv" : "=a"(eax) , "=d"(edx) : "c"(index) );
+    return ( (unsigned long long)edx << 32 ) | eax;
+#endif
+}
+
+static SIMD_ISA detectSimdIsa(){
+    unsigned regs[4] = { 0 };
+    cpuid( 0 , 0 , regs );
+    const auto max_leaf = regs[0];
+    if( max_leaf < 1 )
+        return SIMD_ISA_NONE;
+
+    cpuid( 1 , 0 , regs );
+    const auto sse41   = ( regs[2] & ( 1u << 19 ) ) != 0;
+    const auto fma     = ( regs[2] & ( 1u << 12 ) ) != 0;
+    const auto osxsave = ( regs[2] & ( 1u << 27 ) ) != 0;
+    const auto avx     = ( regs[2] & ( 1u << 28 ) ) != 0;
+    if( !sse41 )
+        return SIMD_ISA_NONE;
+
+    // Even if the CPU supports AVX, the OS needs to save the upper half of YMM registers, and ZMM/opmask registers
+    // for AVX-512, during context switches. Otherwise the registers could be corrupted.
+    const auto xcr0 = osxsave ? xgetbv( 0 ) : 0ull;
+    const auto os_avx = ( xcr0 & 0x06 ) == 0x06;
+    const auto os_avx512 = ( xcr0 & 0xe6 ) == 0xe6;
+    if( !avx || !fma || !os_avx || max_leaf < 7 )
+        return SIMD_ISA_SSE41;
+
+    cpuid( 7 , 0 , regs );
+    const auto avx2     = ( regs[1] & ( 1u << 5 ) ) != 0;
+    const auto avx512f  = ( regs[1] & ( 1u << 16 ) ) != 0;
+    const auto avx512dq = ( regs[1] & ( 1u << 17 ) ) != 0;
+    const auto avx512bw = ( regs[1] & ( 1u << 30 ) ) != 0;
+    const auto avx512vl = ( regs[1] & ( 1u << 31 ) ) != 0;
+    if( !avx2 )
+        return SIMD_ISA_SSE41;
+
+    if( !avx512f || !avx512dq || !avx512bw || !avx512vl || !os_avx512 )
+        return SIMD_ISA_AVX2;
+
+    return SIMD_ISA_AVX512;
+}
+
+#else
+
+static SIMD_ISA detectSimdIsa(){
+    return SIMD_ISA_NONE;
+}
+
+#endif
+
+SIMD_ISA GetSupportedSimdIsa(){
+    static const auto isa = detectSimdIsa();
+    return isa;
+}
+
+const char* GetSimdIsaName( SIMD_ISA isa ){
+    switch( isa ){
+        case SIMD_ISA_SSE41:
+            return "SSE4.1";
+        case SIMD_ISA_AVX2:
+            return "AVX2";
+        case SIMD_ISA_AVX512:
+            return "AVX-512";
+        default:
+            return "None";
+    }
+}
@@ -0,0 +1,82 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include "core/define.h"
+
+//! @brief  Instruction sets that SIMD kernels could be compiled for.
+//!
+//! They are sorted so that a later one is always a super set of the previous ones.
+enum SIMD_ISA {
+    SIMD_ISA_NONE = 0,      /**< No SIMD kernel, the scalar version is used. */
+    SIMD_ISA_SSE41,         /**< SSE4.1, for kernels working on 4 lanes. */
+    SIMD_ISA_AVX2,          /**< AVX2 and FMA, for kernels working on 8 lanes. */
+    SIMD_ISA_AVX512,        /**< AVX-512 F/DQ/BW/VL, 8-lane kernels get EVEX encoding and twice as many registers. */
+};
+
+//! @brief  Get the most advanced instruction set supported by both the CPU and the OS.
+//!
+//! The CPU is only queried once, the result is cached after the first call.
+//!
+//! @return     The most advanced instruction set available.
+SIMD_ISA    GetSupportedSimdIsa();
+
+//! @brief  Get the readable name of an instruction set.
+//!
+//! @param  isa     The instruction set.
+//! @return         Name of the instruction set.
+const char* GetSimdIsaName( SIMD_ISA isa );
+
+// When SIMD_DISPATCH_ENABLED is defined, SIMD kernels are not compiled for the instruction set of the whole binary.
+// Instead, every kernel is compiled multiple times in separate translation units, one for each instruction set, and
+// the best one the CPU supports is picked at runtime. This allows one binary to run on all x86 CPUs.
+//
+// Kernels of an instruction set live in their own namespace, otherwise the linker could pick an inlined function
+// compiled for a more advanced instruction set for all translation units. Only functions defined between
+// SIMD_KERNEL_BEGIN and SIMD_KERNEL_END are compiled for the instruction set, everything else in the translation unit,
+// including static initialization that is executed before main, only uses the baseline instruction set. This is
+// why anything outside the kernel should be included before SIMD_KERNEL_BEGIN and why there should be no global
+// variable initialized with SIMD instructions in the kernels.
+//
+// MSVC doesn't need any of this since its intrinsics are always available regardless of the target architecture.
+#ifdef SIMD_DISPATCH_ENABLED
+
+#define SIMD_KERNEL_PRAGMA(...)     _Pragma(#__VA_ARGS__)
+
+#if defined(__clang__)
+    #define SIMD_KERNEL_BEGIN( ns , isa )   SIMD_KERNEL_PRAGMA( clang attribute push( __attribute__((target(isa))) , apply_to = function ) ) \
+                                            namespace ns {
+    #define SIMD_KERNEL_END                 } \
+                                            SIMD_KERNEL_PRAGMA( clang attribute pop )
+#elif defined(__GNUC__)
+    #define SIMD_KERNEL_BEGIN( ns , isa )   SIMD_KERNEL_PRAGMA( GCC push_options ) \
+                                            SIMD_KERNEL_PRAGMA( GCC target( isa ) ) \
+                                            namespace ns {
+    #define SIMD_KERNEL_END                 } \
+                                            SIMD_KERNEL_PRAGMA( GCC pop_options )
+#else
+    #define SIMD_KERNEL_BEGIN( ns , isa )   namespace ns {
+    #define SIMD_KERNEL_END                 }
+#endif
+
+// Target of code generation for each instruction set.
+#define SIMD_KERNEL_TARGET_SSE41        "sse4.1"
+#define SIMD_KERNEL_TARGET_AVX2         "avx2,fma"
+#define SIMD_KERNEL_TARGET_AVX512       "avx512f,avx512dq,avx512bw,avx512vl,avx2,fma"
+
+#endif
@@ -54,81 +54,34 @@ struct alignas(SIMD_ALIGNMENT) Simd_Line{
 
     simd_data  m_mask;                     /**< Mask marks which line is valid. */
 
-    /**< Pointers to original primitive. */
-    const Line*         m_ori_line[SIMD_CHANNEL] = { nullptr };
-    const Primitive*    m_ori_pri[SIMD_CHANNEL] = { nullptr };
+    /**< Indices of original primitives in the primitive buffer of the accelerator. */
+    unsigned   m_pri_id[SIMD_CHANNEL];
 
-#ifdef SIMD_AVX_IMPLEMENTATION
-    char                padding[16];
-#endif
+    //! @brief  Default constructor, there is no line in it.
+    Simd_Line(){
+        Reset();
+    }
 
     //! @brief  Push a line in the data structure.
     //!
-    //! @param  pri     The original primitive.
+    //! @param  id      Index of the original primitive in the primitive buffer of the accelerator.
     //! @return         Whether the data structure is full.
-    bool PushLine( const Primitive* primitive ){
-#ifdef SIMD_SSE_IMPLEMENTATION
-        const Line* line = dynamic_cast<const Line*>(primitive->GetShape());
-        if(IS_PTR_INVALID(m_ori_pri[0])){
-            m_ori_pri[0] = primitive;
-            m_ori_line[0] = line;
-            return false;
-        }else if(IS_PTR_INVALID(m_ori_pri[1])){
-            m_ori_pri[1] = primitive;
-            m_ori_line[1] = line;
-            return false;
-        }else if(IS_PTR_INVALID(m_ori_pri[2])){
-            m_ori_pri[2] = primitive;
-            m_ori_line[2] = line;
-            return false;
-        }
-        m_ori_pri[3] = primitive;
-        m_ori_line[3] = line;
-        return true;
-#endif
-
-#ifdef SIMD_AVX_IMPLEMENTATION
-        const Line* line = dynamic_cast<const Line*>(primitive->GetShape());
-        if(IS_PTR_INVALID(m_ori_pri[0])){
-            m_ori_pri[0] = primitive;
-            m_ori_line[0] = line;
-            return false;
-        }else if(IS_PTR_INVALID(m_ori_pri[1])){
-            m_ori_pri[1] = primitive;
-            m_ori_line[1] = line;
-            return false;
-        }else if(IS_PTR_INVALID(m_ori_pri[2])){
-            m_ori_pri[2] = primitive;
-            m_ori_line[2] = line;
-            return false;
-        }else if(IS_PTR_INVALID(m_ori_pri[3])){
-            m_ori_pri[3] = primitive;
-            m_ori_line[3] = line;
-            return false;
-        }else if(IS_PTR_INVALID(m_ori_pri[4])){
-            m_ori_pri[4] = primitive;
-            m_ori_line[4] = line;
-            return false;
-        }else if(IS_PTR_INVALID(m_ori_pri[5])){
-            m_ori_pri[5] = primitive;
-            m_ori_line[5] = line;
-            return false;
-        }else if(IS_PTR_INVALID(m_ori_pri[6])){
-            m_ori_pri[6] = primitive;
-            m_ori_line[6] = line;
-            return false;
+    bool PushLine( const unsigned id ){
+        for( auto i = 0 ; i < SIMD_CHANNEL ; ++i ){
+            if( INVALID_PRIMITIVE_ID == m_pri_id[i] ){
+                m_pri_id[i] = id;
+                return i == SIMD_CHANNEL - 1;
+            }
         }
-        m_ori_pri[7] = primitive;
-        m_ori_line[7] = line;
         return true;
-#endif
     }
 
     //! @brief  Pack line information into SIMD compatible data.
     //!
-    //! @return     Whether there is valid line inside.
-    bool PackData(){
-        if( !m_ori_pri[0] )
+    //! @param  primitives  The primitive buffer of the accelerator.
+    //! @return             Whether there is valid line inside.
+    bool PackData( const Primitive* const* primitives ){
+        if( INVALID_PRIMITIVE_ID == m_pri_id[0] )
             return false;
 
 		bool	mask[SIMD_CHANNEL] = { false };
@@ -138,12 +91,12 @@ struct alignas(SIMD_ALIGNMENT) Simd_Line{
         float   mat_10[SIMD_CHANNEL] , mat_11[SIMD_CHANNEL] , mat_12[SIMD_CHANNEL] , mat_13[SIMD_CHANNEL];
         float   mat_20[SIMD_CHANNEL] , mat_21[SIMD_CHANNEL] , mat_22[SIMD_CHANNEL] , mat_23[SIMD_CHANNEL];
         for( auto i = 0 ; i < SIMD_CHANNEL ; ++i ){
-			if(IS_PTR_INVALID(m_ori_pri[i])){
+			if(INVALID_PRIMITIVE_ID == m_pri_id[i]){
 				mask[i] = false;
 				continue;
 			}
 
-            const auto line = m_ori_line[i];
+            const auto line = GetLine( primitives , i );
 
             p0_x[i] = line->m_p0.x;
             p0_y[i] = line->m_p0.y;
@@ -204,15 +157,56 @@ struct alignas(SIMD_ALIGNMENT) Simd_Line{
 
     //! @brief  Reset the data for reuse
     void Reset(){
-#ifdef SIMD_SSE_IMPLEMENTATION
-        m_ori_pri[0] = m_ori_pri[1] = m_ori_pri[2] = m_ori_pri[3] = nullptr;
-        m_ori_line[0] = m_ori_line[1] = m_ori_line[2] = m_ori_line[3] = nullptr;
-#endif
+        for( auto i = 0 ; i < SIMD_CHANNEL ; ++i )
+            m_pri_id[i] = INVALID_PRIMITIVE_ID;
+    }
 
-#ifdef SIMD_AVX_IMPLEMENTATION
-        m_ori_pri[0] = m_ori_pri[1] = m_ori_pri[2] = m_ori_pri[3] = m_ori_pri[4] = m_ori_pri[5] = m_ori_pri[6] = m_ori_pri[7] = nullptr;
-        m_ori_line[0] = m_ori_line[1] = m_ori_line[2] = m_ori_line[3] = m_ori_line[4] = m_ori_line[5] = m_ori_line[6] = m_ori_line[7] = nullptr;
-#endif
+    //! @brief  Get the original line.
+    //!
+    //! @param  primitives  The primitive buffer of the accelerator.
+    //! @param  id          Index of the line in the data structure, it has to be a valid one.
+    //! @return             The original line.
+    SORT_FORCEINLINE const Line* GetLine( const Primitive* const* primitives , const int id ) const {
+        return static_cast<const Line*>( primitives[m_pri_id[id]]->GetShape() );
+    }
+
+    //! @brief  A helper function setup the result of intersection.
+    //!
+    //! Being a member function, it has access to the private data of lines.
+    //!
+    //! @param  ray         Ray that we used to tested.
+    //! @param  t_simd      The distances from ray origin to lines.
+    //! @param  inter_x     X coordinate of the intersections in line local space.
+    //! @param  inter_y     Y coordinate of the intersections in line local space.
+    //! @param  inter_z     Z coordinate of the intersections in line local space.
+    //! @param  primitives  The primitive buffer of the accelerator.
+    //! @param  id          Index of the intersection of our interest.
+    //! @param  ret         The pointer to the result to be filled. It can't be nullptr.
+    SORT_FORCEINLINE void SetupIntersection( const Ray& ray , const simd_data& t_simd , const simd_data& inter_x , const simd_data& inter_y , const simd_data& inter_z , const Primitive* const* primitives , const int id , SurfaceInteraction* ret ) const {
+        const auto line = GetLine( primitives , id );
+
+        ret->intersect = ray( t_simd[id] );
+
+        if( inter_y[id] == line->m_length ){
+            // A corner case where the tip of the line is being intersected.
+            ret->gnormal = normalize( line->m_world2Line.GetInversed().TransformVector( Vector( 0.0f , 1.0f , 0.0f ) ) );
+            ret->normal = ret->gnormal;
+            ret->tangent = normalize( line->m_world2Line.GetInversed().TransformVector( Vector( 1.0f , 0.0f , 0.0f ) ) );
+        }else{
+            // This may not be physically correct, but it should be fine for a pixel width line.
+            ret->gnormal = normalize(line->m_world2Line.GetInversed().TransformVector( Vector( inter_x[id], 0.0f , inter_z[id] ) ) );
+            ret->normal = ret->gnormal;
+            ret->tangent = normalize( line->m_gp1 - line->m_gp0 );
+
+            ret->view = -ray.m_Dir;
+        }
+
+        ret->u = 1.0f;
+        ret->v = slerp( line->m_v0 , line->m_v1 , inter_y[id] / line->m_length );
+        ret->t = t_simd[id];
+
+        ret->primitive = primitives[m_pri_id[id]];
+        ret->instance = nullptr;
     }
 };
 
@@ -291,9 +285,10 @@ SORT_FORCEINLINE bool intersectLine_Inner( const Ray& ray , const Simd_Ray_Data&
 //! @param  ray         Ray to be tested against.
 //! @param  ray_simd    Resolved simd ray data.
 //! @param  line_simd   Data structure holds four lines.
+//! @param  primitives  The primitive buffer of the accelerator.
 //! @param  ret         The result of intersection.
 //! @return             Whether there is any intersection that is valid.
-SORT_FORCEINLINE bool intersectLine_SIMD( const Ray& ray , const Simd_Ray_Data& ray_simd, const Simd_Line& line_simd , SurfaceInteraction* ret ){
+SORT_FORCEINLINE bool intersectLine_SIMD( const Ray& ray , const Simd_Ray_Data& ray_simd, const Simd_Line& line_simd , const Primitive* const* primitives , SurfaceInteraction* ret ){
 #ifndef SIMD_LINE_REFERENCE_IMPLEMENTATION
     sAssert(IS_PTR_VALID(ret), SPATIAL_ACCELERATOR );
 
@@ -313,35 +308,13 @@ SORT_FORCEINLINE bool intersectLine_SIMD( const Ray& ray , const Simd_Ray_Data&
     // get the index of the closest one
     const auto resolved_mask = simd_movemask_ps( simd_cmpeq_ps( t_simd , t_min ) );
     const auto res_i = __bsf(resolved_mask);
-    const auto line = line_simd.m_ori_line[res_i];
-
-    ret->intersect = ray( t_simd[res_i] );
-
-    if( inter_y[res_i] == line->m_length ){
-        // A corner case where the tip of the line is being intersected.
-        ret->gnormal = normalize( line->m_world2Line.GetInversed().TransformVector( Vector( 0.0f , 1.0f , 0.0f ) ) );
-        ret->normal = ret->gnormal;
-        ret->tangent = normalize( line->m_world2Line.GetInversed().TransformVector( Vector( 1.0f , 0.0f , 0.0f ) ) );
-    }else{
-        // This may not be physically correct, but it should be fine for a pixel width line.
-        ret->gnormal = normalize(line->m_world2Line.GetInversed().TransformVector( Vector( inter_x[res_i], 0.0f , inter_z[res_i] ) ) );
-        ret->normal = ret->gnormal;
-        ret->tangent = normalize( line->m_gp1 - line->m_gp0 );
-
-        ret->view = -ray.m_Dir;
-    }
-
-    ret->u = 1.0f;
-    ret->v = slerp( line->m_v0 , line->m_v1 , inter_y[res_i] / line->m_length );
-    ret->t = t_simd[res_i];
-
-    ret->primitive = line_simd.m_ori_pri[res_i];
+    line_simd.SetupIntersection( ray , t_simd , inter_x , inter_y , inter_z , primitives , res_i , ret );
 
     return true;
 #else
     bool ret_val = false;
-    for( auto i = 0u ; i < SIMD_CHANNEL && IS_PTR_VALID(line_simd.m_ori_pri[i]) ; ++i )
-        ret_val |= line_simd.m_ori_pri[i]->GetIntersect( ray , ret );
+    for( auto i = 0u ; i < SIMD_CHANNEL && INVALID_PRIMITIVE_ID != line_simd.m_pri_id[i] ; ++i )
+        ret_val |= primitives[line_simd.m_pri_id[i]]->GetIntersect( ray , ret );
     return ret_val;
 #endif
 }
@@ -351,15 +324,16 @@ SORT_FORCEINLINE bool intersectLine_SIMD( const Ray& ray , const Simd_Ray_Data&
 //! @param  ray         Ray to be tested against.
 //! @param  ray_simd    Resolved simd ray data.
 //! @param  line_simd   Data structure holds four lines.
+//! @param  primitives  The primitive buffer of the accelerator.
 //! @return             Whether there is any intersection that is valid.
-SORT_FORCEINLINE bool intersectLineFast_SIMD( const Ray& ray , const Simd_Ray_Data& ray_simd, const Simd_Line& line_simd ){
+SORT_FORCEINLINE bool intersectLineFast_SIMD( const Ray& ray , const Simd_Ray_Data& ray_simd, const Simd_Line& line_simd , const Primitive* const* primitives ){
 #ifndef SIMD_LINE_REFERENCE_IMPLEMENTATION
     simd_data dummy_mask , dummy_t , dummy_inter_x , dummy_inter_y , dummy_inter_z;
     return intersectLine_Inner( ray , ray_simd , line_simd , dummy_mask , dummy_t , dummy_inter_x , dummy_inter_y , dummy_inter_z );
 #else
     bool ret = false;
-    for( auto i = 0u ; i < SIMD_CHANNEL && IS_PTR_VALID(line_simd.m_ori_pri[i]) && !ret ; ++i )
-        ret |= line_simd.m_ori_pri[i]->GetIntersect( ray , nullptr );
+    for( auto i = 0u ; i < SIMD_CHANNEL && INVALID_PRIMITIVE_ID != line_simd.m_pri_id[i] && !ret ; ++i )
+        ret |= primitives[line_simd.m_pri_id[i]]->GetIntersect( ray , nullptr );
     return ret;
 #endif
 }
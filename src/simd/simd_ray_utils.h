@@ -30,9 +30,11 @@
 
 #ifdef SIMD_SSE_IMPLEMENTATION
     #define Simd_Ray_Data   Ray4_Data
+    #define Simd_Ray_Packet Ray4_Packet
 #endif
 #ifdef SIMD_AVX_IMPLEMENTATION
     #define Simd_Ray_Data   Ray8_Data
+    #define Simd_Ray_Packet Ray8_Packet
 #endif
 
 SORT_STATIC_FORCEINLINE float sign( const float x ){
@@ -127,6 +129,37 @@ SORT_STATIC_FORCEINLINE simd_data   ray_scale_y( const Simd_Ray_Data& ray ){
 SORT_STATIC_FORCEINLINE simd_data   ray_scale_z( const Simd_Ray_Data& ray ){
     return ray.scale_z;
 }
+
+//! @brief  A packet of rays saved in structure of arrays.
+//!
+//! Unlike Simd_Ray_Data, which duplicates a single ray in all channels, each channel here holds a different ray. This
+//! allows a bounding box to be tested against SIMD_CHANNEL rays at a time during packet traversal.
+template<unsigned N>
+struct alignas(SIMD_ALIGNMENT) Simd_Ray_Packet{
+    static_assert( N % SIMD_CHANNEL == 0 , "Size of a ray packet has to be a multiple of SIMD channels." );
+
+    float   ori_dir[3][N];  /**< -Ori/Dir of each ray, this is used in ray AABB intersection. */
+    float   rcp_dir[3][N];  /**< 1.0/Dir of each ray, this is used in ray AABB intersection. */
+    float   t_min[N];       /**< Minimum distance along each ray. */
+    float   t_max[N];       /**< Maximum distance along each ray, it shrinks as closer intersections are found. */
+
+    //! @brief Fill a channel with the data of a ray.
+    //!
+    //! @param i            Index of the ray in the packet.
+    //! @param ray          The ray to be filled.
+    //! @param simd_ray     The resolved data of the ray.
+    //! @param t            The maximum distance of interest along the ray.
+    SORT_FORCEINLINE void Set( unsigned i , const Ray& ray , const Simd_Ray_Data& simd_ray , float t ){
+        ori_dir[0][i] = simd_ray.ori_dir_x[0];
+        ori_dir[1][i] = simd_ray.ori_dir_y[0];
+        ori_dir[2][i] = simd_ray.ori_dir_z[0];
+        rcp_dir[0][i] = simd_ray.rcp_dir_x[0];
+        rcp_dir[1][i] = simd_ray.rcp_dir_y[0];
+        rcp_dir[2][i] = simd_ray.rcp_dir_z[0];
+        t_min[i] = ray.m_fMin;
+        t_max[i] = std::min( ray.m_fMax , t );
+    }
+};
 #endif
 
 #endif
\ No newline at end of file
@@ -50,7 +50,8 @@
  * ray triangle intersection by using AVX/SSE. Meaning there is no need to provide sophisticated interface of the class.
  * And since it is quite performance sensitive code, everything is inlined and there is no polymorphisms to keep it
  * as simple as possible. However, since there will be extra data kept in the system, it will also insignificantly 
- * incur more cost in term of memory usage.
+ * incur more cost in term of memory usage. To keep it low, original primitives are referred by 32 bits indices in the
+ * primitive buffer of the accelerator instead of pointers, they are only needed once an intersection is found.
  */
 struct alignas(SIMD_ALIGNMENT) Simd_Triangle{
     simd_data  m_p0_x , m_p0_y , m_p0_z ;  /**< Position of point 0 of the triangle. */
@@ -58,92 +59,45 @@ struct alignas(SIMD_ALIGNMENT) Simd_Triangle{
     simd_data  m_p2_x , m_p2_y , m_p2_z ;  /**< Position of point 2 of the triangle. */
     simd_data  m_mask;
 
-    /**< Pointers to original primitives. */
-    const Triangle*  m_ori_tri[SIMD_CHANNEL] = { nullptr };
-    const Primitive* m_ori_pri[SIMD_CHANNEL] = { nullptr };
+    /**< Indices of original primitives in the primitive buffer of the accelerator. */
+    unsigned   m_pri_id[SIMD_CHANNEL];
 
-#ifdef SIMD_AVX_IMPLEMENTATION
-    char padding[16];
-#endif
+    //! @brief  Default constructor, there is no triangle in it.
+    Simd_Triangle(){
+        Reset();
+    }
 
     //! @brief  Push a triangle in the data structure.
     //!
-    //! @param  pri     The original primitive.
+    //! @param  id      Index of the original primitive in the primitive buffer of the accelerator.
     //! @return         Whether the data structure is full.
-    bool PushTriangle( const Primitive* primitive ){
-#ifdef SIMD_SSE_IMPLEMENTATION
-        const Triangle* triangle = dynamic_cast<const Triangle*>(primitive->GetShape());
-        if(IS_PTR_INVALID(m_ori_pri[0])){
-            m_ori_pri[0] = primitive;
-            m_ori_tri[0] = triangle;
-            return false;
-        }else if(IS_PTR_INVALID(m_ori_pri[1])){
-            m_ori_pri[1] = primitive;
-            m_ori_tri[1] = triangle;
-            return false;
-        }else if(IS_PTR_INVALID(m_ori_pri[2])){
-            m_ori_pri[2] = primitive;
-            m_ori_tri[2] = triangle;
-            return false;
-        }
-        m_ori_pri[3] = primitive;
-        m_ori_tri[3] = triangle;
-        return true;
-#endif
-
-#ifdef SIMD_AVX_IMPLEMENTATION
-        const Triangle* triangle = dynamic_cast<const Triangle*>(primitive->GetShape());
-        if(IS_PTR_INVALID(m_ori_pri[0])){
-            m_ori_pri[0] = primitive;
-            m_ori_tri[0] = triangle;
-            return false;
-        }else if(IS_PTR_INVALID(m_ori_pri[1])){
-            m_ori_pri[1] = primitive;
-            m_ori_tri[1] = triangle;
-            return false;
-        }else if(IS_PTR_INVALID(m_ori_pri[2])){
-            m_ori_pri[2] = primitive;
-            m_ori_tri[2] = triangle;
-            return false;
-        }else if(IS_PTR_INVALID(m_ori_pri[3])){
-            m_ori_pri[3] = primitive;
-            m_ori_tri[3] = triangle;
-            return false;
-        }else if(IS_PTR_INVALID(m_ori_pri[4])){
-            m_ori_pri[4] = primitive;
-            m_ori_tri[4] = triangle;
-            return false;
-        }else if(IS_PTR_INVALID(m_ori_pri[5])){
-            m_ori_pri[5] = primitive;
-            m_ori_tri[5] = triangle;
-            return false;
-        }else if(IS_PTR_INVALID(m_ori_pri[6])){
-            m_ori_pri[6] = primitive;
-            m_ori_tri[6] = triangle;
-            return false;
+    bool PushTriangle( const unsigned id ){
+        for( auto i = 0 ; i < SIMD_CHANNEL ; ++i ){
+            if( INVALID_PRIMITIVE_ID == m_pri_id[i] ){
+                m_pri_id[i] = id;
+                return i == SIMD_CHANNEL - 1;
+            }
         }
-        m_ori_pri[7] = primitive;
-        m_ori_tri[7] = triangle;
         return true;
-#endif
     }
 
     //! @brief  Pack triangle information into SSE/AVX compatible data.
     //!
-    //! @return     Whether there is valid triangle inside.
-    bool PackData(){
-        if( !m_ori_pri[0] )
+    //! @param  primitives  The primitive buffer of the accelerator.
+    //! @return             Whether there is valid triangle inside.
+    bool PackData( const Primitive* const* primitives ){
+        if( INVALID_PRIMITIVE_ID == m_pri_id[0] )
             return false;
 
         bool	mask[SIMD_CHANNEL] = { false };
         float   p0_x[SIMD_CHANNEL] , p0_y[SIMD_CHANNEL] , p0_z[SIMD_CHANNEL] , p1_x[SIMD_CHANNEL] , p1_y[SIMD_CHANNEL] , p1_z[SIMD_CHANNEL] , p2_x[SIMD_CHANNEL] , p2_y[SIMD_CHANNEL] , p2_z[SIMD_CHANNEL];
         for( auto i = 0 ; i < SIMD_CHANNEL ; ++i ){
-			if (IS_PTR_INVALID(m_ori_pri[i])) {
+			if (INVALID_PRIMITIVE_ID == m_pri_id[i]) {
 				mask[i] = false;
 				continue;
 			}
 
-            const auto triangle = m_ori_tri[i];
+            const auto triangle = GetTriangle( primitives , i );
 
             const auto& mem = triangle->m_meshVisual->m_memory;
             const auto id0 = triangle->m_index.m_id[0];
@@ -185,15 +139,61 @@ struct alignas(SIMD_ALIGNMENT) Simd_Triangle{
 
     //! @brief  Reset the data for reuse
     void Reset(){
-#ifdef SIMD_SSE_IMPLEMENTATION
-        m_ori_pri[0] = m_ori_pri[1] = m_ori_pri[2] = m_ori_pri[3] = nullptr;
-        m_ori_tri[0] = m_ori_tri[1] = m_ori_tri[2] = m_ori_tri[3] = nullptr;
-#endif
+        for( auto i = 0 ; i < SIMD_CHANNEL ; ++i )
+            m_pri_id[i] = INVALID_PRIMITIVE_ID;
+    }
 
-#ifdef SIMD_AVX_IMPLEMENTATION
-        m_ori_pri[0] = m_ori_pri[1] = m_ori_pri[2] = m_ori_pri[3] = m_ori_pri[4] = m_ori_pri[5] = m_ori_pri[6] = m_ori_pri[7] = nullptr;
-        m_ori_tri[0] = m_ori_tri[1] = m_ori_tri[2] = m_ori_tri[3] = m_ori_tri[4] = m_ori_tri[5] = m_ori_tri[6] = m_ori_tri[7] = nullptr;
-#endif
+    //! @brief  Get the original triangle.
+    //!
+    //! @param  primitives  The primitive buffer of the accelerator.
+    //! @param  id          Index of the triangle in the data structure, it has to be a valid one.
+    //! @return             The original triangle.
+    SORT_FORCEINLINE const Triangle* GetTriangle( const Primitive* const* primitives , const int id ) const {
+        return static_cast<const Triangle*>( primitives[m_pri_id[id]]->GetShape() );
+    }
+
+    //! @brief  A helper function setup the result of intersection.
+    //!
+    //! Being a member function, it has access to the vertex buffer of triangles, which is private to Triangle.
+    //!
+    //! @param  ray           Ray that we used to tested.
+    //! @param  t_simd        Output, the distances from ray origin to triangles. It will be FLT_MAX if there is no intersection.
+    //! @param  u_simd        Blending factor.
+    //! @param  v_simd        Blending factor.
+    //! @param  primitives    The primitive buffer of the accelerator.
+    //! @param  id            Index of the intersection of our interest.
+    //! @param  intersection  The pointer to the result to be filled. It can't be nullptr.
+    SORT_FORCEINLINE void SetupIntersection( const Ray& ray, const simd_data& t_simd, const simd_data& u_simd, const simd_data& v_simd, const Primitive* const* primitives, const int id, SurfaceInteraction* intersection ) const {
+        const auto* triangle = GetTriangle( primitives , id );
+
+        const auto u = u_simd[id];
+        const auto v = v_simd[id];
+        const auto w = 1 - u - v;
+
+        const auto& mem = triangle->m_meshVisual->m_memory;
+        const auto id0 = triangle->m_index.m_id[0];
+        const auto id1 = triangle->m_index.m_id[1];
+        const auto id2 = triangle->m_index.m_id[2];
+
+        const auto& mv0 = mem->m_vertices[id0];
+        const auto& mv1 = mem->m_vertices[id1];
+        const auto& mv2 = mem->m_vertices[id2];
+
+        const auto res_t = t_simd[id];
+        intersection->intersect = ray(res_t);
+        intersection->t = res_t;
+
+        intersection->gnormal = normalize(cross((mv2.m_position - mv0.m_position), (mv1.m_position - mv0.m_position)));
+        intersection->normal = (w * mv0.m_normal + u * mv1.m_normal + v * mv2.m_normal).Normalize();
+        intersection->tangent = (w * mv0.m_tangent + u * mv1.m_tangent + v * mv2.m_tangent).Normalize();
+        intersection->view = -ray.m_Dir;
+
+        const auto uv = w * mv0.m_texCoord + u * mv1.m_texCoord + v * mv2.m_texCoord;
+        intersection->u = uv.x;
+        intersection->v = uv.y;
+
+        intersection->primitive = primitives[m_pri_id[id]];
+        intersection->instance = nullptr;
     }
 };
 
@@ -298,55 +298,15 @@ SORT_FORCEINLINE bool intersectTriangleInner_SIMD(const Ray& ray, const Simd_Ray
     return true;
 }
 
-//! @brief  A helper function setup the result of intersection.
-//!
-//! @param  tri_simd      The triangle data structure that has 4/8 triangles.
-//! @param  ray           Ray that we used to tested.
-//! @param  t_simd        Output, the distances from ray origin to triangles. It will be FLT_MAX if there is no intersection.
-//! @param  u_simd        Blending factor.
-//! @param  v_simd        Blending factor.
-//! @param  id            Index of the intersection of our interest.
-//! @param  intersection  The pointer to the result to be filled. It can't be nullptr.
-SORT_FORCEINLINE void setupIntersection(const Simd_Triangle& tri_simd, const Ray& ray, const simd_data& t_simd, const simd_data& u_simd, const simd_data& v_simd, const int id, SurfaceInteraction* intersection) {
-    const auto* triangle = tri_simd.m_ori_tri[id];
-
-    const auto u = u_simd[id];
-    const auto v = v_simd[id];
-    const auto w = 1 - u - v;
-
-    const auto& mem = triangle->m_meshVisual->m_memory;
-    const auto id0 = triangle->m_index.m_id[0];
-    const auto id1 = triangle->m_index.m_id[1];
-    const auto id2 = triangle->m_index.m_id[2];
-
-    const auto& mv0 = mem->m_vertices[id0];
-    const auto& mv1 = mem->m_vertices[id1];
-    const auto& mv2 = mem->m_vertices[id2];
-
-    const auto res_t = t_simd[id];
-    intersection->intersect = ray(res_t);
-    intersection->t = res_t;
-
-    intersection->gnormal = normalize(cross((mv2.m_position - mv0.m_position), (mv1.m_position - mv0.m_position)));
-    intersection->normal = (w * mv0.m_normal + u * mv1.m_normal + v * mv2.m_normal).Normalize();
-    intersection->tangent = (w * mv0.m_tangent + u * mv1.m_tangent + v * mv2.m_tangent).Normalize();
-    intersection->view = -ray.m_Dir;
-
-    const auto uv = w * mv0.m_texCoord + u * mv1.m_texCoord + v * mv2.m_texCoord;
-    intersection->u = uv.x;
-    intersection->v = uv.y;
-
-    intersection->primitive = tri_simd.m_ori_pri[id];
-}
-
 //! @brief  With the power of SSE/AVX, this utility function helps intersect a ray with four/eight triangles at the cost of one.
 //!
 //! @param  ray         Ray to be tested against.
 //! @param  simd_ray    Resolved simd ray data.
 //! @param  tri_simd    Data structure holds four/eight triangles.
+//! @param  primitives  The primitive buffer of the accelerator.
 //! @param  ret         The result of intersection. It can't be nullptr.
 //! @return             Whether there is any intersection that is valid.
-SORT_FORCEINLINE bool intersectTriangle_SIMD( const Ray& ray , const Simd_Ray_Data& ray_simd , const Simd_Triangle& tri_simd , SurfaceInteraction* ret ){
+SORT_FORCEINLINE bool intersectTriangle_SIMD( const Ray& ray , const Simd_Ray_Data& ray_simd , const Simd_Triangle& tri_simd , const Primitive* const* primitives , SurfaceInteraction* ret ){
 #ifndef SIMD_TRI_REFERENCE_IMPLEMENTATION
     sAssert(IS_PTR_VALID(ret), SPATIAL_ACCELERATOR );
 
@@ -370,13 +330,13 @@ SORT_FORCEINLINE bool intersectTriangle_SIMD( const Ray& ray , const Simd_Ray_Da
     sAssert( resolved_mask > 0 && resolved_mask < pow(2,SIMD_CHANNEL) , SPATIAL_ACCELERATOR );
     sAssert( res_i >= 0 && res_i < SIMD_CHANNEL , SPATIAL_ACCELERATOR );
     
-    setupIntersection(tri_simd, ray, t_simd, u_simd, v_simd, res_i, ret);
+    tri_simd.SetupIntersection(ray, t_simd, u_simd, v_simd, primitives, res_i, ret);
 
     return true;
 #else
     bool ret_val = false;
-    for( auto i = 0u ; i < SIMD_CHANNEL && IS_PTR_VALID(tri_simd.m_ori_pri[i]) ; ++i )
-        ret_val |= tri_simd.m_ori_pri[i]->GetIntersect( ray , ret );
+    for( auto i = 0u ; i < SIMD_CHANNEL && INVALID_PRIMITIVE_ID != tri_simd.m_pri_id[i] ; ++i )
+        ret_val |= primitives[tri_simd.m_pri_id[i]]->GetIntersect( ray , ret );
     return ret_val;
 #endif
 }
@@ -388,16 +348,17 @@ SORT_FORCEINLINE bool intersectTriangle_SIMD( const Ray& ray , const Simd_Ray_Da
 //! @param  ray         Ray to be tested against.
 //! @param  simd_ray    Resolved simd ray data.
 //! @param  tri_simd    Data structure holds four/eight triangles.
+//! @param  primitives  The primitive buffer of the accelerator.
 //! @return             Whether there is any intersection that is valid.
-SORT_FORCEINLINE bool intersectTriangleFast_SIMD(const Ray& ray, const Simd_Ray_Data& ray_simd , const Simd_Triangle& tri_simd) {
+SORT_FORCEINLINE bool intersectTriangleFast_SIMD(const Ray& ray, const Simd_Ray_Data& ray_simd , const Simd_Triangle& tri_simd , const Primitive* const* primitives) {
 #ifndef SIMD_TRI_REFERENCE_IMPLEMENTATION
     // please optimize these value, compiler.
     simd_data   dummy_u, dummy_v, dummy_t, mask;
     return intersectTriangleInner_SIMD<true>(ray, ray_simd, tri_simd, dummy_t, dummy_u, dummy_v, mask);
 #else
     bool ret = false;
-    for( auto i = 0u ; i < SIMD_CHANNEL && IS_PTR_VALID(tri_simd.m_ori_pri[i]) && !ret ; ++i )
-        ret |= tri_simd.m_ori_pri[i]->GetIntersect( ray , nullptr );
+    for( auto i = 0u ; i < SIMD_CHANNEL && INVALID_PRIMITIVE_ID != tri_simd.m_pri_id[i] && !ret ; ++i )
+        ret |= primitives[tri_simd.m_pri_id[i]]->GetIntersect( ray , nullptr );
     return ret;
 #endif
 }
@@ -407,8 +368,9 @@ SORT_FORCEINLINE bool intersectTriangleFast_SIMD(const Ray& ray, const Simd_Ray_
 //!
 //! @param  ray         Ray to be tested against.
 //! @param  tri_simd    Data structure holds four/eight triangles.
+//! @param  primitives  The primitive buffer of the accelerator.
 //! @param  ret         The result of intersection.
-SORT_FORCEINLINE void intersectTriangleMulti_SIMD(const Ray& ray, const Simd_Ray_Data& ray_simd, const Simd_Triangle& tri_simd, const StringID matID , BSSRDFIntersections& intersections) {
+SORT_FORCEINLINE void intersectTriangleMulti_SIMD(const Ray& ray, const Simd_Ray_Data& ray_simd, const Simd_Triangle& tri_simd, const Primitive* const* primitives, const StringID matID , BSSRDFIntersections& intersections) {
 #ifndef SIMD_TRI_REFERENCE_IMPLEMENTATION
     simd_data   u_simd, v_simd, t_simd, mask;
     const auto intersected = intersectTriangleInner_SIMD<false>(ray, ray_simd, tri_simd, t_simd, u_simd, v_simd, mask);
@@ -428,13 +390,17 @@ SORT_FORCEINLINE void intersectTriangleMulti_SIMD(const Ray& ray, const Simd_Ray
         const auto res_i = __bsf(resolved_mask);
         resolved_mask = resolved_mask & (resolved_mask - 1);
 
-        const auto primitive = tri_simd.m_ori_pri[res_i];
+        const auto primitive = primitives[tri_simd.m_pri_id[res_i]];
         if (matID != primitive->GetMaterial()->GetUniqueID())
             continue;
 
+        // spatial splits could put the triangle in other leaf nodes too, it should only be counted once.
+        if (intersections.HasPrimitive(primitive))
+            continue;
+
         if (intersections.cnt < TOTAL_SSS_INTERSECTION_CNT) {
             intersections.intersections[intersections.cnt] = SORT_MALLOC(BSSRDFIntersection)();
-            setupIntersection(tri_simd, ray, t_simd, u_simd, v_simd, res_i, &intersections.intersections[intersections.cnt++]->intersection);
+            tri_simd.SetupIntersection(ray, t_simd, u_simd, v_simd, primitives, res_i, &intersections.intersections[intersections.cnt++]->intersection);
         } else {
             auto picked_i = -1;
             auto t = 0.0f;
@@ -445,18 +411,22 @@ SORT_FORCEINLINE void intersectTriangleMulti_SIMD(const Ray& ray, const Simd_Ray
                 }
             }
             if( picked_i >= 0 )
-                setupIntersection(tri_simd, ray, t_simd, u_simd, v_simd, res_i, &intersections.intersections[picked_i]->intersection);
+                tri_simd.SetupIntersection(ray, t_simd, u_simd, v_simd, primitives, res_i, &intersections.intersections[picked_i]->intersection);
 
             intersections.ResolveMaxDepth();
         }
     }
 #else
     SurfaceInteraction intersection;
-    for( auto i = 0u ; i < SIMD_CHANNEL && IS_PTR_VALID(tri_simd.m_ori_pri[i]) ; ++i ){
-        const auto* primitive = tri_simd.m_ori_pri[i];
+    for( auto i = 0u ; i < SIMD_CHANNEL && INVALID_PRIMITIVE_ID != tri_simd.m_pri_id[i] ; ++i ){
+        const auto* primitive = primitives[tri_simd.m_pri_id[i]];
         if (matID != primitive->GetMaterial()->GetUniqueID())
             continue;
 
+        // spatial splits could put the triangle in other leaf nodes too, it should only be counted once.
+        if (intersections.HasPrimitive(primitive))
+            continue;
+
         intersection.Reset();
         const auto intersected = primitive->GetIntersect(ray, &intersection);
         if (intersected) {
@@ -22,6 +22,7 @@
 //  - Nan != Nan     ( SIMD, 0xffffffff )     ( Non-SIMD, false )
 
 #include <float.h>
+#include <string.h>
 #include "core/define.h"
 
 #if defined(SIMD_SSE_IMPLEMENTATION) && defined(SIMD_AVX_IMPLEMENTATION)
@@ -34,6 +35,12 @@ const static float mask_true = *((float*)&( mask_true_i ));
 #ifdef SSE_ENABLED
 #include <nmmintrin.h>
 
+// SSE4.1 instructions are only used when the code is compiled for them. With SIMD dispatch, the rest of the binary
+// only assumes SSE2, which every x86-64 CPU supports, while the kernels are always compiled for SSE4.1 or above.
+#if defined(__SSE4_1__) || defined(SIMD_KERNEL_TARGET) || ( defined(_MSC_VER) && !defined(SIMD_DISPATCH_ENABLED) )
+#define SSE41_ENABLED
+#endif
+
 #ifndef SORT_IN_WINDOWS
 #define simd_data_sse   __m128
 #else
@@ -71,10 +78,12 @@ static_assert( sizeof( simd_data_sse ) == sizeof( __m128 ) , "Incorrect SSE data
 
 #ifdef  SIMD_SSE_IMPLEMENTATION
 
-static const __m128 sse_zeros       = _mm_set_ps1( 0.0f );
-static const __m128 sse_infinites   = _mm_set_ps1( FLT_MAX );
-static const __m128 sse_neg_ones    = _mm_set_ps1( -1.0f );
-static const __m128 sse_ones        = _mm_set_ps1(1.0f);
+// Constants are not initialized with intrinsics so that no SIMD instruction is executed during static initialization,
+// which could happen before the CPU is checked, see simd/simd_dispatch.h.
+static const __m128 sse_zeros       = { 0.0f , 0.0f , 0.0f , 0.0f };
+static const __m128 sse_infinites   = { FLT_MAX , FLT_MAX , FLT_MAX , FLT_MAX };
+static const __m128 sse_neg_ones    = { -1.0f , -1.0f , -1.0f , -1.0f };
+static const __m128 sse_ones        = { 1.0f , 1.0f , 1.0f , 1.0f };
 
 #define simd_data       simd_data_sse
 #define simd_ones       sse_ones
@@ -104,6 +113,16 @@ SORT_STATIC_FORCEINLINE simd_data   simd_set_mask(const bool mask[]) {
     return _mm_set_ps(MASK_TO_INT(mask[3]), MASK_TO_INT(mask[2]), MASK_TO_INT(mask[1]), MASK_TO_INT(mask[0]));
 #undef MASK_TO_INT
 }
+SORT_STATIC_FORCEINLINE simd_data   simd_set_u8_ps( const unsigned char d[] ){
+    int bytes;
+    memcpy( &bytes , d , sizeof( bytes ) );
+#ifdef SSE41_ENABLED
+    return _mm_cvtepi32_ps( _mm_cvtepu8_epi32( _mm_cvtsi32_si128( bytes ) ) );
+#else
+    const __m128i zero = _mm_setzero_si128();
+    return _mm_cvtepi32_ps( _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( bytes ) , zero ) , zero ) );
+#endif
+}
 SORT_STATIC_FORCEINLINE simd_data   simd_add_ps( const simd_data& s0 , const simd_data& s1 ){
     return _mm_add_ps( get_sse_data(s0) , get_sse_data(s1) );
 }
@@ -129,7 +148,12 @@ SORT_STATIC_FORCEINLINE simd_data   simd_mad_ps( const simd_data& a , const simd
     return _mm_add_ps( _mm_mul_ps( get_sse_data(a) , get_sse_data(b) ) , get_sse_data(c) );
 }
 SORT_STATIC_FORCEINLINE simd_data   simd_pick_ps( const simd_data& mask , const simd_data& a , const simd_data& b ){
+#ifdef SSE41_ENABLED
     return _mm_blendv_ps( get_sse_data(b) , get_sse_data(a) , get_sse_data(mask) );
+#else
+    // masks are always all bits set or cleared in each channel.
+    return _mm_or_ps( _mm_and_ps( get_sse_data(mask) , get_sse_data(a) ) , _mm_andnot_ps( get_sse_data(mask) , get_sse_data(b) ) );
+#endif
 }
 SORT_STATIC_FORCEINLINE simd_data   simd_cmpeq_ps( const simd_data& s0 , const simd_data& s1 ){
     return _mm_cmpeq_ps( get_sse_data(s0) , get_sse_data(s1) );
@@ -210,10 +234,11 @@ static_assert(sizeof(simd_data_avx) == sizeof(__m256), "Incorrect AVX data size.
 
 #ifdef SIMD_AVX_IMPLEMENTATION
 
-static const __m256 avx_zeros       = _mm256_set_ps(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-static const __m256 avx_infinites   = _mm256_set_ps(FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX );
-static const __m256 avx_neg_ones    = _mm256_set_ps(-1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f);
-static const __m256 avx_ones        = _mm256_set_ps(1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f);
+// Same as above, constants are not initialized with intrinsics.
+static const __m256 avx_zeros       = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+static const __m256 avx_infinites   = { FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX };
+static const __m256 avx_neg_ones    = { -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f };
+static const __m256 avx_ones        = { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f };
 
 #define simd_data       simd_data_avx
 #define simd_ones       avx_ones
@@ -238,6 +263,13 @@ SORT_STATIC_FORCEINLINE simd_data   simd_set_mask(const bool mask[]) {
     return _mm256_set_ps( MASK_TO_INT( mask[7] ) , MASK_TO_INT( mask[6] ) , MASK_TO_INT( mask[5] ) , MASK_TO_INT( mask[4] ) , MASK_TO_INT( mask[3] ) , MASK_TO_INT( mask[2] ) , MASK_TO_INT( mask[1] ) , MASK_TO_INT( mask[0] ) );
 #undef MASK_TO_INT
 }
+SORT_STATIC_FORCEINLINE simd_data   simd_set_u8_ps( const unsigned char d[] ){
+    // AVX2 is not a must, the two halves are converted separately.
+    const __m128i bytes = _mm_loadl_epi64( (const __m128i*)d );
+    const __m128i lo = _mm_cvtepu8_epi32( bytes );
+    const __m128i hi = _mm_cvtepu8_epi32( _mm_srli_si128( bytes , 4 ) );
+    return _mm256_cvtepi32_ps( _mm256_insertf128_si256( _mm256_castsi128_si256( lo ) , hi , 1 ) );
+}
 SORT_STATIC_FORCEINLINE simd_data   simd_add_ps( const simd_data& s0 , const simd_data& s1 ){
     return _mm256_add_ps( get_avx_data(s0) , get_avx_data(s1) );
 }
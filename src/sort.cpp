@@ -22,8 +22,9 @@
 #include "core/scene.h"
 #include "sampler/random.h"
 #include "core/timer.h"
-#include "stream/fstream.h"
+#include "stream/mmapstream.h"
 #include "material/tsl_system.h"
+#include "simd/simd_dispatch.h"
 
 SORT_STATS_DEFINE_COUNTER(sRenderingTimeMS)
 SORT_STATS_DEFINE_COUNTER(sSamplePerPixel)
@@ -57,7 +58,10 @@ void SchedulTasks( Scene& scene , IStreamBase& stream ){
     int cur_dir_len = 1;
     const Vector2i dir[4] = { Vector2i( 0 , -1 ) , Vector2i( -1 , 0 ) , Vector2i( 0 , 1 ) , Vector2i( 1 , 0 ) };
 
-    unsigned int priority = DEFAULT_TASK_PRIORITY;
+    // all first passes are with higher priority than the following passes with adaptive sampling
+    const auto tile_cnt = (unsigned int)( tile_num.x * tile_num.y );
+    const auto pass_cnt = Render_Task::PassCnt();
+    unsigned int rank = 0;
     while (true){
         // only process node inside the image region
         if (cur_pos.x >= 0 && cur_pos.x < tile_num.x && cur_pos.y >= 0 && cur_pos.y < tile_num.y ){
@@ -65,7 +69,8 @@ void SchedulTasks( Scene& scene , IStreamBase& stream ){
             Vector2i size( (tilesize < (width - tl.x)) ? tilesize : (width - tl.x) ,
                            (tilesize < (height - tl.y)) ? tilesize : (height - tl.y) );
 
-            SCHEDULE_TASK<Render_Task>( "render task" , priority-- , {pre_render_task} , tl , size , scene );
+            const auto priority = Render_Task::PassPriority( rank , 0 , tile_cnt , pass_cnt );
+            SCHEDULE_TASK<Render_Task>( "render task" , priority , {pre_render_task} , tl , size , scene , rank++ , 0u );
         }
 
         // turn to the next direction
@@ -106,6 +111,9 @@ int RunSORT( int argc , char** argv ){
             slog(INFO, GENERAL, "Stats collection is disabled.");
         #endif
         slog(INFO, GENERAL, "Profiling system is %s.", SORT_PROFILE_ISENABLED ? "enabled" : "disabled");
+        #ifdef SIMD_DISPATCH_ENABLED
+            slog(INFO, GENERAL, "SIMD instruction set supported by the CPU: %s.", GetSimdIsaName(GetSupportedSimdIsa()));
+        #endif
     }
 
     // Run in unit test mode if required.
@@ -117,7 +125,7 @@ int RunSORT( int argc , char** argv ){
     }
 
     // Load the global configuration from stream
-    IFileStream stream( g_inputFilePath );
+    IMappedFileStream stream( g_inputFilePath );
     GlobalConfiguration::GetSingleton().Serialize(stream);
 
     CreateTSLThreadContexts();
@@ -0,0 +1,116 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include "stream.h"
+
+//! @brief Streaming to a hash.
+/**
+ * OHashStream doesn't keep any data streamed to it, it only digests the data into a 64 bits FNV-1a hash. It is used to
+ * identify objects by their content, an object streaming itself out through 'Serialize' with it gets a hash that only
+ * changes when the data it depends on changes. The same sequence of values always results in the same hash, across
+ * different runs and different platforms with the same endianness.
+ * Any attempt to read data from it will result in immediate crash.
+ */
+class OHashStream : public OStreamBase{
+public:
+    //! @brief Constructing a stream that continues hashing from the hash of previous data.
+    //!
+    //! @param hash         Hash of the data streamed before, it is the offset basis of FNV-1a by default.
+    OHashStream( std::uint64_t hash = 0xcbf29ce484222325ull ) : m_hash( hash ) {}
+
+    // Streaming in math types and StringID is hidden by the overrides below otherwise.
+    using StreamBase::operator <<;
+
+    //! @brief Streaming in a float number to the hash.
+    //!
+    //! @param v            Value to be hashed.
+    //! @return             Reference of the stream itself.
+    StreamBase& operator << (const float v) override {
+        return digest( &v , sizeof( v ) );
+    }
+
+    //! @brief Streaming in an integer number to the hash.
+    //!
+    //! @param v            Value to be hashed.
+    //! @return             Reference of the stream itself.
+    StreamBase& operator << (const int v) override {
+        return digest( &v , sizeof( v ) );
+    }
+
+    //! @brief Streaming in an unsigned integer number to the hash.
+    //!
+    //! @param v            Value to be hashed.
+    //! @return             Reference of the stream itself.
+    StreamBase& operator << (const unsigned int v) override {
+        return digest( &v , sizeof( v ) );
+    }
+
+    //! @brief Streaming in a string to the hash.
+    //!
+    //! The terminating zero is hashed too so that adjacent strings are not mixed up.
+    //!
+    //! @param v            Value to be hashed.
+    //! @return             Reference of the stream itself.
+    StreamBase& operator << (const std::string& v) override {
+        return digest( v.c_str() , v.size() + 1 );
+    }
+
+    //! @brief Streaming in a boolean value to the hash.
+    //!
+    //! @param v            Value to be hashed.
+    //! @return             Reference of the stream itself.
+    StreamBase& operator << (const bool v) override {
+        return digest( &v , sizeof( v ) );
+    }
+
+    //! @brief Streaming in a block of data to the hash.
+    //!
+    //! @param  data        Data to be hashed.
+    //! @param  size        Size of the data in bytes.
+    StreamBase& Write( char* data , int size ) override {
+        return digest( data , (size_t)size );
+    }
+
+    //! @brief Get the hash of all data streamed in so far.
+    //!
+    //! @return             The 64 bits hash.
+    std::uint64_t GetHash() const {
+        return m_hash;
+    }
+
+private:
+    std::uint64_t   m_hash;     /**< Hash of the data streamed in so far. */
+
+    //! @brief Digest a block of data into the hash.
+    //!
+    //! @param  data        Data to be hashed.
+    //! @param  size        Size of the data in bytes.
+    //! @return             Reference of the stream itself.
+    SORT_FORCEINLINE StreamBase& digest( const void* data , size_t size ){
+        const auto bytes = (const unsigned char*)data;
+        auto hash = m_hash;
+        for( size_t i = 0 ; i < size ; ++i ){
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ull;
+        }
+        m_hash = hash;
+        return *this;
+    }
+};
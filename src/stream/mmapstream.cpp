@@ -0,0 +1,109 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+*/
+
+#include "mmapstream.h"
+
+#if defined(SORT_IN_WINDOWS)
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+bool IMappedFileStream::Open( const std::string& filename ){
+    Close();
+
+#if defined(SORT_IN_WINDOWS)
+    m_file = CreateFileA( filename.c_str() , GENERIC_READ , FILE_SHARE_READ , nullptr , OPEN_EXISTING , FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN , nullptr );
+    if( m_file == INVALID_HANDLE_VALUE ){
+        m_file = nullptr;
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if( !GetFileSizeEx( m_file , &size ) || 0 == size.QuadPart ){
+        Close();
+        return false;
+    }
+
+    m_mapping = CreateFileMappingA( m_file , nullptr , PAGE_READONLY , 0 , 0 , nullptr );
+    if( IS_PTR_INVALID(m_mapping) ){
+        Close();
+        return false;
+    }
+
+    m_data = (const char*)MapViewOfFile( m_mapping , FILE_MAP_READ , 0 , 0 , 0 );
+    if( IS_PTR_INVALID(m_data) ){
+        Close();
+        return false;
+    }
+    m_size = (size_t)size.QuadPart;
+#else
+    m_fd = open( filename.c_str() , O_RDONLY );
+    if( m_fd == -1 )
+        return false;
+
+    struct stat st;
+    if( fstat( m_fd , &st ) == -1 || 0 == st.st_size ){
+        Close();
+        return false;
+    }
+
+    auto data = mmap( nullptr , (size_t)st.st_size , PROT_READ , MAP_PRIVATE , m_fd , 0 );
+    if( data == MAP_FAILED ){
+        Close();
+        return false;
+    }
+
+    // the file is mostly streamed from the beginning to the end
+    madvise( data , (size_t)st.st_size , MADV_SEQUENTIAL );
+
+    m_data = (const char*)data;
+    m_size = (size_t)st.st_size;
+#endif
+
+    m_pos = 0;
+    return true;
+}
+
+bool IMappedFileStream::Close(){
+    const auto mapped = IS_PTR_VALID(m_data);
+
+#if defined(SORT_IN_WINDOWS)
+    if( IS_PTR_VALID(m_data) )
+        UnmapViewOfFile( m_data );
+    if( IS_PTR_VALID(m_mapping) )
+        CloseHandle( m_mapping );
+    if( IS_PTR_VALID(m_file) )
+        CloseHandle( m_file );
+    m_mapping = nullptr;
+    m_file = nullptr;
+#else
+    if( IS_PTR_VALID(m_data) )
+        munmap( (void*)m_data , m_size );
+    if( m_fd != -1 )
+        close( m_fd );
+    m_fd = -1;
+#endif
+
+    m_data = nullptr;
+    m_size = 0;
+    m_pos = 0;
+    return mapped;
+}
@@ -0,0 +1,187 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+*/
+
+#pragma once
+
+#include <string.h>
+#include <algorithm>
+#include "stream.h"
+
+//! @brief Streaming from a block of memory.
+/**
+ * IMemoryViewStream streams data from a block of memory that it doesn't own. It is mainly used to deserialize
+ * one part of a bigger stream, like a single entity in a scene file, independently from the rest of it, which
+ * makes it possible to load different parts of the same file in different threads.
+ * The memory needs to stay alive as long as the stream is used. Any attempt to write data through it will result
+ * in immediate crash.
+ */
+class IMemoryViewStream : public IStreamBase{
+public:
+    //! @brief Default constructor with nothing to stream from.
+    IMemoryViewStream() = default;
+
+    //! @brief Constructing from a block of memory.
+    //!
+    //! @param data         Address of the memory.
+    //! @param size         Size of the memory in bytes.
+    IMemoryViewStream( const char* data , size_t size ) : m_data( data ) , m_size( size ) {}
+
+    //! @brief Streaming in a float number from memory.
+    //!
+    //! @param v            Value to be loaded.
+    //! @return             Reference of the stream itself.
+    StreamBase& operator >> (float& v) override {
+        return read( &v , sizeof( v ) );
+    }
+
+    //! @brief Streaming in an integer number from memory.
+    //!
+    //! @param v            Value to be loaded.
+    //! @return             Reference of the stream itself.
+    StreamBase& operator >> (int& v) override {
+        return read( &v , sizeof( v ) );
+    }
+
+    //! @brief Streaming in an unsigned integer number from memory.
+    //!
+    //! @param v            Value to be loaded.
+    //! @return             Reference of the stream itself.
+    StreamBase& operator >> (unsigned int& v) override {
+        return read( &v , sizeof( v ) );
+    }
+
+    //! @brief Streaming in a string from memory.
+    //!
+    //! Unlike stand stream, space doesn't count to separate strings. For example, streaming "hello world" in will
+    //! result in one single string instead of two.
+    //!
+    //! @param v            Value to be loaded.
+    //! @return             Reference of the stream itself.
+    StreamBase& operator >> (std::string& v) override {
+        const auto start = m_data + m_pos;
+        const auto len = strnlen( start , m_size - m_pos );
+        v.assign( start , len );
+
+        // skip the terminating zero too
+        m_pos += std::min( len + 1 , m_size - m_pos );
+        return *this;
+    }
+
+    //! @brief Streaming in a boolean value from memory.
+    //!
+    //! @param v            Value to be loaded.
+    //! @return             Reference of the stream itself.
+    StreamBase& operator >> (bool& v) override {
+        return read( &v , sizeof( v ) );
+    }
+
+    //! @brief Loading data from stream directly.
+    //!
+    //! @param  data    Data to be filled.
+    //! @param  size    Size of the data to be filled in bytes.
+    StreamBase& Load( char* data , int size ) override {
+        return read( data , size );
+    }
+
+    //! @brief Access the next block of data in memory directly.
+    //!
+    //! @param  size    Size of the data in bytes.
+    //! @return         Address of the data, nullptr if there is not enough data left.
+    const char* Map( size_t size ) override {
+        if( m_pos + size > m_size )
+            return nullptr;
+        const auto ret = m_data + m_pos;
+        m_pos += size;
+        return ret;
+    }
+
+    //! @brief Size of the memory in bytes.
+    size_t  Size() const {
+        return m_size;
+    }
+
+    //! @brief Current position in the memory.
+    size_t  Tell() const {
+        return m_pos;
+    }
+
+protected:
+    //! @brief Copy data from memory, anything beyond the end of the view is filled with zero.
+    //!
+    //! @param  data    Data to be filled.
+    //! @param  size    Size of the data to be filled in bytes.
+    //! @return         Reference of the stream itself.
+    SORT_FORCEINLINE StreamBase& read( void* data , size_t size ){
+        const auto available = std::min( size , m_size - m_pos );
+        memcpy( data , m_data + m_pos , available );
+        if( UNLIKELY( available < size ) )
+            memset( (char*)data + available , 0 , size - available );
+        m_pos += available;
+        return *this;
+    }
+
+    const char*     m_data = nullptr;       /**< Address of the memory. */
+    size_t          m_size = 0;             /**< Size of the memory in bytes. */
+    size_t          m_pos = 0;              /**< Current position in the memory. */
+};
+
+//! @brief Streaming from a memory mapped file.
+/**
+ * IMappedFileStream maps the whole file into the address space of the process instead of reading it through
+ * std::ifstream. Streaming in any value is just a copy from the mapped memory, there is no system call involved
+ * at all, it is the OS's job to page in the file. Big blocks of data, like vertex buffers, can also be accessed
+ * directly through 'Map' without any copy.
+ * IMappedFileStream only works for streaming data from a file. Any attempt to write data to a file will result
+ * in immediate crash.
+ */
+class IMappedFileStream : public IMemoryViewStream{
+public:
+    //! @brief Default constructor with no file mapped.
+    IMappedFileStream() = default;
+
+    //! @brief Constructing from a file name.
+    //!
+    //! @param filename     Name of the file to be streamed.
+    IMappedFileStream( const std::string& filename ) {
+        if( !Open( filename ) )
+            slog(WARNING, STREAM, "File %s can't be loaded.", filename.c_str());
+    }
+
+    //! @brief Destructor will unmap the file.
+    ~IMappedFileStream() {
+        Close();
+    }
+
+    //! @brief Map a new file.
+    //!
+    //! @param filename     Name of the file to be streamed.
+    //! @return             Whether the file is mapped.
+    bool    Open( const std::string& filename );
+
+    //! @brief Unmap the currently mapped file.
+    //!
+    //! @return             It returns true if there is a currently mapped file, otherwise false will be returned.
+    bool    Close();
+
+private:
+#if defined(SORT_IN_WINDOWS)
+    void*           m_file = nullptr;       /**< Handle of the file. */
+    void*           m_mapping = nullptr;    /**< Handle of the file mapping. */
+#else
+    int             m_fd = -1;              /**< File descriptor of the file. */
+#endif
+};
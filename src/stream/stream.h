@@ -285,6 +285,16 @@ public:
     //! @param  data    Data to be written.
     //! @param  size    Size of the data to be filled in bytes.
     StreamBase& Write( char* data , int size ) override final { sAssertMsg(false, STREAM, "Streaming in data by using OStreamBase!"); return *this; }
+
+    //! @brief Access the next block of data in the stream directly without copying it.
+    //!
+    //! Only streams that have all data in memory support it, like a memory mapped file. If it is supported, the
+    //! stream advances just like the data is loaded. Otherwise, nullptr is returned and the stream is not touched,
+    //! it is up to the caller to fall back to 'Load'. There is no guarantee on alignment of the returned address.
+    //!
+    //! @param  size    Size of the data in bytes.
+    //! @return         Address of the data, which is valid as long as the stream is alive. nullptr if not supported.
+    virtual const char* Map( size_t size ) { return nullptr; }
 };
 
 //! @brief Streaming out data
@@ -24,10 +24,25 @@
 #include "core/profile.h"
 #include "sampler/random.h"
 #include "medium/medium.h"
+#include "core/timer.h"
+#include "core/stats.h"
 
-Render_Task::Render_Task(const Vector2i& ori , const Vector2i& size , const Scene& scene ,
+SORT_STATS_DEFINE_COUNTER(sAdaptiveSampleCnt)
+SORT_STATS_DEFINE_COUNTER(sAdaptivePixelCnt)
+SORT_STATS_DEFINE_COUNTER(sConvergedPixelCnt)
+SORT_STATS_DEFINE_COUNTER(sAdaptivePassCnt)
+
+SORT_STATS_COUNTER("Adaptive Sampling", "Total Samples", sAdaptiveSampleCnt);
+SORT_STATS_AVG_COUNT("Adaptive Sampling", "Average Sample per Pixel", sAdaptiveSampleCnt, sAdaptivePixelCnt);
+SORT_STATS_RATIO("Adaptive Sampling", "Converged Pixels", sConvergedPixelCnt, sAdaptivePixelCnt);
+SORT_STATS_COUNTER("Adaptive Sampling", "Tile Passes", sAdaptivePassCnt);
+
+// Time elapsed since rendering starts, it is for the time budget of adaptive sampling.
+static Timer g_renderingTimer;
+
+Render_Task::Render_Task(const Vector2i& ori , const Vector2i& size , const Scene& scene , unsigned int rank , unsigned int pass ,
             const char* name , unsigned int priority , const Task::Task_Container& dependencies ) :
-            Task( name , priority , dependencies ), m_coord(ori), m_size(size), m_scene(scene){
+            Task( name , priority , dependencies ), m_coord(ori), m_size(size), m_scene(scene), m_rank(rank), m_pass(pass){
     m_sampler = std::make_unique<RandomSampler>();
     m_pixelSamples = std::make_unique<PixelSample[]>(g_samplePerPixel);
 }
@@ -38,54 +53,196 @@ void Render_Task::Execute(){
 
     auto camera = m_scene.GetCamera();
 
+    // pixels are accumulated in a tile buffer first, there is no need to lock anything since tiles don't overlap.
+    m_tileRadiance = std::make_unique<Spectrum[]>( m_size.x * m_size.y );
+
+    // with adaptive sampling, only a few samples are taken in each pass, the last pass takes whatever is left.
+    const auto spp = g_adaptiveSampling ? std::min( g_adaptiveSamplePerPass , g_samplePerPixel - m_pass * g_adaptiveSamplePerPass ) : g_samplePerPixel;
+
+    // wavefront integrators take all samples of a row in the tile as one batch.
+    if( g_integrator->IsWavefront() ){
+        executeWavefront( spp );
+        finishPass();
+        return;
+    }
+
     // request samples
-    g_integrator->RequestSample( m_sampler.get() , m_pixelSamples.get() , g_samplePerPixel);
+    g_integrator->RequestSample( m_sampler.get() , m_pixelSamples.get() , spp );
+
+    auto li = std::make_unique<Spectrum[]>(spp);
 
     Vector2i rb = m_coord + m_size;
 
     for( int i = m_coord.y ; i < rb.y ; i++ ){
         for( int j = m_coord.x ; j < rb.x ; j++ ){
-            // generate samples to be used later
-            g_integrator->GenerateSample( m_sampler.get() , m_pixelSamples.get(), g_samplePerPixel, m_scene );
+            // converged pixels don't take samples anymore
+            if( g_adaptiveSampling && g_imageSensor->IsPixelConverged( j , i , g_adaptiveErrorThreshold ) )
+                continue;
 
-            // the radiance
-            Spectrum radiance;
+            // generate samples to be used later
+            g_integrator->GenerateSample( m_sampler.get() , m_pixelSamples.get(), spp, m_scene );
 
-            auto valid_pixel_cnt = g_samplePerPixel;
-            for( unsigned k = 0 ; k < g_samplePerPixel; ++k ){
+            for( unsigned k = 0 ; k < spp; ++k ){
                 // clear managed memory after each pixel
                 SORT_CLEAR_MEMPOOL();
 
                 // generate rays
                 auto r = camera->GenerateRay( (float)j , (float)i , m_pixelSamples[k] );
-                // accumulate the radiance
-                auto li = g_integrator->Li( r , m_pixelSamples[k] , m_scene );
-                if( g_clammping > 0.0f )
-                    li = li.Clamp( 0.0f , g_clammping );
-                
-                sAssert( li.IsValid() , GENERAL );
-                
-                if( li.IsValid() )
-                    radiance += li;
-                else
-                    --valid_pixel_cnt;
+                // evaluate the radiance
+                li[k] = g_integrator->Li( r , m_pixelSamples[k] , m_scene );
             }
 
-            if( valid_pixel_cnt > 0 )
-                radiance /= (float)valid_pixel_cnt;
-            
             // store the pixel
-            g_imageSensor->StorePixel( j , i , radiance , *this );
+            storePixel( j , i , li.get() , spp );
+        }
+    }
+
+    finishPass();
+}
+
+void Render_Task::executeWavefront( unsigned spp ){
+    auto camera = m_scene.GetCamera();
+
+    const auto batch_size = m_size.x * spp;
+    auto rays = std::make_unique<Ray[]>(batch_size);
+    auto pixel_samples = std::make_unique<PixelSample[]>(batch_size);
+    auto li = std::make_unique<Spectrum[]>(batch_size);
+    auto pixels = std::make_unique<int[]>(m_size.x);
+
+    // request samples
+    g_integrator->RequestSample( m_sampler.get() , pixel_samples.get() , batch_size );
+
+    Vector2i rb = m_coord + m_size;
+
+    for( int i = m_coord.y ; i < rb.y ; i++ ){
+        // generate rays of all samples in the row, converged pixels are skipped.
+        auto pixel_cnt = 0u;
+        for( int j = m_coord.x ; j < rb.x ; j++ ){
+            if( g_adaptiveSampling && g_imageSensor->IsPixelConverged( j , i , g_adaptiveErrorThreshold ) )
+                continue;
+
+            const auto offset = pixel_cnt * spp;
+            g_integrator->GenerateSample( m_sampler.get() , pixel_samples.get() + offset , spp , m_scene );
+
+            for( unsigned k = 0 ; k < spp ; ++k )
+                rays[offset + k] = camera->GenerateRay( (float)j , (float)i , pixel_samples[offset + k] );
+
+            pixels[pixel_cnt++] = j;
+        }
+
+        if( 0 == pixel_cnt )
+            continue;
+
+        // managed memory needs to be alive until all paths in the batch are done.
+        SORT_CLEAR_MEMPOOL();
+
+        g_integrator->LiStream( rays.get() , pixel_samples.get() , li.get() , pixel_cnt * spp , m_scene );
+
+        // store the pixels
+        for( auto j = 0u ; j < pixel_cnt ; ++j )
+            storePixel( pixels[j] , i , li.get() + j * spp , spp );
+    }
+}
+
+void Render_Task::storePixel( int x , int y , const Spectrum* li , unsigned cnt ){
+    // the radiance
+    PixelStatistics stats;
+    for( unsigned k = 0 ; k < cnt ; ++k ){
+        auto l = li[k];
+        if( g_clammping > 0.0f )
+            l = l.Clamp( 0.0f , g_clammping );
+
+        sAssert( l.IsValid() , GENERAL );
+
+        if( l.IsValid() ){
+            const auto lum = (double)l.GetIntensity();
+            stats.sum += l;
+            stats.lum_sum += lum;
+            stats.lum_sq_sum += lum * lum;
+            ++stats.cnt;
         }
     }
 
-    if( g_integrator->NeedRefreshTile() ){
-        auto x_off = m_coord.x / g_tileSize;
-        auto y_off = (g_resultResollutionHeight - 1 - m_coord.y ) / g_tileSize ;
-        g_imageSensor->FinishTile( x_off, y_off, *this );
+    // adaptive sampling keeps accumulating samples until the tile is done.
+    if( g_adaptiveSampling ){
+        g_imageSensor->AddPixelSamples( x , y , stats );
+        SORT_STATS(sAdaptiveSampleCnt += cnt);
+        return;
     }
+
+    if( stats.cnt > 0 )
+        stats.sum /= (float)stats.cnt;
+
+    // store the pixel
+    m_tileRadiance[( y - m_coord.y ) * m_size.x + x - m_coord.x] = stats.sum;
+}
+
+void Render_Task::finishPass(){
+    if( g_adaptiveSampling ){
+        SORT_STATS(++sAdaptivePassCnt);
+
+        // render another pass of the tile if it is not done yet, it is only picked after all tiles are done with this pass.
+        if( !isTileDone() ){
+            const auto priority = PassPriority( m_rank , m_pass + 1 , tileCnt() , PassCnt() );
+            SCHEDULE_TASK<Render_Task>( "render task" , priority , {} , m_coord , m_size , m_scene , m_rank , m_pass + 1 );
+            return;
+        }
+
+        // the result of the tile is only stored once all passes are done.
+        Vector2i rb = m_coord + m_size;
+        for( int i = m_coord.y ; i < rb.y ; i++ ){
+            for( int j = m_coord.x ; j < rb.x ; j++ ){
+                const auto& stats = g_imageSensor->GetPixelStatistics( j , i );
+                m_tileRadiance[( i - m_coord.y ) * m_size.x + j - m_coord.x] = stats.cnt > 0 ? stats.sum / (float)stats.cnt : Spectrum();
+
+                SORT_STATS(++sAdaptivePixelCnt);
+                SORT_STATS(sConvergedPixelCnt += g_imageSensor->IsPixelConverged( j , i , g_adaptiveErrorThreshold ));
+            }
+        }
+    }
+
+    finishTile();
+}
+
+bool Render_Task::isTileDone() const{
+    // all samples are taken
+    if( ( m_pass + 1 ) * g_adaptiveSamplePerPass >= g_samplePerPixel )
+        return true;
+
+    // time budget runs out
+    if( g_adaptiveTimeBudget > 0.0f && g_renderingTimer.GetElapsedTime() >= g_adaptiveTimeBudget * 1000.0f )
+        return true;
+
+    // all pixels are converged
+    Vector2i rb = m_coord + m_size;
+    for( int i = m_coord.y ; i < rb.y ; i++ )
+        for( int j = m_coord.x ; j < rb.x ; j++ )
+            if( !g_imageSensor->IsPixelConverged( j , i , g_adaptiveErrorThreshold ) )
+                return false;
+    return true;
+}
+
+unsigned int Render_Task::PassCnt(){
+    return g_adaptiveSampling ? ( g_samplePerPixel + g_adaptiveSamplePerPass - 1 ) / g_adaptiveSamplePerPass : 1u;
+}
+
+unsigned int Render_Task::tileCnt() const{
+    const auto tile_num_x = ( g_resultResollutionWidth + g_tileSize - 1 ) / g_tileSize;
+    const auto tile_num_y = ( g_resultResollutionHeight + g_tileSize - 1 ) / g_tileSize;
+    return tile_num_x * tile_num_y;
+}
+
+void Render_Task::finishTile(){
+    auto x_off = m_coord.x / g_tileSize;
+    auto y_off = (g_resultResollutionHeight - 1 - m_coord.y ) / g_tileSize ;
+    g_imageSensor->FinishTile( x_off, y_off, *this );
+
+    m_tileRadiance = nullptr;
 }
 
 void PreRender_Task::Execute(){
     g_integrator->PreProcess(m_scene);
+
+    // rendering starts right after this
+    g_renderingTimer.Reset();
 }
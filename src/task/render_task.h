@@ -27,14 +27,38 @@
 //! Each render task is usually responsible for a tile of image to be rendered in
 //! most cases. In other cases, like light tracing, there is no difference between
 //! different render_task.
+//! With adaptive sampling, each render task only renders one pass of the tile. It
+//! schedules the next pass of the same tile when it is done, until the tile is converged
+//! or the time budget runs out. The priority of a pass is lower than the priority of all
+//! tiles in the previous pass, since the scheduler respects priority globally, no tile
+//! starts a new pass before every other tile has started its current pass.
 class Render_Task : public Task{
 public:
     //! @brief Constructor
     //!
+    //! @param rank         Index of the tile in the order of rendering.
+    //! @param pass         Index of the pass of the tile, it is always zero without adaptive sampling.
     //! @param priority     New priority of the task.
-    Render_Task(const Vector2i& ori , const Vector2i& size , const Scene& scene ,
+    Render_Task(const Vector2i& ori , const Vector2i& size , const Scene& scene , unsigned int rank , unsigned int pass ,
                 const char* name , unsigned int priority , const Task::Task_Container& dependencies );
 
+    //! @brief  Priority of a pass of a tile.
+    //!
+    //! All tiles in one pass are with higher priority than any tile in the next pass, tiles in
+    //! the same pass are ordered by their rank. It is always positive.
+    //!
+    //! @param rank         Index of the tile in the order of rendering.
+    //! @param pass         Index of the pass of the tile.
+    //! @param tile_cnt     Total number of tiles.
+    //! @param pass_cnt     Maximum number of passes of a tile.
+    //! @return             Priority of the render task.
+    static SORT_FORCEINLINE unsigned int PassPriority( unsigned int rank , unsigned int pass , unsigned int tile_cnt , unsigned int pass_cnt ){
+        return ( pass_cnt - pass ) * tile_cnt - rank;
+    }
+
+    //! @brief  Maximum number of passes of a tile, it is one without adaptive sampling.
+    static unsigned int PassCnt();
+
     //! @brief  Execute the task
     void        Execute() override;
 
@@ -52,12 +76,51 @@ public:
         return m_size;
     }
 
+    //! @brief  Get the radiance of a pixel in the tile buffer.
+    //!
+    //! @param x            X coordinate of the pixel in the image.
+    //! @param y            Y coordinate of the pixel in the image.
+    //! @return             Radiance stored in the pixel.
+    SORT_FORCEINLINE const Spectrum& GetPixelRadiance( int x , int y ) const {
+        return m_tileRadiance[( y - m_coord.y ) * m_size.x + x - m_coord.x];
+    }
+
 private:
+    //! @brief  Render the tile with a wavefront integrator, samples of each row are evaluated in one batch.
+    //!
+    //! @param spp          Number of samples per pixel to take.
+    void        executeWavefront( unsigned spp );
+
+    //! @brief  Store the radiance of all samples taken in a pixel in the tile buffer.
+    //!
+    //! @param x            X coordinate of the pixel.
+    //! @param y            Y coordinate of the pixel.
+    //! @param li           Radiance of the samples.
+    //! @param cnt          Number of samples.
+    void        storePixel( int x , int y , const Spectrum* li , unsigned cnt );
+
+    //! @brief  Schedule the next pass of the tile with adaptive sampling, or finish the tile if it is done.
+    void        finishPass();
+
+    //! @brief  Whether the tile doesn't need another pass with adaptive sampling.
+    //!
+    //! @return True if all samples are taken, the time budget runs out or all pixels are converged.
+    bool        isTileDone() const;
+
+    //! @brief  Total number of tiles of the image.
+    unsigned int tileCnt() const;
+
+    //! @brief  Notify the image sensor that the tile is done, the tile buffer is merged into the image then.
+    void        finishTile();
+
     Vector2i                            m_coord;            /**< Top-left corner of the current tile. */
     Vector2i                            m_size;             /**< Size of the current tile to be rendered. */
     const Scene&                        m_scene;            /**< Scene for ray tracing. */
+    unsigned int                        m_rank;             /**< Index of the tile in the order of rendering. */
+    unsigned int                        m_pass;             /**< Index of the pass of the tile with adaptive sampling. */
     std::unique_ptr<Sampler>            m_sampler;          /**< Sampler for taking samples. Currently not used. */
     std::unique_ptr<PixelSample[]>      m_pixelSamples;     /**< Samples to take. Currently not used. */
+    std::unique_ptr<Spectrum[]>         m_tileRadiance;     /**< Radiance of pixels in the tile, it is only allocated when the task is executed. */
 };
 
 //! @brief  PreRender_Task provides a chance for integrators to preprocess some data before rendering.
@@ -15,6 +15,7 @@
     this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
  */
 
+#include <thread>
 #include "task.h"
 #include "core/sassert.h"
 #include "core/profile.h"
@@ -23,21 +24,23 @@ thread_local static const Task* g_currentTask = nullptr;
 
 class UpdateCurrentTaskWrapper{
 public:
-    //! Update current task
-    UpdateCurrentTaskWrapper( const Task* task ){
+    //! Update current task, the previous one is kept since a task could be executed while another one is waiting for a task group.
+    UpdateCurrentTaskWrapper( const Task* task ) : m_previousTask( g_currentTask ){
         g_currentTask = task;
     }
 
-    //! There is no current on-going task any more.
+    //! Restore the previous task.
     ~UpdateCurrentTaskWrapper(){
-        g_currentTask = nullptr;
+        g_currentTask = m_previousTask;
     }
+
+private:
+    const Task* m_previousTask;
 };
 
 void Task::ExecuteTask(){
-    SORT_PROFILE(m_name);
-
     {
+        SORT_PROFILE(m_name);
         UpdateCurrentTaskWrapper uctw( this );
 
         // Execute the task.
@@ -45,74 +48,144 @@ void Task::ExecuteTask(){
     }
 
     // Upon termination of a task, release its dependents' dependencies on this task.
+    // The task is deleted by the scheduler, it should not be touched after this.
     Scheduler::GetSingleton().TaskFinished( this );
 }
 
-// Compare tasks based on its priority, tasks with higher priority get executed earlier.
-Scheduler::Task_Comp Scheduler::task_comp = []( const Task* t0 , const Task* t1 ){
-    return t0->GetPriority() < t1->GetPriority();
-};
+bool Task::AddDependent( Task* task ){
+    std::lock_guard<spinlock_mutex> lock(m_dependentsLock);
+    if( m_finished )
+        return false;
+    m_dependents.push_back( task );
+    return true;
+}
+
+Task::DependentTask_Container Task::FinishDependents(){
+    std::lock_guard<spinlock_mutex> lock(m_dependentsLock);
+    m_finished = true;
+    return std::move(m_dependents);
+}
+
+Scheduler::~Scheduler(){
+    // Tasks are owned by the scheduler until they are finished, delete whatever is left in the queues.
+    for( auto& queue : m_queues ){
+        while( !queue.tasks.empty() ){
+            delete queue.tasks.top();
+            queue.tasks.pop();
+        }
+    }
+}
 
 Task* Scheduler::Schedule( std::unique_ptr<Task> task ){
     if(IS_PTR_INVALID(task))
         return nullptr;
 
-    std::lock_guard<std::mutex> lock(m_mutex);
-
-    auto taskID = task->GetTaskID();
-    m_tasks[taskID] = std::move(task);
-
-    const auto task_ptr = m_tasks[taskID].get();
-    if(task_ptr->NoDependency() )
-        m_availbleTasks.push(task_ptr);
-    else{
-        auto dependencies = task_ptr->GetDependencies();
-        for (auto dep : dependencies) {
-            auto no_const_dep = const_cast<Task*>(dep);
-            no_const_dep->AddDependent(task_ptr);
-        }
-        m_backupTasks.insert(task_ptr);
+    // The scheduler owns the task until it is finished.
+    auto task_ptr = task.release();
+    m_unfinishedCnt.fetch_add( 1 );
+
+    // One extra dependency guards the task from being pushed by a dependency finishing while the rest are still being registered.
+    const auto& dependencies = task_ptr->GetDependencies();
+    task_ptr->m_pendingDependencies.store( (int)dependencies.size() + 1 , std::memory_order_relaxed );
+    for (auto dep : dependencies) {
+        auto no_const_dep = const_cast<Task*>(dep);
+        if( !no_const_dep->AddDependent(task_ptr) )
+            task_ptr->RemoveDependency();
     }
+
+    if( task_ptr->RemoveDependency() )
+        pushTask( task_ptr );
     return task_ptr;
 }
 
 Task* Scheduler::PickTask(){
-    std::unique_lock<std::mutex> lock(m_mutex);
-
-    // Wait until this is at least one available task
-    while( !( (m_backupTasks.empty() && m_availbleTasks.empty()) || m_availbleTasks.size() ) )
-        m_cv.wait_for( lock , std::chrono::seconds(1) );
-
-    // Return nullptr if there is no task available in the scheduler
-    if (m_backupTasks.empty() && m_availbleTasks.empty())
-        return nullptr;
+    while( true ){
+        auto task = popTask();
+        if( IS_PTR_VALID(task) )
+            return task;
+
+        // Return nullptr if there is no task left in the scheduler
+        if( 0 == m_unfinishedCnt.load() )
+            return nullptr;
+
+        // Park the thread until there is at least one available task or all tasks are finished.
+        // The number of parked threads is updated before checking the condition so that a thread pushing
+        // tasks will either see this thread parked or this thread will see the new tasks, no wake-up is lost.
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_parkedCnt.fetch_add( 1 );
+        m_cv.wait( lock , [&](){ return m_availableCnt.load() > 0 || 0 == m_unfinishedCnt.load(); } );
+        m_parkedCnt.fetch_sub( 1 );
+    }
+}
 
-    // Get the available task that is with highest priority
-    Task* ret = m_availbleTasks.top();
-    m_availbleTasks.pop();
-    return ret;
+Task* Scheduler::TryPickTask(){
+    return popTask();
 }
 
 void Scheduler::TaskFinished( const Task* task ){
-    std::lock_guard<std::mutex> lock(m_mutex);
+    // The task is not referenced by the scheduler anymore, it is safe to delete it after all its dependents are updated.
+    std::unique_ptr<Task> finished_task( const_cast<Task*>(task) );
 
-    // Starting remove all dependencies.
-    const auto& dependent = task->GetDependents();
-    for( auto dep : dependent ){
-        // Remove its dependencies.
-        dep->RemoveDependency( task );
+    // Starting remove all dependencies, dependents whose last dependency is this task are pushed to the queue of this thread.
+    for( auto dep : finished_task->FinishDependents() ){
+        if( dep->RemoveDependency() )
+            pushTask( dep );
+    }
 
-        // There is no dependent task of this 'dep' task anymore, push it into the heap and remove it from the backup tasks.
-        if( dep->NoDependency() ){
-            m_backupTasks.erase( dep );
-            m_availbleTasks.push( dep );
+    // Wake all parked threads up if this is the last task so that they can quit.
+    if( 1 == m_unfinishedCnt.fetch_sub( 1 ) ){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cv.notify_all();
+    }
+}
 
-            // Notify one waiting thread to pick up task.
-            m_cv.notify_one();
-        }
+void Scheduler::pushTask( Task* task ){
+    auto& queue = m_queues[ThreadId() % SCHEDULER_QUEUE_CNT];
+    {
+        std::lock_guard<spinlock_mutex> lock(queue.lock);
+        queue.tasks.push( task );
+        queue.top.store( queue.tasks.top()->GetPriority() , std::memory_order_release );
+    }
+    m_availableCnt.fetch_add( 1 );
+
+    // Only touch the mutex if there are threads parked, which is rarely the case when the system is busy.
+    if( m_parkedCnt.load() > 0 ){
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cv.notify_one();
     }
+}
 
-    m_tasks.erase(task->GetTaskID());
+Task* Scheduler::popTask(){
+    const auto start = ThreadId() % SCHEDULER_QUEUE_CNT;
+
+    // Keep searching as long as there are available tasks, this also quickly exits without touching any queue.
+    while( m_availableCnt.load() > 0 ){
+        // Find the queue whose top task has the highest priority, starting from the queue of this thread so that it wins ties.
+        Task_Queue* best = nullptr;
+        long long best_priority = -1;
+        for( auto i = 0 ; i < SCHEDULER_QUEUE_CNT ; ++i ){
+            auto& queue = m_queues[( start + i ) % SCHEDULER_QUEUE_CNT];
+            const auto priority = queue.top.load( std::memory_order_acquire );
+            if( priority > best_priority ){
+                best_priority = priority;
+                best = &queue;
+            }
+        }
+        if( IS_PTR_INVALID(best) )
+            return nullptr;
+
+        // The queue may be drained by other threads in the meantime, simply search again if it is the case.
+        std::lock_guard<spinlock_mutex> lock(best->lock);
+        if( best->tasks.empty() )
+            continue;
+
+        auto ret = best->tasks.top();
+        best->tasks.pop();
+        best->top.store( best->tasks.empty() ? -1ll : (long long)best->tasks.top()->GetPriority() , std::memory_order_release );
+        m_availableCnt.fetch_sub( 1 );
+        return ret;
+    }
+    return nullptr;
 }
 
 void    EXECUTING_TASKS(){
@@ -129,6 +202,27 @@ void    EXECUTING_TASKS(){
     }
 }
 
+void TaskGroup::Fork( std::function<void()> func , const char* name , unsigned int priority ){
+    ++m_pending;
+    SCHEDULE_TASK<Lambda_Task>( name , priority , {} , [this, func = std::move(func)](){
+        func();
+
+        // The group should not be touched after this since the waiting thread may destroy it right away.
+        --m_pending;
+    });
+}
+
+void TaskGroup::Wait(){
+    while( m_pending > 0 ){
+        // Instead of idling, help executing available tasks, which are quite likely the ones forked by this group.
+        auto task = Scheduler::GetSingleton().TryPickTask();
+        if( IS_PTR_VALID(task) )
+            task->ExecuteTask();
+        else
+            std::this_thread::yield();
+    }
+}
+
 const Task* GetCurrentTask(){
     return g_currentTask;
 }
\ No newline at end of file
@@ -18,13 +18,16 @@
 #pragma once
 
 #include <unordered_set>
-#include <unordered_map>
+#include <vector>
+#include <string>
 #include <queue>
 #include <memory>
 #include <mutex>
+#include <atomic>
 #include <functional>
 #include <condition_variable>
 #include "core/singleton.h"
+#include "core/thread.h"
 
 // Default task priority is 100000.
 #define DEFAULT_TASK_PRIORITY       100000
@@ -44,16 +47,13 @@ class Task{
 public:
     // Dependency container for task
     using Task_Container = std::unordered_set<const Task*>;
-    using DependentTask_Container = std::unordered_set<Task*>;
+    using DependentTask_Container = std::vector<Task*>;
 
     //! @brief  Default constructor.
     Task(   const char* name  , unsigned int priority = DEFAULT_TASK_PRIORITY ,
             const Task_Container& dependencies = {} ):
-            m_name(name), m_dependencies(dependencies),m_priority(priority) {
-        static std::mutex m;
-        static unsigned int taskId = 0;
-
-        std::lock_guard<std::mutex> lock(m);
+            m_dependencies(dependencies), m_priority(priority), m_name(name) {
+        static std::atomic<unsigned int> taskId = { 0 };
         m_taskId = (TaskID)++taskId;
     }
 
@@ -73,33 +73,36 @@ public:
         return m_priority;
     }
 
-    //! @brief  Remove dependency from task.
+    //! @brief  Remove one dependency from task.
+    //!
+    //! Upon the termination of any task this task depends on, it is necessary to remove the dependency.
+    //! Only the number of unfinished dependencies is tracked, the dependency itself is not touched at all.
     //!
-    //! Upon the termination of any dependent task, it is necessary to remove it from its dependency.
-    SORT_FORCEINLINE void         RemoveDependency( const Task* taskid ) {
-        m_dependencies.erase( taskid );
+    //! @return True if this is the last dependency, meaning the task is ready to be executed.
+    SORT_FORCEINLINE bool         RemoveDependency() {
+        return 1 == m_pendingDependencies.fetch_sub( 1 , std::memory_order_acq_rel );
     }
 
     //! @brief  If there is no dependent task anymore.
     //!
     //! @return True if all dependent tasks are finished. Otherwise, return false.
     SORT_FORCEINLINE bool         NoDependency() const {
-        return m_dependencies.empty();
+        return 0 == m_pendingDependencies.load( std::memory_order_acquire );
     }
 
-    //! @brief  Get tasks depending on this task.
+    //! @brief  Add dependent.
     //!
-    //! @return Tasks this task depends on.
-    SORT_FORCEINLINE const DependentTask_Container& GetDependents() const  {
-        return m_dependents;
-    }
+    //! It is possible that this task finishes while the dependent is being scheduled, in which case the dependent
+    //! won't be added since nobody is going to remove the dependency later.
+    //!
+    //! @param  task        Task to be added as a dependent.
+    //! @return             False if the task is already finished, the dependent is not added then.
+    bool                AddDependent( Task* task );
 
-    //! @brief  Add dependent.
+    //! @brief  Mark the task finished and take all its dependents.
     //!
-    //! @param  Task to be added as a dependent.
-    SORT_FORCEINLINE void AddDependent( Task* task ){
-        m_dependents.insert( task );
-    }
+    //! @return Tasks depending on this task, no more dependents can be added after this.
+    DependentTask_Container   FinishDependents();
 
     //! @brief  Get the id of the task
     //!
@@ -110,12 +113,8 @@ public:
 
     //! @brief  Get tasks this task depends on.
     //!
-    //! @return Tasks this task depends on.
-    SORT_FORCEINLINE Task_Container& GetDependencies(){
-        return m_dependencies;
-    }
-
-    //! @brief  Get tasks this task depends on.
+    //! Dependencies are never removed from this container, it always holds all tasks this task was scheduled with.
+    //! Some of them may not be alive anymore, use the pointers only for identification.
     //!
     //! @return Tasks this task depends on.
     SORT_FORCEINLINE const Task_Container& GetDependencies() const {
@@ -123,36 +122,61 @@ public:
     }
 
 private:
-    Task_Container              m_dependencies;     /**< Tasks this task depends on. */
-    DependentTask_Container     m_dependents;       /**< Tasks depending on this task. */
-    unsigned int                m_priority;         /**< Priority of the task. */
-    const std::string           m_name;             /**< Name of the task. */
-    TaskID                      m_taskId;           /**< This is to identify the task with id. */
+    const Task_Container        m_dependencies;                     /**< Tasks this task depends on. */
+    std::atomic<int>            m_pendingDependencies = { 0 };      /**< Number of dependencies that are not finished yet. */
+    DependentTask_Container     m_dependents;                       /**< Tasks depending on this task. */
+    spinlock_mutex              m_dependentsLock;                   /**< Lock protecting dependents. */
+    bool                        m_finished = false;                 /**< Whether the task is finished. */
+    unsigned int                m_priority;                         /**< Priority of the task. */
+    const std::string           m_name;                             /**< Name of the task. */
+    TaskID                      m_taskId;                           /**< This is to identify the task with id. */
+
+    friend class Scheduler;
 };
 
+// Number of task queues in the scheduler, each thread pushes to and pops from its own queue and steals from others.
+#define SCHEDULER_QUEUE_CNT         64
+
 //! @brief  Scheduler for scheduling tasks.
 /**
- * Scheduler will pick a task without any dependencies that has highest priority. If there are
- * multiple candidate tasks, a random one will be picked. Each task dependencies will only be
- * removed after it is fully finished, not after it gets started.
+ * Scheduler will pick a task without any dependencies that has highest priority. Each task dependencies
+ * will only be removed after it is fully finished, not after it gets started.
+ * Instead of having one global queue protected by one mutex, which quickly becomes the bottleneck with lots
+ * of small tasks and threads, ready tasks are kept in multiple queues. Each thread pushes tasks it makes ready
+ * into its own queue. Each queue also publishes the priority of its top task, a thread checks the highest
+ * published priority across all queues before popping, so that priority is respected globally instead of
+ * just within the queue of the current thread. Its own queue is preferred when priorities are equal.
+ * Tasks with dependencies are not in any queue at all, they only keep the number of unfinished dependencies
+ * and get pushed by whichever thread finishes their last dependency. Threads with nothing to do are parked
+ * until there are new tasks available or all tasks are finished.
  * Scheduler is thread-safe, which means that multiple threads can retrieve tasks from scheduler
  * concurrently.
  */
 class Scheduler : public Singleton<Scheduler>{
-    /**< Task comparison functor. */
-    using Task_Comp = std::function<bool(const Task* , const Task*)>;
-    /**< Static task comparison functor based on its priority. */
-    static Task_Comp task_comp;
+    /**< Task comparison functor based on its priority. */
+    struct Task_Comp{
+        bool operator()( const Task* t0 , const Task* t1 ) const {
+            return t0->GetPriority() < t1->GetPriority();
+        }
+    };
     /**< Task queue for available tasks is actually a heap. */
-    using TaskQueue = std::priority_queue<Task*,std::vector<Task*>,decltype(task_comp)>;
-    /**< Task container for back-up tasks is just a hash container. */
-    using BackupTaskContainer = std::unordered_set<Task*>;
-    /**< Task container for keeping tasks alive. */
-    using TaskContainer = std::unordered_map<TaskID, std::unique_ptr<Task>>;
+    using TaskQueue = std::priority_queue<Task*,std::vector<Task*>,Task_Comp>;
+
+    //! @brief  A queue of available tasks, aligned to avoid false sharing between queues.
+    struct alignas(64) Task_Queue{
+        TaskQueue                   tasks;              /**< Heap of available tasks. */
+        spinlock_mutex              lock;               /**< Lock protecting the heap. */
+        std::atomic<long long>      top = { -1 };       /**< Priority of the top task in the heap, -1 if empty. It is for checking without locking. */
+    };
 
 public:
+    //! @brief  Destructor deletes all tasks that are not executed.
+    ~Scheduler();
+
     //! @brief  Schedule a task.
     //!
+    //! All dependencies of the task should still be alive at the time it is scheduled.
+    //!
     //! @param  task        Task to be scheduled.
     //! @param              Raw pointer to the task.
     Task*    Schedule( std::unique_ptr<Task> task );
@@ -160,32 +184,53 @@ public:
     //! @brief  Pick a task with highest priority, but no dependencies.
     //!
     //! The scheduler will try picking a task with highest priority, but no dependencies.
-    //! If there is no such a task available for now, the scheduler will hang the thread
-    //! and share its CPU resources to other threads for executing. In the case of a cycle
-    //! graph tasks, it will hang forever. The task picked will be removed from the data
-    //! structures in scheduler.
+    //! If there is no such a task available for now, the thread will be parked until there
+    //! is one. In the case of a cycle graph tasks, it will hang forever. The task picked will
+    //! be removed from the data structures in scheduler.
     //! If there is no task in the scheduler, nullptr will be returned.
     //!
     //! @return    The task picked from scheduler.
     Task*   PickTask();
 
+    //! @brief  Pick a task with highest priority, but no dependencies, without waiting.
+    //!
+    //! Unlike 'PickTask', this function never hangs the thread. It returns nullptr immediately if
+    //! there is no available task at the moment, even if there are still tasks waiting for their
+    //! dependencies. This is used by threads that are waiting for some other tasks to be finished
+    //! so that they can help executing tasks instead of idling.
+    //!
+    //! @return    The task picked from scheduler, nullptr if there is no available task for now.
+    Task*   TryPickTask();
+
     //! @brief  Remove dependencies for a task.
     //!
     //! Upon finish of each task, it needs to update scheduler it is finished so that other
-    //! tasks depending on this task will get chance to be executed in the future.
+    //! tasks depending on this task will get chance to be executed in the future. The task
+    //! is deleted after this.
     //!
     //! @param task     Task that is finished. This task should not be in the scheduler.
     void    TaskFinished( const Task* task );
 
 private:
     //! @brief  Default constructor
-    Scheduler():m_availbleTasks(task_comp){}
+    Scheduler() = default;
+
+    //! @brief  Push a task without dependencies into the queue of the current thread.
+    //!
+    //! @param  task        Task to be pushed.
+    void    pushTask( Task* task );
 
-    TaskQueue                   m_availbleTasks;        /**< Heap of available tasks. */
-    BackupTaskContainer         m_backupTasks;          /**< Container for all tasks not direct available. */
-    std::mutex                  m_mutex;                /**< Mutex to make sure scheduler is thread-safe. */
-    std::condition_variable     m_cv;                   /**< Conditional variable for pick task. */
-    TaskContainer               m_tasks;                /**< This holds all tasks to keep them alive. */
+    //! @brief  Pop the task with highest priority among all queues, the queue of the current thread wins ties.
+    //!
+    //! @return             The task popped, nullptr if all queues are empty.
+    Task*   popTask();
+
+    Task_Queue                  m_queues[SCHEDULER_QUEUE_CNT];      /**< Queues of available tasks. */
+    std::atomic<unsigned int>   m_availableCnt = { 0 };             /**< Number of available tasks in all queues. */
+    std::atomic<unsigned int>   m_unfinishedCnt = { 0 };            /**< Number of tasks scheduled, but not finished yet. */
+    std::atomic<unsigned int>   m_parkedCnt = { 0 };                /**< Number of threads parked. */
+    std::mutex                  m_mutex;                            /**< Mutex for parking threads. */
+    std::condition_variable     m_cv;                               /**< Conditional variable for parking threads. */
 
     friend class Singleton<Scheduler>;
 };
@@ -197,6 +242,52 @@ SORT_FORCEINLINE Task*  SCHEDULE_TASK( const char* name , unsigned int priority
     return Scheduler::GetSingleton().Schedule( std::move(ret) );
 }
 
+//! @brief  A task simply executing a function object.
+class Lambda_Task : public Task{
+public:
+    //! @brief  Constructor.
+    //!
+    //! @param  func        The function to be executed.
+    Lambda_Task( std::function<void()> func , const char* name , unsigned int priority , const Task::Task_Container& dependencies ) :
+        Task( name , priority , dependencies ) , m_func( std::move(func) ) {}
+
+    //! @brief  Execute the task
+    void        Execute() override {
+        m_func();
+    }
+
+private:
+    std::function<void()>   m_func;     /**< The function to be executed. */
+};
+
+//! @brief  A group of forked tasks that can be waited on.
+/**
+ * TaskGroup offers a simple fork-join model on top of the task system. Tasks forked through it have no
+ * dependencies so that any worker thread can pick them up. Waiting on a task group doesn't hang the thread,
+ * it keeps executing available tasks until all forked tasks, including the ones forked by the forked tasks
+ * themselves, are finished. This makes it safe to spawn tasks inside a task, even if there is only one thread.
+ */
+class TaskGroup{
+public:
+    //! @brief  Make sure no forked task outlives the group.
+    ~TaskGroup(){
+        Wait();
+    }
+
+    //! @brief  Fork a function as a new task.
+    //!
+    //! @param  func        The function to be executed in the new task.
+    //! @param  name        Name of the task.
+    //! @param  priority    Priority of the task.
+    void    Fork( std::function<void()> func , const char* name = "Forked Task" , unsigned int priority = DEFAULT_TASK_PRIORITY );
+
+    //! @brief  Wait for all tasks forked in this group to be finished.
+    void    Wait();
+
+private:
+    std::atomic<unsigned int>   m_pending = { 0 };     /**< Number of forked tasks that are not finished yet. */
+};
+
 //! @brief      Executing tasks. It will exit if there is no other tasks.
 void        EXECUTING_TASKS();
 
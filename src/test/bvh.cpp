@@ -0,0 +1,433 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include <functional>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+#include "thirdparty/gtest/gtest.h"
+#include "core/rand.h"
+#include "accel/accelerator.h"
+#include "accel/bvh_utils.h"
+#include "core/diskcache.h"
+#include "core/rtti.h"
+#include "core/mesh.h"
+#include "core/primitive.h"
+#include "entity/visual.h"
+#include "material/material.h"
+#include "math/interaction.h"
+#include "shape/line.h"
+#include "shape/triangle.h"
+#include "stream/mstream.h"
+#include "scatteringevent/bssrdf/bssrdf.h"
+
+template<unsigned N>
+static void quantized_bbox_test( unsigned cnt , float scale ){
+    BBox children[N];
+    for( auto i = 0u ; i < cnt ; ++i ){
+        const Vector offset( scale * 0.3f );
+        const Point p0( sort_canonical() , sort_canonical() , sort_canonical() );
+        const Point p1( sort_canonical() , sort_canonical() , sort_canonical() );
+        children[i] = BBox( p0 * scale - offset , p1 * scale - offset , false );
+    }
+
+    Quantized_BBox<N> qbb;
+    qbb.Quantize( children , cnt );
+    EXPECT_EQ( qbb.child_cnt , cnt );
+
+    for( auto i = 0u ; i < cnt ; ++i ){
+        const auto bbox = qbb[i];
+        for( auto axis = 0 ; axis < 3 ; ++axis ){
+            // quantized bounding boxes should always enclose the original ones, without being too loose.
+            const auto cell = qbb.Cell( axis );
+            EXPECT_EQ( cell , std::ldexp( 1.0f , qbb.exponent[axis] ) );
+            EXPECT_LE( bbox.m_Min[axis] , children[i].m_Min[axis] );
+            EXPECT_GE( bbox.m_Max[axis] , children[i].m_Max[axis] );
+            EXPECT_LE( children[i].m_Min[axis] - bbox.m_Min[axis] , cell );
+            EXPECT_LE( bbox.m_Max[axis] - children[i].m_Max[axis] , cell );
+        }
+    }
+}
+
+TEST(BVH, QuantizedBBox4) {
+    for( auto i = 0 ; i < 1024 ; ++i )
+        quantized_bbox_test<4>( 2 + i % 3 , 0.01f + 100.0f * sort_canonical() );
+}
+
+TEST(BVH, QuantizedBBox8) {
+    for( auto i = 0 ; i < 1024 ; ++i )
+        quantized_bbox_test<8>( 2 + i % 7 , 0.01f + 100.0f * sort_canonical() );
+}
+
+TEST(BVH, QuantizedBBoxFlat) {
+    // children that are flat along an axis, which is quite common for axis-aligned geometry.
+    BBox children[4];
+    children[0] = BBox( Point( 0.0f , 1.0f , 0.0f ) , Point( 1.0f , 1.0f , 1.0f ) );
+    children[1] = BBox( Point( -1.0f , 1.0f , 2.0f ) , Point( 0.5f , 1.0f , 3.0f ) );
+
+    Quantized_BBox<4> qbb;
+    qbb.Quantize( children , 2 );
+    for( auto i = 0u ; i < 2 ; ++i ){
+        const auto bbox = qbb[i];
+        EXPECT_LE( bbox.m_Min.y , 1.0f );
+        EXPECT_GE( bbox.m_Max.y , 1.0f );
+        EXPECT_LE( bbox.m_Max.y - bbox.m_Min.y , qbb.Cell( 1 ) );
+    }
+}
+
+TEST(BVH, LineClipBBox) {
+    for( auto i = 0 ; i < 1024 ; ++i ){
+        const Point p0( sort_canonical() , sort_canonical() , sort_canonical() );
+        const Point p1( sort_canonical() , sort_canonical() , sort_canonical() );
+        const auto w = 0.05f * sort_canonical();
+        const Line line( p0 , p1 , 0.0f , 1.0f , w , w , 0 );
+
+        const Point c0( sort_canonical() , sort_canonical() , sort_canonical() );
+        const Point c1( sort_canonical() , sort_canonical() , sort_canonical() );
+        const BBox box( c0 , c1 , false );
+        const auto clipped = line.ClipBBox( box );
+
+        // the clipped bounding box should hold any point within half width from the center line inside the box.
+        for( auto j = 0 ; j <= 16 ; ++j ){
+            const auto c = p0 + ( p1 - p0 ) * ( j / 16.0f );
+            for( auto k = 0 ; k < 6 ; ++k ){
+                Vector offset;
+                offset[k / 2] = ( k % 2 ) ? w : -w;
+                const auto p = c + offset;
+                if( box.IsInBBox( p , 0.0f ) ){
+                    EXPECT_TRUE( clipped.IsInBBox( p , 1e-5f ) );
+                }
+            }
+        }
+
+        EXPECT_TRUE( !clipped.IsValid() || Intersection( clipped , line.GetBBox() ).IsValid() );
+    }
+}
+
+TEST(BVH, SpatialSplit) {
+    // long and thin lines across the whole scene, which is where spatial splits help the most.
+    constexpr auto primitive_cnt = 1024u;
+    constexpr auto capacity = primitive_cnt + primitive_cnt / 2;
+    constexpr auto w = 0.01f;
+    std::vector<std::unique_ptr<Line>> lines;
+    std::vector<std::unique_ptr<Primitive>> primitives;
+    std::vector<std::pair<Point, Point>> endpoints;
+    auto refs = std::make_unique<Bvh_Primitive[]>( capacity );
+    BBox root_bbox;
+    for( auto i = 0u ; i < primitive_cnt ; ++i ){
+        const Point p0( sort_canonical() , sort_canonical() , sort_canonical() );
+        const Point p1( sort_canonical() , sort_canonical() , sort_canonical() );
+        endpoints.push_back( std::make_pair( p0 * 10.0f , p1 * 10.0f ) );
+        lines.push_back( std::make_unique<Line>( p0 * 10.0f , p1 * 10.0f , 0.0f , 1.0f , w , w , 0 ) );
+        primitives.push_back( std::make_unique<Primitive>( nullptr , nullptr , lines.back().get() ) );
+        refs[i].SetPrimitive( primitives.back().get() );
+        root_bbox.Union( refs[i].GetBBox() );
+    }
+
+    // split the primitives recursively the same way BVH does.
+    std::vector<Bvh_Range> leaves;
+    auto spatial_cnt = 0u;
+    std::function<void(const Bvh_Range&)> split_range = [&]( const Bvh_Range& range ){
+        EXPECT_LE( range.end , range.cap );
+
+        BBox node_bbox;
+        for( auto i = range.start ; i < range.end ; ++i )
+            node_bbox.Union( refs[i].GetBBox() );
+
+        if( range.Count() <= 4 ){
+            leaves.push_back( range );
+            return;
+        }
+
+        const auto split = pickBestSplitSBVH( refs.get() , node_bbox , range , root_bbox.HalfSurfaceArea() );
+        Bvh_Range left , right;
+        if( split.sah >= range.Count() || !splitPrimitives( split , refs.get() , range , left , right ) ){
+            leaves.push_back( range );
+            return;
+        }
+
+        spatial_cnt += split.spatial;
+        EXPECT_EQ( left.start , range.start );
+        EXPECT_LE( left.cap , right.start );
+        EXPECT_EQ( right.cap , range.cap );
+        EXPECT_GE( left.Count() + right.Count() , range.Count() );
+
+        split_range( left );
+        split_range( right );
+    };
+    split_range( Bvh_Range( 0u , primitive_cnt , capacity ) );
+    EXPECT_GT( spatial_cnt , 0u );
+
+    std::unordered_map<const Primitive*, std::vector<BBox>> references;
+    for( const auto& leaf : leaves )
+        for( auto i = leaf.start ; i < leaf.end ; ++i )
+            references[refs[i].primitive].push_back( refs[i].GetBBox() );
+    EXPECT_EQ( references.size() , primitive_cnt );
+
+    // any point within half width from the center line should be inside one of the references of the line.
+    for( auto i = 0u ; i < primitive_cnt ; ++i ){
+        const auto& line_refs = references[primitives[i].get()];
+        for( auto j = 0 ; j <= 64 ; ++j ){
+            const auto c = endpoints[i].first + ( endpoints[i].second - endpoints[i].first ) * ( j / 64.0f );
+            const auto p = c + Vector( sort_canonical() - 0.5f , sort_canonical() - 0.5f , sort_canonical() - 0.5f ) * w;
+            const auto covered = std::any_of( line_refs.begin() , line_refs.end() , [&]( const BBox& ref ){ return ref.IsInBBox( p , 0.0f ); } );
+            EXPECT_TRUE( covered );
+        }
+    }
+}
+
+TEST(BVH, QbvhRefit) {
+    constexpr auto primitive_cnt = 1024u;
+    constexpr auto moved_cnt = 64u;
+    constexpr auto w = 0.05f;
+    std::filesystem::remove_all( "test_bvh_cache" );
+    auto& cache = DiskCache::GetSingleton();
+    cache.SetDirectory( "test_bvh_cache" );
+
+    const auto cached_cnt = [](){
+        return std::distance( std::filesystem::directory_iterator( "test_bvh_cache" ) , std::filesystem::directory_iterator() );
+    };
+
+    std::vector<std::pair<Point, Point>> endpoints;
+    for( auto i = 0u ; i < primitive_cnt ; ++i ){
+        const Point p0( sort_canonical() , sort_canonical() , sort_canonical() );
+        const Vector d( sort_canonical() - 0.5f , sort_canonical() - 0.5f , sort_canonical() - 0.5f );
+        endpoints.push_back( std::make_pair( p0 * 10.0f , p0 * 10.0f + d ) );
+    }
+    std::vector<Transform> transforms( primitive_cnt );
+
+    // every build goes through the disk cache, only the first one is built from scratch.
+    const auto test_scene = [&](){
+        std::vector<std::unique_ptr<Line>> lines;
+        std::vector<std::unique_ptr<Primitive>> primitives;
+        std::vector<const Primitive*> primitive_list;
+        BBox bbox;
+        for( auto i = 0u ; i < primitive_cnt ; ++i ){
+            lines.push_back( std::make_unique<Line>( endpoints[i].first , endpoints[i].second , 0.0f , 1.0f , w , w , 0 ) );
+            lines.back()->SetTransform( transforms[i] );
+            primitives.push_back( std::make_unique<Primitive>( nullptr , nullptr , lines.back().get() ) );
+            primitive_list.push_back( primitives.back().get() );
+            bbox.Union( primitives.back()->GetBBox() );
+        }
+
+        const auto qbvh = MakeUniqueInstance<Accelerator>( StringID( "Qbvh" ) );
+        ASSERT_NE( qbvh , nullptr );
+        qbvh->Build( primitive_list , bbox );
+
+        // the nearest intersection has to be the same as testing all lines one by one.
+        for( auto i = 0u ; i < 256u ; ++i ){
+            const Point ori( sort_canonical() * 10.0f , sort_canonical() * 10.0f , -1.0f );
+            auto dir = Vector( sort_canonical() - 0.5f , sort_canonical() - 0.5f , 1.0f );
+            const Ray ray( ori , dir.Normalize() );
+
+            SurfaceInteraction expected;
+            for( const auto& line : lines )
+                line->GetIntersect( ray , &expected );
+
+            SurfaceInteraction intersect;
+            qbvh->GetIntersect( ray , intersect );
+            EXPECT_EQ( intersect.t , expected.t );
+        }
+    };
+    test_scene();
+
+    // the tree is simply refitted if a few lines move a bit.
+    for( auto i = 0u ; i < moved_cnt ; ++i )
+        transforms[i] = Translate( 0.5f , 0.0f , 0.0f );
+    test_scene();
+
+    // lines in a corner are shuffled and stretched, sub-trees around the corner degrade too much to be refitted.
+    for( auto i = 0u ; i < primitive_cnt ; ++i ){
+        const auto& p0 = endpoints[i].first;
+        if( p0.x > 3.0f || p0.y > 3.0f || p0.z > 3.0f )
+            continue;
+        const auto p1 = Translate( sort_canonical() * 3.0f , sort_canonical() * 3.0f , sort_canonical() * 3.0f );
+        transforms[i] = p1 * Scale( 6.0f ) * Translate( -p0.x , -p0.y , -p0.z );
+    }
+    test_scene();
+
+    // the same tree is loaded without refitting if nothing moves.
+    test_scene();
+
+    // only the SIMD implementation is cached.
+#ifdef SSE_ENABLED
+    // moved lines are still the same lines, all of the above share one tree in the disk cache.
+    ASSERT_EQ( cached_cnt() , 1 );
+    const auto cached_file = std::filesystem::directory_iterator( "test_bvh_cache" )->path();
+    const auto read_file = [&](){
+        std::ifstream file( cached_file , std::ios::binary );
+        return std::string( std::istreambuf_iterator<char>( file ) , std::istreambuf_iterator<char>() );
+    };
+    const auto cached_tree = read_file();
+
+    // different lines don't pick up the tree of others even if there are as many of them, refitting the tree of other
+    // lines would overwrite it.
+    for( auto& endpoint : endpoints )
+        endpoint.second = endpoint.first + Vector( 0.0f , 0.0f , 0.5f );
+    test_scene();
+    EXPECT_EQ( cached_cnt() , 2 );
+    EXPECT_TRUE( read_file() == cached_tree );
+#endif
+
+    cache.SetDirectory( "" );
+}
+
+TEST(BVH, QbvhStream) {
+    constexpr auto primitive_cnt = 1024u;
+    constexpr auto ray_cnt = 100u;
+    constexpr auto w = 0.05f;
+    std::vector<std::unique_ptr<Line>> lines;
+    std::vector<std::unique_ptr<Primitive>> primitives;
+    std::vector<const Primitive*> primitive_list;
+    BBox bbox;
+    for( auto i = 0u ; i < primitive_cnt ; ++i ){
+        const Point p0( sort_canonical() * 10.0f , sort_canonical() * 10.0f , sort_canonical() * 10.0f );
+        const Vector d( sort_canonical() - 0.5f , sort_canonical() - 0.5f , sort_canonical() - 0.5f );
+        lines.push_back( std::make_unique<Line>( p0 , p0 + d * 4.0f , 0.0f , 1.0f , w , w , 0 ) );
+        lines.back()->SetTransform( Transform() );
+        primitives.push_back( std::make_unique<Primitive>( nullptr , nullptr , lines.back().get() ) );
+        primitive_list.push_back( primitives.back().get() );
+        bbox.Union( primitives.back()->GetBBox() );
+    }
+
+    const auto qbvh = MakeUniqueInstance<Accelerator>( StringID( "Qbvh" ) );
+    ASSERT_NE( qbvh , nullptr );
+    qbvh->Build( primitive_list , bbox );
+
+    // rays fan out from a single point like primary rays, some of them miss the scene. The stream size is not a
+    // multiple of the packet size so that partially filled packets are covered too.
+    std::vector<Ray> rays;
+    for( auto i = 0u ; i < ray_cnt ; ++i ){
+        auto dir = Vector( sort_canonical() * 4.0f - 2.0f , sort_canonical() * 4.0f - 2.0f , 1.0f );
+        rays.push_back( Ray( Point( 5.0f , 5.0f , -1.0f ) , dir.Normalize() ) );
+    }
+
+    std::vector<SurfaceInteraction> intersects( ray_cnt );
+    qbvh->IntersectStream( rays.data() , intersects.data() , ray_cnt );
+
+    std::unique_ptr<bool[]> occluded( new bool[ray_cnt] );
+    qbvh->OccludedStream( rays.data() , occluded.get() , ray_cnt );
+
+    // the results have to be the same as testing all lines one by one.
+    auto hit_cnt = 0u;
+    for( auto i = 0u ; i < ray_cnt ; ++i ){
+        SurfaceInteraction expected;
+        for( const auto& line : lines )
+            line->GetIntersect( rays[i] , &expected );
+
+        EXPECT_EQ( intersects[i].t , expected.t );
+        EXPECT_EQ( occluded[i] , expected.t != FLT_MAX );
+        hit_cnt += expected.t != FLT_MAX;
+    }
+    EXPECT_GT( hit_cnt , 0u );
+    EXPECT_LT( hit_cnt , ray_cnt );
+}
+
+// A material that does nothing other than telling primitives apart in BSSRDF intersection tests.
+class BssrdfTestMaterial : public MaterialBase{
+public:
+    BssrdfTestMaterial( const StringID id ) : m_id( id ) {}
+
+    void        UpdateScatteringEvent( ScatteringEvent& se ) const override {}
+    void        UpdateMediumStack( const MediumInteraction& mi , const SE_Interaction flag , MediumStack& ms ) const override {}
+    void        EvaluateMediumSample( const MediumInteraction& mi , MediumSample& ms ) const override {}
+    void        EvaluateMediumSample( const float density , MediumSample& ms ) const override {}
+    Spectrum    EvaluateTransparency( const SurfaceInteraction& intersection ) const override { return 0.0f; }
+    void        BuildMaterial() override {}
+    StringID    GetUniqueID() const override { return m_id; }
+    bool        HasTransparency() const override { return false; }
+    bool        HasSSS() const override { return true; }
+    bool        HasVolumeAttached() const override { return false; }
+    float       GetVolumeStep() const override { return 0.0f; }
+    unsigned    GetVolumeStepCnt() const override { return 0u; }
+    Spectrum    GetEmission() const override { return 0.0f; }
+    void        Serialize( IStreamBase& stream ) override {}
+
+private:
+    const StringID  m_id;
+};
+
+TEST(BVH, BssrdfSpatialSplit) {
+    constexpr auto small_cnt = 1024u;
+    const BssrdfTestMaterial sss_material( StringID( "sss" ) );
+    const BssrdfTestMaterial other_material( StringID( "other" ) );
+
+    // a big triangle across the whole scene surrounded by small ones, spatial splits put it in lots of leaf nodes.
+    MeshVisual visual;
+    visual.m_memory = std::make_unique<Mesh>();
+    auto& mesh = *visual.m_memory;
+    const auto add_triangle = [&]( const Point& p0 , const Point& p1 , const Point& p2 , const MaterialBase* material ){
+        const Point points[] = { p0 , p1 , p2 };
+        MeshFaceIndex face;
+        for( auto k = 0 ; k < 3 ; ++k ){
+            face.m_id[k] = (int)mesh.m_vertices.size();
+            MeshVertex vertex;
+            vertex.m_position = points[k];
+            vertex.m_normal = Vector( 0.0f , 0.0f , 1.0f );
+            mesh.m_vertices.push_back( vertex );
+        }
+        face.m_mat = material;
+        mesh.m_indices.push_back( face );
+    };
+    add_triangle( Point( -10.0f , -10.0f , 0.0f ) , Point( 10.0f , -10.0f , 0.0f ) , Point( 0.0f , 10.0f , 0.0f ) , &sss_material );
+    for( auto i = 0u ; i < small_cnt ; ++i ){
+        const Point p( sort_canonical() * 20.0f - 10.0f , sort_canonical() * 20.0f - 10.0f , sort_canonical() * 20.0f - 10.0f );
+        const Vector d0( sort_canonical() - 0.5f , sort_canonical() - 0.5f , sort_canonical() - 0.5f );
+        const Vector d1( sort_canonical() - 0.5f , sort_canonical() - 0.5f , sort_canonical() - 0.5f );
+        add_triangle( p , p + d0 , p + d1 , &other_material );
+    }
+
+    // the index buffer is not touched anymore, triangles can safely refer to its faces.
+    std::vector<std::unique_ptr<Triangle>> triangles;
+    std::vector<std::unique_ptr<Primitive>> primitives;
+    std::vector<const Primitive*> primitive_list;
+    BBox bbox;
+    for( const auto& face : mesh.m_indices ){
+        triangles.push_back( std::make_unique<Triangle>( &visual , face ) );
+        primitives.push_back( std::make_unique<Primitive>( &mesh , face.m_mat , triangles.back().get() ) );
+        primitive_list.push_back( primitives.back().get() );
+        bbox.Union( primitives.back()->GetBBox() );
+    }
+
+    IMemoryStream config;
+    config << 16u << 4u << true << 1.0f << 1.5f;
+    OMemoryStream config_stream( config );
+    const auto qbvh = MakeUniqueInstance<Accelerator>( StringID( "Qbvh" ) );
+    ASSERT_NE( qbvh , nullptr );
+    qbvh->Serialize( config_stream );
+    qbvh->Build( primitive_list , bbox );
+
+    // any ray through the big triangle should hit it exactly once, no matter how many leaf nodes it is in.
+    for( auto i = 0u ; i < 1024u ; ++i ){
+        auto u = sort_canonical() , v = sort_canonical();
+        if( u + v > 1.0f ){
+            u = 1.0f - u;
+            v = 1.0f - v;
+        }
+        const auto target = Point( -10.0f , -10.0f , 0.0f ) + Vector( 20.0f , 0.0f , 0.0f ) * u + Vector( 10.0f , 20.0f , 0.0f ) * v;
+        const Point ori( sort_canonical() * 20.0f - 10.0f , sort_canonical() * 20.0f - 10.0f , 10.0f );
+        auto dir = target - ori;
+        const Ray ray( ori , dir.Normalize() );
+
+        BSSRDFIntersections intersect;
+        qbvh->GetIntersect( ray , intersect , sss_material.GetUniqueID() );
+        ASSERT_EQ( intersect.cnt , 1u );
+        EXPECT_EQ( intersect.intersections[0]->intersection.primitive , primitives[0].get() );
+        SORT_CLEAR_MEMPOOL();
+    }
+}
@@ -0,0 +1,144 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include <vector>
+#include "thirdparty/gtest/gtest.h"
+#include "light/lightbvh.h"
+#include "core/rand.h"
+#include "core/samplemethod.h"
+
+// Random lights scattered in a box, half of them are one-sided area lights facing random directions if needed.
+static std::vector<LightBounds> randomLights( unsigned cnt , bool one_sided ){
+    std::vector<LightBounds> lights( cnt );
+    for( auto i = 0u ; i < cnt ; ++i ){
+        auto& light = lights[i];
+        const Point p( sort_canonical() * 100.0f , sort_canonical() * 20.0f , sort_canonical() * 100.0f );
+        const Vector extent( sort_canonical() , 0.0f , sort_canonical() );
+        light.m_bbox = BBox( p , p + extent );
+        light.m_power = 0.1f + sort_canonical() * 10.0f;
+        if( one_sided && i % 2 ){
+            light.m_axis = normalize( Vector( sort_canonical() - 0.5f , sort_canonical() - 0.5f , sort_canonical() - 0.5f ) );
+            light.m_cosThetaO = 1.0f;
+            light.m_cosThetaE = 0.0f;
+        }else{
+            light.m_cosThetaO = -1.0f;
+            light.m_cosThetaE = 0.0f;
+        }
+    }
+    return lights;
+}
+
+// The probability of picking each light should match the one returned when sampling.
+static void checkPmf( const std::vector<LightBounds>& lights , bool one_sided ){
+    LightBVH bvh;
+    bvh.Build( lights );
+
+    for( auto k = 0 ; k < 16 ; ++k ){
+        const Point p( sort_canonical() * 100.0f , sort_canonical() * 20.0f , sort_canonical() * 100.0f );
+        const auto n = normalize( Vector( sort_canonical() - 0.5f , sort_canonical() - 0.5f , sort_canonical() - 0.5f ) );
+
+        // Some one-sided lights may face away from the shading point, it is possible that no light is picked since
+        // they are culled deep in the tree.
+        auto total = 0.0;
+        for( auto i = 0u ; i < lights.size() ; ++i )
+            total += bvh.Pmf( p , n , i );
+        if( one_sided )
+            EXPECT_LE( total , 1.0 + 1e-4 );
+        else
+            EXPECT_NEAR( total , 1.0 , 1e-4 );
+
+        for( auto i = 0 ; i < 1024 ; ++i ){
+            auto pmf = 0.0f;
+            const auto id = bvh.Sample( p , n , sort_canonical() , &pmf );
+            if( id < 0 ){
+                EXPECT_TRUE( one_sided );
+                continue;
+            }
+            EXPECT_GT( pmf , 0.0f );
+            EXPECT_NEAR( pmf , bvh.Pmf( p , n , id ) , pmf * 1e-4f );
+        }
+    }
+}
+
+TEST(LIGHT, LightBVHPmf) {
+    checkPmf( randomLights( 1000 , false ) , false );
+    checkPmf( randomLights( 1000 , true ) , true );
+}
+
+// Lights that can't contribute to the shading point should never be picked.
+TEST(LIGHT, LightBVHCulling) {
+    std::vector<LightBounds> lights( 2 );
+    for( auto& light : lights ){
+        light.m_bbox = BBox( Point( 0.0f , 10.0f , 0.0f ) , Point( 1.0f , 10.0f , 1.0f ) );
+        light.m_power = 1.0f;
+    }
+
+    // the first light faces the shading point, the second one faces away from it.
+    lights[0].m_axis = Vector( 0.0f , -1.0f , 0.0f );
+    lights[1].m_axis = Vector( 0.0f , 1.0f , 0.0f );
+
+    LightBVH bvh;
+    bvh.Build( lights );
+
+    const Point p( 0.5f , 0.0f , 0.5f );
+    const Vector n( 0.0f , 1.0f , 0.0f );
+    EXPECT_EQ( bvh.Pmf( p , n , 0 ) , 1.0f );
+    EXPECT_EQ( bvh.Pmf( p , n , 1 ) , 0.0f );
+    for( auto i = 0 ; i < 128 ; ++i ){
+        auto pmf = 0.0f;
+        EXPECT_EQ( bvh.Sample( p , n , sort_canonical() , &pmf ) , 0 );
+        EXPECT_EQ( pmf , 1.0f );
+    }
+}
+
+// Samples of a spherical triangle should all lie in it, they are also uniformly distributed w.r.t solid angle.
+TEST(LIGHT, SphericalTriangleSampling) {
+    const Point p( 0.3f , -0.2f , 0.1f );
+    const Point p0( -1.0f , 1.0f , -1.0f ) , p1( 2.0f , 1.5f , 0.0f ) , p2( 0.0f , 0.8f , 2.0f );
+    const auto a = normalize( p0 - p ) , b = normalize( p1 - p ) , c = normalize( p2 - p );
+    const auto area = SphericalTriangleArea( a , b , c );
+
+    // the solid angle of the sub-triangle made of p0, p1 and the middle point of the edge between p0 and p2
+    const auto ng = cross( p1 - p0 , p2 - p0 );
+    const auto pm = ( p0 + p2 ) * 0.5f;
+    const auto sub_area = SphericalTriangleArea( a , normalize( pm - p ) , b );
+    const auto sub_side = dot( cross( p1 - pm , p0 - pm ) , ng ) > 0.0f;
+
+    constexpr auto N = 1024 * 64;
+    auto sub_hits = 0u;
+    for( auto i = 0 ; i < N ; ++i ){
+        auto pdf = 0.0f;
+        const auto w = UniformSampleSphericalTriangle( a , b , c , ( i + sort_canonical() ) / N , sort_canonical() , &pdf );
+        EXPECT_NEAR( pdf , 1.0f / area , 1e-3f / area );
+        EXPECT_NEAR( w.Length() , 1.0f , 1e-4f );
+
+        // the direction should hit the triangle
+        const auto t = dot( p0 - p , ng ) / dot( w , ng );
+        ASSERT_GT( t , 0.0f );
+        const auto d = ( p + w * t ) - p0;
+        const auto u = dot( cross( d , p2 - p0 ) , ng ) / ng.SquaredLength();
+        const auto v = dot( cross( p1 - p0 , d ) , ng ) / ng.SquaredLength();
+        EXPECT_GE( u , -1e-3f );
+        EXPECT_GE( v , -1e-3f );
+        EXPECT_LE( u + v , 1.0f + 1e-3f );
+
+        // count the samples in the sub-triangle
+        if( ( dot( cross( p1 - pm , ( p + w * t ) - pm ) , ng ) > 0.0f ) == sub_side )
+            ++sub_hits;
+    }
+    EXPECT_NEAR( (float)sub_hits / N , sub_area / area , 0.01f );
+}
@@ -0,0 +1,130 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include <chrono>
+#include <vector>
+#include "thirdparty/gtest/gtest.h"
+#include "core/samplemethod.h"
+#include "core/rand.h"
+
+// Buckets should be picked as often as their weights suggest, the remapped canonical numbers are also uniformly distributed.
+TEST(SAMPLING, AliasTable) {
+    const float weights[] = { 1.0f , 0.0f , 7.0f , 2.0f , 0.5f , 3.5f };
+    constexpr auto cnt = sizeof( weights ) / sizeof( weights[0] );
+    AliasTable table( weights , cnt );
+    EXPECT_EQ( table.GetSum() , 14.0f );
+
+    constexpr auto N = 1024 * 256;
+    unsigned hits[cnt] = { 0 };
+    auto remapped_sum = 0.0;
+    for( auto i = 0 ; i < N ; ++i ){
+        auto pmf = 0.0f, remapped = 0.0f;
+        const auto id = table.Sample( ( i + sort_canonical() ) / N , &pmf , &remapped );
+        ASSERT_GE( id , 0 );
+        ASSERT_LT( id , (int)cnt );
+        EXPECT_EQ( pmf , table.GetProperty( id ) );
+        EXPECT_GE( remapped , 0.0f );
+        EXPECT_LT( remapped , 1.0f );
+        ++hits[id];
+        remapped_sum += remapped;
+    }
+
+    for( auto i = 0u ; i < cnt ; ++i ){
+        EXPECT_EQ( table.GetProperty( i ) , weights[i] / 14.0f );
+        EXPECT_NEAR( (float)hits[i] / N , weights[i] / 14.0f , 0.005f );
+    }
+    EXPECT_NEAR( remapped_sum / N , 0.5 , 0.005 );
+}
+
+// Sampling through the alias table should come with exactly the same pdf as the one through the cdf.
+TEST(SAMPLING, Distribution1DAlias) {
+    constexpr auto cnt = 1000u;
+    std::vector<float> weights( cnt );
+    for( auto& w : weights )
+        w = ( sort_canonical() < 0.1f ) ? 0.0f : sort_canonical() * 10.0f;
+    Distribution1D dist( weights.data() , cnt );
+
+    for( auto i = 0 ; i < 1024 * 16 ; ++i ){
+        const auto u = sort_canonical();
+
+        auto pdf = 0.0f;
+        const auto id = dist.SampleDiscreteAlias( u , &pdf );
+        ASSERT_GE( id , 0 );
+        ASSERT_LT( id , (int)cnt );
+        EXPECT_GT( weights[id] , 0.0f );
+        EXPECT_NEAR( pdf , dist.GetProperty( id ) , pdf * 1e-3f );
+
+        auto cpdf = 0.0f;
+        const auto x = dist.SampleContinuousAlias( u , &cpdf );
+        EXPECT_GE( x , 0.0f );
+        EXPECT_LT( x , 1.0f );
+        const auto bucket = std::min( (unsigned)( x * cnt ) , cnt - 1 );
+        EXPECT_NEAR( cpdf , dist.GetProperty( bucket ) * cnt , cpdf * 1e-3f );
+    }
+}
+
+// The pdf of two dimensional samples taken through alias tables should match the pdf of the distribution.
+TEST(SAMPLING, Distribution2DAlias) {
+    constexpr auto nu = 64u , nv = 32u;
+    std::vector<float> data( nu * nv );
+    for( auto& d : data )
+        d = sort_canonical() * sort_canonical();
+    Distribution2D dist( data.data() , nu , nv );
+
+    for( auto i = 0 ; i < 1024 * 16 ; ++i ){
+        float uv[2] , pdf = 0.0f;
+        dist.SampleContinuousAlias( sort_canonical() , sort_canonical() , uv , &pdf );
+        EXPECT_GE( uv[0] , 0.0f );
+        EXPECT_LT( uv[0] , 1.0f );
+        EXPECT_GE( uv[1] , 0.0f );
+        EXPECT_LT( uv[1] , 1.0f );
+        EXPECT_NEAR( pdf , dist.Pdf( uv[0] , uv[1] ) , pdf * 1e-3f );
+    }
+}
+
+// Micro benchmark comparing the throughput of sampling through the cdf and the alias table, it is only for profiling purpose.
+// Run it with '--gtest_also_run_disabled_tests --gtest_filter=SAMPLING.DISABLED_DistributionBenchmark'.
+TEST(SAMPLING, DISABLED_DistributionBenchmark) {
+    constexpr auto N = 1024 * 1024 * 4;
+    std::vector<float> us( N );
+    for( auto& u : us )
+        u = sort_canonical();
+
+    const auto measure = [&]( const char* name , unsigned cnt , auto&& sample ){
+        const auto start = std::chrono::high_resolution_clock::now();
+        auto checksum = 0.0;
+        for( const auto u : us )
+            checksum += sample( u );
+        const auto end = std::chrono::high_resolution_clock::now();
+        const auto seconds = std::chrono::duration<double>( end - start ).count();
+        printf( "%-24s %10u entries : %8.2f M samples per second\n" , name , cnt , N / seconds * 1e-6 );
+        EXPECT_GE( checksum , 0.0 );
+    };
+
+    for( auto cnt = 1024u ; cnt <= 1024u * 1024u * 16u ; cnt *= 16u ){
+        std::vector<float> weights( cnt );
+        for( auto& w : weights )
+            w = sort_canonical();
+        Distribution1D dist( weights.data() , cnt );
+
+        float pdf;
+        measure( "Discrete CDF" , cnt , [&]( float u ){ return dist.SampleDiscrete( u , &pdf ); } );
+        measure( "Discrete Alias" , cnt , [&]( float u ){ return dist.SampleDiscreteAlias( u , &pdf ); } );
+        measure( "Continuous CDF" , cnt , [&]( float u ){ return dist.SampleContinuous( u , &pdf ); } );
+        measure( "Continuous Alias" , cnt , [&]( float u ){ return dist.SampleContinuousAlias( u , &pdf ); } );
+    }
+}
@@ -49,6 +49,16 @@ TEST(SIMD_TEST, simd_set_ps) {
         EXPECT_EQ( simd_data[i] , data[i] );
 }
 
+TEST(SIMD_TEST, simd_set_u8_ps) {
+    unsigned char data[SIMD_CHANNEL];
+    for( auto i = 0 ; i < SIMD_CHANNEL ; ++i )
+        data[i] = (unsigned char)( 255 - 37 * i );
+
+    const auto simd_data = simd_set_u8_ps( data );
+    for( int i = 0 ; i < SIMD_CHANNEL ; ++i )
+        EXPECT_EQ( simd_data[i] , (float)data[i] );
+}
+
 TEST(SIMD_TEST, simd_set_mask) {
     bool data[SIMD_CHANNEL];
     for( auto i = 0 ; i < SIMD_CHANNEL ; ++i )
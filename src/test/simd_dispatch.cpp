@@ -0,0 +1,47 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+#include <cstring>
+#include "thirdparty/gtest/gtest.h"
+#include "simd/simd_dispatch.h"
+
+TEST(SIMD_DISPATCH, SupportedIsa) {
+    const auto isa = GetSupportedSimdIsa();
+
+    // The detected instruction set should never be lower than what the compiler already assumes.
+#if defined(__AVX512F__) && defined(__AVX512DQ__) && defined(__AVX512BW__) && defined(__AVX512VL__)
+    EXPECT_GE( isa , SIMD_ISA_AVX512 );
+#elif defined(__AVX2__) && defined(__FMA__)
+    EXPECT_GE( isa , SIMD_ISA_AVX2 );
+#elif defined(__SSE4_1__)
+    EXPECT_GE( isa , SIMD_ISA_SSE41 );
+#endif
+
+    // Detection is only done once, the result should not change.
+    EXPECT_EQ( isa , GetSupportedSimdIsa() );
+}
+
+TEST(SIMD_DISPATCH, IsaName) {
+    const SIMD_ISA isas[] = { SIMD_ISA_NONE , SIMD_ISA_SSE41 , SIMD_ISA_AVX2 , SIMD_ISA_AVX512 };
+    for( auto i : isas ){
+        EXPECT_NE( GetSimdIsaName( i ) , nullptr );
+        for( auto j : isas ){
+            if( i != j ){
+                EXPECT_NE( strcmp( GetSimdIsaName( i ) , GetSimdIsaName( j ) ) , 0 );
+            }
+        }
+    }
+}
@@ -18,6 +18,9 @@
 #include "thirdparty/gtest/gtest.h"
 #include "stream/fstream.h"
 #include "stream/mstream.h"
+#include "stream/mmapstream.h"
+#include "stream/hstream.h"
+#include "core/diskcache.h"
 #include "core/rand.h"
 
 #define STREAM_SAMPLE_COUNT 10000
@@ -101,4 +104,155 @@ TEST(STREAM, MemoryStream) {
         EXPECT_EQ(t1, vec_i[i]);
         EXPECT_EQ(t2, vec_u[i]);
     }
-}
\ No newline at end of file
+}
+TEST(STREAM, MappedFileStream) {
+    std::vector<float>           vec_f;
+    std::vector<int>             vec_i;
+    std::vector<unsigned int>    vec_u;
+    OFileStream ofile("test_mapped.bin");
+    std::string str = "this is a random string";
+    ofile<<str;
+    bool flag = true;
+    ofile<<flag;
+    std::string empty_str = "";
+    ofile<<empty_str;
+    for (unsigned i = 0; i < STREAM_SAMPLE_COUNT; ++i) {
+        vec_f.push_back( sort_canonical() );
+        vec_i.push_back( (int)( ( 2.0f * sort_canonical() - 1.0f ) * STREAM_SAMPLE_COUNT ) );
+        vec_u.push_back( (unsigned int)( sort_canonical() * STREAM_SAMPLE_COUNT ) );
+        ofile << vec_f.back() << vec_i.back() ;
+        ofile << vec_u.back();
+    }
+    ofile.Write( (char*)vec_f.data() , (int)( vec_f.size() * sizeof(float) ) );
+    ofile.Close();
+
+    IMappedFileStream ifile("test_mapped.bin");
+    std::string str_copy;
+    ifile>>str_copy;
+    EXPECT_EQ( str_copy , str );
+    bool flag_copy = false;
+    ifile>>flag_copy;
+    EXPECT_EQ( flag_copy , flag );
+    std::string empty_str_copy;
+    ifile>>empty_str_copy;
+    EXPECT_EQ( empty_str_copy , empty_str );
+    for (int i = 0; i < STREAM_SAMPLE_COUNT; ++i) {
+        float t0 = 0.0f;
+        int t1 = 0;
+        unsigned int t2 = 0;
+        ifile >> t0 >> t1 >> t2;
+        EXPECT_EQ(t0, vec_f[i]);
+        EXPECT_EQ(t1, vec_i[i]);
+        EXPECT_EQ(t2, vec_u[i]);
+    }
+
+    // the bulk data can be accessed directly without copying
+    const auto data = ifile.Map( vec_f.size() * sizeof(float) );
+    ASSERT_NE( data , nullptr );
+    EXPECT_EQ( 0 , memcmp( data , vec_f.data() , vec_f.size() * sizeof(float) ) );
+
+    // nothing is left in the file
+    EXPECT_EQ( nullptr , ifile.Map( 1 ) );
+    float t = 1.0f;
+    ifile >> t;
+    EXPECT_EQ( 0.0f , t );
+}
+
+TEST(STREAM, MemoryViewStream) {
+    std::vector<unsigned int> vec_u;
+    for (unsigned i = 0; i < STREAM_SAMPLE_COUNT; ++i)
+        vec_u.push_back( (unsigned int)( sort_canonical() * STREAM_SAMPLE_COUNT ) );
+
+    // two separate views of the same memory, each of them only sees its own half
+    const auto half = vec_u.size() / 2;
+    IMemoryViewStream view0( (const char*)vec_u.data() , half * sizeof(unsigned int) );
+    IMemoryViewStream view1( (const char*)( vec_u.data() + half ) , ( vec_u.size() - half ) * sizeof(unsigned int) );
+    for (auto i = 0u; i < vec_u.size(); ++i) {
+        unsigned int t = 0;
+        ( i < half ? view0 : view1 ) >> t;
+        EXPECT_EQ(t, vec_u[i]);
+    }
+    EXPECT_EQ( view0.Tell() , view0.Size() );
+    EXPECT_EQ( view1.Tell() , view1.Size() );
+
+    // reading beyond the view doesn't touch the memory next to it
+    unsigned int t = 1;
+    view0 >> t;
+    EXPECT_EQ( 0u , t );
+    EXPECT_EQ( nullptr , view0.Map( 1 ) );
+}
+
+TEST(STREAM, HashStream) {
+    std::vector<float> vec_f;
+    for (unsigned i = 0; i < STREAM_SAMPLE_COUNT; ++i)
+        vec_f.push_back( sort_canonical() );
+
+    // the same data results in the same hash, no matter it is streamed in one go or not
+    OHashStream hash0 , hash1;
+    for (const auto f : vec_f)
+        hash0 << f;
+    hash1.Write( (char*)vec_f.data() , (int)( vec_f.size() * sizeof(float) ) );
+    EXPECT_EQ( hash0.GetHash() , hash1.GetHash() );
+
+    // hashing can continue from a previous hash
+    OHashStream hash2( hash0.GetHash() );
+    hash0 << std::string( "hello" ) << 1u;
+    hash2 << std::string( "hello" ) << 1u;
+    EXPECT_EQ( hash0.GetHash() , hash2.GetHash() );
+
+    // any change in the data results in a different hash
+    OHashStream hash3 , hash4;
+    hash3 << std::string( "ab" ) << std::string( "c" );
+    hash4 << std::string( "a" ) << std::string( "bc" );
+    EXPECT_NE( hash3.GetHash() , hash4.GetHash() );
+    vec_f[STREAM_SAMPLE_COUNT / 2] += 1.0f;
+    OHashStream hash5;
+    hash5.Write( (char*)vec_f.data() , (int)( vec_f.size() * sizeof(float) ) );
+    EXPECT_NE( hash1.GetHash() , hash5.GetHash() );
+}
+
+TEST(STREAM, DiskCache) {
+    // an object caching a buffer of plain data
+    struct CachedBuffer : public SerializableObject {
+        std::vector<Point>  m_data;
+        void Serialize( IStreamBase& stream ) override {
+            SerializeBuffer( stream , m_data );
+        }
+        void Serialize( OStreamBase& stream ) override {
+            SerializeBuffer( stream , m_data );
+        }
+    };
+
+    CachedBuffer buffer;
+    for (unsigned i = 0; i < STREAM_SAMPLE_COUNT; ++i)
+        buffer.m_data.push_back( Point( sort_canonical() , sort_canonical() , sort_canonical() ) );
+
+    auto& cache = DiskCache::GetSingleton();
+    cache.SetDirectory( "test_disk_cache" );
+    ASSERT_TRUE( cache.IsEnabled() );
+
+    const std::uint64_t key = 0x0123456789abcdefull;
+    EXPECT_TRUE( cache.Save( "test" , key , buffer ) );
+
+    CachedBuffer loaded;
+    auto stream = cache.Load( "test" , key );
+    ASSERT_NE( stream , nullptr );
+    loaded.Serialize( *stream );
+    ASSERT_EQ( loaded.m_data.size() , buffer.m_data.size() );
+    for (auto i = 0u; i < buffer.m_data.size(); ++i)
+        EXPECT_EQ( loaded.m_data[i] , buffer.m_data[i] );
+
+    // nothing is cached for a different key or category
+    EXPECT_EQ( nullptr , cache.Load( "test" , key + 1 ) );
+    EXPECT_EQ( nullptr , cache.Load( "other" , key ) );
+
+    // a buffer with a different layout is not loaded
+    std::vector<float> floats;
+    stream = cache.Load( "test" , key );
+    ASSERT_NE( stream , nullptr );
+    EXPECT_FALSE( SerializeBuffer( *stream , floats ) );
+
+    cache.SetDirectory( "" );
+    EXPECT_FALSE( cache.IsEnabled() );
+    EXPECT_EQ( nullptr , cache.Load( "test" , key ) );
+}
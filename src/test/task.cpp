@@ -0,0 +1,208 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+*/
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "core/define.h"
+#include "thirdparty/gtest/gtest.h"
+#include "task/task.h"
+#include "task/render_task.h"
+#include "unittest_common.h"
+
+TEST(Task, TaskGroupNestedFork) {
+    std::atomic<int> cnt = { 0 };
+
+    // fork tasks that fork more tasks in the same group
+    TaskGroup task_group;
+    for( auto i = 0 ; i < 16 ; ++i ){
+        task_group.Fork( [&](){
+            for( auto j = 0 ; j < 16 ; ++j )
+                task_group.Fork( [&](){ ++cnt; } );
+            ++cnt;
+        });
+    }
+    task_group.Wait();
+
+    // all tasks, including the nested ones, should be finished by now
+    EXPECT_EQ( 16 * 16 + 16 , cnt );
+}
+
+TEST(Task, TaskGroupMultiThread) {
+    std::atomic<int> cnt = { 0 };
+
+    // multiple threads forking tasks in their own task groups and helping each other
+    ParrallRun<8, 16>( [&](){
+        TaskGroup task_group;
+        for( auto i = 0 ; i < 64 ; ++i )
+            task_group.Fork( [&](){ ++cnt; } );
+        task_group.Wait();
+    });
+
+    EXPECT_EQ( 8 * 16 * 64 , cnt );
+}
+
+TEST(Task, DependencyOrder) {
+    std::mutex mutex;
+    std::vector<int> order;
+    auto record = [&]( int i ){
+        std::lock_guard<std::mutex> lock(mutex);
+        order.push_back( i );
+    };
+
+    // a diamond shaped graph, 'd' depends on both 'b' and 'c', which depend on 'a'
+    auto a = SCHEDULE_TASK<Lambda_Task>( "a" , DEFAULT_TASK_PRIORITY , {} , [&](){ record(0); } );
+    auto b = SCHEDULE_TASK<Lambda_Task>( "b" , DEFAULT_TASK_PRIORITY , {a} , [&](){ record(1); } );
+    auto c = SCHEDULE_TASK<Lambda_Task>( "c" , DEFAULT_TASK_PRIORITY , {a} , [&](){ record(1); } );
+    SCHEDULE_TASK<Lambda_Task>( "d" , DEFAULT_TASK_PRIORITY , {b, c} , [&](){ record(2); } );
+
+    // multiple threads executing tasks, all of them should quit once the graph is done
+    std::thread threads[4];
+    for( auto& thread : threads )
+        thread = std::thread( EXECUTING_TASKS );
+    EXECUTING_TASKS();
+    for( auto& thread : threads )
+        thread.join();
+
+    std::vector<int> expected = { 0 , 1 , 1 , 2 };
+    EXPECT_EQ( expected , order );
+}
+
+TEST(Task, DependencyMultiThread) {
+    constexpr int chain_cnt = 64;
+    constexpr int chain_len = 64;
+    std::atomic<int> cnt = { 0 };
+    std::atomic<int> broken = { 0 };
+    int progress[chain_cnt] = { 0 };
+
+    // a lot of task chains, each task should only be executed after the previous one in its chain is finished
+    for( auto i = 0 ; i < chain_cnt ; ++i ){
+        const Task* prev = nullptr;
+        for( auto j = 0 ; j < chain_len ; ++j ){
+            Task::Task_Container deps;
+            if( prev )
+                deps.insert( prev );
+            prev = SCHEDULE_TASK<Lambda_Task>( "chain" , DEFAULT_TASK_PRIORITY - j , deps , [&, i, j](){
+                if( progress[i] != j )
+                    ++broken;
+                progress[i] = j + 1;
+                ++cnt;
+            });
+        }
+    }
+
+    std::thread threads[7];
+    for( auto& thread : threads )
+        thread = std::thread( EXECUTING_TASKS );
+    EXECUTING_TASKS();
+    for( auto& thread : threads )
+        thread.join();
+
+    EXPECT_EQ( chain_cnt * chain_len , cnt );
+    EXPECT_EQ( 0 , broken );
+}
+
+// Each worker thread pushes tasks into its own queue through 'spawn', then only one of them executes all available tasks until 'done' returns true.
+static void RunFromWorkerQueues( int thread_cnt , const std::function<void(int)>& spawn , const std::function<bool()>& done ){
+    std::atomic<int> arrived = { 0 };
+    std::atomic<int> spawned = { 0 };
+    std::atomic<bool> finished = { false };
+
+    for( auto i = 0 ; i < thread_cnt ; ++i ){
+        SCHEDULE_TASK<Lambda_Task>( "spawner" , DEFAULT_TASK_PRIORITY , {} , [&, i](){
+            // make sure every worker thread is running a spawner so that no spawner is left in the queues
+            ++arrived;
+            while( arrived < thread_cnt )
+                std::this_thread::yield();
+
+            spawn( i );
+            ++spawned;
+            while( spawned < thread_cnt )
+                std::this_thread::yield();
+
+            if( 0 == i ){
+                while( !done() ){
+                    auto task = Scheduler::GetSingleton().TryPickTask();
+                    if( IS_PTR_VALID(task) )
+                        task->ExecuteTask();
+                }
+                finished = true;
+            }
+            while( !finished )
+                std::this_thread::yield();
+        });
+    }
+
+    // worker threads with different ids push tasks to different queues
+    std::vector<std::unique_ptr<WorkerThread>> threads;
+    for( auto i = 0 ; i < thread_cnt ; ++i ){
+        threads.push_back( std::make_unique<WorkerThread>( i + 1 ) );
+        threads.back()->BeginThread();
+    }
+    for( auto& thread : threads )
+        thread->Join();
+}
+
+TEST(Task, PriorityAcrossQueues) {
+    constexpr int thread_cnt = 4;
+    constexpr int task_cnt = 64;
+    std::vector<unsigned int> order;
+
+    // tasks with interleaved priorities in different queues
+    RunFromWorkerQueues( thread_cnt , [&]( int i ){
+        for( auto j = 0 ; j < task_cnt ; ++j ){
+            const auto priority = (unsigned int)( j * thread_cnt + i );
+            SCHEDULE_TASK<Lambda_Task>( "task" , priority , {} , [&, priority](){ order.push_back( priority ); } );
+        }
+    } , [&](){ return (int)order.size() == thread_cnt * task_cnt; } );
+
+    // tasks should be executed in the order of their priorities even if they are in different queues
+    ASSERT_EQ( thread_cnt * task_cnt , (int)order.size() );
+    for( auto i = 1 ; i < thread_cnt * task_cnt ; ++i )
+        EXPECT_GT( order[i-1] , order[i] );
+}
+
+TEST(Task, RenderPassOrder) {
+    constexpr int thread_cnt = 4;
+    constexpr unsigned tile_cnt = 16;
+    constexpr unsigned pass_cnt = 4;
+    std::vector<std::pair<unsigned,unsigned>> order;
+
+    // each tile schedules its next pass once its current pass is done, just like render tasks with adaptive sampling
+    std::function<void(unsigned,unsigned)> schedule_pass = [&]( unsigned rank , unsigned pass ){
+        const auto priority = Render_Task::PassPriority( rank , pass , tile_cnt , pass_cnt );
+        SCHEDULE_TASK<Lambda_Task>( "pass" , priority , {} , [&, rank, pass](){
+            order.push_back( std::make_pair( pass , rank ) );
+            if( pass + 1 < pass_cnt )
+                schedule_pass( rank , pass + 1 );
+        });
+    };
+
+    // first passes of the tiles are spread across queues
+    RunFromWorkerQueues( thread_cnt , [&]( int i ){
+        for( auto rank = (unsigned)i ; rank < tile_cnt ; rank += thread_cnt )
+            schedule_pass( rank , 0 );
+    } , [&](){ return order.size() == tile_cnt * pass_cnt; } );
+
+    // no tile should start a pass before all tiles are done with the previous pass, tiles in a pass follow their rank
+    ASSERT_EQ( tile_cnt * pass_cnt , order.size() );
+    for( auto i = 0u ; i < tile_cnt * pass_cnt ; ++i )
+        EXPECT_EQ( std::make_pair( i / tile_cnt , i % tile_cnt ) , order[i] );
+}
@@ -0,0 +1,249 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include <thread>
+#include <vector>
+#include "thirdparty/gtest/gtest.h"
+#include "texture/texturecache.h"
+#include "texture/texelformat.h"
+#include "texture/imagetexture2d.h"
+#include "thirdparty/tiny_exr/tinyexr.h"
+#include "medium/mediumdata.h"
+#include "stream/fstream.h"
+#include "math/point.h"
+#include "core/rand.h"
+
+#define TEXTURE_TILE_COUNT 1024
+
+// Tiles of different texel formats have different sizes, the cache is expected to handle both of them.
+static unsigned tileSize( unsigned k ){
+    return TEXTURE_TILE_TEXEL_CNT * TexelSize( ( k % 2 ) ? TEXEL_RGBA8 : TEXEL_RGBA32F );
+}
+
+// Fill a tile with values that can be verified later.
+static void fillTile( TextureTile& tile , unsigned k ){
+    for( auto i = 0u ; i < tile.GetSize() ; ++i )
+        tile.GetData()[i] = (unsigned char)( k * 7 + i * 3 );
+}
+
+// Check whether a tile holds the values filled before.
+static bool checkTile( const TextureTile& tile , unsigned k ){
+    if( tile.GetSize() != tileSize( k ) )
+        return false;
+    for( auto i = 0u ; i < tile.GetSize() ; ++i )
+        if( tile.GetData()[i] != (unsigned char)( k * 7 + i * 3 ) )
+            return false;
+    return true;
+}
+
+// Tiles should be paged in correctly even if the cache is way smaller than all tiles.
+TEST(TEXTURE, TextureCache) {
+    auto& cache = TextureCache::GetSingleton();
+    const auto capacity = cache.GetCapacity();
+    cache.SetCapacity( 128 * tileSize( 0 ) );
+
+    std::vector<TextureTileHandle> handles( TEXTURE_TILE_COUNT );
+    for( auto k = 0u ; k < TEXTURE_TILE_COUNT ; ++k ){
+        TextureTile tile( tileSize( k ) );
+        fillTile( tile , k );
+        handles[k] = cache.StoreTile( tile );
+    }
+
+    // looking up tiles in multiple rounds makes sure evicted tiles are paged in again.
+    for( auto round = 0 ; round < 3 ; ++round ){
+        for( auto k = 0u ; k < TEXTURE_TILE_COUNT ; ++k ){
+            const auto index = ( k * 31 + round ) % TEXTURE_TILE_COUNT;
+            EXPECT_TRUE( checkTile( *cache.GetTile( handles[index] ) , index ) );
+        }
+    }
+
+    cache.SetCapacity( capacity );
+}
+
+// Multiple threads looking up the same set of tiles at the same time.
+TEST(TEXTURE, TextureCacheMultiThread) {
+    auto& cache = TextureCache::GetSingleton();
+    const auto capacity = cache.GetCapacity();
+    cache.SetCapacity( 128 * tileSize( 0 ) );
+
+    std::vector<TextureTileHandle> handles( TEXTURE_TILE_COUNT );
+    for( auto k = 0u ; k < TEXTURE_TILE_COUNT ; ++k ){
+        TextureTile tile( tileSize( k ) );
+        fillTile( tile , k );
+        handles[k] = cache.StoreTile( tile );
+    }
+
+    std::atomic<int> failures( 0 );
+    std::vector<std::thread> threads;
+    for( auto t = 0u ; t < 8 ; ++t ){
+        threads.push_back( std::thread( [&,t](){
+            for( auto k = 0u ; k < TEXTURE_TILE_COUNT ; ++k ){
+                const auto index = ( k * 17 + t * 101 ) % TEXTURE_TILE_COUNT;
+                if( !checkTile( *cache.GetTile( handles[index] ) , index ) )
+                    ++failures;
+            }
+        } ) );
+    }
+    for( auto& thread : threads )
+        thread.join();
+
+    EXPECT_EQ( failures , 0 );
+
+    cache.SetCapacity( capacity );
+}
+
+// 8 bit texels are lossless for LDR values, compact HDR formats are within their precision.
+TEST(TEXTURE, TexelFormat) {
+    unsigned char data[16];
+    float rgba[4];
+    for( auto i = 0 ; i < 256 ; ++i ){
+        const float value[4] = { (float)i / 255.0f , (float)( 255 - i ) / 255.0f , 0.0f , 1.0f };
+        EncodeTexel( TEXEL_RGBA8 , value , data );
+        DecodeTexel( TEXEL_RGBA8 , data , rgba );
+        for( auto c = 0 ; c < 4 ; ++c )
+            EXPECT_EQ( rgba[c] , value[c] );
+    }
+
+    for( auto i = 0 ; i < 1024 ; ++i ){
+        const auto x = std::ldexp( 1.0f + (float)i / 1024.0f , i % 32 - 16 );
+        const float value[4] = { x , x * 0.5f , x * 0.25f , 1.0f };
+
+        EncodeTexel( TEXEL_RGBA16F , value , data );
+        DecodeTexel( TEXEL_RGBA16F , data , rgba );
+        for( auto c = 0 ; c < 4 ; ++c )
+            EXPECT_NEAR( rgba[c] , value[c] , value[c] / 1024.0f + 1e-7f );
+
+        // the precision of all channels is bounded by the largest channel in the shared exponent format.
+        EncodeTexel( TEXEL_RGB9E5 , value , data );
+        DecodeTexel( TEXEL_RGB9E5 , data , rgba );
+        for( auto c = 0 ; c < 3 ; ++c )
+            EXPECT_NEAR( rgba[c] , value[c] , value[0] / 256.0f + 1e-7f );
+        EXPECT_EQ( rgba[3] , 1.0f );
+    }
+}
+
+// Bilinear filtering decodes texels of all formats in registers, it should match filtering the decoded texels.
+TEST(TEXTURE, BilinearTexelFormat) {
+    constexpr int w = 200;
+    constexpr int h = 131;
+
+    // some texels are tiny so that they are subnormal in half precision.
+    std::vector<float> texels( w * h * 3 );
+    for( auto i = 0u ; i < texels.size() ; ++i )
+        texels[i] = ( sort_canonical() * 5.0f - 2.0f ) * ( ( i % 7 ) ? 1.0f : 1e-6f );
+    ASSERT_EQ( SaveEXR( texels.data() , w , h , 3 , false , "test_bilinear.exr" ) , TINYEXR_SUCCESS );
+
+    auto& cache = TextureCache::GetSingleton();
+    const auto mode = cache.GetStorageMode();
+
+    // full precision, half precision and shared exponent texels
+    for( auto storage : { TSM_FULL_PRECISION , TSM_HALF_PRECISION , TSM_SHARED_EXPONENT } ){
+        cache.SetStorageMode( storage );
+        ImageTexture2D texture;
+        ASSERT_TRUE( texture.LoadResource( "test_bilinear.exr" ) );
+
+        for( auto i = 0 ; i < 4096 ; ++i ){
+            // texture coordinates out of range are wrapped, footprints crossing tiles are covered too.
+            const auto u = sort_canonical() * 3.0f - 1.0f;
+            const auto v = sort_canonical() * 3.0f - 1.0f;
+            const auto fu = u * w - 0.5f;
+            const auto fv = v * h - 0.5f;
+            const auto x = (int)floor( fu );
+            const auto y = (int)floor( fv );
+            const auto du = fu - x;
+            const auto dv = fv - y;
+            const auto expected = texture.GetColor( x , y ) * ( 1.0f - du ) * ( 1.0f - dv ) + texture.GetColor( x + 1 , y ) * du * ( 1.0f - dv ) +
+                                  texture.GetColor( x , y + 1 ) * ( 1.0f - du ) * dv + texture.GetColor( x + 1 , y + 1 ) * du * dv;
+
+            const auto color = texture.GetSampler().SampleColor( u , v );
+            for( auto c = 0 ; c < 3 ; ++c )
+                EXPECT_NEAR( color.data[c] , expected.data[c] , 1e-6f * ( 1.0f + fabs( expected.data[c] ) ) );
+        }
+    }
+
+    cache.SetStorageMode( mode );
+}
+
+// Dense trilinear filtering as the reference of the sparse 3D texture, it clamps texels to the edge the same way.
+static float denseSample( const std::vector<float>& texels , int w , int h , int d , float u , float v , float s ){
+    if( u < 0.0f || u >= 1.0f || v < 0.0f || v >= 1.0f || s < 0.0f || s >= 1.0f )
+        return 0.0f;
+    const float f[3] = { u * w - 0.5f , v * h - 0.5f , s * d - 0.5f };
+    const int   res[3] = { w , h , d };
+    int i0[3], i1[3];
+    float t[3];
+    for( auto i = 0 ; i < 3 ; ++i ){
+        i0[i] = (int)(unsigned)f[i];
+        i1[i] = std::min( i0[i] + 1 , res[i] - 1 );
+        t[i] = f[i] - i0[i];
+    }
+    const auto texel = [&]( int x , int y , int z ){ return texels[ ( z * h + y ) * w + x ]; };
+    const auto t0 = slerp( texel( i0[0] , i0[1] , i0[2] ) , texel( i1[0] , i0[1] , i0[2] ) , t[0] );
+    const auto t1 = slerp( texel( i0[0] , i0[1] , i1[2] ) , texel( i1[0] , i0[1] , i1[2] ) , t[0] );
+    const auto t2 = slerp( texel( i0[0] , i1[1] , i0[2] ) , texel( i1[0] , i1[1] , i0[2] ) , t[0] );
+    const auto t3 = slerp( texel( i0[0] , i1[1] , i1[2] ) , texel( i1[0] , i1[1] , i1[2] ) , t[0] );
+    return slerp( slerp( t0 , t2 , t[1] ) , slerp( t1 , t3 , t[1] ) , t[2] );
+}
+
+// Sparse 3D texture should match the dense one, while empty bricks take no memory.
+TEST(TEXTURE, SparseTexture3D) {
+    // a ball of density in a volume whose size is not a multiple of the brick size
+    const int w = 37, h = 21, d = 29;
+    std::vector<float> texels( w * h * d , 0.0f );
+    for( auto z = 0 ; z < d ; ++z )
+        for( auto y = 0 ; y < h ; ++y )
+            for( auto x = 0 ; x < w ; ++x ){
+                const auto dx = x - 26.0f , dy = y - 12.0f , dz = z - 17.0f;
+                texels[ ( z * h + y ) * w + x ] = std::max( 0.0f , 9.0f - std::sqrt( dx * dx + dy * dy + dz * dz ) );
+            }
+
+    {
+        OFileStream ofile( "test_volume.bin" );
+        ofile << (unsigned)w << (unsigned)h << (unsigned)d;
+        ofile.Write( (char*)texels.data() , (int)( texels.size() * sizeof( float ) ) );
+    }
+
+    MediumDensity density;
+    IFileStream ifile( "test_volume.bin" );
+    density.Serialize( ifile );
+
+    auto empty_cnt = 0u;
+    for( auto z = 0u ; z < density.GetBrickRes(2) ; ++z )
+        for( auto y = 0u ; y < density.GetBrickRes(1) ; ++y )
+            for( auto x = 0u ; x < density.GetBrickRes(0) ; ++x )
+                empty_cnt += density.IsBrickEmpty( x , y , z ) ? 1 : 0;
+    EXPECT_GT( empty_cnt , 0u );
+    EXPECT_LT( density.GetMemoryUsage() , texels.size() * sizeof( float ) );
+
+    for( auto z = 0 ; z < d ; ++z )
+        for( auto y = 0 ; y < h ; ++y )
+            for( auto x = 0 ; x < w ; ++x )
+                EXPECT_EQ( density.ImageTexture3D<float>::Sample( x , y , z ) , texels[ ( z * h + y ) * w + x ] );
+
+    for( auto i = 0 ; i < 100000 ; ++i ){
+        const Point uvw( sort_canonical() , sort_canonical() , sort_canonical() );
+        const auto expected = denseSample( texels , w , h , d , uvw[0] , uvw[1] , uvw[2] );
+        EXPECT_NEAR( density.Sample( uvw ) , expected , 1e-5f );
+
+        // the density bound of the cell has to cover the filtered density
+        const auto& bound = density.GetCellBound( (unsigned)( uvw[0] * w ) / DENSITY_BOUND_CELL_SIZE ,
+                                                  (unsigned)( uvw[1] * h ) / DENSITY_BOUND_CELL_SIZE ,
+                                                  (unsigned)( uvw[2] * d ) / DENSITY_BOUND_CELL_SIZE );
+        EXPECT_LE( expected , bound.m_max + 1e-5f );
+        EXPECT_GE( expected , bound.m_min - 1e-5f );
+    }
+}
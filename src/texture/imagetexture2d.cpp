@@ -16,9 +16,21 @@
  */
 
 #include <regex>
+#include <cstring>
+#include <algorithm>
 #include "imagetexture2d.h"
 #include "core/sassert.h"
 
+// SSE2 is part of x86-64, texels are always filtered four channels at a time there, even without SSE_ENABLED.
+#if defined(SSE_ENABLED) || defined(AVX_ENABLED) || defined(__SSE2__) || defined(_M_X64)
+#define TEXTURE_SSE_FILTERING
+#include <emmintrin.h>
+#endif
+
+#if defined(AVX_ENABLED) || defined(__F16C__)
+#include <immintrin.h>
+#endif
+
 #define TINYEXR_IMPLEMENTATION
 #include "thirdparty/tiny_exr/tinyexr.h"
 
@@ -27,125 +39,450 @@
 
 Spectrum ImageTexture2D::GetColor( int x , int y ) const{
     // if there is no image, just crash
-    sAssertMsg(IS_PTR_VALID(m_memory) && IS_PTR_VALID(m_memory->m_rgb) , IMAGE , "Texture %s not loaded!" , m_name.c_str() );
-
-    // filter the texture coordinate
-    texCoordFilter( x , y );
+    sAssertMsg(!m_levels.empty() , IMAGE , "Texture %s not loaded!" , m_name.c_str() );
 
-    // get the offset
-    int offset = ( m_iTexHeight - 1 - y ) * m_iTexWidth + x;
-
-    // get the color
-    return m_memory->m_rgb[ offset ];
+    float rgba[TEXTURE_TILE_CHANNEL];
+    texel( m_levels[0] , x , y , rgba );
+    return Spectrum( rgba[0] , rgba[1] , rgba[2] );
 }
 
 float ImageTexture2D::GetAlpha( int x , int y ) const{
     // if there is no image, just crash
-    sAssertMsg(IS_PTR_VALID(m_memory), IMAGE , "Texture %s not loaded!" , m_name.c_str() );
+    sAssertMsg(!m_levels.empty() , IMAGE , "Texture %s not loaded!" , m_name.c_str() );
 
     // in case of acquiring alpha value in a texture without this channel, 1.0 is returned by default.
-    if(IS_PTR_INVALID(m_memory->m_a))
+    if( !m_hasAlpha )
         return 1.0f;
 
-    // filter the texture coordinate
-    texCoordFilter( x , y );
+    float rgba[TEXTURE_TILE_CHANNEL];
+    texel( m_levels[0] , x , y , rgba );
+    return rgba[3];
+}
 
-    // get the offset
-    int offset = ( m_iTexHeight - 1 - y ) * m_iTexWidth + x;
+Spectrum ImageTexture2D::GetColorFromUV( float u , float v ) const{
+    float rgba[TEXTURE_TILE_CHANNEL];
+    m_sampleFunc( *this , 0 , &u , &v , 1 , rgba );
+    return Spectrum( rgba[0] , rgba[1] , rgba[2] );
+}
 
-    // get the color
-    return m_memory->m_a[ offset ];
+Spectrum ImageTexture2D::GetColorFromUV( float u , float v , float footprint ) const{
+    float rgba[TEXTURE_TILE_CHANNEL];
+    trilinear( u , v , footprint , rgba );
+    return Spectrum( rgba[0] , rgba[1] , rgba[2] );
 }
 
-// load image from file
-bool ImageTexture2D::LoadResource( const std::string str ){
-    static const std::regex exr_reg(".*\\.exr$", std::regex_constants::icase);
+float ImageTexture2D::GetAlphaFromtUV( float u , float v ) const{
+    if( !m_hasAlpha )
+        return 1.0f;
 
-    m_memory = std::make_unique<ImgMemory>();
-    m_name = str;
-    if (std::regex_match(m_name, exr_reg)) {
-        float* out = nullptr;
-        const char* err;
+    float rgba[TEXTURE_TILE_CHANNEL];
+    m_sampleFunc( *this , 0 , &u , &v , 1 , rgba );
+    return rgba[3];
+}
 
-        const auto ret = LoadEXR(&out, &m_iTexWidth, &m_iTexHeight, m_name.c_str(), &err);
+float ImageTexture2D::GetAlphaFromtUV( float u , float v , float footprint ) const{
+    if( !m_hasAlpha )
+        return 1.0f;
 
-        if (ret >= 0) {
-            const auto total = m_iTexWidth * m_iTexHeight;
-            m_memory->m_rgb = std::make_unique<Spectrum[]>(total);
-            for (auto i = 0; i < total; i++)
-                m_memory->m_rgb[i] = Spectrum(out[4 * i], out[4 * i + 1], out[4 * i + 2]);
+    float rgba[TEXTURE_TILE_CHANNEL];
+    trilinear( u , v , footprint , rgba );
+    return rgba[3];
+}
 
-            free(out);
+void ImageTexture2D::texel( const MipLevel& level , int x , int y , float* rgba ) const{
+    texCoordFilter( x , y , level.m_width , level.m_height );
 
-            average();
-            return true;
-        }
+    const auto tile = TextureCache::GetSingleton().GetTile( level.m_tiles[ ( y / TEXTURE_TILE_SIZE ) * level.m_tileCntX + x / TEXTURE_TILE_SIZE ] );
+    const auto offset = ( ( y % TEXTURE_TILE_SIZE ) * TEXTURE_TILE_STRIDE + x % TEXTURE_TILE_SIZE ) * TexelSize( m_format );
+    DecodeTexel( m_format , tile->GetData() + offset , rgba );
+}
+
+#if defined(TEXTURE_SSE_FILTERING)
+// Bilinear interpolation of a 2x2 footprint of decoded texels.
+SORT_STATIC_FORCEINLINE void lerpTexels( __m128 t00 , __m128 t10 , __m128 t01 , __m128 t11 , float du , float dv , float* rgba ){
+    const auto sdu = _mm_set1_ps( du );
+    const auto r0 = _mm_add_ps( t00 , _mm_mul_ps( _mm_sub_ps( t10 , t00 ) , sdu ) );
+    const auto r1 = _mm_add_ps( t01 , _mm_mul_ps( _mm_sub_ps( t11 , t01 ) , sdu ) );
+    _mm_storeu_ps( rgba , _mm_add_ps( r0 , _mm_mul_ps( _mm_sub_ps( r1 , r0 ) , _mm_set1_ps( dv ) ) ) );
+}
+
+// Convert four half floats in the lower 64 bits to floats, it matches 'HalfToFloat' exactly, including subnormals,
+// infinities and NaNs. No subnormal float is involved, it works even if denormals are flushed to zero.
+SORT_STATIC_FORCEINLINE __m128 halfToFloat( __m128i h ){
+#if defined(__F16C__)
+    return _mm_cvtph_ps( h );
+#else
+    const auto bits = _mm_unpacklo_epi16( h , _mm_setzero_si128() );
+    const auto expmant = _mm_and_si128( bits , _mm_set1_epi32( 0x7fff ) );
+    const auto sign = _mm_slli_epi32( _mm_xor_si128( bits , expmant ) , 16 );
+
+    // rebias the exponent, infinities and NaNs are rebiased twice so that they have the largest exponent.
+    const auto rebias = _mm_set1_epi32( 112 << 23 );
+    const auto infnan = _mm_cmpgt_epi32( expmant , _mm_set1_epi32( 0x7bff ) );
+    auto normal = _mm_add_epi32( _mm_slli_epi32( expmant , 13 ) , rebias );
+    normal = _mm_add_epi32( normal , _mm_and_si128( infnan , rebias ) );
+
+    // zeros and subnormal halves are normal floats, they are simply the mantissa scaled by 2^-24.
+    const auto subnormal = _mm_castps_si128( _mm_mul_ps( _mm_cvtepi32_ps( expmant ) , _mm_set1_ps( 5.9604644775390625e-8f ) ) );
+    const auto is_subnormal = _mm_cmplt_epi32( expmant , _mm_set1_epi32( 0x0400 ) );
+    const auto ret = _mm_or_si128( _mm_and_si128( is_subnormal , subnormal ) , _mm_andnot_si128( is_subnormal , normal ) );
+    return _mm_castsi128_ps( _mm_or_si128( ret , sign ) );
+#endif
+}
 
-        return false;
+// Decode a shared exponent texel, it matches 'UnpackRGB9E5' exactly since all scales are powers of two.
+SORT_STATIC_FORCEINLINE __m128 rgb9e5ToFloat( __m128i v ){
+    v = _mm_shuffle_epi32( v , 0 );
+    const auto mantissa = _mm_cvtepi32_ps( _mm_and_si128( v , _mm_setr_epi32( 0x1ff , 0x1ff << 9 , 0x1ff << 18 , 0 ) ) );
+    const auto scale = _mm_castsi128_ps( _mm_slli_epi32( _mm_add_epi32( _mm_srli_epi32( v , 27 ) , _mm_set1_epi32( 127 - 24 ) ) , 23 ) );
+    const auto rgb = _mm_mul_ps( _mm_mul_ps( mantissa , _mm_setr_ps( 1.0f , 1.0f / 512.0f , 1.0f / 262144.0f , 0.0f ) ) , scale );
+    return _mm_add_ps( rgb , _mm_setr_ps( 0.0f , 0.0f , 0.0f , 1.0f ) );
+}
+
+// Decode two neighboring texels in a row of a tile.
+template<TEXEL_FORMAT format>
+SORT_STATIC_FORCEINLINE void decodeTexels( const unsigned char* data , __m128& t0 , __m128& t1 ){
+    switch( format ){
+    case TEXEL_RGBA32F:
+        t0 = _mm_loadu_ps( (const float*)data );
+        t1 = _mm_loadu_ps( (const float*)data + TEXTURE_TILE_CHANNEL );
+        break;
+    case TEXEL_RGBA8:
+    {
+        // the division matches the lookup table exactly.
+        const auto bytes = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)data ) , _mm_setzero_si128() );
+        const auto unorm = _mm_set1_ps( 255.0f );
+        t0 = _mm_div_ps( _mm_cvtepi32_ps( _mm_unpacklo_epi16( bytes , _mm_setzero_si128() ) ) , unorm );
+        t1 = _mm_div_ps( _mm_cvtepi32_ps( _mm_unpackhi_epi16( bytes , _mm_setzero_si128() ) ) , unorm );
+        break;
+    }
+    case TEXEL_RGBA16F:
+    {
+        const auto halves = _mm_loadu_si128( (const __m128i*)data );
+        t0 = halfToFloat( halves );
+        t1 = halfToFloat( _mm_srli_si128( halves , 8 ) );
+        break;
+    }
+    case TEXEL_RGB9E5:
+    {
+        const auto texels = _mm_loadl_epi64( (const __m128i*)data );
+        t0 = rgb9e5ToFloat( texels );
+        t1 = rgb9e5ToFloat( _mm_srli_si128( texels , 4 ) );
+        break;
+    }
+    }
+}
+#endif
+
+// Bilinear interpolation of a 2x2 footprint, each row holds two neighboring RGBA texels.
+SORT_STATIC_FORCEINLINE void lerpRows( const float* row0 , const float* row1 , float du , float dv , float* rgba ){
+#if defined(AVX_ENABLED)
+    // the two texels in a row are next to each other in memory, each row of the footprint is one single load.
+    const auto r0 = _mm256_loadu_ps( row0 );
+    const auto r1 = _mm256_loadu_ps( row1 );
+    const auto col = _mm256_add_ps( r0 , _mm256_mul_ps( _mm256_sub_ps( r1 , r0 ) , _mm256_set1_ps( dv ) ) );
+    const auto weight = _mm256_insertf128_ps( _mm256_castps128_ps256( _mm_set1_ps( 1.0f - du ) ) , _mm_set1_ps( du ) , 1 );
+    const auto ret = _mm256_mul_ps( col , weight );
+    _mm_storeu_ps( rgba , _mm_add_ps( _mm256_castps256_ps128( ret ) , _mm256_extractf128_ps( ret , 1 ) ) );
+#elif defined(TEXTURE_SSE_FILTERING)
+    lerpTexels( _mm_loadu_ps( row0 ) , _mm_loadu_ps( row0 + TEXTURE_TILE_CHANNEL ) ,
+                _mm_loadu_ps( row1 ) , _mm_loadu_ps( row1 + TEXTURE_TILE_CHANNEL ) , du , dv , rgba );
+#else
+    for( auto i = 0 ; i < TEXTURE_TILE_CHANNEL ; ++i ){
+        const auto r0 = row0[i] + ( row0[i + TEXTURE_TILE_CHANNEL] - row0[i] ) * du;
+        const auto r1 = row1[i] + ( row1[i + TEXTURE_TILE_CHANNEL] - row1[i] ) * du;
+        rgba[i] = r0 + ( r1 - r0 ) * dv;
+    }
+#endif
+}
+
+// Bilinear interpolation of the 2x2 footprint starting from a texel in a tile.
+template<TEXEL_FORMAT format>
+SORT_STATIC_FORCEINLINE void lerpFootprint( const TextureTile& tile , int tx , int ty , float du , float dv , float* rgba ){
+    constexpr auto texel_size = TexelSize( format );
+    const auto row0 = tile.GetData() + ( ty * TEXTURE_TILE_STRIDE + tx ) * texel_size;
+    const auto row1 = row0 + TEXTURE_TILE_STRIDE * texel_size;
+
+#if defined(TEXTURE_SSE_FILTERING)
+    // full precision texels are filtered in place without any decoding.
+    if( format == TEXEL_RGBA32F ){
+        lerpRows( (const float*)row0 , (const float*)row1 , du , dv , rgba );
+        return;
     }
 
-    stbi_ldr_to_hdr_gamma(1.0f);
-    stbi_ldr_to_hdr_scale(1.0f);
+    // compact texels are decoded in registers, two texels of a row at a time.
+    __m128 t00 , t10 , t01 , t11;
+    decodeTexels<format>( row0 , t00 , t10 );
+    decodeTexels<format>( row1 , t01 , t11 );
+    lerpTexels( t00 , t10 , t01 , t11 , du , dv , rgba );
+#else
+    float quad[4 * TEXTURE_TILE_CHANNEL];
+    DecodeTexel<format>( row0 , quad );
+    DecodeTexel<format>( row0 + texel_size , quad + TEXTURE_TILE_CHANNEL );
+    DecodeTexel<format>( row1 , quad + 2 * TEXTURE_TILE_CHANNEL );
+    DecodeTexel<format>( row1 + texel_size , quad + 3 * TEXTURE_TILE_CHANNEL );
+    lerpRows( quad , quad + 2 * TEXTURE_TILE_CHANNEL , du , dv , rgba );
+#endif
+}
 
-    auto comp = 0;
-    const auto* data = stbi_loadf(m_name.c_str(), &m_iTexWidth, &m_iTexHeight, &comp, STBI_rgb_alpha);
+template<TEXCOORDFILTER filter, TEXEL_FORMAT format>
+SORT_FORCEINLINE void ImageTexture2D::fetch( const MipLevel& level , int x , int y , float* rgba ){
+    x = texCoordFilter<filter>( x , level.m_width );
+    y = texCoordFilter<filter>( y , level.m_height );
 
-    if (data) {
-        if( m_iTexWidth > 0 && m_iTexHeight > 0 ){
-            m_memory->m_rgb = std::make_unique<Spectrum[]>(m_iTexWidth*m_iTexHeight);
-            for (auto i = 0; i < m_iTexHeight; ++i) {
-                for (auto j = 0; j < m_iTexWidth; ++j) {
-                    const auto k = i * m_iTexWidth + j;
+    const auto tile = TextureCache::GetSingleton().GetTile( level.m_tiles[ ( y / TEXTURE_TILE_SIZE ) * level.m_tileCntX + x / TEXTURE_TILE_SIZE ] );
+    const auto offset = ( ( y % TEXTURE_TILE_SIZE ) * TEXTURE_TILE_STRIDE + x % TEXTURE_TILE_SIZE ) * TexelSize( format );
+    DecodeTexel<format>( tile->GetData() + offset , rgba );
+}
 
-                    auto& color = m_memory->m_rgb[i * m_iTexWidth + j];
+template<TEXCOORDFILTER filter, TEXEL_FORMAT format>
+SORT_FORCEINLINE void ImageTexture2D::bilinear( const MipLevel& level , float u , float v , float* rgba ){
+    const auto fu = u * level.m_width - 0.5f;
+    const auto fv = v * level.m_height - 0.5f;
+    const auto fx = floor( fu );
+    const auto fy = floor( fv );
+    const auto x = (int)fx;
+    const auto y = (int)fy;
+    const auto du = fu - fx;
+    const auto dv = fv - fy;
+
+    // The extra column and row of each tile hold the filtered neighbors, as long as the first texel is inside the
+    // mip level, the whole footprint lives in one single tile.
+    if( (unsigned)x < (unsigned)level.m_width && (unsigned)y < (unsigned)level.m_height ){
+        const auto ux = (unsigned)x;
+        const auto uy = (unsigned)y;
+        const auto tile = TextureCache::GetSingleton().GetTile( level.m_tiles[ ( uy / TEXTURE_TILE_SIZE ) * level.m_tileCntX + ux / TEXTURE_TILE_SIZE ] );
+        lerpFootprint<format>( *tile , ux % TEXTURE_TILE_SIZE , uy % TEXTURE_TILE_SIZE , du , dv , rgba );
+        return;
+    }
 
-                    color.r = data[4 * k];
-                    color.g = data[4 * k + 1];
-                    color.b = data[4 * k + 2];
-                }
+    float quad[4 * TEXTURE_TILE_CHANNEL];
+    fetch<filter, format>( level , x , y , quad );
+    fetch<filter, format>( level , x + 1 , y , quad + TEXTURE_TILE_CHANNEL );
+    fetch<filter, format>( level , x , y + 1 , quad + 2 * TEXTURE_TILE_CHANNEL );
+    fetch<filter, format>( level , x + 1 , y + 1 , quad + 3 * TEXTURE_TILE_CHANNEL );
+    lerpRows( quad , quad + 2 * TEXTURE_TILE_CHANNEL , du , dv , rgba );
+}
+
+template<TEXCOORDFILTER filter, TEXEL_FORMAT format>
+void ImageTexture2D::sampleStream( const ImageTexture2D& texture , int level , const float* u , const float* v , unsigned cnt , float* rgba ){
+    sAssertMsg(level < (int)texture.m_levels.size() , IMAGE , "Texture %s not loaded!" , texture.m_name.c_str() );
+
+    const auto& mip = texture.m_levels[level];
+    for( auto i = 0u ; i < cnt ; ++i )
+        bilinear<filter, format>( mip , u[i] , v[i] , rgba + i * TEXTURE_TILE_CHANNEL );
+}
+
+ImageTexture2D::ImageTexture2D() : m_sampleFunc( resolveSampleFunc( m_TexCoordFilter , m_format ) ) , m_sampler( *this , m_sampleFunc ) {
+}
+
+template<TEXCOORDFILTER filter>
+ImageTexture2DSampler::SampleFunc ImageTexture2D::resolveSampleFunc( TEXEL_FORMAT format ){
+    switch( format ){
+    case TEXEL_RGBA8:
+        return sampleStream<filter, TEXEL_RGBA8>;
+    case TEXEL_RGBA16F:
+        return sampleStream<filter, TEXEL_RGBA16F>;
+    case TEXEL_RGB9E5:
+        return sampleStream<filter, TEXEL_RGB9E5>;
+    default:
+        return sampleStream<filter, TEXEL_RGBA32F>;
+    }
+}
+
+ImageTexture2DSampler::SampleFunc ImageTexture2D::resolveSampleFunc( TEXCOORDFILTER filter , TEXEL_FORMAT format ){
+    switch( filter ){
+    case TCF_CLAMP:
+        return resolveSampleFunc<TCF_CLAMP>( format );
+    case TCF_MIRROR:
+        return resolveSampleFunc<TCF_MIRROR>( format );
+    default:
+        return resolveSampleFunc<TCF_WARP>( format );
+    }
+}
+
+void ImageTexture2DSampler::SampleColor( const float* u , const float* v , unsigned cnt , Spectrum* color ) const{
+    // texels are sampled in small chunks so that the intermediate results stay on the stack.
+    constexpr unsigned CHUNK_SIZE = 64;
+    float rgba[CHUNK_SIZE * TEXTURE_TILE_CHANNEL];
+    for( auto offset = 0u ; offset < cnt ; offset += CHUNK_SIZE ){
+        const auto chunk = std::min( CHUNK_SIZE , cnt - offset );
+        m_sample( *m_texture , 0 , u + offset , v + offset , chunk , rgba );
+        for( auto i = 0u ; i < chunk ; ++i )
+            color[offset + i] = Spectrum( rgba[i * TEXTURE_TILE_CHANNEL] , rgba[i * TEXTURE_TILE_CHANNEL + 1] , rgba[i * TEXTURE_TILE_CHANNEL + 2] );
+    }
+}
+
+void ImageTexture2D::trilinear( float u , float v , float footprint , float* rgba ) const{
+    const auto last = (int)m_levels.size() - 1;
+    const auto level = ( footprint > 0.0f ) ? log2( footprint * std::max( m_iTexWidth , m_iTexHeight ) ) : 0.0f;
+    if( level <= 0.0f ){
+        m_sampleFunc( *this , 0 , &u , &v , 1 , rgba );
+        return;
+    }
+    if( level >= last ){
+        m_sampleFunc( *this , last , &u , &v , 1 , rgba );
+        return;
+    }
+
+    const auto l0 = (int)level;
+    const auto t = level - l0;
+    float fine[TEXTURE_TILE_CHANNEL], coarse[TEXTURE_TILE_CHANNEL];
+    m_sampleFunc( *this , l0 , &u , &v , 1 , fine );
+    m_sampleFunc( *this , l0 + 1 , &u , &v , 1 , coarse );
+    for( auto i = 0 ; i < TEXTURE_TILE_CHANNEL ; ++i )
+        rgba[i] = fine[i] * ( 1.0f - t ) + coarse[i] * t;
+}
+
+// Downsample RGBA texels with a box filter. Each texel in the result covers the exact area of the source texels, partially
+// covered texels are weighted by their coverage, this makes sure odd sized levels don't shift the average of the texture.
+static std::unique_ptr<float[]> downsample( const float* src , int w , int h , int nw , int nh ){
+    const auto resample = []( const float* src , int src_cnt , int src_stride , float* dst , int dst_cnt , int dst_stride ){
+        const auto scale = (float)src_cnt / (float)dst_cnt;
+        for( auto j = 0 ; j < dst_cnt ; ++j ){
+            const auto lo = j * scale;
+            const auto hi = ( j + 1 ) * scale;
+            float sum[TEXTURE_TILE_CHANNEL] = { 0.0f };
+            for( auto i = (int)lo ; i < std::min( src_cnt , (int)ceil( hi ) ) ; ++i ){
+                const auto weight = std::min( hi , (float)( i + 1 ) ) - std::max( lo , (float)i );
+                for( auto c = 0 ; c < TEXTURE_TILE_CHANNEL ; ++c )
+                    sum[c] += src[ i * src_stride + c ] * weight;
             }
+            for( auto c = 0 ; c < TEXTURE_TILE_CHANNEL ; ++c )
+                dst[ j * dst_stride + c ] = sum[c] / scale;
         }
+    };
 
-        // there is alpha channel in the texture.
-        if( comp == STBI_rgb_alpha ){
-            m_memory->m_a = std::make_unique<float[]>(m_iTexWidth*m_iTexHeight);
-            for (auto i = 0; i < m_iTexHeight; ++i) {
-                for (auto j = 0; j < m_iTexWidth; ++j) {
-                    const auto k = i * m_iTexWidth + j;
+    // the filter is separable, rows are downsampled first and then columns.
+    auto rows = std::make_unique<float[]>( nw * h * TEXTURE_TILE_CHANNEL );
+    for( auto y = 0 ; y < h ; ++y )
+        resample( src + y * w * TEXTURE_TILE_CHANNEL , w , TEXTURE_TILE_CHANNEL , rows.get() + y * nw * TEXTURE_TILE_CHANNEL , nw , TEXTURE_TILE_CHANNEL );
 
-                    auto& alpha = m_memory->m_a[i * m_iTexWidth + j];
+    auto ret = std::make_unique<float[]>( nw * nh * TEXTURE_TILE_CHANNEL );
+    for( auto x = 0 ; x < nw ; ++x )
+        resample( rows.get() + x * TEXTURE_TILE_CHANNEL , h , nw * TEXTURE_TILE_CHANNEL , ret.get() + x * TEXTURE_TILE_CHANNEL , nh , nw * TEXTURE_TILE_CHANNEL );
+    return ret;
+}
 
-                    alpha = data[4 * k + 3];
+void ImageTexture2D::addMipLevel( const float* texels , int w , int h ){
+    MipLevel level;
+    level.m_width = w;
+    level.m_height = h;
+    level.m_tileCntX = ( w + TEXTURE_TILE_SIZE - 1 ) / TEXTURE_TILE_SIZE;
+    const auto tile_cnt_y = ( h + TEXTURE_TILE_SIZE - 1 ) / TEXTURE_TILE_SIZE;
+    level.m_tiles.reserve( level.m_tileCntX * tile_cnt_y );
+
+    auto& cache = TextureCache::GetSingleton();
+    const auto texel_size = TexelSize( m_format );
+    TextureTile tile( TEXTURE_TILE_TEXEL_CNT * texel_size );
+    for( auto ty = 0 ; ty < tile_cnt_y ; ++ty ){
+        for( auto tx = 0 ; tx < level.m_tileCntX ; ++tx ){
+            for( auto j = 0 ; j < TEXTURE_TILE_STRIDE ; ++j ){
+                for( auto i = 0 ; i < TEXTURE_TILE_STRIDE ; ++i ){
+                    // texels outside the mip level are never touched, they are filled anyway to keep things simple.
+                    auto x = tx * TEXTURE_TILE_SIZE + i;
+                    auto y = ty * TEXTURE_TILE_SIZE + j;
+                    texCoordFilter( x , y , w , h );
+
+                    EncodeTexel( m_format , texels + ( y * w + x ) * TEXTURE_TILE_CHANNEL , tile.GetData() + ( j * TEXTURE_TILE_STRIDE + i ) * texel_size );
                 }
             }
+            level.m_tiles.push_back( cache.StoreTile( tile ) );
         }
+    }
 
-        stbi_image_free((void*)data);
+    m_levels.push_back( std::move( level ) );
+}
 
-        average();
-        return true;
+// load image from file
+bool ImageTexture2D::LoadResource( const std::string str ){
+    static const std::regex exr_reg(".*\\.exr$", std::regex_constants::icase);
+
+    m_levels.clear();
+    m_hasAlpha = false;
+    m_name = str;
+
+    float* data = nullptr;
+    auto is_exr = false;
+    auto is_hdr = false;
+    if (std::regex_match(m_name, exr_reg)) {
+        const char* err;
+        if (LoadEXR(&data, &m_iTexWidth, &m_iTexHeight, m_name.c_str(), &err) < 0)
+            return false;
+        is_exr = true;
+        is_hdr = true;
+    }else{
+        stbi_ldr_to_hdr_gamma(1.0f);
+        stbi_ldr_to_hdr_scale(1.0f);
+
+        auto comp = 0;
+        data = stbi_loadf(m_name.c_str(), &m_iTexWidth, &m_iTexHeight, &comp, STBI_rgb_alpha);
+        if (!data)
+            return false;
+
+        // there is alpha channel in the texture.
+        m_hasAlpha = ( comp == STBI_rgb_alpha );
+        is_hdr = stbi_is_hdr(m_name.c_str()) != 0;
+    }
+
+    // Pick the storage format of texels. 8 bit LDR images are loaded without any gamma correction, storing them in
+    // 8 bit per channel is lossless. HDR images are quantized to the precision picked by the texture cache, the
+    // shared exponent format has no alpha channel, it is only used when the alpha channel is not needed.
+    switch( TextureCache::GetSingleton().GetStorageMode() ){
+    case TSM_HALF_PRECISION:
+        m_format = is_hdr ? TEXEL_RGBA16F : TEXEL_RGBA8;
+        break;
+    case TSM_SHARED_EXPONENT:
+        m_format = is_hdr ? ( m_hasAlpha ? TEXEL_RGBA16F : TEXEL_RGB9E5 ) : TEXEL_RGBA8;
+        break;
+    default:
+        m_format = TEXEL_RGBA32F;
+        break;
+    }
+    m_sampleFunc = resolveSampleFunc( m_TexCoordFilter , m_format );
+    m_sampler = ImageTexture2DSampler( *this , m_sampleFunc );
+
+    if( m_iTexWidth > 0 && m_iTexHeight > 0 ){
+        // flip the image vertically so that the first row is the bottom one, which matches texture coordinate.
+        auto w = m_iTexWidth;
+        auto h = m_iTexHeight;
+        auto level = std::make_unique<float[]>( w * h * TEXTURE_TILE_CHANNEL );
+        for (auto i = 0; i < h; ++i)
+            memcpy( level.get() + i * w * TEXTURE_TILE_CHANNEL , data + ( h - 1 - i ) * w * TEXTURE_TILE_CHANNEL , sizeof(float) * w * TEXTURE_TILE_CHANNEL );
+
+        average( level.get() );
+
+        // generate the mip chain with a box filter.
+        while( true ){
+            addMipLevel( level.get() , w , h );
+            if( w == 1 && h == 1 )
+                break;
+
+            const auto nw = std::max( 1 , w / 2 );
+            const auto nh = std::max( 1 , h / 2 );
+            level = downsample( level.get() , w , h , nw , nh );
+            w = nw;
+            h = nh;
+        }
     }
-    return false;
+
+    if( is_exr )
+        free(data);
+    else
+        stbi_image_free((void*)data);
+
+    return !m_levels.empty();
 }
 
 Spectrum ImageTexture2D::GetAverage() const{
     return m_average;
 }
 
-void ImageTexture2D::average(){
-    // if there is no image, just crash
-    if(IS_PTR_INVALID(m_memory) || IS_PTR_INVALID(m_memory->m_rgb))
-        return;
-
+void ImageTexture2D::average( const float* texels ){
     Spectrum average;
-    for (auto i = 0; i < m_iTexHeight; ++i) {
-        for (auto j = 0; j < m_iTexWidth; ++j) {
-            // get the offset
-            int offset = i * m_iTexWidth + j;
-            // get the color
-            average += m_memory->m_rgb[offset];
-        }
-    }
+    const auto total = m_iTexWidth * m_iTexHeight;
+    for (auto i = 0; i < total; ++i)
+        average += Spectrum( texels[ i * TEXTURE_TILE_CHANNEL ] , texels[ i * TEXTURE_TILE_CHANNEL + 1 ] , texels[ i * TEXTURE_TILE_CHANNEL + 2 ] );
 
-    m_average = average / (float)( m_iTexWidth * m_iTexHeight );
+    m_average = average / (float)total;
 }
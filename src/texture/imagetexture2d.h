@@ -18,16 +18,74 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 #include "core/resource.h"
 #include "texturebase.h"
+#include "texturecache.h"
+#include "texelformat.h"
+
+class ImageTexture2D;
+
+//! @brief  Sampler of an image texture.
+/**
+ * Texture lookups from shaders are one of the hottest paths during rendering. Instead of going through the virtual
+ * interfaces of Texture2DBase, which resolve the texture coordinate filter for every single texel, a sampler has the
+ * concrete texture type, its texture coordinate filter and texel format resolved once when it is bound to a shader. A
+ * lookup through it is a direct call to the bilinear filtering specialized for both of them.
+ */
+class ImageTexture2DSampler{
+public:
+    //! @brief  Bilinear filtering function with the texture coordinate filter and texel format resolved.
+    using SampleFunc = void (*)( const ImageTexture2D& texture , int level , const float* u , const float* v , unsigned cnt , float* rgba );
+
+    //! @brief  Constructor.
+    //!
+    //! @param  texture     The texture to be sampled.
+    //! @param  func        The bilinear filtering function of the texture.
+    ImageTexture2DSampler( const ImageTexture2D& texture , SampleFunc func ) : m_texture(&texture) , m_sample(func) {}
+
+    //! @brief  Get the color given a texture coordinate.
+    //!
+    //! @param  u           U coordinate. If out of range, it will be filtered.
+    //! @param  v           V coordinate. If out of range, it will be filtered.
+    //! @return             The color at the specific texture coordinate.
+    Spectrum SampleColor( float u , float v ) const;
+
+    //! @brief  Get the alpha given a texture coordinate.
+    //!
+    //! @param  u           U coordinate. If out of range, it will be filtered.
+    //! @param  v           V coordinate. If out of range, it will be filtered.
+    //! @return             The alpha at the specific texture coordinate.
+    float SampleAlpha( float u , float v ) const;
+
+    //! @brief  Get the colors of a batch of texture coordinates.
+    //!
+    //! @param  u           U coordinates. If out of range, they will be filtered.
+    //! @param  v           V coordinates. If out of range, they will be filtered.
+    //! @param  cnt         Number of texture coordinates in the batch.
+    //! @param  color       The colors at the texture coordinates.
+    void SampleColor( const float* u , const float* v , unsigned cnt , Spectrum* color ) const;
+
+private:
+    const ImageTexture2D*   m_texture = nullptr;    /**< The texture to be sampled. */
+    SampleFunc              m_sample = nullptr;     /**< Bilinear filtering function with the filter and texel format resolved. */
+};
 
 //! @brief  Image texture.
 /**
  * Image texture is the most commonly used texture. It is just a two dimensional set of pixels.
- * There is no mip-map solution for now.
+ * Right after loading, a full mip chain is generated for the texture, each mip level is then split into tiles that
+ * are handed over to the texture cache. The texture itself only holds the handles of its tiles, texels are paged
+ * in on demand during lookups so that the memory footprint of textures is bounded by the capacity of the cache.
+ * Texels are stored in a compact format, LDR images keep their 8 bit channels and HDR images are quantized to half
+ * precision floats or a shared exponent format depending on the storage mode of the texture cache, which makes more
+ * tiles fit in the same cache capacity.
  */
 class ImageTexture2D : public Texture2DBase, public Resource{
 public:
+    //! @brief  Default constructor.
+    ImageTexture2D();
+
     //! @brief  Load the resource from file.
     //!
     //! @param  filename        Name of the external file holding the data.
@@ -48,11 +106,41 @@ public:
     //! @return             The alpha at the specific position, it will return 1.0 for textures without alpha channel.
     float GetAlpha( int x , int y ) const override;
 
+    //! @brief  Get the color given a texture coordinate with bilinear filtering on the finest mip level.
+    //!
+    //! @param  u           U coordinate. If out of range, it will be filtered.
+    //! @param  v           V coordinate. If out of range, it will be filtered.
+    //! @return             The color at the specific texture coordinate.
+    Spectrum GetColorFromUV( float u , float v ) const override;
+
+    //! @brief  Get the color given a texture coordinate with trilinear filtering.
+    //!
+    //! @param  u           U coordinate. If out of range, it will be filtered.
+    //! @param  v           V coordinate. If out of range, it will be filtered.
+    //! @param  footprint   Size of the lookup footprint in texture space, it picks the mip levels to be filtered.
+    //! @return             The color at the specific texture coordinate.
+    Spectrum GetColorFromUV( float u , float v , float footprint ) const override;
+
+    //! @brief  Get the alpha given a texture coordinate with bilinear filtering on the finest mip level.
+    //!
+    //! @param  u           U coordinate. If out of range, it will be filtered.
+    //! @param  v           V coordinate. If out of range, it will be filtered.
+    //! @return             The alpha at the specific texture coordinate.
+    float GetAlphaFromtUV( float u , float v ) const override;
+
+    //! @brief  Get the alpha given a texture coordinate with trilinear filtering.
+    //!
+    //! @param  u           U coordinate. If out of range, it will be filtered.
+    //! @param  v           V coordinate. If out of range, it will be filtered.
+    //! @param  footprint   Size of the lookup footprint in texture space, it picks the mip levels to be filtered.
+    //! @return             The alpha at the specific texture coordinate.
+    float GetAlphaFromtUV( float u , float v , float footprint ) const override;
+
     //! @brief  Whether the 2d texture is valid or not.
     //!
     //! @return             True if the texture is valid.
     bool IsValid() const override { 
-        return IS_PTR_VALID(m_memory); 
+        return !m_levels.empty(); 
     }
 
     //! @brief  Get the average color of the texture.
@@ -60,15 +148,44 @@ public:
     //! @return             The average color of the texture.
     Spectrum GetAverage() const;
 
+    //! @brief  Get the sampler of the texture.
+    //!
+    //! @return             The sampler with the texture coordinate filter of the texture resolved.
+    const ImageTexture2DSampler& GetSampler() const {
+        return m_sampler;
+    }
+
+    //! @brief  Whether there is alpha channel in the texture.
+    //!
+    //! @return             True if there is alpha channel in the texture.
+    bool HasAlpha() const {
+        return m_hasAlpha;
+    }
+
+    //! @brief  Get the number of mip levels of the texture.
+    //!
+    //! @return             Number of mip levels, the finest level is the first one.
+    int GetMipLevelCount() const {
+        return (int)m_levels.size();
+    }
+
 private:
-    class ImgMemory{
-    public:
-        std::unique_ptr<Spectrum[]>     m_rgb = nullptr;   /**< RGB Channels. */
-        std::unique_ptr<float[]>        m_a  = nullptr;   /**< Alpha Channel. */
+    //! @brief  A mip level of the texture.
+    struct MipLevel{
+        int                             m_width = 0;        /**< Width of the mip level. */
+        int                             m_height = 0;       /**< Height of the mip level. */
+        int                             m_tileCntX = 0;     /**< Number of tiles along each row. */
+        std::vector<TextureTileHandle>  m_tiles;            /**< Handles of the tiles in the texture cache, row by row. */
     };
 
-    // array saving the color of image
-    std::unique_ptr<ImgMemory>  m_memory = nullptr;
+    /**< Mip levels of the texture, the finest level is the first one. */
+    std::vector<MipLevel>   m_levels;
+
+    /**< Whether there is alpha channel in the texture. */
+    bool        m_hasAlpha = false;
+
+    /**< Storage format of texels in the tiles of the texture. */
+    TEXEL_FORMAT    m_format = TEXEL_RGBA32F;
 
     // the average radiance of the texture
     Spectrum    m_average;
@@ -76,6 +193,94 @@ private:
     // texture name
     std::string m_name;
 
+    /**< Bilinear filtering function with the texture coordinate filter and texel format resolved. */
+    ImageTexture2DSampler::SampleFunc   m_sampleFunc = nullptr;
+
+    /**< Sampler of the texture. */
+    ImageTexture2DSampler   m_sampler;
+
+    //! @brief  Split the texels into tiles and hand them over to the texture cache as a new mip level.
+    //!
+    //! @param  texels      RGBA texels of the mip level, row by row, starting from the bottom row.
+    //! @param  w           Width of the mip level.
+    //! @param  h           Height of the mip level.
+    void    addMipLevel( const float* texels , int w , int h );
+
+    //! @brief  Fetch a texel of a mip level.
+    //!
+    //! @param  level       The mip level.
+    //! @param  x           X coordinate. If out of range, it will be filtered.
+    //! @param  y           Y coordinate. If out of range, it will be filtered.
+    //! @param  rgba        The RGBA value of the texel.
+    void    texel( const MipLevel& level , int x , int y , float* rgba ) const;
+
+    //! @brief  Trilinear filtering across the two mip levels matching the footprint.
+    //!
+    //! @param  u           U coordinate. If out of range, it will be filtered.
+    //! @param  v           V coordinate. If out of range, it will be filtered.
+    //! @param  footprint   Size of the lookup footprint in texture space.
+    //! @param  rgba        The filtered RGBA value.
+    void    trilinear( float u , float v , float footprint , float* rgba ) const;
+
     // compute average radiance
-    void    average();
+    void    average( const float* texels );
+
+    //! @brief  Fetch a texel of a mip level with a specific texture coordinate filter and texel format.
+    //!
+    //! @param  level       The mip level.
+    //! @param  x           X coordinate. If out of range, it will be filtered.
+    //! @param  y           Y coordinate. If out of range, it will be filtered.
+    //! @param  rgba        The RGBA value of the texel.
+    template<TEXCOORDFILTER filter, TEXEL_FORMAT format>
+    static void fetch( const MipLevel& level , int x , int y , float* rgba );
+
+    //! @brief  Bilinear filtering on a mip level with a specific texture coordinate filter and texel format.
+    //!
+    //! @param  level       The mip level.
+    //! @param  u           U coordinate. If out of range, it will be filtered.
+    //! @param  v           V coordinate. If out of range, it will be filtered.
+    //! @param  rgba        The filtered RGBA value.
+    template<TEXCOORDFILTER filter, TEXEL_FORMAT format>
+    static void bilinear( const MipLevel& level , float u , float v , float* rgba );
+
+    //! @brief  Bilinear filtering on a mip level for a batch of texture coordinates.
+    //!
+    //! @param  texture     The texture to be sampled.
+    //! @param  level       Index of the mip level to be sampled.
+    //! @param  u           U coordinates. If out of range, they will be filtered.
+    //! @param  v           V coordinates. If out of range, they will be filtered.
+    //! @param  cnt         Number of texture coordinates in the batch.
+    //! @param  rgba        The filtered RGBA values.
+    template<TEXCOORDFILTER filter, TEXEL_FORMAT format>
+    static void sampleStream( const ImageTexture2D& texture , int level , const float* u , const float* v , unsigned cnt , float* rgba );
+
+    //! @brief  Pick the bilinear filtering function matching a texel format with a specific texture coordinate filter.
+    //!
+    //! @param  format      The texel format.
+    //! @return             The bilinear filtering function.
+    template<TEXCOORDFILTER filter>
+    static ImageTexture2DSampler::SampleFunc resolveSampleFunc( TEXEL_FORMAT format );
+
+    //! @brief  Pick the bilinear filtering function matching a texture coordinate filter and a texel format.
+    //!
+    //! @param  filter      The texture coordinate filter.
+    //! @param  format      The texel format.
+    //! @return             The bilinear filtering function.
+    static ImageTexture2DSampler::SampleFunc resolveSampleFunc( TEXCOORDFILTER filter , TEXEL_FORMAT format );
 };
+
+inline Spectrum ImageTexture2DSampler::SampleColor( float u , float v ) const{
+    float rgba[TEXTURE_TILE_CHANNEL];
+    m_sample( *m_texture , 0 , &u , &v , 1 , rgba );
+    return Spectrum( rgba[0] , rgba[1] , rgba[2] );
+}
+
+inline float ImageTexture2DSampler::SampleAlpha( float u , float v ) const{
+    // in case of acquiring alpha value in a texture without this channel, 1.0 is returned by default.
+    if( !m_texture->HasAlpha() )
+        return 1.0f;
+
+    float rgba[TEXTURE_TILE_CHANNEL];
+    m_sample( *m_texture , 0 , &u , &v , 1 , rgba );
+    return rgba[3];
+}
@@ -15,18 +15,41 @@
     this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
  */
 
+#include <algorithm>
 #include "imagetexture3d.h"
+#include "stream/stream.h"
+#include "core/stats.h"
+
+SORT_STATS_DEFINE_COUNTER(sVolumeBricks)
+SORT_STATS_DEFINE_COUNTER(sOccupiedVolumeBricks)
+
+SORT_STATS_COUNTER("Statistics", "Volume Bricks", sVolumeBricks);
+SORT_STATS_RATIO("Statistics", "Occupied Volume Bricks", sOccupiedVolumeBricks, sVolumeBricks);
 
 template class ImageTexture3D<float>;
 template class ImageTexture3D<Spectrum>;
 
+static SORT_FORCEINLINE bool isZero(const float v) {
+    return v == 0.0f;
+}
+
+static SORT_FORCEINLINE bool isZero(const Spectrum& v) {
+    return v.IsBlack();
+}
+
 template<class T>
 T ImageTexture3D<T>::Sample(int x, int y, int z) const {
     if (x < 0 || x >= (int)Texture3DBase<T>::m_width || y < 0 || y >= (int)Texture3DBase<T>::m_height || z < 0 || z >= (int)Texture3DBase<T>::m_depth)
         return 0.0f;
 
-    const auto offset = z * Texture3DBase<T>::m_width * Texture3DBase<T>::m_height + y * Texture3DBase<T>::m_width + x;
-    return m_memory->m_texel[offset];
+    const auto brick = m_brickIndices[((z / TEXTURE3D_BRICK_SIZE) * m_brickRes[1] + y / TEXTURE3D_BRICK_SIZE) * m_brickRes[0] + x / TEXTURE3D_BRICK_SIZE];
+    if (brick == TEXTURE3D_EMPTY_BRICK)
+        return 0.0f;
+
+    const auto lx = x % TEXTURE3D_BRICK_SIZE;
+    const auto ly = y % TEXTURE3D_BRICK_SIZE;
+    const auto lz = z % TEXTURE3D_BRICK_SIZE;
+    return m_brickTexels[(size_t)brick * TEXTURE3D_BRICK_TEXEL_CNT + (lz * TEXTURE3D_BRICK_STRIDE + ly) * TEXTURE3D_BRICK_STRIDE + lx];
 }
 
 template<class T>
@@ -49,27 +72,96 @@ T ImageTexture3D<T>::Sample(float u, float v, float w) const{
     const auto y = (unsigned)(fy);
     const auto z = (unsigned)(fz);
 
+    const auto brick = m_brickIndices[((z / TEXTURE3D_BRICK_SIZE) * m_brickRes[1] + y / TEXTURE3D_BRICK_SIZE) * m_brickRes[0] + x / TEXTURE3D_BRICK_SIZE];
+    if (brick == TEXTURE3D_EMPTY_BRICK)
+        return 0.0f;
+
     const auto dx = fx - x;
     const auto dy = fy - y;
     const auto dz = fz - z;
 
-    const auto slice_strand = width * height;
-    const auto offset00 = z * slice_strand + y * width + x;
-    const auto offset01 = (x < width - 1) ? offset00 + 1 : offset00;
-    const auto offset10 = (z < depth - 1) ? offset00 + slice_strand : offset00;
-    const auto offset11 = (x < width - 1) ? offset10 + 1 : offset10;
-    const auto offset20 = (y < height - 1) ? offset00 + width : offset00;
-    const auto offset21 = (x < width - 1) ? offset20 + 1 : offset20;
-    const auto offset30 = (z < depth - 1) ? offset20 + slice_strand : offset20;
-    const auto offset31 = (x < width - 1) ? offset30 + 1 : offset30;
-
-    const auto t0 = slerp(m_memory->m_texel[offset00], m_memory->m_texel[offset01], dx);
-    const auto t1 = slerp(m_memory->m_texel[offset10], m_memory->m_texel[offset11], dx);
-    const auto t2 = slerp(m_memory->m_texel[offset20], m_memory->m_texel[offset21], dx);
-    const auto t3 = slerp(m_memory->m_texel[offset30], m_memory->m_texel[offset31], dx);
+    // The apron of the brick makes sure all eight texels are in the same brick, texels out of the texture are
+    // clamped to the edge when building the apron.
+    const auto* texels = m_brickTexels.data() + (size_t)brick * TEXTURE3D_BRICK_TEXEL_CNT;
+    constexpr auto slice_strand = TEXTURE3D_BRICK_STRIDE * TEXTURE3D_BRICK_STRIDE;
+    const auto offset00 = ((z % TEXTURE3D_BRICK_SIZE) * TEXTURE3D_BRICK_STRIDE + y % TEXTURE3D_BRICK_SIZE) * TEXTURE3D_BRICK_STRIDE + x % TEXTURE3D_BRICK_SIZE;
+    const auto offset01 = offset00 + 1;
+    const auto offset10 = offset00 + slice_strand;
+    const auto offset11 = offset10 + 1;
+    const auto offset20 = offset00 + TEXTURE3D_BRICK_STRIDE;
+    const auto offset21 = offset20 + 1;
+    const auto offset30 = offset20 + slice_strand;
+    const auto offset31 = offset30 + 1;
+
+    const auto t0 = slerp(texels[offset00], texels[offset01], dx);
+    const auto t1 = slerp(texels[offset10], texels[offset11], dx);
+    const auto t2 = slerp(texels[offset20], texels[offset21], dx);
+    const auto t3 = slerp(texels[offset30], texels[offset31], dx);
 
     const auto t02 = slerp(t0, t2, dy);
     const auto t13 = slerp(t1, t3, dy);
     
     return slerp(t02, t13, dz);
-}
\ No newline at end of file
+}
+
+template<class T>
+void ImageTexture3D<T>::loadTexels(IStreamBase& stream) {
+    const auto width    = Texture3DBase<T>::m_width;
+    const auto height   = Texture3DBase<T>::m_height;
+    const auto depth    = Texture3DBase<T>::m_depth;
+
+    m_brickRes[0] = (width + TEXTURE3D_BRICK_SIZE - 1) / TEXTURE3D_BRICK_SIZE;
+    m_brickRes[1] = (height + TEXTURE3D_BRICK_SIZE - 1) / TEXTURE3D_BRICK_SIZE;
+    m_brickRes[2] = (depth + TEXTURE3D_BRICK_SIZE - 1) / TEXTURE3D_BRICK_SIZE;
+    m_brickIndices.resize(m_brickRes[0] * m_brickRes[1] * m_brickRes[2]);
+    m_brickTexels.clear();
+
+    // A slab holds all slices needed by one layer of bricks, including the slice of the apron.
+    const auto slice_size = width * height;
+    std::vector<T> slab(slice_size * TEXTURE3D_BRICK_STRIDE);
+    auto slice_cnt = std::min(TEXTURE3D_BRICK_STRIDE, depth);
+    stream.Load((char*)slab.data(), (int)(sizeof(T) * slice_size * slice_cnt));
+
+    T brick_texels[TEXTURE3D_BRICK_TEXEL_CNT];
+    for (auto bz = 0u; bz < m_brickRes[2]; ++bz) {
+        const auto z0 = bz * TEXTURE3D_BRICK_SIZE;
+        for (auto by = 0u; by < m_brickRes[1]; ++by) {
+            const auto y0 = by * TEXTURE3D_BRICK_SIZE;
+            for (auto bx = 0u; bx < m_brickRes[0]; ++bx) {
+                const auto x0 = bx * TEXTURE3D_BRICK_SIZE;
+
+                auto empty = true;
+                auto i = 0u;
+                for (auto lz = 0u; lz < TEXTURE3D_BRICK_STRIDE; ++lz) {
+                    const auto* slice = slab.data() + (std::min(z0 + lz, depth - 1) - z0) * slice_size;
+                    for (auto ly = 0u; ly < TEXTURE3D_BRICK_STRIDE; ++ly) {
+                        const auto* row = slice + std::min(y0 + ly, height - 1) * width;
+                        for (auto lx = 0u; lx < TEXTURE3D_BRICK_STRIDE; ++lx, ++i) {
+                            brick_texels[i] = row[std::min(x0 + lx, width - 1)];
+                            empty &= isZero(brick_texels[i]);
+                        }
+                    }
+                }
+
+                auto& index = m_brickIndices[(bz * m_brickRes[1] + by) * m_brickRes[0] + bx];
+                if (empty) {
+                    index = TEXTURE3D_EMPTY_BRICK;
+                } else {
+                    index = (unsigned)(m_brickTexels.size() / TEXTURE3D_BRICK_TEXEL_CNT);
+                    m_brickTexels.insert(m_brickTexels.end(), brick_texels, brick_texels + TEXTURE3D_BRICK_TEXEL_CNT);
+                    SORT_STATS(++sOccupiedVolumeBricks);
+                }
+            }
+        }
+
+        // the apron slice is the first slice of the next layer of bricks
+        if (bz + 1 < m_brickRes[2]) {
+            std::copy(slab.begin() + TEXTURE3D_BRICK_SIZE * slice_size, slab.begin() + TEXTURE3D_BRICK_STRIDE * slice_size, slab.begin());
+            slice_cnt = std::min(TEXTURE3D_BRICK_SIZE, depth - 1 - (z0 + TEXTURE3D_BRICK_SIZE));
+            stream.Load((char*)(slab.data() + slice_size), (int)(sizeof(T) * slice_size * slice_cnt));
+        }
+    }
+
+    m_brickTexels.shrink_to_fit();
+    SORT_STATS(sVolumeBricks += (StatsInt)m_brickIndices.size());
+}
@@ -17,11 +17,30 @@
 
 #pragma once
 
+#include <vector>
 #include "texturebase.h"
 
+class IStreamBase;
+
+//! @brief  Number of texels along each axis of a brick in 3D image texture.
+constexpr unsigned int TEXTURE3D_BRICK_SIZE = 8;
+
+//! @brief  Number of texels along each axis of a brick in memory, including the apron.
+constexpr unsigned int TEXTURE3D_BRICK_STRIDE = TEXTURE3D_BRICK_SIZE + 1;
+
+//! @brief  Number of texels of a brick in memory, including the apron.
+constexpr unsigned int TEXTURE3D_BRICK_TEXEL_CNT = TEXTURE3D_BRICK_STRIDE * TEXTURE3D_BRICK_STRIDE * TEXTURE3D_BRICK_STRIDE;
+
+//! @brief  Index of bricks that are totally empty, no memory is allocated for them.
+constexpr unsigned int TEXTURE3D_EMPTY_BRICK = 0xffffffff;
+
 //! @brief  3D image texture.
 /**
  * 3D image texture is a three dimentional set of pixel data.
+ * Volume data, like the cache of a smoke simulation, is usually mostly empty. Instead of a dense grid, texels are
+ * stored in bricks of 8x8x8 texels and only bricks with non-zero texels occupy memory, an index of all bricks tells
+ * where the texels of a brick are. Each brick also has a one texel apron duplicated from its neighbors on the positive
+ * side of each axis, so that trilinear filtering never needs to touch more than one brick.
  */
 template<class T>
 class ImageTexture3D : public Texture3DBase<T>{
@@ -43,13 +62,48 @@ public:
     //! @param w        W coordinate.
     T Sample(float u, float v, float w) const override;
 
+    //! @brief  Get the number of bricks along an axis.
+    //!
+    //! @param  axis    Index of the axis, 0 for x, 1 for y and 2 for z.
+    //! @return         Number of bricks along the axis.
+    unsigned int GetBrickRes(const int axis) const {
+        return m_brickRes[axis];
+    }
+
+    //! @brief  Whether a brick is totally empty.
+    //!
+    //! Since the apron is included, trilinear filtering of any position whose lower corner texel is in an
+    //! empty brick is zero, which makes it possible to skip empty space.
+    //!
+    //! @param  bx      Index of the brick along x axis.
+    //! @param  by      Index of the brick along y axis.
+    //! @param  bz      Index of the brick along z axis.
+    //! @return         True if all texels in the brick are zero.
+    bool IsBrickEmpty(const unsigned int bx, const unsigned int by, const unsigned int bz) const {
+        return m_brickIndices[(bz * m_brickRes[1] + by) * m_brickRes[0] + bx] == TEXTURE3D_EMPTY_BRICK;
+    }
+
+    //! @brief  Get the memory used by the texels of the 3D texture.
+    //!
+    //! @return         Memory in bytes.
+    size_t GetMemoryUsage() const {
+        return m_brickIndices.size() * sizeof(unsigned int) + m_brickTexels.size() * sizeof(T);
+    }
+
 protected:
-    template<class D>
-    class ImgMemory {
-    public:
-        std::unique_ptr<D[]>     m_texel = nullptr;   /**< RGB Channels. */
-    };
-
-    /**< 3d texture memory. */
-    std::unique_ptr<ImgMemory<T>>  m_memory = nullptr;
-};
\ No newline at end of file
+    //! @brief  Load the texels from a stream.
+    //!
+    //! Texels are densely stored slice by slice in the stream. Only one layer of bricks is loaded at a time,
+    //! so that the peak memory is bounded by the size of a few slices instead of the whole dense grid.
+    //!
+    //! @param  stream  The stream where the texels come from, the size of the texture should be set already.
+    void loadTexels(IStreamBase& stream);
+
+private:
+    /**< Number of bricks along each axis. */
+    unsigned int            m_brickRes[3] = { 0u , 0u , 0u };
+    /**< Index of the texels of each brick in the brick pool, TEXTURE3D_EMPTY_BRICK for empty ones. */
+    std::vector<unsigned>   m_brickIndices;
+    /**< Texels of all non-empty bricks. */
+    std::vector<T>          m_brickTexels;
+};
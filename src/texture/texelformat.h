@@ -0,0 +1,257 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include "core/define.h"
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+//! @brief  Storage format of texels in texture tiles.
+enum TEXEL_FORMAT{
+    TEXEL_RGBA32F = 0 ,     /**< 32 bit float per channel. */
+    TEXEL_RGBA8 ,           /**< 8 bit unsigned normalized integer per channel, decoded through a lookup table. */
+    TEXEL_RGBA16F ,         /**< 16 bit float per channel. */
+    TEXEL_RGB9E5            /**< Three 9 bit mantissas sharing one 5 bit exponent, there is no alpha channel. */
+};
+
+//! @brief  Get the size of a texel in bytes.
+//!
+//! @param  format      Format of the texel.
+//! @return             Size of the texel in bytes.
+SORT_STATIC_FORCEINLINE constexpr unsigned TexelSize( TEXEL_FORMAT format ){
+    return ( format == TEXEL_RGBA32F ) ? 16 : ( format == TEXEL_RGBA16F ) ? 8 : 4;
+}
+
+//! @brief  Lookup table decoding 8 bit channels.
+/**
+ * LDR images are loaded with gamma of 1.0, a channel is simply its integer value divided by 255. This matches exactly
+ * what 'stbi_loadf' returns, 8 bit textures look exactly the same as they are stored in 32 bit float.
+ */
+struct UnormLut{
+    float   m_values[256];  /**< Decoded value of each 8 bit channel. */
+
+    //! @brief  Constructor filling the table.
+    UnormLut(){
+        for( auto i = 0 ; i < 256 ; ++i )
+            m_values[i] = (float)i / 255.0f;
+    }
+};
+inline const UnormLut g_unormLut;
+
+//! @brief  Convert a float to a half float, rounding to the nearest even.
+//!
+//! Values out of range of half float are clamped to the largest finite half float.
+//!
+//! @param  f           The float to be converted.
+//! @return             Bits of the half float.
+SORT_STATIC_FORCEINLINE unsigned short FloatToHalf( float f ){
+    unsigned int x;
+    memcpy( &x , &f , sizeof(x) );
+    const auto sign = ( x >> 16 ) & 0x8000;
+    x &= 0x7fffffff;
+
+    unsigned int ret;
+    if( x > 0x7f800000 ){
+        // NaN
+        ret = 0x7e00;
+    }else if( x >= 0x477ff000 ){
+        // out of range, clamped to the largest half float
+        ret = 0x7bff;
+    }else if( x < 0x38800000 ){
+        // subnormal half float, the hardware does the rounding by adding the magic number 0.5.
+        float v;
+        memcpy( &v , &x , sizeof(v) );
+        v += 0.5f;
+        memcpy( &x , &v , sizeof(x) );
+        ret = x - 0x3f000000;
+    }else{
+        // rebias the exponent and round the mantissa to the nearest even
+        const auto odd = ( x >> 13 ) & 1;
+        x += 0xc8000fff + odd;
+        ret = x >> 13;
+    }
+    return (unsigned short)( ret | sign );
+}
+
+//! @brief  Convert a half float to a float.
+//!
+//! @param  h           Bits of the half float.
+//! @return             The float.
+SORT_STATIC_FORCEINLINE float HalfToFloat( unsigned short h ){
+    const unsigned int sign = ( h & 0x8000 ) << 16;
+    const unsigned int exp = ( h >> 10 ) & 0x1f;
+    const unsigned int mantissa = h & 0x3ff;
+
+    unsigned int x;
+    if( exp == 0 ){
+        // zero or subnormal half float
+        const float v = (float)mantissa * 5.9604644775390625e-8f;
+        memcpy( &x , &v , sizeof(x) );
+        x |= sign;
+    }else if( exp == 31 ){
+        x = sign | 0x7f800000 | ( mantissa << 13 );
+    }else{
+        x = sign | ( ( exp + 112 ) << 23 ) | ( mantissa << 13 );
+    }
+
+    float ret;
+    memcpy( &ret , &x , sizeof(ret) );
+    return ret;
+}
+
+//! @brief  Pack RGB into the shared exponent format RGB9E5.
+//!
+//! Negative values are clamped to zero, values out of range are clamped to the largest value the format can represent.
+//!
+//! @param  rgb         The RGB values to be packed.
+//! @return             The packed value.
+SORT_STATIC_FORCEINLINE unsigned int PackRGB9E5( const float* rgb ){
+    constexpr auto max_value = 65408.0f;    // ( 2^9 - 1 ) / 2^9 * 2^( 31 - 15 )
+    const auto r = std::min( std::max( rgb[0] , 0.0f ) , max_value );
+    const auto g = std::min( std::max( rgb[1] , 0.0f ) , max_value );
+    const auto b = std::min( std::max( rgb[2] , 0.0f ) , max_value );
+    const auto max_channel = std::max( r , std::max( g , b ) );
+
+    // the shared exponent is picked so that the largest channel fits in 9 bits
+    auto exp = 0;
+    if( max_channel > 0.0f ){
+        frexp( max_channel , &exp );
+        exp = std::max( -16 , exp - 1 ) + 16;
+    }
+    auto scale = ldexp( 1.0f , 9 + 15 - exp );
+    if( (int)floor( max_channel * scale + 0.5f ) == 512 ){
+        ++exp;
+        scale *= 0.5f;
+    }
+
+    const auto rm = (unsigned int)floor( r * scale + 0.5f );
+    const auto gm = (unsigned int)floor( g * scale + 0.5f );
+    const auto bm = (unsigned int)floor( b * scale + 0.5f );
+    return rm | ( gm << 9 ) | ( bm << 18 ) | ( (unsigned int)exp << 27 );
+}
+
+//! @brief  Unpack RGB from the shared exponent format RGB9E5.
+//!
+//! @param  v           The packed value.
+//! @param  rgb         The unpacked RGB values.
+SORT_STATIC_FORCEINLINE void UnpackRGB9E5( unsigned int v , float* rgb ){
+    // the scale is 2^( exp - 15 - 9 ), which is always a normal float, its bits can be assembled directly.
+    const unsigned int scale_bits = ( ( v >> 27 ) + 127 - 24 ) << 23;
+    float scale;
+    memcpy( &scale , &scale_bits , sizeof(scale) );
+    rgb[0] = (float)( v & 0x1ff ) * scale;
+    rgb[1] = (float)( ( v >> 9 ) & 0x1ff ) * scale;
+    rgb[2] = (float)( ( v >> 18 ) & 0x1ff ) * scale;
+}
+
+//! @brief  Decode a texel to RGBA float.
+//!
+//! @param  data        Data of the texel.
+//! @param  rgba        The decoded RGBA values.
+template<TEXEL_FORMAT format>
+SORT_STATIC_FORCEINLINE void DecodeTexel( const unsigned char* data , float* rgba ){
+    switch( format ){
+    case TEXEL_RGBA32F:
+        memcpy( rgba , data , 4 * sizeof(float) );
+        break;
+    case TEXEL_RGBA8:
+        rgba[0] = g_unormLut.m_values[data[0]];
+        rgba[1] = g_unormLut.m_values[data[1]];
+        rgba[2] = g_unormLut.m_values[data[2]];
+        rgba[3] = g_unormLut.m_values[data[3]];
+        break;
+    case TEXEL_RGBA16F:
+    {
+#if defined(__F16C__)
+        _mm_storeu_ps( rgba , _mm_cvtph_ps( _mm_loadl_epi64( (const __m128i*)data ) ) );
+#else
+        unsigned short h[4];
+        memcpy( h , data , sizeof(h) );
+        for( auto i = 0 ; i < 4 ; ++i )
+            rgba[i] = HalfToFloat( h[i] );
+#endif
+        break;
+    }
+    case TEXEL_RGB9E5:
+    {
+        unsigned int v;
+        memcpy( &v , data , sizeof(v) );
+        UnpackRGB9E5( v , rgba );
+        rgba[3] = 1.0f;
+        break;
+    }
+    }
+}
+
+//! @brief  Decode a texel to RGBA float, the format is only known at runtime.
+//!
+//! @param  format      Format of the texel.
+//! @param  data        Data of the texel.
+//! @param  rgba        The decoded RGBA values.
+SORT_STATIC_FORCEINLINE void DecodeTexel( TEXEL_FORMAT format , const unsigned char* data , float* rgba ){
+    switch( format ){
+    case TEXEL_RGBA32F:
+        DecodeTexel<TEXEL_RGBA32F>( data , rgba );
+        break;
+    case TEXEL_RGBA8:
+        DecodeTexel<TEXEL_RGBA8>( data , rgba );
+        break;
+    case TEXEL_RGBA16F:
+        DecodeTexel<TEXEL_RGBA16F>( data , rgba );
+        break;
+    case TEXEL_RGB9E5:
+        DecodeTexel<TEXEL_RGB9E5>( data , rgba );
+        break;
+    }
+}
+
+//! @brief  Encode a texel from RGBA float.
+//!
+//! @param  format      Format of the texel.
+//! @param  rgba        The RGBA values to be encoded.
+//! @param  data        Data of the encoded texel.
+SORT_STATIC_FORCEINLINE void EncodeTexel( TEXEL_FORMAT format , const float* rgba , unsigned char* data ){
+    switch( format ){
+    case TEXEL_RGBA32F:
+        memcpy( data , rgba , 4 * sizeof(float) );
+        break;
+    case TEXEL_RGBA8:
+        for( auto i = 0 ; i < 4 ; ++i )
+            data[i] = (unsigned char)( std::min( std::max( rgba[i] , 0.0f ) , 1.0f ) * 255.0f + 0.5f );
+        break;
+    case TEXEL_RGBA16F:
+    {
+        unsigned short h[4];
+        for( auto i = 0 ; i < 4 ; ++i )
+            h[i] = FloatToHalf( rgba[i] );
+        memcpy( data , h , sizeof(h) );
+        break;
+    }
+    case TEXEL_RGB9E5:
+    {
+        const auto v = PackRGB9E5( rgba );
+        memcpy( data , &v , sizeof(v) );
+        break;
+    }
+    }
+}
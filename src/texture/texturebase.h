@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include "core/define.h"
 #include "spectrum/spectrum.h"
 
@@ -81,6 +82,18 @@ public:
     //! @return             The color at the specific texture coordinate.
     virtual Spectrum GetColorFromUV( float u , float v ) const;
 
+    //! @brief  Get the color given a texture coordinate and the size of the lookup footprint.
+    //!
+    //! Textures without mip levels simply ignore the footprint.
+    //!
+    //! @param  u           U coordinate. If out of range, it will be filtered.
+    //! @param  v           V coordinate. If out of range, it will be filtered.
+    //! @param  footprint   Size of the lookup footprint in texture space.
+    //! @return             The color at the specific texture coordinate.
+    virtual Spectrum GetColorFromUV( float u , float v , float footprint ) const {
+        return GetColorFromUV( u , v );
+    }
+
     //! @brief  Get the alpha given a texture coordinate.
     //!
     //! @param  u           U coordinate. If out of range, it will be filtered.
@@ -88,6 +101,18 @@ public:
     //! @return             The alpha at the specific texture coordinate.
     virtual float GetAlphaFromtUV( float u , float v ) const;
 
+    //! @brief  Get the alpha given a texture coordinate and the size of the lookup footprint.
+    //!
+    //! Textures without mip levels simply ignore the footprint.
+    //!
+    //! @param  u           U coordinate. If out of range, it will be filtered.
+    //! @param  v           V coordinate. If out of range, it will be filtered.
+    //! @param  footprint   Size of the lookup footprint in texture space.
+    //! @return             The alpha at the specific texture coordinate.
+    virtual float GetAlphaFromtUV( float u , float v , float footprint ) const {
+        return GetAlphaFromtUV( u , v );
+    }
+
     //! @brief  Get the width of the texture.
     //!
     //! @return             The width of the 2d texture.
@@ -122,6 +147,38 @@ protected:
     //! @return u       U coordinate.
     //! @return v       V coordinate.
     void texCoordFilter( int& u , int&v ) const;
+
+    //! @brief  Apply texture coordinate filter on a texture with a specific size, like a mip level.
+    //!
+    //! @return u       U coordinate.
+    //! @return v       V coordinate.
+    //! @param  w       Width of the texture.
+    //! @param  h       Height of the texture.
+    void texCoordFilter( int& u , int&v , int w , int h ) const;
+
+    //! @brief  Apply a specific texture coordinate filter on one coordinate.
+    //!
+    //! This is for the cases where the filter is resolved in advance, the switch is gone once it is inlined.
+    //!
+    //! @param  x       The coordinate to be filtered.
+    //! @param  w       Size of the texture along the dimension of the coordinate.
+    //! @return         The filtered coordinate.
+    template<TEXCOORDFILTER filter>
+    SORT_STATIC_FORCEINLINE int texCoordFilter( int x , int w ){
+        switch( filter ){
+        case TCF_WARP:
+            return ( x >= 0 ) ? x % w : ( w - ( -x ) % w ) % w;
+        case TCF_CLAMP:
+            return std::min( w - 1 , std::max( x , 0 ) );
+        case TCF_MIRROR:
+            x = ( x >= 0 )?x:(1-x);
+            x = x % ( 2 * w );
+            x -= w;
+            x = ( x >= 0 )?x:(1-x);
+            return w - 1 - x;
+        }
+        return x;
+    }
 };
 
 //! @brief  Base interface of 3D texture.
@@ -0,0 +1,202 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#include <vector>
+#include <cstring>
+#include "texturecache.h"
+#include "core/log.h"
+
+#if defined(SORT_IN_WINDOWS)
+    #include <windows.h>
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+SORT_STATS_DEFINE_COUNTER(sTextureTileLookups)
+SORT_STATS_DEFINE_COUNTER(sTextureTileMisses)
+SORT_STATS_DEFINE_COUNTER(sTextureTileEvictions)
+
+SORT_STATS_COUNTER("Texture Cache", "Tile Lookups", sTextureTileLookups);
+SORT_STATS_RATIO("Texture Cache", "Tile Miss Rate", sTextureTileMisses, sTextureTileLookups);
+SORT_STATS_COUNTER("Texture Cache", "Tile Evictions", sTextureTileEvictions);
+
+// Default capacity of the texture cache, it is overwritten by the global configuration.
+static constexpr size_t DEFAULT_TEXTURE_CACHE_CAPACITY = 1024ull * 1024ull * 1024ull;
+
+// Number of tiles each thread remembers without touching the shards.
+static constexpr unsigned TILE_MEMO_SIZE = 16;
+
+// Tiles recently touched by the current thread. Handles are never reused, a stale slot is simply not matched.
+struct TileMemo{
+    TextureTileHandle                       m_handles[TILE_MEMO_SIZE];
+    std::shared_ptr<const TextureTile>      m_tiles[TILE_MEMO_SIZE];
+
+    TileMemo(){
+        for( auto& handle : m_handles )
+            handle = ~(TextureTileHandle)0;
+    }
+};
+static thread_local TileMemo g_tileMemo;
+
+// Positioned IO on the backing file, it doesn't touch the position of the file so that it is safe for multiple threads
+// to read different tiles at the same time without any lock.
+static bool accessBackingFile( FILE* file , unsigned char* data , unsigned size , size_t offset , bool write ){
+#ifdef SORT_IN_WINDOWS
+    const auto handle = (HANDLE)_get_osfhandle( _fileno( file ) );
+#else
+    const auto fd = fileno( file );
+#endif
+
+    // reads and writes could be partial, the rest is done in the next iteration.
+    while( size > 0 ){
+#ifdef SORT_IN_WINDOWS
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = (DWORD)offset;
+        overlapped.OffsetHigh = (DWORD)( (unsigned long long)offset >> 32 );
+        DWORD done = 0;
+        const auto ret = write ? WriteFile( handle , data , size , &done , &overlapped ) : ReadFile( handle , data , size , &done , &overlapped );
+        if( !ret || 0 == done )
+            return false;
+#else
+        const auto done = write ? pwrite( fd , data , size , (off_t)offset ) : pread( fd , data , size , (off_t)offset );
+        if( done <= 0 )
+            return false;
+#endif
+        data += done;
+        size -= (unsigned)done;
+        offset += (size_t)done;
+    }
+    return true;
+}
+
+TextureCache::TextureCache(){
+    m_backingFile = std::tmpfile();
+    if( IS_PTR_INVALID(m_backingFile) )
+        slog( WARNING , IMAGE , "Failed to create the backing file of texture cache, all textures will stay in memory." );
+    SetCapacity( DEFAULT_TEXTURE_CACHE_CAPACITY );
+}
+
+TextureCache::~TextureCache(){
+    if( IS_PTR_VALID(m_backingFile) )
+        fclose( m_backingFile );
+}
+
+void TextureCache::SetCapacity( size_t bytes ){
+    m_capacity = bytes;
+    m_shardCapacity = bytes / SHARD_CNT;
+}
+
+TextureTileHandle TextureCache::StoreTile( const TextureTile& tile ){
+    // Only reserving room in the backing file needs the lock, nobody could look up the tile before it is written.
+    TextureTileHandle handle;
+    size_t offset;
+    {
+        std::lock_guard<std::shared_mutex> lock(m_tileLock);
+        handle = (TextureTileHandle)m_tileLocations.size();
+        offset = m_backingSize;
+        m_tileLocations.push_back( std::make_pair( offset , tile.GetSize() ) );
+        m_backingSize += tile.GetSize();
+    }
+
+    if( IS_PTR_VALID(m_backingFile) && accessBackingFile( m_backingFile , (unsigned char*)tile.GetData() , tile.GetSize() , offset , true ) )
+        return handle;
+
+    // Keep the tile in memory if it can't be paged out, this could happen when the disk is full.
+    auto resident = std::make_shared<TextureTile>( tile.GetSize() );
+    memcpy( resident->GetData() , tile.GetData() , tile.GetSize() );
+
+    std::lock_guard<std::shared_mutex> lock(m_tileLock);
+    m_residentTiles[handle] = resident;
+    return handle;
+}
+
+const TextureTile* TextureCache::GetTile( TextureTileHandle handle ){
+    SORT_STATS(++sTextureTileLookups);
+
+    // The thread local memo is checked first, this doesn't need any synchronization.
+    const auto slot = handle % TILE_MEMO_SIZE;
+    if( g_tileMemo.m_handles[slot] == handle )
+        return g_tileMemo.m_tiles[slot].get();
+
+    auto& shard = m_shards[handle % SHARD_CNT];
+    std::shared_ptr<const TextureTile> tile;
+    {
+        std::lock_guard<spinlock_mutex> lock(shard.m_lock);
+        auto it = shard.m_lookup.find(handle);
+        if( it != shard.m_lookup.end() ){
+            shard.m_lru.splice( shard.m_lru.begin() , shard.m_lru , it->second );
+            tile = it->second->second;
+        }
+    }
+
+    if( !tile ){
+        SORT_STATS(++sTextureTileMisses);
+
+        // Paging in happens outside the lock of the shard so that other threads are not blocked by IO.
+        tile = loadTile( handle );
+
+        std::vector<std::shared_ptr<const TextureTile>> evicted;
+        {
+            std::lock_guard<spinlock_mutex> lock(shard.m_lock);
+            auto it = shard.m_lookup.find(handle);
+            if( it != shard.m_lookup.end() ){
+                // Some other thread paged in the same tile in the mean time.
+                shard.m_lru.splice( shard.m_lru.begin() , shard.m_lru , it->second );
+                tile = it->second->second;
+            }else{
+                shard.m_lru.push_front( std::make_pair( handle , tile ) );
+                shard.m_lookup[handle] = shard.m_lru.begin();
+                shard.m_size += tile->GetSize();
+
+                // the tile just paged in is never evicted, even if it is larger than the capacity of the shard.
+                const auto capacity = m_shardCapacity.load( std::memory_order_relaxed );
+                while( shard.m_size > capacity && shard.m_lru.size() > 1 ){
+                    shard.m_size -= shard.m_lru.back().second->GetSize();
+                    evicted.push_back( std::move(shard.m_lru.back().second) );
+                    shard.m_lookup.erase( shard.m_lru.back().first );
+                    shard.m_lru.pop_back();
+                }
+            }
+        }
+        SORT_STATS(sTextureTileEvictions += (StatsInt)evicted.size());
+    }
+
+    // The memo keeps the tile alive even if it is evicted by other threads.
+    g_tileMemo.m_handles[slot] = handle;
+    g_tileMemo.m_tiles[slot] = std::move(tile);
+    return g_tileMemo.m_tiles[slot].get();
+}
+
+std::shared_ptr<const TextureTile> TextureCache::loadTile( TextureTileHandle handle ){
+    std::pair<size_t, unsigned> location;
+    {
+        std::shared_lock<std::shared_mutex> lock(m_tileLock);
+        auto it = m_residentTiles.find(handle);
+        if( it != m_residentTiles.end() )
+            return it->second;
+        location = m_tileLocations[handle];
+    }
+
+    // The tile is read without any lock, other threads could page in tiles at the same time.
+    auto tile = std::make_shared<TextureTile>( location.second );
+    if( !accessBackingFile( m_backingFile , tile->GetData() , location.second , location.first , false ) ){
+        slog( WARNING , IMAGE , "Failed to page in texture tile %llu." , handle );
+        memset( tile->GetData() , 0 , location.second );
+    }
+    return tile;
+}
@@ -0,0 +1,204 @@
+/*
+    This file is a part of SORT(Simple Open Ray Tracing), an open-source cross
+    platform physically based renderer.
+
+    Copyright (c) 2011-2020 by Jiayin Cao - All rights reserved.
+
+    SORT is a free software written for educational purpose. Anyone can distribute
+    or modify it under the the terms of the GNU General Public License Version 3 as
+    published by the Free Software Foundation. However, there is NO warranty that
+    all components are functional in a perfect manner. Without even the implied
+    warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along with
+    this program. If not, see <http://www.gnu.org/licenses/gpl-3.0.html>.
+ */
+
+#pragma once
+
+#include <list>
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
+#include <memory>
+#include <atomic>
+#include <cstdio>
+#include <unordered_map>
+#include "core/define.h"
+#include "core/singleton.h"
+#include "core/thread.h"
+#include "core/stats.h"
+
+//! @brief  Size of a texture tile in texels along each dimension.
+constexpr int   TEXTURE_TILE_SIZE = 64;
+//! @brief  Number of texels along each dimension of a tile in memory, one extra texel for bilinear filtering.
+constexpr int   TEXTURE_TILE_STRIDE = TEXTURE_TILE_SIZE + 1;
+//! @brief  Number of channels of each texel, it is always RGBA.
+constexpr int   TEXTURE_TILE_CHANNEL = 4;
+//! @brief  Number of texels in a tile, including the extra column and row.
+constexpr int   TEXTURE_TILE_TEXEL_CNT = TEXTURE_TILE_STRIDE * TEXTURE_TILE_STRIDE;
+
+//! @brief  Precision of texels stored in texture tiles.
+enum TEXTURE_STORAGE_MODE{
+    TSM_FULL_PRECISION = 0 ,    /**< All textures are stored as 32 bit float. */
+    TSM_HALF_PRECISION ,        /**< LDR textures are stored as 8 bit per channel, HDR textures are stored as 16 bit float. */
+    TSM_SHARED_EXPONENT         /**< LDR textures are stored as 8 bit per channel, HDR textures are stored as RGB9E5. */
+};
+
+//! @brief  A tile of texels in a specific mip level of a texture.
+/**
+ * Besides the TEXTURE_TILE_SIZE x TEXTURE_TILE_SIZE texels the tile covers, there is also one extra column and row
+ * holding the texels right after the tile, filtered with the texture coordinate filter. This makes sure the footprint
+ * of bilinear filtering never goes across tiles so that a bilinear lookup only needs to fetch one tile.
+ * The texture cache doesn't care about the format of the texels, it is up to the texture to interpret the data.
+ */
+class TextureTile{
+public:
+    //! @brief  Constructor allocating the memory of the tile.
+    //!
+    //! @param  size        Size of the tile in bytes.
+    TextureTile( unsigned size ) : m_size(size) , m_data(std::make_unique<unsigned char[]>(size)) {}
+
+    //! @brief  Get the data of the tile.
+    //!
+    //! @return             Pointer to the data of the tile.
+    SORT_FORCEINLINE const unsigned char* GetData() const{
+        return m_data.get();
+    }
+
+    //! @brief  Get the data of the tile.
+    //!
+    //! @return             Pointer to the data of the tile.
+    SORT_FORCEINLINE unsigned char* GetData(){
+        return m_data.get();
+    }
+
+    //! @brief  Get the size of the tile.
+    //!
+    //! @return             Size of the tile in bytes.
+    SORT_FORCEINLINE unsigned GetSize() const{
+        return m_size;
+    }
+
+private:
+    unsigned                            m_size = 0;     /**< Size of the tile in bytes. */
+    std::unique_ptr<unsigned char[]>    m_data;         /**< Texels of the tile, row by row. */
+};
+
+//! @brief  Handle of a tile in the texture cache.
+using TextureTileHandle = unsigned long long;
+
+//! @brief  Texture cache shared by all image textures.
+/**
+ * Instead of keeping all texels of all textures in memory, image textures split each of their mip levels into tiles
+ * and hand them over to the texture cache right after loading. The cache pages them out to a temporary file and only
+ * keeps the recently used tiles in memory, the total size of the resident tiles is bounded by the capacity of the
+ * cache, least recently used tiles are evicted once it is exceeded. Missed tiles are paged back in on demand.
+ *
+ * Tiles are distributed across a number of shards, each having its own lock and LRU list so that threads looking
+ * up different tiles rarely contend with each other. On top of it, each thread also remembers a few tiles it touched
+ * recently, which doesn't need any lock at all. Lookups of a texture are usually coherent enough that most of them
+ * hit this thread local memo.
+ *
+ * Missed tiles are read from the temporary file with positioned reads, which don't share the position of the file, so
+ * that multiple threads could page in tiles at the same time. The lock of the tile locations is only held to find out
+ * where a tile is, never during IO.
+ *
+ * In case there is no temporary file available, tiles stay in memory all the time and the capacity is not respected.
+ */
+class TextureCache : public Singleton<TextureCache>{
+public:
+    //! @brief  Destructor closes the backing file.
+    ~TextureCache();
+
+    //! @brief  Set the precision of texels stored in the cache.
+    //!
+    //! This only affects textures loaded afterwards.
+    //!
+    //! @param  mode        The precision of texels.
+    void SetStorageMode( TEXTURE_STORAGE_MODE mode ){
+        m_storageMode = mode;
+    }
+
+    //! @brief  Get the precision of texels stored in the cache.
+    //!
+    //! @return             The precision of texels.
+    TEXTURE_STORAGE_MODE GetStorageMode() const {
+        return m_storageMode;
+    }
+
+    //! @brief  Set the capacity of the cache.
+    //!
+    //! Tiles that are already in the cache won't be evicted until the next tile is paged in.
+    //!
+    //! @param  bytes       Maximum total size of the tiles resident in memory.
+    void SetCapacity( size_t bytes );
+
+    //! @brief  Get the capacity of the cache.
+    //!
+    //! @return             Maximum total size of the tiles resident in memory.
+    size_t GetCapacity() const {
+        return m_capacity;
+    }
+
+    //! @brief  Store a tile in the cache.
+    //!
+    //! The tile is written to the backing storage, it is not resident in memory until the first time it is looked up.
+    //! This is thread safe, textures are loaded in multiple threads.
+    //!
+    //! @param  tile        The tile to be stored, tiles could be of different sizes.
+    //! @return             Handle of the tile used for looking it up later.
+    TextureTileHandle StoreTile( const TextureTile& tile );
+
+    //! @brief  Look up a tile in the cache, it is paged in if it is not in memory.
+    //!
+    //! The tile returned is only guaranteed to be alive until the next time the same thread looks up a tile, it is
+    //! not supposed to be held by the caller. This is thread safe.
+    //!
+    //! @param  handle      Handle of the tile returned when storing it.
+    //! @return             The tile.
+    const TextureTile* GetTile( TextureTileHandle handle );
+
+private:
+    //! @brief  Number of shards of the cache.
+    static constexpr unsigned   SHARD_CNT = 64;
+
+    //! @brief  A shard of the cache with its own LRU list.
+    struct Shard{
+        using Entry = std::pair<TextureTileHandle, std::shared_ptr<const TextureTile>>;
+
+        spinlock_mutex                                                          m_lock;         /**< Lock protecting the shard. */
+        size_t                                                                  m_size = 0;     /**< Total size of the resident tiles in bytes. */
+        std::list<Entry>                                                        m_lru;          /**< Resident tiles, the most recently used one is at the front. */
+        std::unordered_map<TextureTileHandle, std::list<Entry>::iterator>       m_lookup;       /**< Resident tiles indexed by handles. */
+    };
+
+    Shard                   m_shards[SHARD_CNT];        /**< Shards of the cache. */
+    std::atomic<size_t>     m_capacity;                 /**< Maximum total size of resident tiles in bytes. */
+    std::atomic<size_t>     m_shardCapacity;            /**< Maximum total size of resident tiles in each shard in bytes. */
+    TEXTURE_STORAGE_MODE    m_storageMode = TSM_HALF_PRECISION;     /**< Precision of texels stored in the cache. */
+
+    std::shared_mutex       m_tileLock;                 /**< Lock protecting locations of tiles and tiles stored in memory. */
+    FILE*                   m_backingFile = nullptr;    /**< Temporary file holding all tiles. */
+    size_t                  m_backingSize = 0;          /**< Size of the backing file in bytes. */
+
+    /**< Offset and size of each tile in the backing file, indexed by the handles of tiles. */
+    std::vector<std::pair<size_t, unsigned>>    m_tileLocations;
+
+    /**< Tiles stored in memory if there is no backing file available. */
+    std::unordered_map<TextureTileHandle, std::shared_ptr<const TextureTile>>   m_residentTiles;
+
+    //! @brief  Private constructor opens the backing file.
+    TextureCache();
+
+    //! @brief  Load a tile from the backing storage.
+    //!
+    //! @param  handle      Handle of the tile.
+    //! @return             The tile loaded.
+    std::shared_ptr<const TextureTile> loadTile( TextureTileHandle handle );
+
+    SORT_STATS_ENABLE( "Texture Cache" )
+
+    friend class Singleton<TextureCache>;
+};